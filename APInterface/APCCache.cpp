@@ -65,6 +65,16 @@ void CAPCCache::prepForGet()
    m_getNextSeqNum = m_lastSentSeqNum - m_numPackets;
 }
 
+void CAPCCache::prepForGet(uint32_t a_lastSeqNum)
+{
+   boost::unique_lock<boost::mutex>  lock(m_lock);
+   uint64_t lastSeqNum = a_lastSeqNum | (m_lastSentSeqNum & 0xFFFFFFFF00000000);
+   if (a_lastSeqNum > (m_lastSentSeqNum & 0xFFFFFFFF) && lastSeqNum >= 0x100000000)
+      lastSeqNum -= 0x100000000;
+   // Older packets than cached ones are skipped by getNextPacket
+   m_getNextSeqNum = std::min(lastSeqNum, m_lastSentSeqNum);
+}
+
 apc_error_t CAPCCache::getNextPacket(apc_cache_pkt_s * pPkt)
 {
    boost::unique_lock<boost::mutex>  lock(m_lock);
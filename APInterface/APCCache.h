@@ -48,6 +48,11 @@ public:
     */
    void       prepForGet();
 
+   /**
+    * Prepare to get packets after 'lastSeqNum' (packets up to it are sent already).
+    */
+   void       prepForGet(uint32_t lastSeqNum);
+
    /**
     * Gets a next packet from cache.
     *
@@ -1,20 +1,40 @@
 #include "APCClient.h"
+#include "FlightRecorder.h"
 using namespace std;
 #include "common/Version.h"
 
-CAPCClient::CAPCClient(uint32_t  cacheSize) : m_cache( cacheSize)
+CAPCClient::CAPCClient(uint32_t  cacheSize) : m_cache( cacheSize),
+   m_resolver(m_IOService), m_connectTimer(m_IOService), m_staggerTimer(m_IOService)
 {
    m_state = APCCLIENT_STATE_INIT;
    m_intfId = APINTFID_EMPTY;
    m_pConnector = nullptr;    
    m_kaTimeout = m_freeBufTimeout = 0;
+   m_netRxBatchSize = m_netRxBatchDelay = 0;
+   m_compressLevel = 0;
+   m_protoVer = APC_PROTO_VER;
    m_pConnector = nullptr;
    m_pInput = nullptr;   
    m_reconnectTimer = nullptr;
    m_disconnectTime = TIME_EMPTY;   
 
    m_reconnectionDelayMsec = m_disconnectTimeoutMsec = 0;
+   m_numFailedConn = 0;
+   m_connectGen = 0;
+   m_isConnecting = false;
+   m_numFailedAttempts = 0;
+   m_connectTimeoutMsec = m_reconnectMaxDelayMsec = 0;
+   m_ackDelayMsec = m_ackEveryPkts = 0;
+   m_isDialStandby = false;
+   m_activeMngr = 0;
+   m_pStandby = nullptr;
+   m_isStandbyReady = m_isStandbyEnabled = m_isActivating = false;
+   m_numFailedStandby = 0;
    m_lastRxSeqNum = 0;
+   m_isCreditEnabled = m_isCreditPaused = false;
+   m_txCreditLimit = m_lastTxSeqNum = 0;
+   m_inputSpace = APC_CREDIT_INPUT_SPACE;
+   m_isPrioritySched = false;
    m_currentGpsState = ap_int_gpslockstat_t::APINTF_GPS_NOLOCK;
 
    m_netId = 0;
@@ -52,12 +72,17 @@ apc_error_t CAPCClient::start(const start_param_t& param)
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
    apc_error_t        res;
-   string             msg;
-   CAPCConnector::ptr pAPC = nullptr;
 
-   if (m_pConnector != nullptr)
+   if (m_pConnector != nullptr || m_pStandby != nullptr || m_isConnecting)
       return APC_ERR_STATE;
 
+   const apc_sock_policy_s * pSockPolicy = CAPCSocketPolicy::find(param.sockPolicy);
+   if (pSockPolicy == NULL) {
+      DUSTLOG_ERROR(m_logName, "CAPCClient. Unknown socket policy '" << param.sockPolicy << "'");
+      return APC_ERR_INIT;
+   }
+   m_sockPolicy = *pSockPolicy;
+
    // Restart IO service
    try {
       m_IOService.reset();  
@@ -72,43 +97,45 @@ apc_error_t CAPCClient::start(const start_param_t& param)
       return res;
 
    // Save connection parameters: Host:Port, timeouts....
-   ostringstream  os;
+   ostringstream  os, osStandby;
    os << param.port; 
-   m_port = os.str();
-   m_host = param.host;
+   osStandby << (param.standbyPort != 0 ? param.standbyPort : param.port);
+   m_mngrs[0].m_host = param.host;
+   m_mngrs[0].m_port = os.str();
+   m_mngrs[1].m_host = param.standbyHost;
+   m_mngrs[1].m_port = osStandby.str();
+   m_activeMngr = 0;
+   m_isStandbyEnabled = !param.standbyHost.empty();
+   m_isStandbyReady = m_isActivating = false;
    m_kaTimeout = param.kaTimeout;
    m_freeBufTimeout = param.freeBufTimeout; 
+   m_netRxBatchSize = param.netRxBatchSize;
+   m_netRxBatchDelay = param.netRxBatchDelayMsec;
+   m_compressLevel = param.compressLevel;
+   m_protoVer = (uint8_t)std::max(std::min(param.protoVer, (uint32_t)APC_PROTO_VER_MAX), (uint32_t)APC_PROTO_VER);
    m_reconnectionDelayMsec = param.reconnectionDelayMsec;
    m_disconnectTimeoutMsec = param.disconnectTimeoutMsec;
+   m_connectTimeoutMsec = param.connectTimeoutMsec;
+   m_reconnectMaxDelayMsec = param.reconnectMaxDelayMsec;
+   m_ackDelayMsec = param.ackDelayMsec;
+   m_ackEveryPkts = param.ackEveryPkts;
+   m_isCreditEnabled = param.isCredit;
+   m_isPrioritySched = param.isPrioritySched;
    BOOST_ASSERT(m_disconnectTimeoutMsec == 0 || (m_disconnectTimeoutMsec != 0 && m_reconnectionDelayMsec != 0));
 
    // Clean internal variable: Session ID, last received packet, cache of packets
    m_state  = APCCLIENT_STATE_INIT;
    m_intfId = APINTFID_EMPTY;
    m_lastRxSeqNum = 0;
+   m_txCreditLimit = m_lastTxSeqNum = 0;
+   m_isCreditPaused = false;
+   CFlightRecorder::record(FLIGHTREC_CACHE_CLEAR, m_cache.getNumCachedPkts());
    m_cache.clear();
+   m_sched.clear();
 
-   // Establish IP connection
-   pAPC = ipConnect_p(msg);
-   if (pAPC == nullptr)
-      res = APC_ERR_INIT;
-
-   // Start APCConnector
-   if (res == APC_OK) 
-      res = pAPC->start();
-   
-   // Send 'new' (APINTFID_EMPTY) Connect message
-   if (res == APC_OK) {
-	  apc_msg_net_gpslock_s gpsState = {m_currentGpsState};
-      res = pAPC->connect(m_intfId, 0, 0, gpsState, 0);
-   }
-
-   if (res != APC_OK) {
-      if (pAPC != nullptr)
-         pAPC->stop(APC_STOP_CREATE, res, CAPCConnector::STOP_FL_DISCONNECT);
-      DUSTLOG_ERROR(m_logName, "CAPCClient. Connection to '" << m_host << ":" << m_port << "' failed. " 
-                    << toString(res) << " " << msg);
-   }
+   // Establish IP connection in IO thread. Failed attempts are repeated until stop()
+   m_numFailedAttempts = m_numFailedStandby = 0;
+   startConnect_p(false);
    DUSTLOG_INFO(m_logName, "CAPCClient. START: " << toString(res));
    return res;
 }
@@ -120,20 +147,27 @@ void CAPCClient::stop()
    {
       boost::unique_lock<boost::mutex> lock(m_lock);
 
-      // Stop reconnect timer
+      // Stop reconnect timer and connection attempt
       stopTimer_p(m_reconnectTimer);
+      cancelConnect_p();
       m_disconnectTime = TIME_EMPTY;
       m_state       = APCCLIENT_STATE_DISCONNECT;
+      m_isActivating = false;
 
-      // Stop connector
-      if (m_pConnector) {
+      // Stop connectors
+      stopStandby_p();
+      if (m_pConnector)
          m_pConnector->disconnect();
-         m_sigDisconnect.wait_for(lock, sec_t(1)); // Wait finish of stop processing (finish apcDisconnect notification)
-      }
+      // Wait finish of stop processing (finish apcDisconnect notifications)
+      mngr_time_t waitEnd = TIME_NOW() + sec_t(1);
+      while ((m_pConnector != nullptr || m_pStandby != nullptr) && 
+             m_sigDisconnect.wait_until(lock, waitEnd) != boost::cv_status::timeout)
+         ;
 
-      if (m_pConnector != nullptr) {
+      if (m_pConnector != nullptr || m_pStandby != nullptr) {
          DUSTLOG_ERROR(m_logName, "CAPCClient #" << m_intfId <<" Stop error. Can not close connection");
          m_pConnector = nullptr;
+         m_pStandby = nullptr;
       }
    }
 
@@ -141,7 +175,12 @@ void CAPCClient::stop()
    m_ioSrvThread.stopIOSrvThread();
 
    // Clean cache
+   CFlightRecorder::record(FLIGHTREC_CACHE_CLEAR, m_cache.getNumCachedPkts());
    m_cache.clear();
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      m_sched.clear();
+   }
    DUSTLOG_TRACE(m_logName, "CAPCClient. STOP finished");
 }
 
@@ -149,8 +188,17 @@ void CAPCClient::stop()
 // Send data to server
 apc_error_t CAPCClient::sendData(const uint8_t * payload, uint32_t payloadLength)
 {
-   boost::unique_lock<boost::mutex> lock(m_lock);
-   return sendData_p(APC_NET_RX, payload, payloadLength);
+   apc_error_t res;
+   bool        isChanged, isPaused;
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      res = sendData_p(APC_NET_RX, payload, payloadLength);
+      isChanged = updateCreditPause_p();
+      isPaused = m_isCreditPaused;
+   }
+   if (isChanged)
+      notifyCreditPause(isPaused);
+   return res;
 }
 
 // Send TxDone message
@@ -178,21 +226,31 @@ apc_error_t CAPCClient::sendTimeMap(const ap_time_map_t& p)
 // Send AP Lost message
 apc_error_t CAPCClient::sendApLost()
 {
-   boost::unique_lock<boost::mutex> lock(m_lock);
-   return sendData_p(APC_AP_LOST);
+   apc_error_t res;
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      res = sendData_p(APC_AP_LOST);
+   }
+   // Keep events preceding AP lost
+   CFlightRecorder::save("aplost");
+   return res;
 }
 
-// Send Resume message
+// Send Resume message. Manager with credit follows free space of AP input instead
 apc_error_t CAPCClient::sendResume()
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
+   if (m_pConnector != nullptr && m_pConnector->isCredit())
+      return APC_OK;
    return sendData_p(APC_NET_TX_RESUME);
 }
 
-// Send Pause message
+// Send Pause message. Manager with credit follows free space of AP input instead
 apc_error_t CAPCClient::sendPause ()
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
+   if (m_pConnector != nullptr && m_pConnector->isCredit())
+      return APC_OK;
    return sendData_p(APC_NET_TX_PAUSE);
 }
 
@@ -203,16 +261,125 @@ apc_error_t CAPCClient::sendGpsLock(const ap_intf_gpslock_t& p)
    return APC_OK;
 }
 
+// Free space of AP input
+void CAPCClient::setInputSpace(uint32_t numMsgs)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   m_inputSpace = numMsgs;
+   updateRxCredit_p();
+}
+
+// Get rates of manager connection
+void CAPCClient::getRateStats(ratestat_s * pToMngr, ratestat_s * pFromMngr)
+{
+   if (pToMngr != NULL)
+      m_rateTx.getStat(pToMngr);
+   if (pFromMngr != NULL)
+      m_rateRx.getStat(pFromMngr);
+}
+
+// TCP state of manager connection
+bool CAPCClient::getTcpInfo(apc_tcp_info_s * pInfo)
+{
+   CAPCConnector::ptr pAPC;
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      pAPC = m_pConnector;
+   }
+   return pAPC != nullptr && pAPC->getTcpInfo(pInfo);
+}
+
+// Clear statistics
+void CAPCClient::clearStats()
+{
+   m_rateTx.clear();
+   m_rateRx.clear();
+   m_compressStats.clear();
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   m_sched.clearStat();
+   if (m_pConnector != nullptr)
+      m_pConnector->clearStats();
+}
+
+void CAPCClient::getSchedStats(apc_sched_stats_s * pStats)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   m_sched.getStat(pStats);
+}
 //]
 
 // Interface IAPCConnectorNotif  -------------------------------------------
 // Message received
-void CAPCClient::messageReceived(const param_received_s& param, const uint8_t * pPayload, uint16_t size)
+void CAPCClient::messageReceived(CAPCConnector::ptr pAPC, const param_received_s& param, 
+                                 const uint8_t * pPayload, uint16_t size)
 {
+   if (param.type == APC_ACTIVATE) {
+      // Answer of secondary manager: session continues on former standby connection
+      apc_error_t res;
+      {
+         boost::unique_lock<boost::mutex> lock(m_lock);
+         if (pAPC != m_pConnector || !m_isActivating)
+            return;
+         m_isActivating = false;
+         stopTimer_p(m_reconnectTimer);
+         m_disconnectTime = TIME_EMPTY;
+         m_numFailedAttempts = 0;
+         // Manager gives credit after its answer (KA)
+         m_txCreditLimit = param.yourSeq;
+         m_isCreditPaused = false;
+         res = replayCache_p(param.yourSeq);
+         if (res == APC_OK) {
+            m_state = APCCLIENT_STATE_ONLINE;
+            updateRxCredit_p();
+            startStandby_p();
+         }
+      }
+      if (res == APC_OK) {
+         DUSTLOG_INFO(m_logName, "CAPCClient #" << m_intfId << " Online (failover)");
+         if (m_pInput)
+            m_pInput->online();
+      }
+      return;
+   }
+   {
+      // Standby connection is not used until activation
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (pAPC != m_pConnector)
+         return;
+   }
+
    m_cache.confirmedSeqNum(param.yourSeq);
+   CFlightRecorder::record(FLIGHTREC_CACHE_CONFIRM, param.yourSeq, m_cache.getNumCachedPkts());
    if ((param.flags & APC_HDR_FLAGS_NOTRACK) == 0) 
       m_lastRxSeqNum = param.mySeq;
 
+   if (param.type == APC_KA) {
+      // Credit of manager: send packets waiting in cache
+      bool isChanged = false, isPaused = false;
+      {
+         boost::unique_lock<boost::mutex> lock(m_lock);
+         if (pAPC != m_pConnector)
+            return;
+         if (pAPC->isCredit() && size >= sizeof(apc_msg_credit_s) && 
+             (int32_t)(((const apc_msg_credit_s *)pPayload)->limit - m_txCreditLimit) > 0) {
+            m_txCreditLimit = ((const apc_msg_credit_s *)pPayload)->limit;
+            apc_error_t res = m_state == APCCLIENT_STATE_ONLINE ? sendCached_p() : APC_OK;
+            if (res != APC_OK) {
+               pAPC->stop(APC_STOP_WRITE, res, res == APC_ERR_PKTSERIALIZATION ? CAPCConnector::STOP_FL_DISCONNECT :
+                                                                                CAPCConnector::STOP_FL_OFFLINE);
+               return;
+            }
+            if (m_state == APCCLIENT_STATE_ONLINE)
+               sendScheduled_p();
+         }
+         isChanged = updateCreditPause_p();
+         isPaused = m_isCreditPaused;
+      }
+      if (isChanged)
+         notifyCreditPause(isPaused);
+      return;
+   }
+
    if (m_pInput == NULL)
       return;
 
@@ -236,6 +403,7 @@ void CAPCClient::messageReceived(const param_received_s& param, const uint8_t *
          hdr.slot    = pCmd->slot;              
          hdr.offset  = pCmd->offset;            
          hdr.dst     = pCmd->dst;    
+         hdr.rxTime  = mngr_time_t(mngr_time_t::duration(param.rxTime));
          m_pInput->dataRx(hdr, pPayload+sizeof(apc_msg_net_tx_s), size-sizeof(apc_msg_net_tx_s));
       }
       break;
@@ -246,13 +414,21 @@ void CAPCClient::messageReceived(const param_received_s& param, const uint8_t *
    case APC_GET_TIME      : m_pInput->getTime(); break;
    default: break;
    }
+
+   // Message is passed to AP input: credit of manager moves
+   if ((param.flags & APC_HDR_FLAGS_NOTRACK) == 0) {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (pAPC == m_pConnector)
+         updateRxCredit_p();
+   }
 }
 
 // Process Start notification from CAPCConnector
 void CAPCClient::apcStarted(CAPCConnector::ptr pAPC) 
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
-   m_pConnector = pAPC;
+   if (pAPC != m_pStandby)
+      m_pConnector = pAPC;
 }
 
 // Process Connect notification from CAPCConnector
@@ -263,7 +439,28 @@ void CAPCClient::apcConnected(CAPCConnector::ptr pAPC, const param_connected_s&
    {
       boost::unique_lock<boost::mutex> lock(m_lock);
 
-      if (param.ver != APC_PROTO_VER) {
+      if (pAPC == m_pStandby) {
+         if (!pAPC->isWorking())
+            return;   // Already stopped
+         // Manager keeps standby connection of the session if it echoes the flag. Otherwise it 
+         // may take the session over, so standby is not tried again
+         if (param.ver < APC_PROTO_VER || param.ver > m_protoVer || param.apcId != m_intfId ||
+             (param.cmdFlags & APC_FL_STANDBY) == 0) {
+            DUSTLOG_ERROR(m_logName, "CAPCClient #" << m_intfId << " Standby connection to '" 
+                          << m_mngrs[(m_activeMngr + 1) % APC_NUM_MNGRS].m_host 
+                          << "' is not accepted by manager. Standby is disabled");
+            m_isStandbyEnabled = false;
+            pAPC->stop(APC_STOP_RECONNECTION, APC_ERR_PROTOCOL, CAPCConnector::STOP_FL_OFFLINE);
+            return;
+         }
+         m_isStandbyReady = true;
+         m_numFailedStandby = 0;
+         DUSTLOG_INFO(m_logName, "CAPCClient #" << m_intfId << " Standby connection is ready");
+         return;
+      }
+
+      // Manager answers with offered or lower version
+      if (param.ver < APC_PROTO_VER || param.ver > m_protoVer) {
          // Request for disconnection. Close current session 
          pAPC->stop(APC_STOP_VER, APC_ERR_PROTOCOL, CAPCConnector::STOP_FL_DISCONNECT);
          DUSTLOG_ERROR(m_logName, "CAPCClient #" << m_intfId << " Wrong version of protocol " << param.ver);
@@ -282,6 +479,7 @@ void CAPCClient::apcConnected(CAPCConnector::ptr pAPC, const param_connected_s&
       // Stop reconnection timers
       stopTimer_p(m_reconnectTimer);
       m_disconnectTime = TIME_EMPTY;
+      m_numFailedAttempts = 0;
       // Initialize interface ID
       m_intfId = param.apcId;
       m_netId = param.netId;
@@ -290,18 +488,18 @@ void CAPCClient::apcConnected(CAPCConnector::ptr pAPC, const param_connected_s&
       if ((param.hdrFlags & APC_HDR_FLAGS_NOTRACK) == 0) 
          m_lastRxSeqNum = param.mySeq;
 
-      // For restoring connection
-      if (!isNewConnection) {   
-         // Send data from cache
-         CAPCCache::apc_cache_pkt_s  pkt;
-         m_cache.confirmedSeqNum(param.yourSeq, true); 
-         m_cache.prepForGet();
-         while(res == APC_OK && m_cache.getNextPacket(&pkt) != APC_ERR_NOTFOUND) {
-            res = m_pConnector->sendData(pkt.m_type, 0, pkt.m_seqNumb, pkt.m_payload.data(), pkt.m_size, NULL, 0);
-         }
-      }
-      if (res == APC_OK)
+      // Manager gives credit after CONNECT (KA). Cache waits for it
+      m_txCreditLimit = m_lastTxSeqNum = param.yourSeq;
+      m_isCreditPaused = false;
+
+      // For restoring connection: send data from cache
+      if (!isNewConnection)
+         res = replayCache_p(param.yourSeq);
+      if (res == APC_OK) {
          m_state  = APCCLIENT_STATE_ONLINE;
+         updateRxCredit_p();
+         startStandby_p();
+      }
    }
 
    if (res == APC_OK) {
@@ -313,14 +511,7 @@ void CAPCClient::apcConnected(CAPCConnector::ptr pAPC, const param_connected_s&
          else
             m_pInput->online();
       }
-   } else {
-      if (res == APC_ERR_PKTSERIALIZATION)   // Fatal error. Close session
-         pAPC->stop(APC_STOP_RECONNECTION, res, CAPCConnector::STOP_FL_DISCONNECT);
-      else if (res != APC_OK)                // Error. Go to offline
-         pAPC->stop(APC_STOP_RECONNECTION, res, CAPCConnector::STOP_FL_OFFLINE);
-      DUSTLOG_ERROR(m_logName, "CAPCClient #" << m_intfId << " Cache output error: " << toString(res));
    }
-
 }
 
 // Process Disconnection notification from CAPCConnector
@@ -331,9 +522,24 @@ void CAPCClient::apcDisconnected(CAPCConnector::ptr pAPC, const param_disconnect
    {
       boost::unique_lock<boost::mutex> lock(m_lock);
 
+      if (pAPC == m_pStandby) {
+         // Standby connection is closed. It is started again while session is online
+         DUSTLOG_INFO(m_logName, "CAPCClient #" << m_intfId << " Standby connection closed. Reason:" 
+                     << toString(param.reason));
+         if (!m_isStandbyReady)
+            m_numFailedStandby++;
+         m_pStandby = nullptr;
+         m_isStandbyReady = false;
+         if (m_state == APCCLIENT_STATE_ONLINE && m_isStandbyEnabled && !m_isConnecting)
+            startTimer_p();
+         m_sigDisconnect.notify_all();
+         return;
+      }
+
       if (pAPC != m_pConnector) 
          DUSTLOG_ERROR(m_logName, "CAPCClient #" << m_intfId << " 'apcDisconnect' APC pointers is not equal.");
       m_pConnector = nullptr;
+      m_isActivating = false;
 
       // Disconnect if ...
       if (param.flags == CAPCConnector::STOP_FL_DISCONNECT || // Disconnect explicitly required 
@@ -347,15 +553,21 @@ void CAPCClient::apcDisconnected(CAPCConnector::ptr pAPC, const param_disconnect
                     m_state != APCCLIENT_STATE_OFFLINE;  // Goes to offline 
 
       m_state  = isImmediately ? APCCLIENT_STATE_DISCONNECT : APCCLIENT_STATE_OFFLINE;
+      scheduleToCache_p();
 
       stopTimer_p(m_reconnectTimer);   // Kill old reconnection timer
       if (isImmediately) {
          m_disconnectTime = TIME_EMPTY;
+         stopStandby_p();
       } else {
-         // Client is offline. Try reconnect
+         // Client is offline. Switch to standby connection or try reconnect
          if (m_disconnectTime == TIME_EMPTY) 
             m_disconnectTime = TIME_NOW() + msec_t(m_disconnectTimeoutMsec);
-         // Start reconnection timer
+         if (m_isStandbyReady)
+            failover_p();
+         else
+            stopStandby_p();
+         // Start reconnection timer. During failover it limits waiting for activation
          startTimer_p();
       }
 
@@ -374,6 +586,22 @@ void CAPCClient::apcDisconnected(CAPCConnector::ptr pAPC, const param_disconnect
    }
 }
 
+// Output buffer of connector is freed: send messages waiting in scheduler
+void CAPCClient::apcTxReady(CAPCConnector::ptr pAPC)
+{
+   bool isChanged, isPaused;
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (pAPC != m_pConnector || m_state != APCCLIENT_STATE_ONLINE)
+         return;
+      sendScheduled_p();
+      isChanged = updateCreditPause_p();
+      isPaused = m_isCreditPaused;
+   }
+   if (isChanged)
+      notifyCreditPause(isPaused);
+}
+
 //[ Timer Callback functions --------------------------------------------------
 // Callback function
 void CAPCClient::reconnectTimerFun_p(const boost::system::error_code& error) 
@@ -385,7 +613,20 @@ void CAPCClient::reconnectTimerFun_p(const boost::system::error_code& error)
       boost::unique_lock<boost::mutex> lock(m_lock);
       if (m_state == APCCLIENT_STATE_DISCONNECT)
          return;
-      if (TIME_NOW() < m_disconnectTime)
+      if (m_isActivating) {
+         // Secondary manager did not answer APC_ACTIVATE. Offline processing continues by apcDisconnected
+         DUSTLOG_ERROR(m_logName, "CAPCClient #" << m_intfId << " Activation of standby connection timed out");
+         m_reconnectTimer = nullptr;
+         m_pConnector->stop(APC_STOP_TIMEOUT, APC_ERR_STATE, CAPCConnector::STOP_FL_OFFLINE);
+         return;
+      }
+      if (m_state == APCCLIENT_STATE_ONLINE) {
+         m_reconnectTimer = nullptr;
+         startStandby_p();
+         return;
+      }
+      // First connection is repeated until stop()
+      if (m_state == APCCLIENT_STATE_INIT || TIME_NOW() < m_disconnectTime)
          reconnect_p();
       else
          isSendNotif = disconnect_p();
@@ -397,35 +638,16 @@ void CAPCClient::reconnectTimerFun_p(const boost::system::error_code& error)
 // Try reconnect to server
 void CAPCClient::reconnect_p() 
 {
-   string      msg;
-   apc_error_t res;
-   
-   if (m_pConnector != nullptr) 
+   if (m_pConnector != nullptr || m_isConnecting) 
       return; // Ignore. Previous connection is not finished
-
-   // Try to open IP connection
-   CAPCConnector::ptr pAPC = ipConnect_p(msg);
-   if (pAPC == nullptr) { 
-      // Can not open IP connection. Restart timer
-      startTimer_p();
-      DUSTLOG_ERROR(m_logName, "CAPCClient. Re-connection to '" << m_host << ":" << m_port << "' failed. " << msg);
-   } else {
-      m_reconnectTimer = nullptr;   // Doesn't restart timer
-      // Start CAPCConnector
-      res = pAPC->start();
-      // Send 'connect' message with current session ID
-      if (res == APC_OK) {
-		 apc_msg_net_gpslock_s gpsState = {m_currentGpsState};
-         res = pAPC->connect(m_intfId, m_cache.getLastSent(), m_lastRxSeqNum, gpsState, 0);
-	  }
-      if (res != APC_OK) 
-         pAPC->stop(APC_STOP_CREATE, res, CAPCConnector::STOP_FL_OFFLINE); 
-   }
+   m_reconnectTimer = nullptr;   // Restarted if attempt fails
+   startConnect_p(false);
 }
 
 // Start disconnect process
 bool CAPCClient::disconnect_p() 
 {
+   cancelConnect_p();
    // Close connection
    if (m_pConnector)  {
       m_pConnector->stop(APC_STOP_RECONNECTION, APC_OK, CAPCConnector::STOP_FL_DISCONNECT);
@@ -444,9 +666,6 @@ bool CAPCClient::disconnect_p()
 apc_error_t CAPCClient::sendData_p(apc_msg_type_t  type, const uint8_t * payload1, uint16_t size1, 
                                    const uint8_t * payload2, uint16_t size2)
 {
-   apc_error_t res;
-   uint32_t    seqNum;
-   
    if (m_state == APCCLIENT_STATE_DISCONNECT)
       return APC_ERR_DISCONNECT;
    if (m_state == APCCLIENT_STATE_OFFLINE)
@@ -456,13 +675,39 @@ apc_error_t CAPCClient::sendData_p(apc_msg_type_t  type, const uint8_t * payload
    if (m_pConnector == nullptr)
       return APC_ERR_STATE;
 
+   if (m_isPrioritySched && (!m_sched.empty() || !isTxReady_p())) {
+      // Output is busy: message waits without sequence number and is sent by priority.
+      // Waiting messages must fit in cache with unconfirmed ones (see scheduleToCache_p)
+      size_t numCached = m_cache.getNumCachedPkts();
+      size_t cacheSize = m_cache.getCacheSize();
+      apc_error_t res = m_sched.push(type, payload1, size1, payload2, size2, 
+                                     numCached < cacheSize ? cacheSize - numCached : 0);
+      if (res == APC_OK)
+         sendScheduled_p();
+      return res;
+   }
+   return sendSeq_p(type, payload1, size1, payload2, size2);
+}
+
+// Save message in cache and pass it to connector
+apc_error_t CAPCClient::sendSeq_p(apc_msg_type_t  type, const uint8_t * payload1, uint16_t size1, 
+                                  const uint8_t * payload2, uint16_t size2)
+{
+   apc_error_t res;
+   uint32_t    seqNum;
+
    // Save data in cache
    res = m_cache.addPacket(type, payload1, size1, payload2, size2, &seqNum);
+   CFlightRecorder::record(FLIGHTREC_CACHE_ADD, seqNum, type, res);
    if (res == APC_ERR_OUTBUFOVERFLOW) 
       DUSTLOG_WARN(m_logName, "CAPCClient #" << m_intfId << "Cache overflow");
+   if (res != APC_ERR_SIZE && isCreditHeld_p(seqNum))
+      return APC_OK;   // Sent on credit of manager (see sendCached_p)
    
    // Send data
    res = m_pConnector->sendData(type, 0, seqNum, payload1, size1, payload2, size2);
+   if (res == APC_OK)
+      m_lastTxSeqNum = seqNum;
    if (res == APC_ERR_PKTSERIALIZATION)   // Fatal error. Close session
       m_pConnector->stop(APC_STOP_WRITE, res, CAPCConnector::STOP_FL_DISCONNECT);
    else if (res != APC_OK)                // Error. Go to offline
@@ -470,32 +715,475 @@ apc_error_t CAPCClient::sendData_p(apc_msg_type_t  type, const uint8_t * payload
    return res;
 }
 
-// Open IP connection
-CAPCConnector::ptr CAPCClient::ipConnect_p(string& errMsg)
+//[ Asynchronous connection ----------------------------------------------------
+// Resolve name of manager and race its addresses. Called under m_lock
+void CAPCClient::startConnect_p(bool isStandby)
+{
+   cancelConnect_p();
+   m_isConnecting = true;
+   m_isDialStandby = isStandby;
+   uint32_t gen = m_connectGen;
+   try {
+      // Limits resolve (or local connection). Every address then gets its own deadline
+      if (m_connectTimeoutMsec > 0) {
+         m_connectTimer.expires_from_now(boost::posix_time::milliseconds(m_connectTimeoutMsec));
+         m_connectTimer.async_wait(boost::bind(&CAPCClient::handleConnectTimeout_p, this, gen, 
+                                               boost::asio::placeholders::error));
+      }
+      // Manager on the same host: AF_UNIX socket, for "shm:" it passes shared memory
+      std::string     path;
+      apc_transport_t transport = apcParseTransport(getDialMngr_p().m_host, &path);
+      if (transport != APC_TRANSPORT_TCP) {
+         m_localSocket.reset(new boost::asio::local::stream_protocol::socket(m_IOService));
+         m_localSocket->async_connect(boost::asio::local::stream_protocol::endpoint(path),
+                                      boost::bind(&CAPCClient::handleLocalConnect_p, this, gen, m_localSocket,
+                                                  transport, boost::asio::placeholders::error));
+         return;
+      }
+      boost::asio::ip::tcp::resolver::query query(getDialMngr_p().m_host, getDialMngr_p().m_port);
+      m_resolver.async_resolve(query, boost::bind(&CAPCClient::handleResolve_p, this, gen, 
+                                                  boost::asio::placeholders::error,
+                                                  boost::asio::placeholders::iterator));
+   } catch (exception& e) {
+      connectFailed_p(e.what());
+   }
+}
+
+// Cancel all operations of connection attempt
+void CAPCClient::cancelConnect_p()
+{
+   boost::system::error_code ec;
+   m_connectGen++;
+   m_isConnecting = false;
+   m_resolver.cancel();
+   m_connectTimer.cancel(ec);
+   m_staggerTimer.cancel(ec);
+   for (auto& sock : m_connSockets) {
+      if (sock != nullptr)
+         sock->close(ec);
+   }
+   m_connSockets.clear();
+   for (auto& timer : m_connTimers) {
+      if (timer != nullptr)
+         timer->cancel(ec);
+   }
+   m_connTimers.clear();
+   if (m_localSocket != nullptr) {
+      m_localSocket->close(ec);
+      m_localSocket.reset();
+   }
+   m_endpoints.clear();
+   m_numFailedConn = 0;
+}
+
+// Start connection to next address. Following address is tried if this one does not answer in time.
+// Each address has its own deadline counted from start of its connection
+void CAPCClient::connectNext_p()
+{
+   size_t                                idx = m_connSockets.size();
+   const boost::asio::ip::tcp::endpoint& ep  = m_endpoints[idx];
+   sockptr_t                             sock(new boost::asio::ip::tcp::socket(m_IOService));
+   timerptr_t                            timer;
+   boost::system::error_code             ec;
+
+   m_connSockets.push_back(sock);
+   sock->open(ep.protocol(), ec);
+   if (ec) {
+      m_IOService.post(boost::bind(&CAPCClient::handleConnect_p, this, m_connectGen, sock, idx, ec));
+   } else {
+      sock->async_connect(ep, boost::bind(&CAPCClient::handleConnect_p, this, m_connectGen, sock, idx, 
+                                          boost::asio::placeholders::error));
+      if (m_connectTimeoutMsec > 0) {
+         timer.reset(new boost::asio::deadline_timer(m_IOService));
+         timer->expires_from_now(boost::posix_time::milliseconds(m_connectTimeoutMsec));
+         timer->async_wait(boost::bind(&CAPCClient::handleSockTimeout_p, this, m_connectGen, idx, 
+                                       boost::asio::placeholders::error));
+      }
+   }
+   m_connTimers.push_back(timer);
+   if (m_connSockets.size() < m_endpoints.size()) {
+      m_staggerTimer.expires_from_now(boost::posix_time::milliseconds(APC_CONNECT_STAGGER_MSEC));
+      m_staggerTimer.async_wait(boost::bind(&CAPCClient::handleStagger_p, this, m_connectGen, 
+                                            boost::asio::placeholders::error));
+   }
+}
+
+// Connection attempt failed. Called under m_lock
+void CAPCClient::connectFailed_p(const std::string& errMsg)
 {
-   CAPCConnector::ptr pAPC = nullptr;
+   const mngr_addr_s& mngr = getDialMngr_p();
+   cancelConnect_p();
+   DUSTLOG_ERROR(m_logName, "CAPCClient. " << (m_isDialStandby ? "Standby connection" : "Connection") << " to '" 
+                 << mngr.getName() << "' failed. " << errMsg);
+   if (m_isDialStandby) {
+      m_numFailedStandby++;
+   } else {
+      m_numFailedAttempts++;
+      // Without standby connection managers are tried in turn
+      if (!m_mngrs[1].m_host.empty())
+         m_activeMngr = (m_activeMngr + 1) % APC_NUM_MNGRS;
+   }
+   if (m_state != APCCLIENT_STATE_DISCONNECT)
+      startTimer_p();
+}
 
+// Connection is established. Called under m_lock
+void CAPCClient::connectDone_p(IAPCTransport::ptr transport)
+{
    CAPCConnector::init_param_t connectorParam = {
       m_intfName, &m_IOService, &m_notifThread, m_kaTimeout, 
       m_freeBufTimeout, (uint32_t)(m_cache.getCacheSize() * 0.75), m_logName,
-      getVersionLabel(),
+      getVersionLabel(), &m_rateTx, &m_rateRx, m_netRxBatchSize, m_netRxBatchDelay,
+      m_compressLevel, APC_COMPRESS_UPSTREAM, &m_compressStats, m_protoVer, &m_sockPolicy,
+      m_ackDelayMsec, m_ackEveryPkts,
    };
 
-   pAPC = CAPCConnector::createConnection(connectorParam);
+   CAPCConnector::ptr pAPC = CAPCConnector::createConnection(connectorParam);
+   pAPC->setTransport(transport);
+   if (m_isDialStandby) {
+      m_pStandby = pAPC;
+      m_isStandbyReady = false;
+   }
 
-   try {
-      boost::asio::ip::tcp::resolver           resolver(m_IOService);
-      boost::asio::ip::tcp::resolver::query    query(m_host.c_str(), m_port.c_str());
-      boost::asio::ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-      boost::asio::connect(pAPC->getSocket(), endpoint_iterator);
-   } catch (exception& e) {
-      errMsg = e.what();
-      pAPC = nullptr;
+   // Start CAPCConnector
+   apc_error_t res = pAPC->start();
+   // Send 'new' (APINTFID_EMPTY) Connect message or Connect with current session ID
+   if (res == APC_OK) {
+      apc_msg_net_gpslock_s gpsState = {m_currentGpsState};
+      uint32_t              flags = m_isCreditEnabled ? APC_FL_CREDIT : 0;
+      if (m_intfId == APINTFID_EMPTY)
+         res = pAPC->connect(m_intfId, 0, 0, gpsState, 0, flags);
+      else
+         res = pAPC->connect(m_intfId, m_cache.getLastSent(), m_lastRxSeqNum, gpsState, 0, 
+                             flags | (m_isDialStandby ? APC_FL_STANDBY : 0));
    }
-   
-   return pAPC;
+   if (res != APC_OK) {
+      DUSTLOG_ERROR(m_logName, "CAPCClient. Start of connection to '" << getDialMngr_p().getName() 
+                    << "' failed. " << toString(res));
+      pAPC->stop(APC_STOP_CREATE, res, m_intfId == APINTFID_EMPTY ? CAPCConnector::STOP_FL_DISCONNECT : 
+                                                                     CAPCConnector::STOP_FL_OFFLINE);
+   }
+}
+
+// Manager of current connection attempt
+const CAPCClient::mngr_addr_s& CAPCClient::getDialMngr_p() const
+{
+   return m_mngrs[m_isDialStandby ? (m_activeMngr + 1) % APC_NUM_MNGRS : m_activeMngr];
+}
+
+// Exponential backoff from reconnection delay with +-25% jitter: clients of 
+// restarted manager do not reconnect at the same time
+uint32_t CAPCClient::getReconnectDelay_p(uint32_t numFailed)
+{
+   uint32_t baseDelay = std::max(m_reconnectionDelayMsec, APC_RECONNECT_MIN_DELAY_MSEC);
+   uint32_t maxDelay  = std::max(m_reconnectMaxDelayMsec, baseDelay);
+   uint32_t delay     = baseDelay;
+   for (uint32_t i = 0; i < numFailed && i < APC_RECONNECT_MAX_SHIFT && delay < maxDelay; i++)
+      delay *= 2;
+   delay = std::min(delay, maxDelay);
+   return delay - delay / 4 + getRand(delay / 2 + 1);
+}
+
+// Callback of name resolution
+void CAPCClient::handleResolve_p(uint32_t gen, const boost::system::error_code& error,
+                                 boost::asio::ip::tcp::resolver::iterator it)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (gen != m_connectGen)
+      return;
+   if (error) {
+      connectFailed_p("Resolve error: " + error.message());
+      return;
+   }
+
+   // Interleave address families, starting with the first resolved one (RFC 8305)
+   std::vector<boost::asio::ip::tcp::endpoint> first, second;
+   for (boost::asio::ip::tcp::resolver::iterator end; it != end; ++it) {
+      const boost::asio::ip::tcp::endpoint& ep = it->endpoint();
+      if (first.empty() || ep.protocol() == first[0].protocol())
+         first.push_back(ep);
+      else
+         second.push_back(ep);
+   }
+   for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+      if (i < first.size())
+         m_endpoints.push_back(first[i]);
+      if (i < second.size())
+         m_endpoints.push_back(second[i]);
+   }
+   if (m_endpoints.empty()) {
+      connectFailed_p("No address");
+      return;
+   }
+   boost::system::error_code ec;
+   m_connectTimer.cancel(ec);
+   connectNext_p();
+}
+
+// Callback of connection to one address
+void CAPCClient::handleConnect_p(uint32_t gen, sockptr_t sock, size_t idx, const boost::system::error_code& error)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   // Socket is closed by its deadline timer: failure is already counted
+   if (gen != m_connectGen || m_connSockets[idx] != sock)
+      return;
+
+   if (error) {
+      endpointFailed_p(idx, error.message());
+      return;
+   }
+
+   // First established connection wins. Others are closed
+   DUSTLOG_INFO(m_logName, "CAPCClient. Connected to " << m_endpoints[idx]);
+   m_connSockets[idx] = nullptr;
+   cancelConnect_p();
+   connectDone_p(IAPCTransport::ptr(new CAPCTcpTransport(std::move(*sock))));
+}
+
+// Callback of connection to "unix:" / "shm:" manager
+void CAPCClient::handleLocalConnect_p(uint32_t gen, localsockptr_t sock, apc_transport_t transport,
+                                      const boost::system::error_code& error)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (gen != m_connectGen)
+      return;
+   if (error) {
+      connectFailed_p(error.message());
+      return;
+   }
+
+   IAPCTransport::ptr pTransport;
+   if (transport == APC_TRANSPORT_SHM) {
+      std::string errMsg;
+      pTransport = CAPCShmTransport::create(m_IOService, std::move(*sock), &errMsg);
+      if (pTransport == nullptr) {
+         connectFailed_p(errMsg);
+         return;
+      }
+   } else {
+      pTransport.reset(new CAPCUnixTransport(std::move(*sock)));
+   }
+   DUSTLOG_INFO(m_logName, "CAPCClient. Connected to " << pTransport->getName());
+   m_localSocket.reset();
+   cancelConnect_p();
+   connectDone_p(pTransport);
+}
+
+// Callback of stagger timer: next address is raced
+void CAPCClient::handleStagger_p(uint32_t gen, const boost::system::error_code& error)
+{
+   if (error)
+      return;
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (gen == m_connectGen && m_connSockets.size() < m_endpoints.size())
+      connectNext_p();
+}
+
+// Callback of connection attempt timer
+void CAPCClient::handleConnectTimeout_p(uint32_t gen, const boost::system::error_code& error)
+{
+   if (error)
+      return;
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (gen != m_connectGen)
+      return;
+   ostringstream os;
+   os << "Timeout " << m_connectTimeoutMsec << " msec";
+   connectFailed_p(os.str());
+}
+
+// Callback of deadline of connection to one address: only this socket is closed
+void CAPCClient::handleSockTimeout_p(uint32_t gen, size_t idx, const boost::system::error_code& error)
+{
+   if (error)
+      return;
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (gen != m_connectGen || m_connSockets[idx] == nullptr)
+      return;
+   ostringstream os;
+   os << "Timeout " << m_connectTimeoutMsec << " msec";
+   endpointFailed_p(idx, os.str());
+}
+
+// Connection to one address failed. Called under m_lock
+void CAPCClient::endpointFailed_p(size_t idx, const std::string& errMsg)
+{
+   boost::system::error_code ec;
+   ostringstream os;
+   os << m_endpoints[idx] << " " << errMsg;
+   DUSTLOG_DEBUG(m_logName, "CAPCClient. Connection to " << os.str() << " failed");
+   m_connSockets[idx]->close(ec);
+   m_connSockets[idx] = nullptr;
+   if (m_connTimers[idx] != nullptr)
+      m_connTimers[idx]->cancel(ec);
+   if (++m_numFailedConn == m_endpoints.size()) {
+      connectFailed_p(os.str());
+   } else if (m_numFailedConn == m_connSockets.size()) {
+      // All started connections failed: don't wait for stagger timer
+      connectNext_p();
+   }
+}
+//]
+
+//[ Hot-standby connection ------------------------------------------------------
+// Send packets from cache after confirmed one. Called under m_lock
+apc_error_t CAPCClient::replayCache_p(uint32_t yourSeq)
+{
+   m_cache.confirmedSeqNum(yourSeq, true); 
+   CFlightRecorder::record(FLIGHTREC_CACHE_CONFIRM, yourSeq, m_cache.getNumCachedPkts());
+   m_lastTxSeqNum = yourSeq;
+   apc_error_t res = sendCached_p();
+   if (res != APC_OK) {
+      if (res == APC_ERR_PKTSERIALIZATION)   // Fatal error. Close session
+         m_pConnector->stop(APC_STOP_RECONNECTION, res, CAPCConnector::STOP_FL_DISCONNECT);
+      else                                   // Error. Go to offline
+         m_pConnector->stop(APC_STOP_RECONNECTION, res, CAPCConnector::STOP_FL_OFFLINE);
+      DUSTLOG_ERROR(m_logName, "CAPCClient #" << m_intfId << " Cache output error: " << toString(res));
+   }
+   return res;
 }
 
+// Connect to the other manager with APC_FL_STANDBY. Called under m_lock
+void CAPCClient::startStandby_p()
+{
+   if (!m_isStandbyEnabled || m_state != APCCLIENT_STATE_ONLINE || m_pStandby != nullptr || m_isConnecting)
+      return;
+   startConnect_p(true);
+}
+
+// Called under m_lock. apcDisconnected of standby connector follows
+void CAPCClient::stopStandby_p()
+{
+   if (m_isConnecting && m_isDialStandby)
+      cancelConnect_p();
+   if (m_pStandby != nullptr)
+      m_pStandby->stop(APC_STOP_CLOSE, APC_OK, CAPCConnector::STOP_FL_OFFLINE);
+   m_isStandbyReady = false;
+}
+
+// Active connection is lost, standby one takes over the session without new handshake.
+// Cache is replayed after answer of manager (see messageReceived). Called under m_lock
+void CAPCClient::failover_p()
+{
+   m_pConnector = m_pStandby;
+   m_pStandby = nullptr;
+   m_isStandbyReady = false;
+   m_activeMngr = (m_activeMngr + 1) % APC_NUM_MNGRS;
+   m_isActivating = true;
+   DUSTLOG_INFO(m_logName, "CAPCClient #" << m_intfId << " Failover to '" << m_mngrs[m_activeMngr].getName() << "'");
+   apc_error_t res = m_pConnector->activate(m_cache.getLastSent(), m_lastRxSeqNum);
+   if (res != APC_OK)
+      m_pConnector->stop(APC_STOP_WRITE, res, CAPCConnector::STOP_FL_OFFLINE);
+}
+//]
+
+//[ Credit flow control ----------------------------------------------------------
+// Send packets from cache after m_lastTxSeqNum while manager gives credit. Called under m_lock
+apc_error_t CAPCClient::sendCached_p()
+{
+   apc_error_t                 res = APC_OK;
+   CAPCCache::apc_cache_pkt_s  pkt;
+   m_cache.prepForGet(m_lastTxSeqNum);
+   while(res == APC_OK && m_cache.getNextPacket(&pkt) != APC_ERR_NOTFOUND) {
+      if (isCreditHeld_p(pkt.m_seqNumb))
+         break;
+      CFlightRecorder::record(FLIGHTREC_CACHE_RESEND, pkt.m_seqNumb, pkt.m_type);
+      res = m_pConnector->sendData(pkt.m_type, 0, pkt.m_seqNumb, pkt.m_payload.data(), pkt.m_size, NULL, 0);
+      if (res == APC_OK)
+         m_lastTxSeqNum = pkt.m_seqNumb;
+   }
+   return res;
+}
+
+// Packet is beyond credit of manager. Called under m_lock
+bool CAPCClient::isCreditHeld_p(uint32_t seqNum) const
+{
+   return m_pConnector != nullptr && m_pConnector->isCredit() && (int32_t)(seqNum - m_txCreditLimit) > 0;
+}
+
+// Manager may send up to received messages + free space of AP input. Called under m_lock
+void CAPCClient::updateRxCredit_p()
+{
+   if (m_pConnector != nullptr)
+      m_pConnector->setRxCredit(m_lastRxSeqNum + m_inputSpace);
+}
+
+// Packets without credit stay in cache. Input is paused before they overwrite 
+// unconfirmed ones (AP gets NACK and keeps its data). Called under m_lock
+bool CAPCClient::updateCreditPause_p()
+{
+   size_t numCached = m_cache.getNumCachedPkts() + m_sched.getNumMsgs();
+   size_t cacheSize = m_cache.getCacheSize();
+   bool   isPaused;
+   if (m_isCreditPaused)
+      isPaused = numCached > cacheSize * APC_CREDIT_RESUME_LEVEL;
+   else
+      isPaused = ((m_lastTxSeqNum != m_cache.getLastSent() && isCreditHeld_p(m_cache.getLastSent())) ||
+                  !m_sched.empty()) &&
+                 numCached >= cacheSize * APC_CREDIT_PAUSE_LEVEL;
+   if (isPaused == m_isCreditPaused)
+      return false;
+   m_isCreditPaused = isPaused;
+   return true;
+}
+
+void CAPCClient::notifyCreditPause(bool isPaused)
+{
+   DUSTLOG_INFO(m_logName, "CAPCClient #" << m_intfId << (isPaused ? " Pause" : " Resume") 
+                << " input: cached " << m_cache.getNumCachedPkts() << " packets");
+   if (m_pInput == NULL)
+      return;
+   if (isPaused)
+      m_pInput->pause();
+   else
+      m_pInput->resume();
+}
+//]
+
+//[ Priority scheduler of upstream messages ---------------------------------------
+// Output takes next message without waiting. If there is no free buffer, connector 
+// sends apcTxReady when it is freed. Called under m_lock
+bool CAPCClient::isTxReady_p()
+{
+   // Cached packets wait for credit of manager (see sendCached_p)
+   if (m_lastTxSeqNum != m_cache.getLastSent() || isCreditHeld_p(m_cache.getLastSent() + 1))
+      return false;
+   return m_pConnector->isTxReady(true);
+}
+
+// Sequence numbers are assigned in order of sending. Called under m_lock
+void CAPCClient::sendScheduled_p()
+{
+   apc_error_t res = APC_OK;
+   while (res == APC_OK && !m_sched.empty() && m_pConnector != nullptr && isTxReady_p()) {
+      const CAPCUpstreamSched::msg_s& msg = m_sched.front();
+      res = sendSeq_p(msg.m_type, msg.m_payload.data(), (uint16_t)msg.m_payload.size(), NULL, 0);
+      m_sched.pop();
+   }
+}
+
+// Connection is lost: messages accepted by scheduler are kept for replay. Called under m_lock
+void CAPCClient::scheduleToCache_p()
+{
+   uint32_t seqNum;
+   size_t   numDropped = 0;
+   while (!m_sched.empty()) {
+      const CAPCUpstreamSched::msg_s& msg = m_sched.front();
+      apc_error_t res = m_cache.addPacket(msg.m_type, msg.m_payload.data(), (uint32_t)msg.m_payload.size(), 
+                                          NULL, 0, &seqNum);
+      CFlightRecorder::record(FLIGHTREC_CACHE_ADD, seqNum, msg.m_type, res);
+      if (res != APC_OK)
+         numDropped++;
+      m_sched.pop();
+   }
+   if (numDropped > 0) {
+      m_sched.addRejected(numDropped);
+      DUSTLOG_WARN(m_logName, "CAPCClient #" << m_intfId << " " << numDropped 
+                   << " waiting messages are not accepted by cache and dropped");
+   }
+}
+//]
+
 // Start reconnection timer
 apc_error_t CAPCClient::startTimer_p()
 {
@@ -503,7 +1191,9 @@ apc_error_t CAPCClient::startTimer_p()
       m_reconnectTimer = tmrptr_t(new boost::asio::deadline_timer(m_IOService));
 
    try {
-      m_reconnectTimer->expires_from_now(boost::posix_time::milliseconds(m_reconnectionDelayMsec));
+      // Online session: timer restarts standby connection
+      uint32_t numFailed = m_state == APCCLIENT_STATE_ONLINE ? m_numFailedStandby : m_numFailedAttempts;
+      m_reconnectTimer->expires_from_now(boost::posix_time::milliseconds(getReconnectDelay_p(numFailed)));
       m_reconnectTimer->async_wait(boost::bind(&CAPCClient::reconnectTimerFun_p, this, boost::asio::placeholders::error));
    } catch(exception& e) {
       DUSTLOG_ERROR(m_logName, "CAPCClient #" << m_intfId << "Start Reconnect Timer error: " << e.what());
@@ -3,10 +3,20 @@
 #include "APInterface/public/IAPCClient.h"
 #include "APCConnector.h"
 #include "APCCache.h"
+#include "APCUpstreamSched.h"
 #include "APCCntrlNotifThread.h"
 #include "IOSrvThread.h"
 
 #include <boost/thread.hpp>
+#include <vector>
+
+const uint32_t APC_CONNECT_STAGGER_MSEC     = 250;  ///< Delay before racing next address of manager (RFC 8305)
+const uint32_t APC_RECONNECT_MIN_DELAY_MSEC = 100;  ///< Min delay between connection attempts
+const uint32_t APC_RECONNECT_MAX_SHIFT      = 10;   ///< Max exponent of reconnection backoff
+const uint32_t APC_NUM_MNGRS                = 2;    ///< Primary and secondary (hot-standby) manager
+const uint32_t APC_CREDIT_INPUT_SPACE       = 8;    ///< Credit of manager until AP input reports its space
+const double   APC_CREDIT_PAUSE_LEVEL       = 0.75; ///< Input is paused when packets without credit fill cache to it
+const double   APC_CREDIT_RESUME_LEVEL      = 0.5;  ///< and resumed below it
 
 class CAPCClient : public IAPCClient, IAPCConnectorNotif
 {
@@ -29,13 +39,19 @@ public:
    virtual apc_error_t sendResume();
    virtual apc_error_t sendPause ();
    virtual apc_error_t sendGpsLock(const ap_intf_gpslock_t& p);
+   virtual void        setInputSpace(uint32_t numMsgs);
    virtual bool        isConnected();
 
    virtual size_t getCachedPkts() { return m_cache.getNumCachedPkts(); }
    virtual statdelays_s getAPCCStats() const { return m_pConnector->getAPCCStatistics().m_sendStat; }
    virtual uint32_t getNumRcvPkt() const {return m_pConnector->getAPCCStatistics().m_numRcvPkt; }
 
-   virtual void clearStats() { m_pConnector->clearStats(); }
+   virtual void getRateStats(ratestat_s * pToMngr, ratestat_s * pFromMngr);
+   virtual void getCompressStats(apc_compress_stats_s * pStats) { m_compressStats.getStat(pStats); }
+   virtual bool getTcpInfo(apc_tcp_info_s * pInfo);
+   virtual void getSchedStats(apc_sched_stats_s * pStats);
+
+   virtual void clearStats();
 
    virtual uint32_t getNetId() const { return m_netId; }
 private:
@@ -50,10 +66,24 @@ private:
    CAPCCtrlNotifThread             m_notifThread;     // Thread for Connector notification
    CAPCCache                       m_cache;           // Cache of output packets
    uint32_t                        m_lastRxSeqNum;    // Last received seq.number
-   std::string                     m_host;            // Server host name
-   std::string                     m_port;            // Server port
+   struct mngr_addr_s {
+      std::string                  m_host;            // Server host name (empty - not configured)
+      std::string                  m_port;            // Server port
+
+      // Address for logs ("unix:PATH" and "shm:PATH" have no port)
+      std::string getName() const {
+         return apcParseTransport(m_host, NULL) == APC_TRANSPORT_TCP ? m_host + ":" + m_port : m_host;
+      }
+   };
+   mngr_addr_s                     m_mngrs[APC_NUM_MNGRS]; // Managers from start parameters
+   uint32_t                        m_activeMngr;      // Index of manager of active connection
    uint32_t                        m_kaTimeout;       // Connector: Keep Alive timeout
    uint32_t                        m_freeBufTimeout;  // Connector: Max time to wait for free buffer
+   uint32_t                        m_netRxBatchSize;  // Connector: Max payload of NET_RX batch
+   uint32_t                        m_netRxBatchDelay; // Connector: Max time of packet in NET_RX batch
+   uint32_t                        m_compressLevel;   // Connector: Offered compression level (0 - none)
+   uint8_t                         m_protoVer;        // Connector: Max offered protocol version
+   apc_sock_policy_s               m_sockPolicy;      // Connector: Socket options
    std::string                     m_intfName;        // Name of Client Connector
    IAPCClientNotif               * m_pInput;          // IAPCClientNotif interface
    std::string                     m_logName;         // Logger name
@@ -66,9 +96,106 @@ private:
    uint32_t                        m_disconnectTimeoutMsec; // Max time before disconnecting when offline
    ap_int_gpslockstat_t            m_currentGpsState; // Current gps state (0 = no lock, 1 = lock)
    uint32_t                        m_netId;           // Network ID
+   CStatRateCalc                   m_rateTx;          // Rate of messages sent to server (kept across reconnections)
+   CStatRateCalc                   m_rateRx;          // Rate of messages received from server
+   CAPCCompressStats               m_compressStats;   // Compression statistics (kept across reconnections)
+
+   //[ ---- Asynchronous connection. All addresses of manager are raced (Happy Eyeballs)
+   typedef boost::shared_ptr<boost::asio::ip::tcp::socket> sockptr_t;
+   typedef boost::shared_ptr<boost::asio::deadline_timer>  timerptr_t;
+   boost::asio::ip::tcp::resolver  m_resolver;        // Resolver of manager name
+   boost::asio::deadline_timer     m_connectTimer;    // Timeout of name resolution or local connection
+   boost::asio::deadline_timer     m_staggerTimer;    // Start of connection to next address
+   std::vector<boost::asio::ip::tcp::endpoint> m_endpoints; // Addresses of manager, families interleaved
+   std::vector<sockptr_t>          m_connSockets;     // Started connections (index in m_endpoints, NULL - failed)
+   std::vector<timerptr_t>         m_connTimers;      // Timeout of each started connection
+   typedef boost::shared_ptr<boost::asio::local::stream_protocol::socket> localsockptr_t;
+   localsockptr_t                  m_localSocket;     // Connection to "unix:" / "shm:" manager
+   size_t                          m_numFailedConn;   // Failed connections of current attempt
+   uint32_t                        m_connectGen;      // Generation of attempt. Callbacks of old ones are ignored
+   bool                            m_isConnecting;    // Connection attempt is in progress
+   uint32_t                        m_numFailedAttempts; // Failed attempts in a row (backoff exponent)
+   uint32_t                        m_connectTimeoutMsec;    // Max time of connection to one address (0 - unlimited)
+   uint32_t                        m_reconnectMaxDelayMsec; // Max delay between attempts
+   uint32_t                        m_ackDelayMsec;    // Max delay of acknowledgement of received messages
+   uint32_t                        m_ackEveryPkts;    // Acknowledge every N received messages
+   bool                            m_isDialStandby;   // Attempt is for standby connection
+   //]
+
+   //[ ---- Hot-standby connection to secondary manager (see APC_FL_STANDBY)
+   CAPCConnector::ptr              m_pStandby;        // Standby connector (NULL - none)
+   bool                            m_isStandbyReady;  // Manager accepted standby connection
+   bool                            m_isStandbyEnabled;// Secondary manager is configured and supports standby
+   bool                            m_isActivating;    // APC_ACTIVATE is sent on former standby connection
+   uint32_t                        m_numFailedStandby;// Failed standby attempts in a row
+   //]
+
+   //[ ---- Credit flow control (see APC_FL_CREDIT)
+   bool                            m_isCreditEnabled; // Offer credit to manager
+   uint32_t                        m_txCreditLimit;   // Last seq.number manager accepts
+   uint32_t                        m_lastTxSeqNum;    // Last cached packet passed to connector
+   uint32_t                        m_inputSpace;      // Free space of AP input (messages)
+   bool                            m_isCreditPaused;  // Input is paused: cache is filled by packets without credit
+   //]
+
+   //[ ---- Priority scheduler of upstream messages (see CAPCUpstreamSched)
+   bool                            m_isPrioritySched; // Messages wait in m_sched while output is busy
+   CAPCUpstreamSched               m_sched;           // Messages without sequence number
+   //]
 
-   // Open IP connection with server
-   CAPCConnector::ptr  ipConnect_p(std::string& errMsg);
+   // Start asynchronous connection attempt to active manager or (isStandby) to the other one
+   void                startConnect_p(bool isStandby);
+   // Cancel connection attempt
+   void                cancelConnect_p();
+   // Start connection to next address of manager
+   void                connectNext_p();
+   // Connection to one address failed. Next address is tried, attempt fails after the last one
+   void                endpointFailed_p(size_t idx, const std::string& errMsg);
+   // Connection attempt failed. Retry after backoff delay
+   void                connectFailed_p(const std::string& errMsg);
+   // Connection is established: create connector and send Connect message
+   void                connectDone_p(IAPCTransport::ptr transport);
+   // Manager of current connection attempt
+   const mngr_addr_s&  getDialMngr_p() const;
+   // Delay before next connection attempt (exponential backoff with jitter)
+   uint32_t            getReconnectDelay_p(uint32_t numFailed);
+   // Resend packets not confirmed by manager ('yourSeq'). Connector is stopped on error
+   apc_error_t         replayCache_p(uint32_t yourSeq);
+   // Send cached packets after m_lastTxSeqNum up to credit of manager
+   apc_error_t         sendCached_p();
+   // Packets of cache wait for credit of manager
+   bool                isCreditHeld_p(uint32_t seqNum) const;
+   // Advertise credit to manager: received messages + free space of AP input
+   void                updateRxCredit_p();
+   // Pause / resume input by filling of cache. Returns true if state is changed
+   bool                updateCreditPause_p();
+   // Notify input about changed pause state (called without m_lock)
+   void                notifyCreditPause(bool isPaused);
+   // Save message in cache and pass it to connector. Connector is stopped on error
+   apc_error_t         sendSeq_p(apc_msg_type_t  type, const uint8_t * payload1, uint16_t size1,
+                                 const uint8_t * payload2, uint16_t size2);
+   // Next message is sent without waiting for output buffer or credit of manager
+   bool                isTxReady_p();
+   // Send messages of scheduler by priority while output is ready
+   void                sendScheduled_p();
+   // Waiting messages get sequence numbers in cache, they are sent by replay after reconnection
+   void                scheduleToCache_p();
+   // Start standby connection if it is enabled and session is online
+   void                startStandby_p();
+   // Close standby connection or cancel its attempt
+   void                stopStandby_p();
+   // Standby connection becomes active: send APC_ACTIVATE
+   void                failover_p();
+   // Callbacks of asynchronous connection
+   void                handleResolve_p(uint32_t gen, const boost::system::error_code& error,
+                                       boost::asio::ip::tcp::resolver::iterator it);
+   void                handleConnect_p(uint32_t gen, sockptr_t sock, size_t idx, 
+                                       const boost::system::error_code& error);
+   void                handleLocalConnect_p(uint32_t gen, localsockptr_t sock, apc_transport_t transport,
+                                            const boost::system::error_code& error);
+   void                handleStagger_p(uint32_t gen, const boost::system::error_code& error);
+   void                handleConnectTimeout_p(uint32_t gen, const boost::system::error_code& error);
+   void                handleSockTimeout_p(uint32_t gen, size_t idx, const boost::system::error_code& error);
    // Start / stop timer
    apc_error_t         startTimer_p();
    void                stopTimer_p(tmrptr_t& timer);
@@ -89,7 +216,9 @@ private:
    virtual void apcStarted(CAPCConnector::ptr pAPC);
    virtual void apcConnected(CAPCConnector::ptr pAPC, const param_connected_s& param);
    virtual void apcDisconnected(CAPCConnector::ptr pAPC, const param_disconnected_s& param);
-   virtual void messageReceived(const param_received_s& param, const uint8_t * pPayload, uint16_t size);
+   virtual void messageReceived(CAPCConnector::ptr pAPC, const param_received_s& param, 
+                                const uint8_t * pPayload, uint16_t size);
+   virtual void apcTxReady(CAPCConnector::ptr pAPC);
 
 };
 
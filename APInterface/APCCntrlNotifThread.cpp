@@ -105,7 +105,11 @@ void    CAPCCtrlNotifThread::threadFun()
             m_pExtrnAPCNotif->apcDisconnected(pNotif->m_apc, pNotif->m_param.m_disconnect);
             break;
          case APC_MSGRCVD:
-            m_pExtrnAPCNotif->messageReceived(pNotif->m_param.m_msg, pNotif->m_payload.data(), pNotif->m_payloadSize);
+            m_pExtrnAPCNotif->messageReceived(pNotif->m_apc, pNotif->m_param.m_msg, pNotif->m_payload.data(), 
+                                              pNotif->m_payloadSize);
+            break;
+         case APC_TXREADY:
+            m_pExtrnAPCNotif->apcTxReady(pNotif->m_apc);
             break;
 
          default:
@@ -163,13 +167,15 @@ void CAPCCtrlNotifThread::apcDisconnected(CAPCConnector::ptr pAPC, const param_d
    insertNotif_p(pNotif);
 }
 
-void CAPCCtrlNotifThread::messageReceived(const param_received_s& param, const uint8_t * pPayload, uint16_t size)
+void CAPCCtrlNotifThread::messageReceived(CAPCConnector::ptr pAPC, const param_received_s& param, 
+                                          const uint8_t * pPayload, uint16_t size)
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
    if (!m_isWork)
       return;
    apcnotif_t * pNotif = newNotif_p();
    pNotif->m_type = APC_MSGRCVD;
+   pNotif->m_apc  = pAPC;
    pNotif->m_param.m_msg = param;
    if (size > 0) {
       if (size > pNotif->m_payload.size())
@@ -180,6 +186,17 @@ void CAPCCtrlNotifThread::messageReceived(const param_received_s& param, const u
    insertNotif_p(pNotif);
 }
 
+void CAPCCtrlNotifThread::apcTxReady(CAPCConnector::ptr pAPC)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (!m_isWork)
+      return;
+   apcnotif_t * pNotif = newNotif_p();
+   pNotif->m_type = APC_TXREADY;
+   pNotif->m_apc  = pAPC;
+   insertNotif_p(pNotif);
+}
+
 void CAPCCtrlNotifThread::sendStopSignal_p()
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
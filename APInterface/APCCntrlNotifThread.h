@@ -23,7 +23,9 @@ public:
    virtual void apcStarted(CAPCConnector::ptr pAPC);
    virtual void apcConnected(CAPCConnector::ptr pAPC, const param_connected_s& param);
    virtual void apcDisconnected(CAPCConnector::ptr pAPC, const param_disconnected_s& param);
-   virtual void messageReceived(const param_received_s& param, const uint8_t * pPayload, uint16_t size);
+   virtual void messageReceived(CAPCConnector::ptr pAPC, const param_received_s& param, 
+                                const uint8_t * pPayload, uint16_t size);
+   virtual void apcTxReady(CAPCConnector::ptr pAPC);
 
 protected:
    enum apc_notiftype_t {  // "#IGNORE"
@@ -32,6 +34,7 @@ protected:
       APC_CONNECT,
       APC_DISCONNECT,
       APC_MSGRCVD,
+      APC_TXREADY,
       APC_TERMINATE,
    };
 
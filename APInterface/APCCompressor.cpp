@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "APCCompressor.h"
+#include "APCProto.h"
+#include "Logger.h"
+#include "6lowpan/6lowpanhdr.h"
+
+#include <boost/chrono/thread_clock.hpp>
+#include <cstring>
+
+const int     APC_COMPRESS_WINDOW_BITS = -15;    // Raw deflate, 32K window
+const int     APC_COMPRESS_MEM_LEVEL   = 8;
+const size_t  APC_DECOMPRESS_BUF_SIZE  = 4096;
+
+static uint64_t threadCpuUsec()
+{
+   return boost::chrono::duration_cast<boost::chrono::microseconds>(
+             boost::chrono::thread_clock::now().time_since_epoch()).count();
+}
+
+/////////////////////////////////////////////////
+//    Preset dictionaries
+/////////////////////////////////////////////////
+static void appendBytes(std::vector<uint8_t>& dict, const void * p, size_t size)
+{
+   const uint8_t * b = (const uint8_t *)p;
+   dict.insert(dict.end(), b, b + size);
+}
+
+static void appendApcHdr(std::vector<uint8_t>& dict, apc_msg_type_t type, uint8_t flags, uint16_t length)
+{
+   apc_hdr_s hdr;
+   hdr.cookie  = APC_COOKIE;
+   hdr.flags   = flags;
+   hdr.type    = type;
+   hdr.mySeq   = 0;
+   hdr.yourSeq = 0;
+   hdr.length  = htons(length);
+   appendBytes(dict, &hdr, sizeof(hdr));
+}
+
+// Beginning of mesh packet (see 6lowpan/6lowpanhdr.h): dispatch, mesh
+// specifier (short addresses, priority), TTL, ASN, graph ID, source and
+// destination. Long address is built from Dust OUI
+static void appendMeshHdr(std::vector<uint8_t>& dict, uint8_t priority, bool isLongSrc)
+{
+   const uint8_t TTL = 127;
+   uint8_t hdr[] = { 0x00, (uint8_t)(isLongSrc ? 0x08 : 0x00), priority, TTL, 0x00, 0x00, 0x01 };
+   const uint8_t longAddr[]  = { 0x00, 0x17, 0x0D, 0x00, 0x00, 0x38, 0x00, 0x00 };
+   const uint8_t shortAddr[] = { 0x00, 0x01 };
+   appendBytes(dict, hdr, sizeof(hdr));
+   if (isLongSrc)
+      appendBytes(dict, longAddr, sizeof(longAddr));
+   else
+      appendBytes(dict, shortAddr, sizeof(shortAddr));
+   appendBytes(dict, shortAddr, sizeof(shortAddr));
+}
+
+// Most frequent messages are at the end: they are closer to the compressed data
+static std::vector<uint8_t> makeDictionary(apc_compress_dir_t dir)
+{
+   std::vector<uint8_t> dict;
+   appendApcHdr(dict, APC_KA, APC_HDR_FLAGS_NOTRACK, 0);
+   if (dir == APC_COMPRESS_UPSTREAM) {
+      apc_msg_net_txdone_s txDone;
+      memset(&txDone, 0, sizeof(txDone));
+      appendApcHdr(dict, APC_NET_TXDONE, 0, sizeof(txDone));
+      appendBytes(dict, &txDone, sizeof(txDone));
+      appendApcHdr(dict, APC_NET_RX_BATCH, 0, 0);
+      for (uint8_t priority = PKT_PRIORITY_NORMAL; priority <= PKT_PRIORITY_CMD; priority++) {
+         appendApcHdr(dict, APC_NET_RX, 0, 0);
+         appendMeshHdr(dict, priority, priority == PKT_PRIORITY_CMD);
+      }
+   } else {
+      appendApcHdr(dict, APC_NET_TX_PAUSE,  APC_HDR_FLAGS_NOTRACK, 0);
+      appendApcHdr(dict, APC_NET_TX_RESUME, APC_HDR_FLAGS_NOTRACK, 0);
+      for (uint8_t priority = PKT_PRIORITY_NORMAL; priority <= PKT_PRIORITY_CMD; priority++) {
+         apc_msg_net_tx_s txHdr;
+         memset(&txHdr, 0, sizeof(txHdr));
+         txHdr.priority = priority;
+         appendApcHdr(dict, APC_NET_TX, 0, 0);
+         appendBytes(dict, &txHdr, sizeof(txHdr));
+         appendMeshHdr(dict, priority, false);
+      }
+   }
+   return dict;
+}
+
+const std::vector<uint8_t>& CAPCCompressor::getDictionary(apc_compress_dir_t dir)
+{
+   static const std::vector<uint8_t> s_upstream   = makeDictionary(APC_COMPRESS_UPSTREAM);
+   static const std::vector<uint8_t> s_downstream = makeDictionary(APC_COMPRESS_DOWNSTREAM);
+   return dir == APC_COMPRESS_UPSTREAM ? s_upstream : s_downstream;
+}
+
+/////////////////////////////////////////////////
+//    CAPCCompressStats
+/////////////////////////////////////////////////
+void CAPCCompressStats::add(bool isTx, size_t rawBytes, size_t compBytes, uint64_t cpuUsec)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (isTx) {
+      m_stats.m_txRawBytes  += rawBytes;
+      m_stats.m_txCompBytes += compBytes;
+      m_stats.m_txCpuUsec   += cpuUsec;
+   } else {
+      m_stats.m_rxRawBytes  += rawBytes;
+      m_stats.m_rxCompBytes += compBytes;
+      m_stats.m_rxCpuUsec   += cpuUsec;
+   }
+}
+
+void CAPCCompressStats::getStat(apc_compress_stats_s * pStats)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   *pStats = m_stats;
+}
+
+void CAPCCompressStats::clear()
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/////////////////////////////////////////////////
+//    CAPCCompressor
+/////////////////////////////////////////////////
+CAPCCompressor::CAPCCompressor(apc_compress_dir_t txDir, int level, CAPCCompressStats * pStats,
+                               const char * logName) :
+   m_txDir(txDir),
+   m_level(level),
+   m_pSharedStats(pStats),
+   m_isTxInit(false),
+   m_isRxInit(false),
+   m_rxBuf(APC_DECOMPRESS_BUF_SIZE),
+   m_log(logName)
+{
+   memset(&m_stats, 0, sizeof(m_stats));
+   memset(&m_tx, 0, sizeof(m_tx));
+   memset(&m_rx, 0, sizeof(m_rx));
+}
+
+CAPCCompressor::~CAPCCompressor()
+{
+   if (m_isTxInit)
+      deflateEnd(&m_tx);
+   if (m_isRxInit)
+      inflateEnd(&m_rx);
+}
+
+apc_error_t CAPCCompressor::init()
+{
+   apc_compress_dir_t rxDir = m_txDir == APC_COMPRESS_UPSTREAM ? APC_COMPRESS_DOWNSTREAM : APC_COMPRESS_UPSTREAM;
+   const std::vector<uint8_t>& txDict = getDictionary(m_txDir);
+   const std::vector<uint8_t>& rxDict = getDictionary(rxDir);
+
+   int rc = deflateInit2(&m_tx, m_level, Z_DEFLATED, APC_COMPRESS_WINDOW_BITS, APC_COMPRESS_MEM_LEVEL,
+                         Z_DEFAULT_STRATEGY);
+   m_isTxInit = rc == Z_OK;
+   if (rc == Z_OK)
+      rc = deflateSetDictionary(&m_tx, txDict.data(), (uInt)txDict.size());
+   if (rc == Z_OK) {
+      rc = inflateInit2(&m_rx, APC_COMPRESS_WINDOW_BITS);
+      m_isRxInit = rc == Z_OK;
+   }
+   if (rc == Z_OK)
+      rc = inflateSetDictionary(&m_rx, rxDict.data(), (uInt)rxDict.size());
+   if (rc != Z_OK) {
+      DUSTLOG_ERROR(m_log, "Compression init error: " << rc);
+      return APC_ERR_INIT;
+   }
+   return APC_OK;
+}
+
+apc_error_t CAPCCompressor::compress(const uint8_t * data, size_t size, uint8_t * out, size_t maxSize,
+                                     size_t * pOutSize)
+{
+   uint64_t startCpu = threadCpuUsec();
+   m_tx.next_in   = (Bytef *)data;
+   m_tx.avail_in  = (uInt)size;
+   m_tx.next_out  = out;
+   m_tx.avail_out = (uInt)maxSize;
+   int rc = deflate(&m_tx, Z_SYNC_FLUSH);
+   // Full output buffer: flush may be incomplete
+   if (rc != Z_OK || m_tx.avail_in != 0 || m_tx.avail_out == 0) {
+      DUSTLOG_ERROR(m_log, "Compression error: " << rc << " size " << size);
+      return APC_ERR_SIZE;
+   }
+   *pOutSize = maxSize - m_tx.avail_out;
+
+   uint64_t cpuUsec = threadCpuUsec() - startCpu;
+   m_stats.m_txRawBytes  += size;
+   m_stats.m_txCompBytes += *pOutSize;
+   m_stats.m_txCpuUsec   += cpuUsec;
+   if (m_pSharedStats)
+      m_pSharedStats->add(true, size, *pOutSize, cpuUsec);
+   return APC_OK;
+}
+
+apc_error_t CAPCCompressor::decompress(const uint8_t * data, size_t size,
+                                       const std::function<apc_error_t(uint8_t *, size_t)>& fun)
+{
+   apc_error_t res = APC_OK;
+   size_t      rawBytes = 0;
+   uint64_t    cpuUsec = 0, startCpu = threadCpuUsec();
+
+   m_rx.next_in  = (Bytef *)data;
+   m_rx.avail_in = (uInt)size;
+   do {
+      m_rx.next_out  = m_rxBuf.data();
+      m_rx.avail_out = (uInt)m_rxBuf.size();
+      int rc = inflate(&m_rx, Z_SYNC_FLUSH);
+      // Peer never finishes the stream
+      if (rc != Z_OK && rc != Z_BUF_ERROR) {
+         DUSTLOG_ERROR(m_log, "Decompression error: " << rc << (m_rx.msg ? m_rx.msg : ""));
+         res = APC_ERR_PROTOCOL;
+         break;
+      }
+      size_t len = m_rxBuf.size() - m_rx.avail_out;
+      if (len == 0)
+         break;
+      rawBytes += len;
+      // Processing of messages is not counted as decompression time
+      cpuUsec += threadCpuUsec() - startCpu;
+      res = fun(m_rxBuf.data(), len);
+      startCpu = threadCpuUsec();
+   } while (res == APC_OK && (m_rx.avail_in > 0 || m_rx.avail_out == 0));
+   cpuUsec += threadCpuUsec() - startCpu;
+
+   m_stats.m_rxCompBytes += size;
+   m_stats.m_rxRawBytes  += rawBytes;
+   m_stats.m_rxCpuUsec   += cpuUsec;
+   if (m_pSharedStats)
+      m_pSharedStats->add(false, rawBytes, size, cpuUsec);
+   return res;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "common.h"
+#include "public/APCError.h"
+#include "public/IAPCCommon.h"
+
+const uint32_t APC_COMPRESS_OVERHEAD = 64;   ///< Max growth of one compressed message
+
+/**
+ * Direction of APC stream. Selects preset dictionary
+ */
+enum apc_compress_dir_t {
+   APC_COMPRESS_UPSTREAM   = 0,   // apc -> manager
+   APC_COMPRESS_DOWNSTREAM = 1,   // manager -> apc
+};
+
+/**
+ * Statistics of compression shared by connectors of one client
+ */
+class CAPCCompressStats {
+public:
+   CAPCCompressStats() { clear(); }
+   void add(bool isTx, size_t rawBytes, size_t compBytes, uint64_t cpuUsec);
+   void getStat(apc_compress_stats_s * pStats);
+   void clear();
+private:
+   boost::mutex          m_lock;
+   apc_compress_stats_s  m_stats;
+};
+
+/**
+ * Stream compression of APC connection (raw deflate, RFC 1951)
+ *
+ * Both directions are separate deflate streams, each primed with a preset
+ * dictionary of typical APC and mesh headers of its direction. Every message
+ * is compressed with sync flush: the receiver gets the complete message
+ * without waiting for next data, and the deflate window is kept between
+ * messages, so repeated headers cost a few bits.
+ */
+class CAPCCompressor {
+public:
+   // 'txDir' - direction of sent data, 'level' - zlib compression level (1-9)
+   CAPCCompressor(apc_compress_dir_t txDir, int level, CAPCCompressStats * pStats, const char * logName);
+   ~CAPCCompressor();
+
+   // Create zlib streams
+   apc_error_t init();
+
+   // Compress one serialized message to 'out'
+   apc_error_t compress(const uint8_t * data, size_t size, uint8_t * out, size_t maxSize, size_t * pOutSize);
+
+   // Decompress received data. 'fun' is called for every portion of decompressed data
+   // (it may modify the data)
+   apc_error_t decompress(const uint8_t * data, size_t size,
+                          const std::function<apc_error_t(uint8_t *, size_t)>& fun);
+
+   // Statistics of this connection
+   const apc_compress_stats_s& getStats() const { return m_stats; }
+
+   // Preset dictionary of direction
+   static const std::vector<uint8_t>& getDictionary(apc_compress_dir_t dir);
+
+private:
+   apc_compress_dir_t    m_txDir;
+   int                   m_level;
+   CAPCCompressStats   * m_pSharedStats;   // Can be NULL
+   apc_compress_stats_s  m_stats;
+   z_stream              m_tx;
+   z_stream              m_rx;
+   bool                  m_isTxInit;
+   bool                  m_isRxInit;
+   std::vector<uint8_t>  m_rxBuf;          // Decompressed data
+   std::string           m_log;
+};
@@ -1,5 +1,9 @@
 #include "APCConnector.h"
+#include "AsyncLog.h"
+#include "FlightRecorder.h"
+#include <algorithm>
 #include <boost/bind.hpp>
+#include <boost/chrono/ceil.hpp>
 #include <boost/thread.hpp>
 #include <string>
 using namespace std;
@@ -8,85 +12,17 @@ using namespace std;
    #pragma warning( disable : 4996 )
 #endif
 
-/////////////////////////////////////////////////
-//    CAPCKATimer
-/////////////////////////////////////////////////
-CAPCKATimer::ptr CAPCKATimer::createKATimer(boost::asio::io_service * pIOService, uint32_t timeoutMsec, 
-                                            const char * logName)
-{
-   return ptr(new CAPCKATimer(pIOService, timeoutMsec, logName));
-}
+const uint32_t APC_KA_TIMER_MIN_MSEC = 1;       // Min delay of KA timer (no busy loop)
 
-CAPCKATimer::CAPCKATimer(boost::asio::io_service * pIOService, uint32_t timeoutMsec, const char * logName) :
-   m_kaTimer(*pIOService), m_cbFun(nullptr), m_kaTimeoutMsec(timeoutMsec), m_isWorking(false)
+// Activity times are kept as steady clock ticks in atomic variables
+static boost::chrono::steady_clock::rep steadyNow()
 {
-   m_log = logName;
+   return boost::chrono::steady_clock::now().time_since_epoch().count();
 }
 
-CAPCKATimer::~CAPCKATimer()
+static boost::chrono::steady_clock::time_point steadyTime(boost::chrono::steady_clock::rep ticks)
 {
-}
-
-apc_error_t CAPCKATimer::startTimer(cbfun_t fun)
-{
-   m_isWorking = true;
-   m_cbFun  = fun;
-   m_timeLastActivity = boost::chrono::steady_clock::now();
-   return startTimer_p();
-}
-
-void  CAPCKATimer::stopTimer()
-{
-   boost::unique_lock<boost::mutex> lock(m_lockWrkFlag);
-   m_isWorking = false;
-   m_cbFun  = nullptr;
-   try {
-      m_kaTimer.cancel();
-   } catch(exception& e) {
-      DUSTLOG_WARN(m_log, "Stop Timer error: " << e.what());
-   }
-}
-
-void  CAPCKATimer::recordActivity()
-{
-   boost::unique_lock<boost::mutex> lock(m_lock);
-   m_timeLastActivity = boost::chrono::steady_clock::now();
-}
-
-void CAPCKATimer::handle_timer_p(const boost::system::error_code& error)
-{
-   if (error) 
-      return;              // Timer is canceled
-   cbfun_t cbFun = nullptr;
-   {
-      boost::unique_lock<boost::mutex> lock(m_lockWrkFlag);
-      // Restart working timer
-      if (m_isWorking) {
-         cbFun = m_cbFun;
-         startTimer_p();      
-      }
-   }
-   if (cbFun != nullptr)
-      (cbFun)(getTimeLastActivity_p());
-}
-
-apc_error_t CAPCKATimer::startTimer_p()
-{
-   ptr p = shared_from_this();
-   try {
-      m_kaTimer.expires_from_now(boost::posix_time::milliseconds(m_kaTimeoutMsec));
-      m_kaTimer.async_wait(boost::bind(&CAPCKATimer::handle_timer_p, p, boost::asio::placeholders::error));
-   } catch(exception& e) {
-      DUSTLOG_ERROR(m_log, "Start Timer error: " << e.what());
-      return APC_ERR_ASYNC_OPERATION;
-   }
-   return APC_OK;
-}
-
-boost::chrono::steady_clock::time_point CAPCKATimer::getTimeLastActivity_p() 
-{
-   boost::unique_lock<boost::mutex> lock(m_lock);
-   return m_timeLastActivity;
+   return boost::chrono::steady_clock::time_point(boost::chrono::steady_clock::duration(ticks));
 }
 
 /////////////////////////////////////////////////
@@ -106,42 +42,73 @@ CAPCConnector::CAPCConnector(const init_param_t& param) :
    m_isWorking(false),
    m_isConnected(false),
    m_forceDisconnect(false),
-   m_kaTxTimer(nullptr),
-   m_kaRxTimer(nullptr),
    m_unconfirmedInpPkt(param.unconfirmedInpPkt),
    m_txTimeout(boost::chrono::milliseconds(param.kaTimeout / 4)),
    m_rxTimeout(boost::chrono::milliseconds(param.kaTimeout * 2)),
+   m_kaTimer(*param.pIOService),
+   m_isKaEnabled(param.kaTimeout > 0),
+   m_isKaTxStarted(false),
+   m_isKaTimerArmed(false),
+   m_lastRxTime(0),
+   m_lastTxTime(0),
+   m_ackDelay(boost::chrono::milliseconds(param.ackDelay)),
+   // 0: acknowledged when more than 'unconfirmedInpPkt' are unreported (previous behavior)
+   m_ackEveryPkts(param.ackEveryPkts > 0 ? std::min(param.ackEveryPkts, param.unconfirmedInpPkt) : 
+                                           param.unconfirmedInpPkt + 1),
+   m_isAckPending(false),
    m_numFreeOutBuf(APC_NUM_OUT_BUFS),
    m_minNumFreeOutBuf(APC_NUM_OUT_BUFS),
+   m_isTxReadyNotif(false),
    m_lastReceivedSeqNum(0),
    m_lastReportedSeqNum(0),
    m_curFreeBufIdx(0),
    m_stats(),
-   m_socket(*param.pIOService),
-   m_freeBufWait(boost::chrono::milliseconds(param.freeBufTimeout))
+   m_pRateTx(param.pRateTx),
+   m_pRateRx(param.pRateRx),
+   m_freeBufWait(boost::chrono::milliseconds(param.freeBufTimeout)),
+   m_netRxBatchSize(std::min(param.netRxBatchSize, APC_NETRX_BATCH_MAX_LEN)),
+   m_netRxBatchDelay(param.netRxBatchDelay),
+   m_isNetRxBatch(false),
+   m_isTxDoneBatch(false),
+   m_batchType(APC_NET_RX),
+   m_batchLastSeq(0),
+   m_isBatchFlushPending(false),
+   m_batchTimer(*param.pIOService),
+   m_pCompressor(nullptr),
+   m_isConnectSent(false),
+   m_isTxCompressed(false),
+   m_isRxCompressed(false),
+   m_isCreditOffered(false),
+   m_isCredit(false),
+   m_rxCreditLimit(0),
+   m_advertisedCredit(0),
+   m_protoVer(std::max(std::min(param.protoVer, APC_PROTO_VER_MAX), APC_PROTO_VER)),
+   m_hdrVer(APC_PROTO_VER),
+   m_isCorked(false)
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
    BOOST_ASSERT(param.pIOService != NULL);
    m_log = param.logName;
+   m_sockPolicy = *(param.pSockPolicy ? param.pSockPolicy : CAPCSocketPolicy::find("default"));
    m_pSerializer = new CAPCSerializer(APC_MAX_MSG_SIZE, this, m_log.c_str());
-   // Create Keep Alive Timers
-   if (param.kaTimeout > 0) {
-      m_kaTxTimer = CAPCKATimer::createKATimer(param.pIOService, param.kaTimeout, param.logName.c_str());
-      m_kaRxTimer = CAPCKATimer::createKATimer(param.pIOService, param.kaTimeout, param.logName.c_str());
+   if (param.compressLevel > 0) {
+      m_pCompressor = new CAPCCompressor(param.compressDir, param.compressLevel, param.pCompressStats, m_log.c_str());
+      if (m_pCompressor->init() != APC_OK) {
+         delete m_pCompressor;
+         m_pCompressor = nullptr;
+      }
    }
    //DUSTLOG_DEBUG(m_log, "CAPCConnector (" << (uint32_t)this << ") created");
 }
 
 CAPCConnector::~CAPCConnector() 
 {
-   // Close socket
-   if (m_socket.is_open()) {
-      try {
-         m_socket.close();
-      } catch(...) {;}
-   }
+   // Close transport
+   if (m_transport != nullptr)
+      m_transport->close();
 
    delete m_pSerializer;
+   delete m_pCompressor;
    //DUSTLOG_DEBUG(m_log, "CAPCConnector #" << m_intfId << " (" << (uint32_t)this << ") deleted " );
 }
 
@@ -150,16 +117,40 @@ CAPCConnector::stats_s CAPCConnector::getAPCCStatistics()
    stats_s res;
    res.m_faultAllocTime  = m_stats.m_faultAllocTime;
    res.m_numRcvPkt       = m_stats.m_numRcvPkt;
+   res.m_numBatches      = m_stats.m_numBatches;
+   res.m_numBatchedPkts  = m_stats.m_numBatchedPkts;
+   res.m_numTxDoneBatches  = m_stats.m_numTxDoneBatches;
+   res.m_numBatchedTxDones = m_stats.m_numBatchedTxDones;
+   res.m_numKaSent       = m_stats.m_numKaSent;
+   res.m_numAckSent      = m_stats.m_numAckSent;
+   res.m_numCreditSent   = m_stats.m_numCreditSent;
    m_stats.m_sendStat.getStat(&res.m_sendStat);
    return res;
 }
 
+bool CAPCConnector::getTcpInfo(apc_tcp_info_s * pInfo)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   boost::asio::ip::tcp::socket * pSocket = m_transport != nullptr ? m_transport->getTcpSocket() : NULL;
+   return pSocket != NULL && CAPCSocketPolicy::getTcpInfo(*pSocket, pInfo);
+}
+
 bool CAPCConnector::isWorking() 
 { 
    boost::unique_lock<boost::mutex> lock(m_lock);
    return m_isWorking; 
 }
 
+bool CAPCConnector::isTxReady(bool isNotify)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (m_numFreeOutBuf > 0)
+      return true;
+   if (isNotify)
+      m_isTxReadyNotif = true;
+   return false;
+}
+
 //Starts processing receive data and sending KA 
 apc_error_t CAPCConnector::start()
 {
@@ -167,22 +158,23 @@ apc_error_t CAPCConnector::start()
    apc_error_t res = APC_OK;
    ptr p = shared_from_this();
 
+   if (m_transport == nullptr)
+      return APC_ERR_STATE;
    if (m_pApcNotif)  
       m_pApcNotif->apcStarted(p);
 
    m_isWorking = true;
+   CFlightRecorder::record(FLIGHTREC_APC_START, m_intfId);
 
-   try {
-      // TRY block prevent from error if socket is not initialize yet
-      DUSTLOG_INFO(m_log, "CAPCConnector #" << m_intfId  << " Start. Port:" << m_socket.local_endpoint().port() 
-                  << " from " << m_socket.remote_endpoint().address() << ":" << m_socket.remote_endpoint().port());
-   } catch (...) {;}
-
-   //[ ---- Start Keep alive timers
-   if (m_kaRxTimer != nullptr)
-      res = m_kaRxTimer->startTimer(boost::bind(&CAPCConnector::ka_timeout_rx_p, p, _1));
-   if (res != APC_OK)
-      return res;
+   DUSTLOG_INFO(m_log, "CAPCConnector #" << m_intfId  << " Start. " << m_transport->getName());
+   // Socket policy is TCP only
+   if (m_transport->getTcpSocket() != NULL)
+      CAPCSocketPolicy::apply(*m_transport->getTcpSocket(), m_sockPolicy, m_log);
+
+   //[ ---- Start Keep alive timer (RX timeout). Keep alive is sent after peer's CONNECT
+   m_lastRxTime.store(steadyNow(), boost::memory_order_relaxed);
+   m_lastTxTime.store(steadyNow(), boost::memory_order_relaxed);
+   armKaTimer_p();
    //]
    
    // Set request for socket read
@@ -197,9 +189,16 @@ apc_error_t CAPCConnector::connect(ap_intf_id_t intfId, uint32_t mySeq, uint32_t
    apc_msg_connect_s conMsg;
    m_intfId = intfId;
    m_lastReceivedSeqNum = m_lastReportedSeqNum = yourSeq;
+   // Peer has no credit until first KA
+   m_rxCreditLimit = m_advertisedCredit = yourSeq;
+   m_isCreditOffered = (flags & APC_FL_CREDIT) != 0;
    // Set connection parameters
-   conMsg.ver   = APC_PROTO_VER;
+   conMsg.ver   = m_protoVer;
    conMsg.flags = flags;
+   if (m_netRxBatchSize > 0)
+      conMsg.flags |= APC_FL_NETRX_BATCH | APC_FL_TXDONE_BATCH;
+   if (m_pCompressor != nullptr)
+      conMsg.flags |= APC_FL_COMPRESS;
    conMsg.sesId = intfId;
    strncpy(conMsg.identity, m_apcName.c_str(), sizeof(conMsg.identity));
    conMsg.identity[sizeof(conMsg.identity) - 1] = 0;
@@ -208,9 +207,25 @@ apc_error_t CAPCConnector::connect(ap_intf_id_t intfId, uint32_t mySeq, uint32_t
    strncpy(conMsg.version, m_swVersion.c_str(), sizeof(conMsg.version));
    conMsg.version[sizeof(conMsg.version) - 1] = 0;
 
+   CFlightRecorder::record(FLIGHTREC_APC_CONNECT, intfId, mySeq, yourSeq);
    return sendData(APC_CONNECT, 0, mySeq, (const uint8_t *)&conMsg, sizeof(conMsg), NULL, 0);
 }
 
+// Send Activate message.
+apc_error_t CAPCConnector::activate(uint32_t mySeq, uint32_t yourSeq)
+{
+   apc_msg_activate_s actMsg;
+   // Session continues on this connection. Credit of peer starts from yourSeq again
+   m_lastReceivedSeqNum = m_lastReportedSeqNum = yourSeq;
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      m_rxCreditLimit = m_advertisedCredit = yourSeq;
+   }
+   actMsg.lastSent     = mySeq;
+   actMsg.lastReceived = yourSeq;
+   return sendData(APC_ACTIVATE, APC_HDR_FLAGS_NOTRACK, 0, (const uint8_t *)&actMsg, sizeof(actMsg), NULL, 0);
+}
+
 // Terminate connection.
 void CAPCConnector::disconnect()
 {
@@ -230,6 +245,13 @@ void CAPCConnector::stop(apc_stop_reason_t reason, apc_error_t err, stopflags_t
       return;
    
    m_isWorking = false;
+   CFlightRecorder::record(FLIGHTREC_APC_STOP, m_intfId, reason, err);
+
+   // Packets of open batch are kept by sender cache and resent after reconnection
+   m_batch.clear();
+   m_isBatchFlushPending = false;
+   boost::system::error_code ec;
+   m_batchTimer.cancel(ec);
 
    if (isFinishWriting)
       // Wait release of all output buffers
@@ -240,30 +262,39 @@ void CAPCConnector::stop(apc_stop_reason_t reason, apc_error_t err, stopflags_t
    DUSTLOG_INFO(m_log, "         Stat #" << m_intfId << " numRX: " << m_stats.m_numRcvPkt << " TX-stat: " << m_stats.m_sendStat);
    if (m_stats.m_faultAllocTime > 0)
       DUSTLOG_INFO(m_log, "         Stat #" << m_intfId << " Unsuccessful allocation time: " << m_stats.m_faultAllocTime);
+   if (m_stats.m_numBatches > 0)
+      DUSTLOG_INFO(m_log, "         Stat #" << m_intfId << " NET_RX batches: " << m_stats.m_numBatches 
+                          << " packets: " << m_stats.m_numBatchedPkts);
+   if (m_stats.m_numTxDoneBatches > 0)
+      DUSTLOG_INFO(m_log, "         Stat #" << m_intfId << " NET_TXDONE batches: " << m_stats.m_numTxDoneBatches 
+                          << " notifications: " << m_stats.m_numBatchedTxDones);
+   if (m_stats.m_numKaSent > 0 || m_stats.m_numAckSent > 0 || m_stats.m_numCreditSent > 0)
+      DUSTLOG_INFO(m_log, "         Stat #" << m_intfId << " Sent KA: " << m_stats.m_numKaSent 
+                          << " ACK: " << m_stats.m_numAckSent << " credit: " << m_stats.m_numCreditSent);
+   apc_tcp_info_s tcpInfo;
+   if (m_transport != nullptr && m_transport->getTcpSocket() != NULL && 
+       CAPCSocketPolicy::getTcpInfo(*m_transport->getTcpSocket(), &tcpInfo))
+      DUSTLOG_INFO(m_log, "         Stat #" << m_intfId << " TCP rtt: " << tcpInfo.m_rttUsec << "/" 
+                          << tcpInfo.m_rttVarUsec << " usec, cwnd: " << tcpInfo.m_cwnd 
+                          << " retrans: " << tcpInfo.m_totalRetrans << " lost: " << tcpInfo.m_lost);
+   if (m_isTxCompressed || m_isRxCompressed) {
+      const apc_compress_stats_s& cs = m_pCompressor->getStats();
+      DUSTLOG_INFO(m_log, "         Stat #" << m_intfId << " Compression TX: " << cs.m_txRawBytes << " -> " 
+                          << cs.m_txCompBytes << " bytes, " << cs.m_txCpuUsec << " usec. RX: " 
+                          << cs.m_rxCompBytes << " -> " << cs.m_rxRawBytes << " bytes, " << cs.m_rxCpuUsec << " usec");
+   }
 
    // Send signal for unlock 'getFreeBuf_p' function (if it lock)
    m_freeBufSig.notify_all();
 
-   //[ ----- Stop timers
-   if (m_kaTxTimer != nullptr) {
-      m_kaTxTimer->stopTimer();
-      m_kaTxTimer = nullptr;
-   }
-
-   if (m_kaRxTimer != nullptr) {
-      m_kaRxTimer->stopTimer();
-      m_kaRxTimer = nullptr;
-   }
-   //]
+   // Stop keep alive timer
+   m_kaTimer.cancel(ec);
+   m_isKaTimerArmed = false;
+   m_isAckPending   = false;
    
-   // Close IP socket and any async read/write operations
-   if (m_socket.is_open()) {
-      try {
-         m_socket.close();
-      } catch(exception& e) {
-         DUSTLOG_ERROR(m_log, "CAPCConnector #" << m_intfId << " Close socket error: " << e.what());
-      }
-   }
+   // Close transport and any async read/write operations
+   if (m_transport != nullptr && m_transport->isOpen())
+      m_transport->close();
 
    m_isConnected = false;
 
@@ -287,13 +318,119 @@ apc_error_t CAPCConnector::sendData(apc_msg_type_t type, uint8_t flags, uint32_t
                                     const uint8_t * payload2, uint16_t size2)
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
-   size_t    msgSize;
-   ptr       p = shared_from_this();
-   uint8_t * pBuf = NULL;
 
    if (m_isWorking == false || (!m_isConnected && (type != APC_CONNECT && type != APC_KA)))
       return APC_ERR_NOTCONNECT;
 
+   if (flags == 0 && ((m_isNetRxBatch && type == APC_NET_RX) || (m_isTxDoneBatch && type == APC_NET_TXDONE)))
+      return addToBatch_p(lock, type, mySeq, payload1, size1, payload2, size2);
+
+   // Tracked messages keep order: packets of open batch are sent first.
+   // Untracked messages (KA) may be sent by IO thread and never wait for batch
+   if ((flags & APC_HDR_FLAGS_NOTRACK) == 0) {
+      apc_error_t res = flushBatch_p(lock, true);
+      if (res != APC_OK)
+         return res;
+   }
+   return sendMsg_p(lock, type, flags, mySeq, payload1, size1, payload2, size2);
+}
+
+// Add APC_NET_RX packet or APC_NET_TXDONE notification to open batch
+apc_error_t CAPCConnector::addToBatch_p(boost::unique_lock<boost::mutex>& lock, apc_msg_type_t type, uint32_t mySeq, 
+                                        const uint8_t * payload1, uint16_t size1, 
+                                        const uint8_t * payload2, uint16_t size2)
+{
+   auto add = [&]() -> bool {
+      if (type == APC_NET_TXDONE)
+         return size2 == 0 && CAPCSerializer::addBatchTxDone(m_batch, payload1, size1, m_netRxBatchSize);
+      return CAPCSerializer::addBatchPkt(m_batch, payload1, size1, payload2, size2);
+   };
+
+   apc_error_t res = APC_OK;
+   // Messages of batch have the same type and consecutive sequence numbers
+   if (!m_batch.empty() && (type != m_batchType || mySeq != m_batchLastSeq + 1))
+      res = flushBatch_p(lock, true);
+   m_batchType = type;
+   if (res == APC_OK && !add()) {
+      res = flushBatch_p(lock, true);
+      if (res == APC_OK && !add())
+         // Message is larger than batch
+         return sendMsg_p(lock, type, 0, mySeq, payload1, size1, payload2, size2);
+   }
+   if (res != APC_OK)
+      return res;
+
+   m_batchLastSeq = mySeq;
+   if (m_batch.size() >= m_netRxBatchSize)
+      return flushBatch_p(lock, true);
+   if (m_batch[0] == 1) {
+      // First packet of batch: start flush timer
+      try {
+         m_batchTimer.expires_from_now(boost::posix_time::milliseconds(m_netRxBatchDelay));
+         m_batchTimer.async_wait(boost::bind(&CAPCConnector::handle_batch_timer_p, shared_from_this(),
+                                             boost::asio::placeholders::error));
+      } catch(exception& e) {
+         DUSTLOG_ERROR(m_log, "CAPCConnector #" << m_intfId << " Start batch timer error: " << e.what());
+         return APC_ERR_ASYNC_OPERATION;
+      }
+   }
+   return APC_OK;
+}
+
+// Send open batch
+apc_error_t CAPCConnector::flushBatch_p(boost::unique_lock<boost::mutex>& lock, bool isWait)
+{
+   m_isBatchFlushPending = false;
+   if (m_batch.empty())
+      return APC_OK;
+   if (!isWait && m_numFreeOutBuf == 0) {
+      // IO thread does not wait: handle_write_p flushes the batch
+      m_isBatchFlushPending = true;
+      return APC_OK;
+   }
+   boost::system::error_code ec;
+   m_batchTimer.cancel(ec);
+
+   // Batch is detached: sendMsg_p may unlock object while waiting for buffer
+   std::vector<uint8_t> batch;
+   batch.swap(m_batch);
+   uint32_t lastSeq = m_batchLastSeq;
+   if (m_batchType == APC_NET_TXDONE) {
+      // Single notification is sent without batch header
+      if (batch[0] == 1)
+         return sendMsg_p(lock, APC_NET_TXDONE, 0, lastSeq, batch.data() + sizeof(apc_msg_net_txdone_batch_s),
+                          sizeof(apc_msg_net_txdone_s), NULL, 0);
+      apc_error_t res = sendMsg_p(lock, APC_NET_TXDONE_BATCH, 0, lastSeq, batch.data(), (uint16_t)batch.size(), NULL, 0);
+      if (res == APC_OK) {
+         m_stats.m_numTxDoneBatches++;
+         m_stats.m_numBatchedTxDones += batch[0];
+      }
+      return res;
+   }
+   if (batch[0] == 1) {
+      // Single packet is sent without batch header
+      size_t          offset = sizeof(apc_msg_net_rx_batch_s);
+      uint16_t        pktSize = 0;
+      const uint8_t * pPkt = CAPCSerializer::getBatchPkt(batch.data(), batch.size(), &offset, &pktSize);
+      return sendMsg_p(lock, APC_NET_RX, 0, lastSeq, pPkt, pktSize, NULL, 0);
+   }
+   apc_error_t res = sendMsg_p(lock, APC_NET_RX_BATCH, 0, lastSeq, batch.data(), (uint16_t)batch.size(), NULL, 0);
+   if (res == APC_OK) {
+      m_stats.m_numBatches++;
+      m_stats.m_numBatchedPkts += batch[0];
+   }
+   return res;
+}
+
+// Prepare and send message
+apc_error_t CAPCConnector::sendMsg_p(boost::unique_lock<boost::mutex>& lock, apc_msg_type_t type, uint8_t flags, 
+                                     uint32_t mySeq, const uint8_t * payload1, uint16_t size1, 
+                                     const uint8_t * payload2, uint16_t size2)
+{
+   size_t    msgSize;
+   ptr       p = shared_from_this();
+   uint8_t * pBuf = NULL;
+
    mngr_time_t startTime = TIME_NOW();
    //[ ---- Get free buffer
    pBuf = getFreeBuf_p(lock);
@@ -306,34 +443,54 @@ apc_error_t CAPCConnector::sendData(apc_msg_type_t type, uint8_t flags, uint32_t
    //iobuf_t outbufs;
    //pBuf = outbufs.data();
 
-   // Prepare packet
-   apc_error_t res = m_pSerializer->prepMsg(pBuf, APC_MAX_MSG_SIZE, &msgSize, m_intfId, type, flags,
+   // Prepare packet. Compressed message is serialized to intermediate buffer
+   uint8_t   * pMsg = m_isTxCompressed ? m_txRawBuf.data() : pBuf;
+   apc_error_t res = m_pSerializer->prepMsg(pMsg, APC_MAX_MSG_SIZE, &msgSize, m_intfId, type, flags,
                                             mySeq, m_lastReceivedSeqNum,
                                             payload1, size1, payload2, size2);
+   if (res == APC_OK && m_isTxCompressed)
+      res = m_pCompressor->compress(pMsg, msgSize, pBuf, APC_MAX_WIRE_SIZE, &msgSize);
    if (res != APC_OK) {
       // Serialization error. Free buffer
       returnBuf_p();
       return APC_ERR_PKTSERIALIZATION;
    }
 
-   DUSTLOG_TRACEDATA(m_log, string("TX #") + to_string(m_intfId), pBuf, msgSize);
+   DUSTLOG_TRACEDATA(m_log, "TX #" << m_intfId, pBuf, msgSize);
+   // Previous write is not finished: hold partial segments until all queued data is written
+   if (m_sockPolicy.m_cork && !m_isCorked && m_numFreeOutBuf + 1 < APC_NUM_OUT_BUFS && 
+       m_transport->getTcpSocket() != NULL) {
+      CAPCSocketPolicy::setCork(*m_transport->getTcpSocket(), true);
+      m_isCorked = true;
+   }
    try {
       // Send data. 
-      boost::asio::async_write(m_socket, boost::asio::buffer(pBuf, msgSize), 
+      m_transport->asyncWrite(pBuf, msgSize, 
                   boost::bind(&CAPCConnector::handle_write_p, p,
                               boost::asio::placeholders::error,
                               boost::asio::placeholders::bytes_transferred));
-      //boost::asio::write(m_socket, boost::asio::buffer(pBuf, msgSize));
 
       //[ ----- Statistics calculation
       m_stats.m_sendStat.addEvent(startTime);
+      if (m_pRateTx != nullptr)
+         m_pRateTx->addPacket(msgSize);
 	   DUSTLOG_TRACE(m_log, "CAPCConnector #" << m_intfId << " sendData counter #" << m_stats.m_sendStat.getNumEvents() << ", type " << type);
       //]
    } catch (exception& e) {
       DUSTLOG_ERROR(m_log, "CAPCConnector #" << m_intfId << " async_write error: " << e.what());
       return APC_ERR_ASYNC_OPERATION;
    }
+   // Own yourSeq confirms received packets: delayed ACK is not needed
    m_lastReportedSeqNum = m_lastReceivedSeqNum;
+   m_isAckPending = false;
+   m_lastTxTime.store(steadyNow(), boost::memory_order_relaxed);
+   if (type == APC_CONNECT) {
+      // Manager side: peer's CONNECT is received before own one
+      m_isConnectSent  = true;
+      m_isTxCompressed = m_isRxCompressed;
+      if (m_hdrVer >= APC_PROTO_VER_2)
+         m_pSerializer->setTxVersion(m_hdrVer);
+   }
    return APC_OK;
 }
 
@@ -350,8 +507,12 @@ void CAPCConnector::getProperty(property_t * pProperty)
    pProperty->maxAllocOutBuf  = APC_NUM_OUT_BUFS - m_minNumFreeOutBuf;
    m_stats.m_sendStat.getStat(&pProperty->sendStat);
    pProperty->numReceivedPkt  = m_stats.m_numRcvPkt;
+   // Addresses are known for TCP only
+   boost::asio::ip::tcp::socket * pSocket = m_transport != nullptr ? m_transport->getTcpSocket() : NULL;
+   if (pSocket == NULL)
+      return;
    try {
-      auto l = m_socket.local_endpoint(), r = m_socket.remote_endpoint();
+      auto l = pSocket->local_endpoint(), r = pSocket->remote_endpoint();
       pProperty->localAddress = l.address();
       pProperty->localPort    = l.port();
       pProperty->peerAddress  = r.address();
@@ -359,49 +520,130 @@ void CAPCConnector::getProperty(property_t * pProperty)
    }  catch(...) {;}
 }
 
-// Callback for Keep Alive timer of INPUT packets
-bool CAPCConnector::ka_timeout_rx_p(const boost::chrono::steady_clock::time_point& lastAction)
+// Arm keep alive timer to the nearest deadline: input timeout, output idle or delayed ACK.
+// Called under m_lock
+void CAPCConnector::armKaTimer_p()
 {
-   // If after last input packet > max - stop connection and go to state 'Offline'
-   if (boost::chrono::steady_clock::now() - lastAction >= m_rxTimeout) {
-      stop(APC_STOP_TIMEOUT, APC_OK, STOP_FL_OFFLINE, false);
-      return false;
-   } 
-   return true;
+   bool                        isDeadline = false;
+   steady_clock_t::time_point  deadline;
+   auto setDeadline = [&](const steady_clock_t::time_point& t) {
+      if (!isDeadline || t < deadline)
+         deadline = t;
+      isDeadline = true;
+   };
+
+   if (m_isKaEnabled) {
+      setDeadline(steadyTime(m_lastRxTime.load(boost::memory_order_relaxed)) + m_rxTimeout);
+      if (m_isKaTxStarted)
+         setDeadline(steadyTime(m_lastTxTime.load(boost::memory_order_relaxed)) + m_txTimeout);
+   }
+   if (m_isAckPending)
+      setDeadline(m_ackTime);
+   // Armed timer expires earlier: it re-arms itself
+   if (!isDeadline || (m_isKaTimerArmed && m_kaTimerExpiry <= deadline))
+      return;
+
+   auto     delay = deadline - steady_clock_t::now();
+   int64_t  delayMsec = boost::chrono::ceil<boost::chrono::milliseconds>(delay).count();
+   if (delayMsec < APC_KA_TIMER_MIN_MSEC)
+      delayMsec = APC_KA_TIMER_MIN_MSEC;
+   boost::system::error_code ec;
+   m_kaTimer.expires_from_now(boost::posix_time::milliseconds(delayMsec), ec);
+   m_kaTimer.async_wait(boost::bind(&CAPCConnector::handle_ka_timer_p, shared_from_this(),
+                                    boost::asio::placeholders::error));
+   m_kaTimerExpiry  = deadline;
+   m_isKaTimerArmed = true;
 }
 
-// Callback for Keep Alive timer of OUTPUT packets
-bool CAPCConnector::ka_timeout_tx_p(const boost::chrono::steady_clock::time_point& lastAction)
+// Callback for keep alive timer
+void CAPCConnector::handle_ka_timer_p(const boost::system::error_code& error)
 {
-   if (boost::chrono::steady_clock::now() - lastAction >= m_txTimeout) {
+   if (error)
+      return;              // Timer is canceled or re-armed
+   bool isTimeout = false, isKa = false, isAck = false;
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (!m_isWorking)
+         return;
+      m_isKaTimerArmed = false;
+      steady_clock_t::time_point now = steady_clock_t::now();
+      if (m_isKaEnabled) {
+         // After last input packet > max - stop connection and go to state 'Offline'
+         isTimeout = now - steadyTime(m_lastRxTime.load(boost::memory_order_relaxed)) >= m_rxTimeout;
+         isKa = m_isKaTxStarted && 
+                now - steadyTime(m_lastTxTime.load(boost::memory_order_relaxed)) >= m_txTimeout;
+      }
+      isAck = m_isAckPending && now >= m_ackTime;
+      if (isKa)
+         m_stats.m_numKaSent++;
+      else if (isAck)
+         m_stats.m_numAckSent++;
+   }
+   if (isTimeout) {
+      stop(APC_STOP_TIMEOUT, APC_OK, STOP_FL_OFFLINE, false);
+      return;
+   }
+   if (isKa || isAck) {
       apc_error_t res = send_ka_p();
       if (res != APC_OK) {
          stop(APC_STOP_WRITE, res, STOP_FL_OFFLINE, false);
-         return false;
+         return;
       }
    }
-   return true;
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (m_isWorking)
+      armKaTimer_p();
 }
 
 // Callback for finish of write operation
 void CAPCConnector::handle_write_p(const boost::system::error_code& error, size_t len)
 {
+   apc_error_t res = APC_OK;
+   bool        isTxReady = false;
    if (error) {
       freeBuf_p();   
    } else {
       boost::unique_lock<boost::mutex> lock(m_lock);
-      // Refresh activity of Output Keep Alive timer
-      if (m_kaTxTimer != nullptr)
-         m_kaTxTimer->recordActivity();
       // Free output buffer
       freeBuf_p();   
+      if (m_isCorked && m_numFreeOutBuf == APC_NUM_OUT_BUFS) {
+         CAPCSocketPolicy::setCork(*m_transport->getTcpSocket(), false);
+         m_isCorked = false;
+      }
+      // Batch timer expired when all buffers were busy
+      if (m_isBatchFlushPending && m_isWorking)
+         res = flushBatch_p(lock, false);
+      // Client holds messages till output is free
+      isTxReady = m_isTxReadyNotif && m_isWorking && m_numFreeOutBuf > 0;
+      if (isTxReady)
+         m_isTxReadyNotif = false;
+   }
+   if (res != APC_OK)
+      stop(APC_STOP_WRITE, res, STOP_FL_OFFLINE, false);
+   else if (isTxReady && m_pApcNotif)
+      m_pApcNotif->apcTxReady(shared_from_this());
+}
+
+// Callback for batch flush timer
+void CAPCConnector::handle_batch_timer_p(const boost::system::error_code& error)
+{
+   if (error)
+      return;              // Timer is canceled
+   apc_error_t res = APC_OK;
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (m_isWorking)
+         res = flushBatch_p(lock, false);
    }
+   if (res != APC_OK)
+      stop(APC_STOP_WRITE, res, STOP_FL_OFFLINE, false);
 }
 
 // Callback for read operation
 void CAPCConnector::handle_read_p (const boost::system::error_code& error, size_t len)
 {
    apc_error_t res;
+   bool        isAckNow = false;
 
    if (error) {
       DUSTLOG_ERROR(m_log, "CAPCConnector #" << m_intfId << " Read error: " << error.message().c_str());
@@ -410,10 +652,26 @@ void CAPCConnector::handle_read_p (const boost::system::error_code& error, size_
    } 
 
    if (len > 0) {
-      DUSTLOG_TRACEDATA(m_log, string("RX #") + to_string(m_intfId), m_inpbuf.data(), len);
+      m_rxTime = TIME_NOW();
+      DUSTLOG_TRACEDATA(m_log, "RX #" << m_intfId, m_inpbuf.data(), len);
+      // Messages are counted by messageReceived
+      if (m_pRateRx != nullptr)
+         m_pRateRx->addEvent(0, len);
 
       // Read data
-      res = m_pSerializer->dataReceived(m_intfId, m_inpbuf.data(), len);
+      uint8_t       * pData = m_inpbuf.data();
+      size_t          processed = 0;
+      res = APC_OK;
+      if (!m_isRxCompressed) {
+         // Stops after APC_CONNECT if the rest of stream is compressed
+         res = m_pSerializer->dataReceived(m_intfId, pData, len, &processed);
+         pData += processed; len -= processed;
+      }
+      if (res == APC_OK && len > 0 && m_isRxCompressed) {
+         res = m_pCompressor->decompress(pData, len, [this](uint8_t * p, size_t n) {
+            return m_pSerializer->dataReceived(m_intfId, p, n);
+         });
+      }
       if (res != APC_OK) {
          if (res == APC_STOP_CONNECTOR) {
             stop(APC_DISCONNECT_MSG, res, STOP_FL_DISCONNECT, false); 
@@ -428,15 +686,23 @@ void CAPCConnector::handle_read_p (const boost::system::error_code& error, size_
          if(!m_isWorking)  {
             return;
          }
-         // Refresh activity of Input Keep Alive timer
-         if (m_kaRxTimer != nullptr) 
-            m_kaRxTimer->recordActivity();
+         m_lastRxTime.store(steadyNow(), boost::memory_order_relaxed);
+         // Received packets are confirmed by next sent message or by KA: immediately 
+         // after 'm_ackEveryPkts' packets, otherwise after 'm_ackDelay'
+         uint32_t numUnacked = m_lastReceivedSeqNum - m_lastReportedSeqNum;
+         if (numUnacked >= m_ackEveryPkts) {
+            isAckNow = true;
+            m_stats.m_numAckSent++;
+         } else if (numUnacked > 0 && !m_isAckPending && m_ackDelay.count() > 0) {
+            m_isAckPending = true;
+            m_ackTime = steady_clock_t::now() + m_ackDelay;
+            armKaTimer_p();
+         }
       }     
    }
 
    res = async_read_p();   
-   // If number of last received packet is not reported long time then generate Keep Alive
-   if (res == APC_OK && m_lastReceivedSeqNum - m_lastReportedSeqNum > m_unconfirmedInpPkt)
+   if (res == APC_OK && isAckNow)
       res = send_ka_p();
 
    if (res != APC_OK) 
@@ -448,7 +714,7 @@ void CAPCConnector::handle_read_p (const boost::system::error_code& error, size_
 apc_error_t CAPCConnector::async_read_p() {
    ptr p = shared_from_this();
    try {
-      m_socket.async_read_some(boost::asio::buffer(m_inpbuf),  
+      m_transport->asyncRead(m_inpbuf.data(), m_inpbuf.size(),  
          boost::bind(&CAPCConnector::handle_read_p, p,
                      boost::asio::placeholders::error,
                      boost::asio::placeholders::bytes_transferred));
@@ -459,10 +725,40 @@ apc_error_t CAPCConnector::async_read_p() {
    return APC_OK;
 }
 
-// Send Keep alive (by timer or number of received packets)
+// Send Keep alive (by timer or number of received packets). It carries credit if negotiated
 apc_error_t CAPCConnector::send_ka_p()
 {
-   return sendData(APC_KA, APC_HDR_FLAGS_NOTRACK, 0, NULL, 0, NULL, 0);
+   apc_msg_credit_s credit;
+   bool             isCredit;
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      isCredit = m_isCredit;
+      credit.limit = m_advertisedCredit = m_rxCreditLimit;
+   }
+   return sendData(APC_KA, APC_HDR_FLAGS_NOTRACK, 0, isCredit ? (const uint8_t *)&credit : NULL, 
+                   isCredit ? sizeof(credit) : 0, NULL, 0);
+}
+
+// Set credit of peer
+void CAPCConnector::setRxCredit(uint32_t limit)
+{
+   {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if ((int32_t)(limit - m_rxCreditLimit) <= 0)
+         return;
+      m_rxCreditLimit = limit;
+      if (!m_isCredit || !m_isWorking)
+         return;
+      // Small increase waits for next KA (delayed ACK or keep alive). Peer without 
+      // credit gets any increase at once
+      int32_t left = std::max((int32_t)(m_advertisedCredit - m_lastReceivedSeqNum), 0);
+      if ((int32_t)(limit - m_advertisedCredit) < left)
+         return;
+      m_stats.m_numCreditSent++;
+   }
+   apc_error_t res = send_ka_p();
+   if (res != APC_OK)
+      stop(APC_STOP_WRITE, res, STOP_FL_OFFLINE, false);
 }
 
 void CAPCConnector::incrNumFreeBuf_p() 
@@ -470,7 +766,7 @@ void CAPCConnector::incrNumFreeBuf_p()
    if (m_numFreeOutBuf < APC_NUM_OUT_BUFS)
       m_numFreeOutBuf++;
    else
-      DUSTLOG_WARN(m_log, "CAPCConnector #" << m_intfId << " Unexpected number free buffers");
+      DUSTLOG_ASYNC_WARN(m_log, "CAPCConnector #{} Unexpected number free buffers", m_intfId);
 }
 
 // Get free buffer
@@ -526,15 +822,42 @@ apc_error_t CAPCConnector::messageReceived(ap_intf_id_t apcId, apc_msg_type_t ty
    }
 
    m_stats.m_numRcvPkt++; 
-   DUSTLOG_TRACE(m_log, "CAPCConnector#" << m_intfId  << " messageReceived counter #" << m_stats.m_numRcvPkt << ", type " << type);
+   if (m_pRateRx != nullptr)
+      m_pRateRx->addEvent(1, 0);
+   DUSTLOG_ASYNC_TRACE(m_log, "CAPCConnector#{} messageReceived counter #{}, type {}", m_intfId, m_stats.m_numRcvPkt, type);
 
    if (type == APC_CONNECT) {
       // Generate apcConnect notification
       m_isConnected = true;
+      CFlightRecorder::record(FLIGHTREC_APC_CONNECTED, m_intfId, mySeq, yourSeq);
+      {
+         boost::unique_lock<boost::mutex> lock(m_lock);
+         m_isNetRxBatch = m_netRxBatchSize > 0 && (((apc_msg_connect_s *)pPayload)->flags & APC_FL_NETRX_BATCH) != 0;
+         m_isTxDoneBatch = m_netRxBatchSize > 0 && (((apc_msg_connect_s *)pPayload)->flags & APC_FL_TXDONE_BATCH) != 0;
+         m_isCredit = m_isCreditOffered && (((apc_msg_connect_s *)pPayload)->flags & APC_FL_CREDIT) != 0;
+         if (m_pCompressor != nullptr && (((apc_msg_connect_s *)pPayload)->flags & APC_FL_COMPRESS) != 0) {
+            // Peer's stream after this message is compressed. Own stream - after own CONNECT
+            m_isRxCompressed = true;
+            m_isTxCompressed = m_isConnectSent;
+            m_pSerializer->breakInput();
+         }
+         // Compact header: input after this message, output after own CONNECT
+         m_hdrVer = std::min(m_protoVer, ((apc_msg_connect_s *)pPayload)->ver);
+         if (m_hdrVer >= APC_PROTO_VER_2) {
+            m_pSerializer->setRxVersion(m_hdrVer);
+            if (m_isConnectSent)
+               m_pSerializer->setTxVersion(m_hdrVer);
+         }
+      }
       if (m_pApcNotif) {
          apc_msg_connect_s * pConnect = (apc_msg_connect_s *)pPayload;
          m_peerIntfName = pConnect->identity;
-         DUSTLOG_INFO(m_log, "CAPCConnector #" << m_intfId  << " Peer name: '" << m_peerIntfName << "'");
+         DUSTLOG_INFO(m_log, "CAPCConnector #" << m_intfId  << " Peer name: '" << m_peerIntfName << "'"
+                             << (m_isNetRxBatch ? " NET_RX batching" : "")
+                             << (m_isTxDoneBatch ? " NET_TXDONE batching" : "")
+                             << (m_isRxCompressed ? " compression" : "")
+                             << (m_isCredit ? " credit" : "")
+                             << " protocol v" << (int)m_hdrVer);
 
          IAPCConnectorNotif::param_connected_s param;
          param.ver      = pConnect->ver; 
@@ -549,15 +872,55 @@ apc_error_t CAPCConnector::messageReceived(ap_intf_id_t apcId, apc_msg_type_t ty
 
          m_pApcNotif->apcConnected(p, param);
       }
-      //[ ---- Start Keep alive timers after receiving CONNECT back from Manager
-      if (m_kaTxTimer != nullptr) {
-         res = m_kaTxTimer->startTimer(boost::bind(&CAPCConnector::ka_timeout_tx_p, p, _1));
-         if (res != APC_OK)
-            return res;
+      //[ ---- Start output keep alive after receiving CONNECT back from Manager
+      {
+         boost::unique_lock<boost::mutex> lock(m_lock);
+         m_isKaTxStarted = true;
+         m_lastTxTime.store(steadyNow(), boost::memory_order_relaxed);
+         if (m_isWorking)
+            armKaTimer_p();
       }
+      //]
    } else if (type == APC_DISCONNECT) {
       // Disconnect
       res = APC_STOP_CONNECTOR;
+   } else if (type == APC_NET_RX_BATCH) {
+      // Split to APC_NET_RX notifications. Packets have consecutive sequence numbers
+      if (m_pApcNotif) {
+         IAPCConnectorNotif::param_received_s param;
+         param.apcId     = apcId;
+         param.flags     = flags;
+         param.mySeq     = mySeq - ((const apc_msg_net_rx_batch_s *)pPayload)->numPkts;
+         param.yourSeq   = yourSeq;
+         param.type      = APC_NET_RX;
+         param.rxTime    = m_rxTime.time_since_epoch().count();
+
+         size_t          offset = sizeof(apc_msg_net_rx_batch_s);
+         uint16_t        pktSize;
+         const uint8_t * pPkt;
+         while ((pPkt = CAPCSerializer::getBatchPkt(pPayload, size, &offset, &pktSize)) != NULL) {
+            param.mySeq++;
+            m_pApcNotif->messageReceived(p, param, pPkt, pktSize);
+         }
+      }
+   } else if (type == APC_NET_TXDONE_BATCH) {
+      // Split to APC_NET_TXDONE notifications. Notifications have consecutive sequence numbers
+      if (m_pApcNotif) {
+         IAPCConnectorNotif::param_received_s param;
+         uint8_t numIds  = ((const apc_msg_net_txdone_batch_s *)pPayload)->numIds;
+         param.apcId     = apcId;
+         param.flags     = flags;
+         param.mySeq     = mySeq - numIds;
+         param.yourSeq   = yourSeq;
+         param.type      = APC_NET_TXDONE;
+         param.rxTime    = m_rxTime.time_since_epoch().count();
+
+         const uint8_t * pId = pPayload + sizeof(apc_msg_net_txdone_batch_s);
+         for (uint8_t i = 0; i < numIds; i++, pId += sizeof(apc_msg_net_txdone_s)) {
+            param.mySeq++;
+            m_pApcNotif->messageReceived(p, param, pId, sizeof(apc_msg_net_txdone_s));
+         }
+      }
    } else if (m_pApcNotif) {
       // Generate messageReceive notification
       IAPCConnectorNotif::param_received_s param;
@@ -566,14 +929,15 @@ apc_error_t CAPCConnector::messageReceived(ap_intf_id_t apcId, apc_msg_type_t ty
       param.mySeq     = mySeq;
       param.yourSeq   = yourSeq;
       param.type      = type;
+      param.rxTime    = m_rxTime.time_since_epoch().count();
 
-      m_pApcNotif->messageReceived(param, pPayload, size);
+      m_pApcNotif->messageReceived(p, param, pPayload, size);
    }
 
    if (mySeq > m_lastReceivedSeqNum)
       m_lastReceivedSeqNum = mySeq;
    else if (mySeq != 0)
-      DUSTLOG_WARN(m_log, "CAPCConnector #" << m_intfId << " received packet with wrong sequence number: " << 
-                           mySeq << " expected: > " << m_lastReceivedSeqNum);
+      DUSTLOG_ASYNC_WARN(m_log, "CAPCConnector #{} received packet with wrong sequence number: {} expected: > {}", 
+                         m_intfId, mySeq, m_lastReceivedSeqNum);
    return res;
 }
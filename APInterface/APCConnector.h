@@ -5,12 +5,17 @@
 #pragma once
 #include "common.h"
 #include "StatDelaysCalc.h"
+#include "StatRateCalc.h"
 #include "APCProto.h"
 #include "public/APCError.h"
 #include "APCSerializer.h"
+#include "APCCompressor.h"
+#include "APCSocketPolicy.h"
+#include "APCTransport.h"
 #include "logging/Logger.h"
 #include <string>
 #include <boost/asio.hpp>
+#include <boost/atomic.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/chrono.hpp>
 #include <boost/thread.hpp>
@@ -19,66 +24,32 @@
 
 class IAPCConnectorNotif;
 const uint32_t APC_MAX_MSG_SIZE = MAX_NET_PKT_SIZE + MAX_APC_HDR_SIZE;       ///< Max size of APC message
+const uint32_t APC_MAX_WIRE_SIZE = APC_MAX_MSG_SIZE + APC_COMPRESS_OVERHEAD;  ///< Max size of (compressed) APC message
+const uint32_t APC_READ_BUF_SIZE = 8 * 1024;                                   ///< Size of socket read buffer (several messages)
 const uint32_t APC_NUM_OUT_BUFS = 2;          ///< Number of output buffers !!! must be power 2 (or 1) !!!
 const uint32_t APC_NUM_OUT_BUFS_MASK = APC_NUM_OUT_BUFS - 1;   // Mask .for calculating index of free buffer
 const uint32_t APC_CONNECTOR_NAME_LENGTH = 31;                   // Max length of connector name (see 'apcConnected')
 
-// Keep Alive timers for Transmit / Received operation
-class CAPCKATimer  : public boost::enable_shared_from_this<CAPCKATimer>
-{
-public:
-   typedef boost::shared_ptr<CAPCKATimer> ptr;
-
-   
-   //  Defines an alias representing the timer expire callback function
-   //
-   //  bool F(bool isSuccessful, time_point& timeLastOp, milliseconds& timeout) 
-   //    param isSuccessful true if timer run without errors otherwise false
-   //    param timeLastOp   time of last operation (Transmit or Receive)
-   //    return             true if timer should be reschedule, otherwise false
-   typedef std::function<bool(const boost::chrono::steady_clock::time_point&)> cbfun_t;
-
-   // Create timer
-   static ptr createKATimer(boost::asio::io_service * pIOService, uint32_t timeoutMsec, const char * logName);
-    // Destructor
-   ~CAPCKATimer();
-   // Start timer
-   apc_error_t startTimer(cbfun_t fun);
-   // Stop timer
-   void        stopTimer();
-   // Set current time as time of last operation (Transmit or Receive)
-   void        recordActivity();
-private:
-   CAPCKATimer(boost::asio::io_service * pIOService, uint32_t timeoutMsec, const char * logName);
-
-   boost::mutex                             m_lockWrkFlag;
-   boost::mutex                             m_lock;
-   boost::asio::deadline_timer              m_kaTimer;
-   cbfun_t                                  m_cbFun;
-   uint32_t                                 m_kaTimeoutMsec;
-   boost::chrono::steady_clock::time_point  m_timeLastActivity;
-   bool                                     m_isWorking;
-   std::string                              m_log;
-
-   void handle_timer_p(const boost::system::error_code& error);
-   apc_error_t startTimer_p();
-
-   boost::chrono::steady_clock::time_point getTimeLastActivity_p();
-};
-
 /**
  * APC connection.
  * 
  * Class implements send / receive operations between Client (AP) and Server (Manager).
  * After start(), the object begins rx processing and sends keep alive packets. 
  * Object automatically generates 'APC_CONNECT' message.
+ *
+ * Every sent message acknowledges received ones (yourSeq). Standalone
+ * acknowledgement (KA) is sent after 'ackEveryPkts' unacknowledged messages
+ * or 'ackDelay' after the first of them, if no other message is sent before.
+ * Keep alive, RX timeout and delayed ACK share one timer; activity times are
+ * recorded without lock.
  */
 class CAPCConnector : public boost::enable_shared_from_this<CAPCConnector>, public ISerRxHandler 
 {
 
 public:
   typedef boost::shared_ptr<CAPCConnector> ptr;
-  typedef boost::array<uint8_t, APC_MAX_MSG_SIZE> iobuf_t;
+  typedef boost::array<uint8_t, APC_MAX_WIRE_SIZE> iobuf_t;
+  typedef boost::array<uint8_t, APC_READ_BUF_SIZE> inpbuf_t;
 
    /**
     * Initialization parameters of APC connector
@@ -93,9 +64,26 @@ public:
       uint32_t                     unconfirmedInpPkt; ///< Max number of unreported input numbers
       std::string                  logName;        ///< Name of logger
       std::string                  swVersion;      ///< string with software version
+      CStatRateCalc              * pRateTx;        ///< Rate meter of sent messages (can be NULL)
+      CStatRateCalc              * pRateRx;        ///< Rate meter of received messages (can be NULL)
+      uint32_t                     netRxBatchSize; ///< Max payload of APC_NET_RX_BATCH (0 - don't offer batching)
+      uint32_t                     netRxBatchDelay;///< Max time of packet in open batch (milliseconds)
+      uint32_t                     compressLevel;  ///< Compression level 1-9 (0 - don't offer compression)
+      apc_compress_dir_t           compressDir;    ///< Direction of sent data (selects dictionary)
+      CAPCCompressStats          * pCompressStats; ///< Compression statistics (can be NULL)
+      uint8_t                      protoVer;       ///< Max offered protocol version (APC_PROTO_VER...APC_PROTO_VER_MAX)
+      const apc_sock_policy_s    * pSockPolicy;    ///< Socket options (NULL - kernel defaults)
+      uint32_t                     ackDelay;       ///< Max delay of acknowledgement of received messages 
+                                                   ///< (milliseconds, 0 - by count and keep alive only)
+      uint32_t                     ackEveryPkts;   ///< Acknowledge every N received messages (0 - more than unconfirmedInpPkt)
       void clear() {
          pIOService = NULL; pApcNotif = NULL; 
+         pRateTx = NULL; pRateRx = NULL;
          kaTimeout = 0;
+         netRxBatchSize = 0; netRxBatchDelay = 0;
+         compressLevel = 0; compressDir = APC_COMPRESS_UPSTREAM; pCompressStats = NULL;
+         protoVer = APC_PROTO_VER; pSockPolicy = NULL;
+         ackDelay = 0; ackEveryPkts = 0;
          apcConnect.clear(); logName.clear(); swVersion.clear();
       }
    };
@@ -126,6 +114,13 @@ public:
       statdelays_s  m_sendStat;
       uint32_t      m_faultAllocTime;              // Time unsuccessful buffer allocation
       uint32_t      m_numRcvPkt;                   // Number or received packets
+      uint32_t      m_numBatches;                  // Number of sent APC_NET_RX_BATCH messages
+      uint32_t      m_numBatchedPkts;              // Number of packets sent in APC_NET_RX_BATCH
+      uint32_t      m_numTxDoneBatches;            // Number of sent APC_NET_TXDONE_BATCH messages
+      uint32_t      m_numBatchedTxDones;           // Number of notifications sent in APC_NET_TXDONE_BATCH
+      uint32_t      m_numKaSent;                   // Number of keep alive messages sent on idle connection
+      uint32_t      m_numAckSent;                  // Number of standalone acknowledgements (delayed ACK)
+      uint32_t      m_numCreditSent;               // Number of KA sent to update credit of peer
    };
 
    /**
@@ -133,6 +128,11 @@ public:
     */
    stats_s getAPCCStatistics();
 
+   /**
+    * Get TCP state of connection (TCP_INFO). false if it is not available
+    */
+   bool getTcpInfo(apc_tcp_info_s * pInfo);
+
 
    enum stopflags_t {  //"#IGNORE"
       STOP_FL_OFFLINE,
@@ -171,6 +171,38 @@ public:
      return connect(sesId, mySeq, yourSeq, gpsState, netId, flags);
   }
 
+  /**
+   * Send Activate message: standby connection becomes active (see APC_FL_STANDBY).
+   *
+   * \param mySeq    Sender's last sequence number in session.
+   * \param yourSeq  Sequence number of last received peer packet in session
+   *
+   * \return   result of operation
+   */
+  apc_error_t activate(uint32_t mySeq, uint32_t yourSeq);
+
+  /**
+   * Credit flow control is negotiated (APC_FL_CREDIT in both CONNECT messages).
+   */
+  bool       isCredit() const { return m_isCredit; }
+
+  /**
+   * Free output buffer is available: message is sent without waiting.
+   *
+   * \param isNotify    If output is busy, send apcTxReady notification when
+   *                    a buffer is freed.
+   */
+  bool       isTxReady(bool isNotify);
+
+  /**
+   * Sets credit of peer: last sequence number of peer's messages the client 
+   * accepts. It is sent with every KA, without waiting for one if the increase 
+   * is not less than the credit left to peer. Decrease is ignored.
+   *
+   * \param limit   Last sequence number the peer may send.
+   */
+  void       setRxCredit(uint32_t limit);
+
   /**
    * Terminate connection.
    */
@@ -200,7 +232,10 @@ public:
                  bool isFinishWriting = true, bool isSendNotif = true);
 
   /**
-   * Send a message to the other side of the APC Connection
+   * Send a message to the other side of the APC Connection.
+   * If batching is negotiated, tracked APC_NET_RX packets are collected to 
+   * APC_NET_RX_BATCH message (sent by size or by delay timer). APC_NET_TXDONE
+   * notifications are collected to APC_NET_TXDONE_BATCH in the same way.
    *
    * \param type        Message type.
    * \param flags       Message flags, see \ref apc_hdr_flags_t.
@@ -216,11 +251,12 @@ public:
                        const uint8_t * payload1, uint16_t size1, 
                        const uint8_t * payload2, uint16_t size2);
   /**
-   * Gets the socket.
+   * Sets transport of connection (connected TCP / AF_UNIX socket or shared memory).
+   * Must be called before start().
    *
-   * \return   The socket.
+   * \param transport   The transport.
    */
-  boost::asio::ip::tcp::socket&  getSocket() { return m_socket; }
+  void   setTransport(IAPCTransport::ptr transport) { m_transport = transport; }
 
   /**
    * Gets interface property.
@@ -240,6 +276,13 @@ private:
       CStatDelaysCalc  m_sendStat;
       uint32_t         m_faultAllocTime;              // Time unsuccessful buffer allocation
       uint32_t         m_numRcvPkt;                   // Number or received packets
+      uint32_t         m_numBatches;                  // Number of sent APC_NET_RX_BATCH messages
+      uint32_t         m_numBatchedPkts;              // Number of packets sent in APC_NET_RX_BATCH
+      uint32_t         m_numTxDoneBatches;            // Number of sent APC_NET_TXDONE_BATCH messages
+      uint32_t         m_numBatchedTxDones;           // Number of notifications sent in APC_NET_TXDONE_BATCH
+      uint32_t         m_numKaSent;                   // Number of keep alive messages sent on idle connection
+      uint32_t         m_numAckSent;                  // Number of standalone acknowledgements (delayed ACK)
+      uint32_t         m_numCreditSent;               // Number of KA sent to update credit of peer
 
       APCCStats() {
          reset();
@@ -250,6 +293,13 @@ private:
          m_sendStat.clear();
          m_faultAllocTime   = 0;
          m_numRcvPkt        = 0;
+         m_numBatches       = 0;
+         m_numBatchedPkts   = 0;
+         m_numTxDoneBatches = 0;
+         m_numBatchedTxDones= 0;
+         m_numKaSent        = 0;
+         m_numAckSent       = 0;
+         m_numCreditSent    = 0;
       }
    };
 
@@ -261,29 +311,79 @@ private:
    bool             m_isWorking;                   // Flag - Connecter is working
    bool             m_isConnected;                 // Flag - connection is established
    bool             m_forceDisconnect;             // Disconnect by 'disconnect' method
-   CAPCKATimer::ptr m_kaTxTimer;                   // TX Keep Alive timer
-   CAPCKATimer::ptr m_kaRxTimer;                   // RX Keep Alive timer
    uint32_t         m_unconfirmedInpPkt;           // Max number of unreported input numbers
    boost::chrono::milliseconds m_txTimeout;        // Max time between transition (KA timeout * 0.25)
    boost::chrono::milliseconds m_rxTimeout;        // Max time between receiving  (KA timeout * 2)
-   iobuf_t          m_inpbuf;                      // Input buffer
+
+   //[ ---- Keep alive and delayed acknowledgement. One timer per connection
+   typedef boost::chrono::steady_clock             steady_clock_t;
+   boost::asio::deadline_timer  m_kaTimer;         // Expires at nearest of RX timeout, TX keep alive, ACK time
+   bool                         m_isKaEnabled;     // Keep alive timeout is configured
+   bool                         m_isKaTxStarted;   // Peer's CONNECT is received: keep alive is sent
+   bool                         m_isKaTimerArmed;  // Timer waits for m_kaTimerExpiry
+   steady_clock_t::time_point   m_kaTimerExpiry;
+   boost::atomic<steady_clock_t::rep> m_lastRxTime;// Time of last received data (lock-free)
+   boost::atomic<steady_clock_t::rep> m_lastTxTime;// Time of last sent message (lock-free)
+   boost::chrono::milliseconds  m_ackDelay;        // Max delay of acknowledgement (0 - disabled)
+   uint32_t                     m_ackEveryPkts;    // Acknowledge every N received messages
+   bool                         m_isAckPending;    // Received messages wait for acknowledgement till m_ackTime
+   steady_clock_t::time_point   m_ackTime;
+   //]
+   inpbuf_t         m_inpbuf;                      // Input buffer. Messages are parsed in place
+   mngr_time_t      m_rxTime;                      // Time of last read from transport
    iobuf_t          m_outbufs[APC_NUM_OUT_BUFS];   // Output buffers
    uint32_t         m_numFreeOutBuf;               // Number of free output buffers
    uint32_t         m_minNumFreeOutBuf;            // Min number of free buffers
+   bool             m_isTxReadyNotif;              // Send apcTxReady when a buffer is freed
    uint32_t         m_lastReceivedSeqNum;           // Seq. number of received packet (input 'mySeq')
    uint32_t         m_lastReportedSeqNum;          // Last reported reported seq.number (out 'yourSeq')
    uint32_t         m_curFreeBufIdx;               // Index of current free buffer
 
    APCCStats                    m_stats;           // APC Connector Statistics
+   CStatRateCalc              * m_pRateTx;         // Rate meter of sent messages (owned by client)
+   CStatRateCalc              * m_pRateRx;         // Rate meter of received messages (owned by client)
 
    std::string                   m_log;            // Logger
-   boost::asio::ip::tcp::socket m_socket;          // TCP socket
+   IAPCTransport::ptr           m_transport;       // TCP / AF_UNIX socket or shared memory
    boost::mutex                 m_lock;            // Lock for object
    std::string                  m_peerIntfName;    // Name of other side of connection
 
    boost::condition_variable    m_freeBufSig;      // Signal of buffer free
    usec_t                       m_freeBufWait;     // max time of waiting buffer
 
+   //[ ---- Batching of APC_NET_RX and APC_NET_TXDONE (see APC_FL_NETRX_BATCH, APC_FL_TXDONE_BATCH)
+   uint32_t                     m_netRxBatchSize;  // Max payload of batch (0 - batching is not offered)
+   uint32_t                     m_netRxBatchDelay; // Max time of packet in open batch (milliseconds)
+   bool                         m_isNetRxBatch;    // Batching is accepted by peer
+   bool                         m_isTxDoneBatch;   // Batching of APC_NET_TXDONE is accepted by peer
+   apc_msg_type_t               m_batchType;       // Type of messages in open batch
+   std::vector<uint8_t>         m_batch;           // Payload of open batch
+   uint32_t                     m_batchLastSeq;    // Seq. number of last packet in open batch
+   bool                         m_isBatchFlushPending; // Flush open batch after write is finished
+   boost::asio::deadline_timer  m_batchTimer;      // Flush timer of open batch
+   //]
+
+   //[ ---- Stream compression (see APC_FL_COMPRESS)
+   CAPCCompressor             * m_pCompressor;     // NULL - compression is not offered
+   bool                         m_isConnectSent;   // APC_CONNECT is sent
+   bool                         m_isTxCompressed;  // Output after own APC_CONNECT is compressed
+   bool                         m_isRxCompressed;  // Input after peer's APC_CONNECT is compressed
+   iobuf_t                      m_txRawBuf;        // Serialized message before compression
+   //]
+
+   //[ ---- Credit flow control (see APC_FL_CREDIT)
+   bool                         m_isCreditOffered; // Own CONNECT carries APC_FL_CREDIT
+   bool                         m_isCredit;        // Peer's CONNECT carries it too
+   uint32_t                     m_rxCreditLimit;   // Credit of peer set by client
+   uint32_t                     m_advertisedCredit;// Credit sent to peer
+   //]
+
+   uint8_t                      m_protoVer;        // Offered protocol version
+   uint8_t                      m_hdrVer;          // Negotiated protocol version (after peer's CONNECT)
+
+   apc_sock_policy_s            m_sockPolicy;      // Socket options
+   bool                         m_isCorked;        // TCP_CORK is set while several writes are in flight
+
    CAPCConnector(const init_param_t& param);
    
    // Get free buffer.
@@ -296,17 +396,31 @@ private:
    // Increase number of free buffers
    void               incrNumFreeBuf_p();    
 
-   // RX Keep Alive timer callback function
-   bool        ka_timeout_rx_p(const boost::chrono::steady_clock::time_point& lastAction);
-   // TX Keep Alive timer callback function
-   bool        ka_timeout_tx_p(const boost::chrono::steady_clock::time_point& lastAction);
+   // Prepare and send message (m_lock is locked)
+   apc_error_t        sendMsg_p(boost::unique_lock<boost::mutex>& lock, apc_msg_type_t type, uint8_t flags, 
+                                uint32_t mySeq, const uint8_t * payload1, uint16_t size1, 
+                                const uint8_t * payload2, uint16_t size2);
+   // Add APC_NET_RX packet or APC_NET_TXDONE notification to open batch
+   apc_error_t        addToBatch_p(boost::unique_lock<boost::mutex>& lock, apc_msg_type_t type, uint32_t mySeq, 
+                                   const uint8_t * payload1, uint16_t size1, 
+                                   const uint8_t * payload2, uint16_t size2);
+   // Send open batch. If 'isWait' is false and no free buffer then flush is 
+   // postponed till the end of current write
+   apc_error_t        flushBatch_p(boost::unique_lock<boost::mutex>& lock, bool isWait);
+
+   // Keep alive / ACK timer callback function
+   void        handle_ka_timer_p(const boost::system::error_code& error);
+   // Set keep alive timer to nearest deadline if it is earlier than current expiry (m_lock is locked)
+   void        armKaTimer_p();
    // Async write callback function
    void        handle_write_p(const boost::system::error_code& error, size_t len);
+   // Batch flush timer callback function
+   void        handle_batch_timer_p(const boost::system::error_code& error);
    // Async read callback function
    void        handle_read_p (const boost::system::error_code& error, size_t len);
    // Start async read
    apc_error_t async_read_p();
-   // Send 'Keep Alive' message.
+   // Send 'Keep Alive' message. It acknowledges received messages (yourSeq)
    apc_error_t send_ka_p();
 
    // IAPCRxHandler interface -------------------------------------------------
@@ -347,6 +461,8 @@ public:
       uint32_t       mySeq;
       uint32_t       yourSeq;
       apc_msg_type_t type;
+      mngr_time_t::rep rxTime; ///< Time of reading the message from transport (ticks of mngr_time_t).
+                               ///< Not mngr_time_t: the struct is a member of union
    };
 
 
@@ -379,12 +495,21 @@ public:
    /**
     * Data receive notification
     *
+    * \param   pAPC     Connector that received data
     * \param   apcId    Interface ID
     * \param   type     The type of receiving data
     * \param   pPayload The payload.
     * \param   size     The size.
     */
-   virtual void messageReceived(const param_received_s& param, const uint8_t * pPayload, uint16_t size) = 0;
+   virtual void messageReceived(CAPCConnector::ptr pAPC, const param_received_s& param, 
+                                const uint8_t * pPayload, uint16_t size) = 0;
+
+   /**
+    * Output buffer is freed after CAPCConnector::isTxReady(true) returned false.
+    *
+    * \param   pAPC     Connector that can send
+    */
+   virtual void apcTxReady(CAPCConnector::ptr pAPC) = 0;
 
 };
 
@@ -9,8 +9,11 @@
 // Max size of string representation of software version
 const uint32_t SIZE_STR_VER = 80;
 
-// Protocol version
-const uint8_t  APC_PROTO_VER = 1;
+// Protocol version. CONNECT carries the max version supported by the sender, 
+// both sides use the lower one
+const uint8_t  APC_PROTO_VER     = 1;
+const uint8_t  APC_PROTO_VER_2   = 2;   // Compact message header (see apc_hdr_s)
+const uint8_t  APC_PROTO_VER_MAX = APC_PROTO_VER_2;
 
 /**
  * Values that represent types of APC interface messages
@@ -23,15 +26,19 @@ enum apc_msg_type_t : uint8_t
    APC_NET_TX        = 3,  ///<  Mgr->APC Manager sends network packet to AP
    APC_NET_RX        = 4,  ///<  APC->Mgr AP sends network packet to Manager
    APC_NET_TXDONE    = 5,  ///<  APC->Mgr Tx done notification from the AP
-   APC_NET_TX_PAUSE  = 6,  ///<  bi-dir Pause network traffic to originator of this message
-   APC_NET_TX_RESUME = 7,  ///<  bi-dir Resume network traffic to originator of this message
+   APC_NET_TX_PAUSE  = 6,  ///<  bi-dir Pause network traffic to originator of this message (not used with APC_FL_CREDIT)
+   APC_NET_TX_RESUME = 7,  ///<  bi-dir Resume network traffic to originator of this message (not used with APC_FL_CREDIT)
    APC_RESET_AP      = 8,  ///<  Mgr->APC Manager requests h/w reset of AP
-   APC_KA            = 9,  ///<  bi-dir Keep-alive message
+   APC_KA            = 9,  ///<  bi-dir Keep-alive message. Carries credit if APC_FL_CREDIT is negotiated
    APC_AP_LOST       = 10, ///<  APC->Mgr Indication that APC lost communication with the AP
    APC_GET_TIME      = 11, ///<  Mgr->APC Request UTC/ASN time map from AP
    APC_TIME_MAP      = 12, ///<  APC->Mgr Notification that contains UTC/ASN time mapping
    APC_GPS_LOCK      = 13, ///<  APC->Mgr Notification that contains GPS Lock state
    APC_DISCONNECT_AP = 14, ///<  Mgr->APC Manager requests s/w reset of AP
+   APC_NET_RX_BATCH  = 15, ///<  APC->Mgr Several network packets from AP (see APC_FL_NETRX_BATCH)
+   APC_ACTIVATE      = 16, ///<  bi-dir Standby connection becomes active (see APC_FL_STANDBY). Answer carries
+                           ///<  in yourSeq the last sequence number received by the Manager in the session
+   APC_NET_TXDONE_BATCH = 17, ///< APC->Mgr Several Tx done notifications (see APC_FL_TXDONE_BATCH)
 };
 ENUM2STR(apc_msg_type_t);
 
@@ -39,6 +46,15 @@ ENUM2STR(apc_msg_type_t);
  *    APC / AP flags
  */
 const uint32_t APC_FL_INTSYNCH_AP = 0x1;    // AP should start in Internal-synch mode
+const uint32_t APC_FL_NETRX_BATCH = 0x2;    // Sender supports APC_NET_RX_BATCH. Used if both CONNECT messages carry it
+const uint32_t APC_FL_COMPRESS    = 0x4;    // Sender supports compression (see APCCompressor.h). If both CONNECT 
+                                            // messages carry it, stream of each side after its CONNECT is compressed
+const uint32_t APC_FL_STANDBY     = 0x8;    // CONNECT of hot-standby connection of existing session. Manager
+                                            // that supports it echoes the flag and does not use the connection
+                                            // until APC_ACTIVATE
+const uint32_t APC_FL_CREDIT      = 0x10;   // Sender supports credit flow control (see apc_msg_credit_s). Used if
+                                            // both CONNECT messages carry it, instead of APC_NET_TX_PAUSE/RESUME
+const uint32_t APC_FL_TXDONE_BATCH = 0x20;  // Sender supports APC_NET_TXDONE_BATCH. Used if both CONNECT messages carry it
 
 const uint32_t APC_COOKIE = 0x7E7E7E7E;
 
@@ -59,6 +75,10 @@ enum apc_nettx_flags
 };
 const uint16_t APC_NETTX_NOTXDONE = 0xFFFF;  ///< Suppress generation Tx Done message
 
+const uint32_t APC_NETRX_BATCH_MAX_LEN  = MAX_NET_PKT_SIZE;  ///< Max payload of APC_NET_RX_BATCH message
+const uint8_t  APC_NETRX_BATCH_MAX_PKTS = 0xFF;              ///< Max number of packets in APC_NET_RX_BATCH
+const uint8_t  APC_TXDONE_BATCH_MAX_IDS = 0xFF;              ///< Max number of notifications in APC_NET_TXDONE_BATCH
+
 PACKED_START
 /**
  * Header of APC interface messages
@@ -74,6 +94,23 @@ struct apc_hdr_s
    // Payload
 };
 
+/**
+ * Compact header of protocol version 2. CONNECT messages always have apc_hdr_s,
+ * stream of each side after CONNECT exchange uses compact header:
+ *   uint8_t  type (APC_HDR2_TYPE_MASK) and APC_HDR2_xxx flags
+ *   varint   payload length
+ *   varint   mySeq if APC_HDR2_MYSEQ. Tracked message: delta from mySeq of previous 
+ *            tracked message (absent - 1). Untracked message: mySeq (absent - 0)
+ *   varint   delta from yourSeq of previous message if APC_HDR2_YOURSEQ (absent - 0)
+ * Varint: 7 bits per byte starting from least significant, bit 0x80 - next byte follows.
+ * Deltas are modulo 2^32, first message is compared with 0.
+ */
+const uint8_t  APC_HDR2_TYPE_MASK = 0x1F;
+const uint8_t  APC_HDR2_NOTRACK   = 0x20;   ///< APC_HDR_FLAGS_NOTRACK
+const uint8_t  APC_HDR2_MYSEQ     = 0x40;
+const uint8_t  APC_HDR2_YOURSEQ   = 0x80;
+const uint32_t APC_HDR2_MAX_SIZE  = 1 + 3 + 5 + 5;
+
 ///////////////////////////////////////////////
 //          APC interface messages
 ///////////////////////////////////////////////
@@ -100,6 +137,28 @@ struct apc_msg_connect_s
    char     version[SIZE_STR_VER];   ///< APC / Manager software version
 };
 
+/**
+ * APC_ACTIVATE. Activation of standby connection
+ */
+struct apc_msg_activate_s
+{
+   uint32_t lastSent;      ///< Last sequence number sent by the sender in the session
+   uint32_t lastReceived;  ///< Last sequence number received by the sender in the session
+};
+
+/**
+ * APC_KA payload if credit flow control is negotiated (APC_FL_CREDIT).
+ * Credit is the last sequence number of tracked messages the sender of KA
+ * accepts from the peer; it never decreases. Initial credit is yourSeq of
+ * peer's CONNECT (or ACTIVATE): nothing is sent until first KA with credit,
+ * so each side sends one right after CONNECT exchange. KA without payload
+ * does not change credit.
+ */
+struct apc_msg_credit_s
+{
+   uint32_t   limit;    ///< Last sequence number the peer may send
+};
+
 /**
  * APC_NET_TX: APC transmit message.
  */
@@ -115,6 +174,17 @@ struct apc_msg_net_tx_s
    // payload bytes packet payload, starting with mesh header
 };
 
+/**
+ * APC_NET_RX_BATCH: several APC_NET_RX packets in one message.
+ * Packets have consecutive sequence numbers, mySeq of message header is the 
+ * sequence number of the last packet.
+ */
+struct apc_msg_net_rx_batch_s
+{
+   uint8_t    numPkts;  ///< Number of packets
+   // numPkts times: uint16_t length, 'length' bytes of packet payload
+};
+
 /**
  * APC_NET_TXDONE: APC TX done message
  */
@@ -124,6 +194,17 @@ struct apc_msg_net_txdone_s
    uint8_t    status;
 };
 
+/**
+ * APC_NET_TXDONE_BATCH: several APC_NET_TXDONE notifications in one message.
+ * Notifications have consecutive sequence numbers, mySeq of message header
+ * is the sequence number of the last one.
+ */
+struct apc_msg_net_txdone_batch_s
+{
+   uint8_t    numIds;   ///< Number of notifications
+   // numIds times: apc_msg_net_txdone_s
+};
+
 /**
  * APC_TIME_MAP: APC time map message
  */
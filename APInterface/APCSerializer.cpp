@@ -11,8 +11,18 @@ CAPCSerializer::CAPCSerializer(size_t maxMsgSize, ISerRxHandler * pRxHndlr, cons
    m_inpBuf(maxMsgSize),
    m_inpNumReceived(0),
    m_inpNumExpected(sizeof(apc_hdr_s)),
-   m_logName(logName)
-{;}
+   m_inpHdrSize(0),
+   m_isBreak(false),
+   m_logName(logName),
+   m_txVer(APC_PROTO_VER),
+   m_rxVer(APC_PROTO_VER),
+   m_txMySeq(0),
+   m_txYourSeq(0),
+   m_rxMySeq(0),
+   m_rxYourSeq(0)
+{
+   memset(&m_inpHdr, 0, sizeof(m_inpHdr));
+}
 
 CAPCSerializer::~CAPCSerializer()
 {;}
@@ -24,30 +34,184 @@ apc_error_t CAPCSerializer::prepMsg(uint8_t * msg, size_t maxSize, size_t * pMsg
 {
    BOOST_ASSERT((size1 == 0 || payload1 != NULL) && (size2 == 0 || payload2 != NULL));
 
-   size_t fullSize = size1 + size2;
+   size_t   fullSize = size1 + size2;
+   hdr_s    hdr = { type, flags, mySeq, yourSeq, (uint16_t)fullSize };
+   uint8_t  hdrBuf[sizeof(apc_hdr_s)];
+   size_t   hdrSize;
+   uint32_t txMySeq = m_txMySeq, txYourSeq = m_txYourSeq;
 
-   *pMsgSize = fullSize + sizeof(apc_hdr_s);
-   if (*pMsgSize > maxSize)
+   if (fullSize > 0xFFFF)
       return APC_ERR_SIZE;
+   if (m_txVer >= APC_PROTO_VER_2) {
+      if ((type & ~APC_HDR2_TYPE_MASK) != 0 || (flags & ~APC_HDR_FLAGS_NOTRACK) != 0)
+         return APC_ERR_PROTOCOL;
+      hdrSize = packHdr2_p(hdrBuf, hdr, &txMySeq, &txYourSeq);
+   } else {
+      apc_hdr_s * pHdr = (apc_hdr_s *)hdrBuf;
+      pHdr->cookie = APC_COOKIE;
+      pHdr->flags = flags;
+      pHdr->type = type;
+      pHdr->mySeq  = htonl(mySeq);
+      pHdr->yourSeq = htonl(yourSeq);
+      pHdr->length = htons((uint16_t) fullSize);
+      hdrSize = sizeof(apc_hdr_s);
+   }
 
-   apc_hdr_s * pHdr = (apc_hdr_s *)msg;
-   pHdr->cookie = APC_COOKIE;
-   pHdr->flags = flags;
-   pHdr->type = type;
-   pHdr->mySeq  = htonl(mySeq);
-   pHdr->yourSeq = htonl(yourSeq);
-   pHdr->length = htons((uint16_t) fullSize);
+   *pMsgSize = fullSize + hdrSize;
+   if (*pMsgSize > maxSize)
+      return APC_ERR_SIZE;
 
+   uint8_t * payload = msg + hdrSize;
+   memcpy(msg, hdrBuf, hdrSize);
    if (size1 > 0) 
-      memcpy((uint8_t *)(pHdr+1), payload1, size1);
+      memcpy(payload, payload1, size1);
    if (size2 > 0) 
-      memcpy((uint8_t *)(pHdr+1) + size1, payload2, size2);
+      memcpy(payload + size1, payload2, size2);
 
-   apc_error_t res = convert(HOST_TO_NET, type, (uint8_t *)(pHdr+1), fullSize);
-   trace_p("TX", intfId, pHdr, (uint8_t *)(pHdr+1), fullSize);
+   apc_error_t res = convert(HOST_TO_NET, type, payload, fullSize);
+   trace_p("TX", intfId, hdr, payload, fullSize);
+   if (res == APC_OK) {
+      // Receiver restores sequence numbers of compact header from the same values
+      m_txMySeq   = txMySeq;
+      m_txYourSeq = txYourSeq;
+   }
    return res;
 }
 
+void CAPCSerializer::setTxVersion(uint8_t ver)
+{
+   m_txVer     = ver;
+   m_txMySeq   = 0;
+   m_txYourSeq = 0;
+}
+
+void CAPCSerializer::setRxVersion(uint8_t ver)
+{
+   m_rxVer     = ver;
+   m_rxMySeq   = 0;
+   m_rxYourSeq = 0;
+   if (m_inpNumReceived == 0 && m_inpHdrSize == 0)
+      m_inpNumExpected = inpHdrStart_p();
+}
+
+static size_t putVarint(uint8_t * buf, uint32_t value)
+{
+   size_t len = 0;
+   while (value >= 0x80) {
+      buf[len++] = (uint8_t)(value | 0x80);
+      value >>= 7;
+   }
+   buf[len++] = (uint8_t)value;
+   return len;
+}
+
+// Return 1 - value is read, 0 - more bytes are needed, -1 - wrong encoding
+static int getVarint(const uint8_t ** pp, const uint8_t * pEnd, uint32_t * pValue)
+{
+   uint32_t value = 0;
+   for (uint32_t shift = 0; shift < 35; shift += 7) {
+      if (*pp >= pEnd)
+         return 0;
+      uint8_t b = *(*pp)++;
+      value |= (uint32_t)(b & 0x7F) << shift;
+      if ((b & 0x80) == 0) {
+         *pValue = value;
+         return 1;
+      }
+   }
+   return -1;
+}
+
+// Pack compact header. '*pMySeq', '*pYourSeq' - last sequence numbers, updated
+size_t CAPCSerializer::packHdr2_p(uint8_t * buf, const hdr_s& hdr, uint32_t * pMySeq, uint32_t * pYourSeq) const
+{
+   size_t   len = 1;
+   uint32_t yourSeqDelta = hdr.yourSeq - *pYourSeq;
+   buf[0] = (uint8_t)hdr.type;
+   len += putVarint(buf + len, hdr.length);
+   if (hdr.flags & APC_HDR_FLAGS_NOTRACK) {
+      buf[0] |= APC_HDR2_NOTRACK;
+      if (hdr.mySeq != 0) {
+         buf[0] |= APC_HDR2_MYSEQ;
+         len += putVarint(buf + len, hdr.mySeq);
+      }
+   } else {
+      uint32_t mySeqDelta = hdr.mySeq - *pMySeq;
+      if (mySeqDelta != 1) {
+         buf[0] |= APC_HDR2_MYSEQ;
+         len += putVarint(buf + len, mySeqDelta);
+      }
+      *pMySeq = hdr.mySeq;
+   }
+   if (yourSeqDelta != 0) {
+      buf[0] |= APC_HDR2_YOURSEQ;
+      len += putVarint(buf + len, yourSeqDelta);
+   }
+   *pYourSeq = hdr.yourSeq;
+   return len;
+}
+
+// Parse header at 'data'. '*pHdrSize' is 0 if header is not complete
+apc_error_t CAPCSerializer::parseHdr_p(const uint8_t * data, size_t size, hdr_s * pHdr, size_t * pHdrSize) const
+{
+   *pHdrSize = 0;
+   if (m_rxVer < APC_PROTO_VER_2) {
+      if (size < sizeof(apc_hdr_s))
+         return APC_OK;
+      const apc_hdr_s * pApcHdr = (const apc_hdr_s *)data;
+      if (pApcHdr->cookie != APC_COOKIE)
+         return APC_ERR_PROTOCOL;
+      pHdr->type    = pApcHdr->type;
+      pHdr->flags   = pApcHdr->flags;
+      pHdr->mySeq   = ntohl(pApcHdr->mySeq);
+      pHdr->yourSeq = ntohl(pApcHdr->yourSeq);
+      pHdr->length  = ntohs(pApcHdr->length);
+      *pHdrSize     = sizeof(apc_hdr_s);
+   } else {
+      const uint8_t * p    = data;
+      const uint8_t * pEnd = data + size;
+      uint8_t  b0 = *p++;
+      uint32_t length = 0, mySeq = 0, yourSeqDelta = 0;
+      int      rc = getVarint(&p, pEnd, &length);
+      if (rc > 0 && (b0 & APC_HDR2_MYSEQ))
+         rc = getVarint(&p, pEnd, &mySeq);
+      if (rc > 0 && (b0 & APC_HDR2_YOURSEQ))
+         rc = getVarint(&p, pEnd, &yourSeqDelta);
+      if (rc < 0 || length > 0xFFFF)
+         return APC_ERR_PROTOCOL;
+      if (rc == 0)
+         return APC_OK;
+      pHdr->type    = (apc_msg_type_t)(b0 & APC_HDR2_TYPE_MASK);
+      pHdr->flags   = (b0 & APC_HDR2_NOTRACK) ? APC_HDR_FLAGS_NOTRACK : 0;
+      pHdr->length  = (uint16_t)length;
+      if (pHdr->flags & APC_HDR_FLAGS_NOTRACK)
+         pHdr->mySeq = mySeq;
+      else
+         pHdr->mySeq = m_rxMySeq + ((b0 & APC_HDR2_MYSEQ) ? mySeq : 1);
+      pHdr->yourSeq = m_rxYourSeq + yourSeqDelta;
+      *pHdrSize     = p - data;
+   }
+   if (*pHdrSize + pHdr->length > m_inpBuf.size())
+      return APC_ERR_SIZE;
+   return APC_OK;
+}
+
+// Convert payload and pass message to handler
+apc_error_t CAPCSerializer::dispatch_p(ap_intf_id_t apcId, const hdr_s& hdr, uint8_t * payload)
+{
+   if (m_rxVer >= APC_PROTO_VER_2) {
+      // Next compact header is relative to this one
+      if ((hdr.flags & APC_HDR_FLAGS_NOTRACK) == 0)
+         m_rxMySeq = hdr.mySeq;
+      m_rxYourSeq = hdr.yourSeq;
+   }
+   trace_p("RX", apcId, hdr, payload, hdr.length);
+   apc_error_t res = convert(NET_TO_HOST, hdr.type, payload, hdr.length);
+   if (res == APC_OK)
+      res = m_pRxHandler->messageReceived(apcId, hdr.type, hdr.flags, hdr.mySeq, hdr.yourSeq, payload, hdr.length);
+   return res;
+}
+
 size_t CAPCSerializer::fillInpBuf_p(const uint8_t * data, size_t size)
 {
    size_t len = m_inpNumExpected - m_inpNumReceived;
@@ -58,38 +222,102 @@ size_t CAPCSerializer::fillInpBuf_p(const uint8_t * data, size_t size)
    return len;
 }
 
-apc_error_t CAPCSerializer::dataReceived(ap_intf_id_t apcId, const uint8_t * data, size_t receivedLen)
+apc_error_t CAPCSerializer::dataReceived(ap_intf_id_t apcId, uint8_t * data, size_t receivedLen,
+                                         size_t * pProcessed)
 {
-   apc_hdr_s * pHdr = (apc_hdr_s *)m_inpBuf.data();
    size_t      processedLen;
+   size_t      totalLen = receivedLen;
    apc_error_t res = APC_OK;
-   while(receivedLen > 0 && res == APC_OK) {
+   m_isBreak = false;
+   while(receivedLen > 0 && res == APC_OK && !m_isBreak) {
+      if (m_inpNumReceived == 0) {
+         // Complete message is handled without copying
+         hdr_s  hdr;
+         size_t hdrSize;
+         res = parseHdr_p(data, receivedLen, &hdr, &hdrSize);
+         if (res != APC_OK)
+            return res;
+         if (hdrSize > 0 && hdrSize + hdr.length <= receivedLen) {
+            res = dispatch_p(apcId, hdr, data + hdrSize);
+            data += hdrSize + hdr.length; receivedLen -= hdrSize + hdr.length;
+            continue;
+         }
+      }
+      // Message is split between calls: collect it in input buffer
       processedLen = fillInpBuf_p(data, receivedLen);
       data += processedLen; receivedLen -= processedLen;
-      if (m_inpNumReceived == sizeof(apc_hdr_s)) {
-         m_inpNumExpected += ntohs(pHdr->length);
-         if (pHdr->cookie != APC_COOKIE)
-            return APC_ERR_PROTOCOL;
-         if (m_inpNumExpected > m_inpBuf.size())
-            return APC_ERR_SIZE;
-      }
-      if (m_inpNumExpected != m_inpNumReceived && receivedLen > 0) {
-         processedLen = fillInpBuf_p(data, receivedLen);
-         data += processedLen; receivedLen -= processedLen;
-      }
-      if (m_inpNumExpected == m_inpNumReceived) {
-         trace_p("RX", apcId, pHdr, (uint8_t *)(pHdr+1), m_inpNumReceived-sizeof(apc_hdr_s));
-         res = convert(NET_TO_HOST, pHdr->type, (uint8_t *)(pHdr+1), m_inpNumReceived-sizeof(apc_hdr_s));
-         if (res == APC_OK)
-            res = m_pRxHandler->messageReceived(apcId, pHdr->type, pHdr->flags, ntohl(pHdr->mySeq), ntohl(pHdr->yourSeq), 
-                                                (uint8_t *)(pHdr+1), m_inpNumReceived-sizeof(apc_hdr_s));
+      if (m_inpHdrSize == 0 && m_inpNumReceived == m_inpNumExpected) {
+         res = parseHdr_p(m_inpBuf.data(), m_inpNumReceived, &m_inpHdr, &m_inpHdrSize);
+         if (res != APC_OK)
+            return res;
+         // Compact header is not complete: request next byte
+         m_inpNumExpected = m_inpHdrSize > 0 ? m_inpHdrSize + m_inpHdr.length : m_inpNumReceived + 1;
+      }
+      if (m_inpHdrSize > 0 && m_inpNumExpected == m_inpNumReceived) {
+         res = dispatch_p(apcId, m_inpHdr, m_inpBuf.data() + m_inpHdrSize);
+         // Handler may change version of header
          m_inpNumReceived = 0;
-         m_inpNumExpected = sizeof(apc_hdr_s);
+         m_inpHdrSize     = 0;
+         m_inpNumExpected = inpHdrStart_p();
       }
    }
+   if (pProcessed)
+      *pProcessed = totalLen - receivedLen;
    return res;
 }
 
+bool CAPCSerializer::addBatchPkt(std::vector<uint8_t>& batch, const uint8_t * payload1, size_t size1,
+                                 const uint8_t * payload2, size_t size2)
+{
+   if (batch.empty())
+      batch.push_back(0);  // apc_msg_net_rx_batch_s::numPkts
+   uint16_t len = (uint16_t)(size1 + size2);
+   if (batch[0] >= APC_NETRX_BATCH_MAX_PKTS || batch.size() + sizeof(len) + len > APC_NETRX_BATCH_MAX_LEN) {
+      if (batch[0] == 0)
+         batch.clear();
+      return false;
+   }
+   const uint8_t * pLen = (const uint8_t *)&len;
+   batch.insert(batch.end(), pLen, pLen + sizeof(len));
+   if (size1 > 0)
+      batch.insert(batch.end(), payload1, payload1 + size1);
+   if (size2 > 0)
+      batch.insert(batch.end(), payload2, payload2 + size2);
+   batch[0]++;
+   return true;
+}
+
+bool CAPCSerializer::addBatchTxDone(std::vector<uint8_t>& batch, const uint8_t * payload, size_t size, 
+                                    size_t maxSize)
+{
+   if (size != sizeof(apc_msg_net_txdone_s))
+      return false;
+   if (batch.empty())
+      batch.push_back(0);  // apc_msg_net_txdone_batch_s::numIds
+   if (batch[0] >= APC_TXDONE_BATCH_MAX_IDS || batch.size() + size > maxSize) {
+      if (batch[0] == 0)
+         batch.clear();
+      return false;
+   }
+   batch.insert(batch.end(), payload, payload + size);
+   batch[0]++;
+   return true;
+}
+
+const uint8_t * CAPCSerializer::getBatchPkt(const uint8_t * payload, size_t size, size_t * pOffset, uint16_t * pPktSize)
+{
+   uint16_t len;
+   if (*pOffset + sizeof(len) > size)
+      return NULL;
+   memcpy(&len, payload + *pOffset, sizeof(len));
+   if (*pOffset + sizeof(len) + len > size)
+      return NULL;
+   const uint8_t * pPkt = payload + *pOffset + sizeof(len);
+   *pOffset += sizeof(len) + len;
+   *pPktSize = len;
+   return pPkt;
+}
+
 // Function for cast binary buffer to message type. 
 // Return NULLPTR if buffer size < size of type 
 template <class T> 
@@ -125,6 +353,19 @@ apc_error_t CAPCSerializer::convert(converttype_t convertType, apc_msg_type_t ms
          pMsg->txDoneId = CONVERT_S(convertType, pMsg->txDoneId);
          break;
       }
+   case APC_NET_TXDONE_BATCH:
+      {
+         apc_msg_net_txdone_batch_s * pMsg = bufferCast_p<apc_msg_net_txdone_batch_s>(payload, size);
+         if (pMsg == nullptr || 
+             size != sizeof(apc_msg_net_txdone_batch_s) + pMsg->numIds * sizeof(apc_msg_net_txdone_s)) {
+            res = APC_ERR_SIZE;
+            break;
+         }
+         apc_msg_net_txdone_s * pId = (apc_msg_net_txdone_s *)(payload + sizeof(apc_msg_net_txdone_batch_s));
+         for (uint8_t i = 0; i < pMsg->numIds; i++, pId++)
+            pId->txDoneId = CONVERT_S(convertType, pId->txDoneId);
+         break;
+      }
    case APC_TIME_MAP:
       {
          apc_msg_timemap_s * pMsg = bufferCast_p<apc_msg_timemap_s>(payload, size);
@@ -138,6 +379,30 @@ apc_error_t CAPCSerializer::convert(converttype_t convertType, apc_msg_type_t ms
          pMsg->asnOffset       = CONVERT_S(convertType,  pMsg->asnOffset      );
          break;
       }
+   case APC_NET_RX_BATCH:
+      {
+         apc_msg_net_rx_batch_s * pMsg = bufferCast_p<apc_msg_net_rx_batch_s>(payload, size);
+         if (pMsg == nullptr) {
+            res = APC_ERR_SIZE;
+            break;
+         }
+         // Convert length of every packet and check that packets fill the payload
+         size_t offset = sizeof(apc_msg_net_rx_batch_s);
+         for (uint8_t i = 0; i < pMsg->numPkts && res == APC_OK; i++) {
+            uint16_t len, convLen;
+            if (offset + sizeof(len) > size) {
+               res = APC_ERR_SIZE;
+               break;
+            }
+            memcpy(&len, payload + offset, sizeof(len));
+            convLen = CONVERT_S(convertType, len);
+            memcpy(payload + offset, &convLen, sizeof(convLen));
+            offset += sizeof(len) + (convertType == NET_TO_HOST ? convLen : len);
+         }
+         if (res == APC_OK && offset != size)
+            res = APC_ERR_SIZE;
+         break;
+      }
    case APC_CONNECT:
       {
          apc_msg_connect_s * pMsg = bufferCast_p<apc_msg_connect_s>(payload, size);
@@ -150,22 +415,46 @@ apc_error_t CAPCSerializer::convert(converttype_t convertType, apc_msg_type_t ms
          pMsg->netId = CONVERT_L(convertType,  pMsg->netId);
          break;
       }
+   case APC_ACTIVATE:
+      {
+         apc_msg_activate_s * pMsg = bufferCast_p<apc_msg_activate_s>(payload, size);
+         if (pMsg == nullptr) {
+            res = APC_ERR_SIZE;
+            break;
+         }
+         pMsg->lastSent     = CONVERT_L(convertType, pMsg->lastSent);
+         pMsg->lastReceived = CONVERT_L(convertType, pMsg->lastReceived);
+         break;
+      }
+   case APC_KA:
+      {
+         // Empty KA or credit
+         if (size == 0)
+            break;
+         apc_msg_credit_s * pMsg = bufferCast_p<apc_msg_credit_s>(payload, size);
+         if (pMsg == nullptr) {
+            res = APC_ERR_SIZE;
+            break;
+         }
+         pMsg->limit = CONVERT_L(convertType, pMsg->limit);
+         break;
+      }
    default:
       break;
    }
    return res;
 }
 
-void  CAPCSerializer::trace_p(const char * title, ap_intf_id_t intfId, const apc_hdr_s * pHdr, uint8_t * payload, size_t size)
+void  CAPCSerializer::trace_p(const char * title, ap_intf_id_t intfId, const hdr_s& hdr, uint8_t * payload, size_t size)
 {
    if (!DUSTLOG_ISENABLED(m_logName, Logger::TRACE_LEVEL))
       return;
 
    CFmtBuffer<256> fb;
-   fb.printf("%s #%d %s flags=0x%x mySeq=%d yourSeq=%d ", title, intfId, toString(pHdr->type),
-      pHdr->flags, ntohl(pHdr->mySeq), ntohl(pHdr->yourSeq));
+   fb.printf("%s #%d %s flags=0x%x mySeq=%d yourSeq=%d ", title, intfId, toString(hdr.type),
+      hdr.flags, hdr.mySeq, hdr.yourSeq);
 
-   switch(pHdr->type) {
+   switch(hdr.type) {
    case APC_NET_TX: 
       {
          apc_msg_net_tx_s * pMsg = bufferCast_p<apc_msg_net_tx_s>(payload, size);
@@ -199,6 +488,34 @@ void  CAPCSerializer::trace_p(const char * title, ap_intf_id_t intfId, const apc
             fb.printf("flags=0x%x, sesId=%d", ntohl(pMsg->flags), ntohl(pMsg->sesId));
          break;
       }
+   case APC_NET_RX_BATCH:
+      {
+         apc_msg_net_rx_batch_s * pMsg = bufferCast_p<apc_msg_net_rx_batch_s>(payload, size);
+         if (pMsg != nullptr) 
+            fb.printf("numPkts=%d len=%d", pMsg->numPkts, (int)size);
+         break;
+      }
+   case APC_NET_TXDONE_BATCH:
+      {
+         apc_msg_net_txdone_batch_s * pMsg = bufferCast_p<apc_msg_net_txdone_batch_s>(payload, size);
+         if (pMsg != nullptr) 
+            fb.printf("numIds=%d", pMsg->numIds);
+         break;
+      }
+   case APC_ACTIVATE:
+      {
+         apc_msg_activate_s * pMsg = bufferCast_p<apc_msg_activate_s>(payload, size);
+         if (pMsg != nullptr) 
+            fb.printf("lastSent=%u lastReceived=%u", ntohl(pMsg->lastSent), ntohl(pMsg->lastReceived));
+         break;
+      }
+   case APC_KA:
+      {
+         apc_msg_credit_s * pMsg = bufferCast_p<apc_msg_credit_s>(payload, size);
+         if (pMsg != nullptr) 
+            fb.printf("credit=%u", ntohl(pMsg->limit));
+         break;
+      }
    default:
       if (size > 0 && payload != NULL)   
          fb.printDump(payload, size, ":", "data=");
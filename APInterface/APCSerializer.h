@@ -25,14 +25,62 @@ public:
                        const uint8_t * payload1, size_t size1, 
                        const uint8_t * payload2, size_t size2);
 
-   apc_error_t dataReceived(ap_intf_id_t apcId, const uint8_t * data, size_t size);
+   // Parse received data. If 'pProcessed' is not NULL, number of used bytes 
+   // (less than 'size' if handler called breakInput).
+   // Complete messages are passed to handler from 'data' (payload is converted in place), 
+   // only messages split between calls are copied
+   apc_error_t dataReceived(ap_intf_id_t apcId, uint8_t * data, size_t size, size_t * pProcessed = NULL);
+   // Protocol version of header of next sent / received message (APC_PROTO_VER by default).
+   // Receive version can be changed by handler: it is used from the next message
+   void        setTxVersion(uint8_t ver);
+   void        setRxVersion(uint8_t ver);
+   // Called by handler: stop dataReceived after current message (the rest of 
+   // data is encoded differently, e.g. compressed stream after APC_CONNECT)
+   void        breakInput() { m_isBreak = true; }
+
+   // Append packet to payload of APC_NET_RX_BATCH (host byte order).
+   // Return false if packet does not fit to the batch
+   static bool            addBatchPkt(std::vector<uint8_t>& batch, const uint8_t * payload1, size_t size1,
+                                      const uint8_t * payload2, size_t size2);
+   // Get packet of APC_NET_RX_BATCH payload (host byte order) at '*pOffset' and move offset 
+   // to the next packet. Start from offset sizeof(apc_msg_net_rx_batch_s). 
+   // Return NULL after the last packet
+   static const uint8_t * getBatchPkt(const uint8_t * payload, size_t size, size_t * pOffset, uint16_t * pPktSize);
+   // Append apc_msg_net_txdone_s to payload of APC_NET_TXDONE_BATCH (host byte order).
+   // Return false if it does not fit to 'maxSize' bytes of batch
+   static bool            addBatchTxDone(std::vector<uint8_t>& batch, const uint8_t * payload, size_t size, 
+                                         size_t maxSize);
 private:
+   // Fields of header in host byte order
+   struct hdr_s {
+      apc_msg_type_t type;
+      uint8_t        flags;
+      uint32_t       mySeq;
+      uint32_t       yourSeq;
+      uint16_t       length;
+   };
+
    ISerRxHandler    * m_pRxHandler;
    std::vector<uint8_t>  m_inpBuf;
    size_t                m_inpNumReceived;
    size_t                m_inpNumExpected;
+   size_t                m_inpHdrSize;     // 0 - header is not parsed yet
+   hdr_s                 m_inpHdr;
+   bool                  m_isBreak;
    std::string           m_logName;
+   //[ ---- Compact header (APC_PROTO_VER_2): last sequence numbers
+   uint8_t               m_txVer;
+   uint8_t               m_rxVer;
+   uint32_t              m_txMySeq;        // Of tracked message
+   uint32_t              m_txYourSeq;
+   uint32_t              m_rxMySeq;
+   uint32_t              m_rxYourSeq;
+   //]
 
-   void                  trace_p(const char * title, ap_intf_id_t intfId, const apc_hdr_s * pHdr, uint8_t * payload, size_t size);
+   void                  trace_p(const char * title, ap_intf_id_t intfId, const hdr_s& hdr, uint8_t * payload, size_t size);
    size_t                fillInpBuf_p(const uint8_t * data, size_t size);
+   size_t                inpHdrStart_p() const { return m_rxVer >= APC_PROTO_VER_2 ? 1 : sizeof(apc_hdr_s); }
+   size_t                packHdr2_p(uint8_t * buf, const hdr_s& hdr, uint32_t * pMySeq, uint32_t * pYourSeq) const;
+   apc_error_t           parseHdr_p(const uint8_t * data, size_t size, hdr_s * pHdr, size_t * pHdrSize) const;
+   apc_error_t           dispatch_p(ap_intf_id_t apcId, const hdr_s& hdr, uint8_t * payload);
 };
\ No newline at end of file
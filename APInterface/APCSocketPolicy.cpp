@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "APCSocketPolicy.h"
+#include "Logger.h"
+
+#include <cstring>
+#ifndef WIN32
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+static const apc_sock_policy_s s_policies[] = {
+   // name           noDelay cork   sndBuf   rcvBuf   userTO  kaIdle kaIntvl kaCnt
+   { "default",      false,  false, 0,       0,       0,      0,     0,      0 },
+   { "low-latency",  true,   false, 0,       0,       0,      0,     0,      0 },
+   { "bulk",         false,  true,  262144,  262144,  0,      0,     0,      0 },
+   { "cellular",     true,   true,  65536,   65536,   30000,  30,    10,     3 },
+};
+
+const apc_sock_policy_s * CAPCSocketPolicy::find(const std::string& name)
+{
+   for (const auto& p : s_policies)
+      if (name == p.m_name)
+         return &p;
+   return NULL;
+}
+
+std::string CAPCSocketPolicy::getNames()
+{
+   std::string names;
+   for (const auto& p : s_policies) {
+      if (!names.empty())
+         names += ", ";
+      names += p.m_name;
+   }
+   return names;
+}
+
+#ifndef WIN32
+// Set integer option of native socket
+static void setIntOpt(boost::asio::ip::tcp::socket& sock, int level, int name, int value, 
+                      const char * optName, const std::string& logName)
+{
+   if (setsockopt(sock.native_handle(), level, name, &value, sizeof(value)) != 0)
+      DUSTLOG_WARN(logName, "Socket option " << optName << "=" << value << " error: " << strerror(errno));
+}
+#endif
+
+void CAPCSocketPolicy::apply(boost::asio::ip::tcp::socket& sock, const apc_sock_policy_s& policy, 
+                             const std::string& logName)
+{
+   boost::system::error_code ec;
+   if (policy.m_noDelay && sock.set_option(boost::asio::ip::tcp::no_delay(true), ec))
+      DUSTLOG_WARN(logName, "Socket option TCP_NODELAY error: " << ec.message());
+   if (policy.m_sndBuf > 0 && sock.set_option(boost::asio::socket_base::send_buffer_size(policy.m_sndBuf), ec))
+      DUSTLOG_WARN(logName, "Socket option SO_SNDBUF error: " << ec.message());
+   if (policy.m_rcvBuf > 0 && sock.set_option(boost::asio::socket_base::receive_buffer_size(policy.m_rcvBuf), ec))
+      DUSTLOG_WARN(logName, "Socket option SO_RCVBUF error: " << ec.message());
+   if (policy.m_kaIdleSec > 0 && sock.set_option(boost::asio::socket_base::keep_alive(true), ec))
+      DUSTLOG_WARN(logName, "Socket option SO_KEEPALIVE error: " << ec.message());
+#ifndef WIN32
+#ifdef TCP_USER_TIMEOUT
+   if (policy.m_userTimeoutMsec > 0)
+      setIntOpt(sock, IPPROTO_TCP, TCP_USER_TIMEOUT, policy.m_userTimeoutMsec, "TCP_USER_TIMEOUT", logName);
+#endif
+#ifdef TCP_KEEPIDLE
+   if (policy.m_kaIdleSec > 0) {
+      setIntOpt(sock, IPPROTO_TCP, TCP_KEEPIDLE,  policy.m_kaIdleSec,     "TCP_KEEPIDLE",  logName);
+      setIntOpt(sock, IPPROTO_TCP, TCP_KEEPINTVL, policy.m_kaIntervalSec, "TCP_KEEPINTVL", logName);
+      setIntOpt(sock, IPPROTO_TCP, TCP_KEEPCNT,   policy.m_kaCount,       "TCP_KEEPCNT",   logName);
+   }
+#endif
+#endif
+   DUSTLOG_INFO(logName, "Socket policy '" << policy.m_name << "'");
+}
+
+void CAPCSocketPolicy::setCork(boost::asio::ip::tcp::socket& sock, bool isCork)
+{
+#if !defined(WIN32) && defined(TCP_CORK)
+   int value = isCork ? 1 : 0;
+   setsockopt(sock.native_handle(), IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#endif
+}
+
+bool CAPCSocketPolicy::getTcpInfo(boost::asio::ip::tcp::socket& sock, apc_tcp_info_s * pInfo)
+{
+   memset(pInfo, 0, sizeof(*pInfo));
+#if !defined(WIN32) && defined(TCP_INFO)
+   struct tcp_info info;
+   socklen_t       len = sizeof(info);
+   memset(&info, 0, sizeof(info));
+   if (!sock.is_open() || getsockopt(sock.native_handle(), IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+      return false;
+   pInfo->m_rttUsec      = info.tcpi_rtt;
+   pInfo->m_rttVarUsec   = info.tcpi_rttvar;
+   pInfo->m_cwnd         = info.tcpi_snd_cwnd;
+   pInfo->m_unacked      = info.tcpi_unacked;
+   pInfo->m_lost         = info.tcpi_lost;
+   pInfo->m_totalRetrans = info.tcpi_total_retrans;
+   return true;
+#else
+   return false;
+#endif
+}
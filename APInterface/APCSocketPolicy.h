@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <string>
+
+#include "common.h"
+#include "public/IAPCCommon.h"
+
+/**
+ * TCP options of manager connection. 0 / false - kernel default is kept
+ */
+struct apc_sock_policy_s {
+   const char * m_name;
+   bool         m_noDelay;          ///< Disable Nagle algorithm (TCP_NODELAY)
+   bool         m_cork;             ///< Cork socket while several messages are written (TCP_CORK)
+   uint32_t     m_sndBuf;           ///< SO_SNDBUF, bytes
+   uint32_t     m_rcvBuf;           ///< SO_RCVBUF, bytes
+   uint32_t     m_userTimeoutMsec;  ///< TCP_USER_TIMEOUT: max time of unacknowledged data
+   uint32_t     m_kaIdleSec;        ///< TCP keepalive: idle time before first probe (0 - keepalive is off)
+   uint32_t     m_kaIntervalSec;    ///< TCP keepalive: interval between probes
+   uint32_t     m_kaCount;          ///< TCP keepalive: number of probes
+};
+
+/**
+ * Named socket policies (profiles) of manager connection
+ *
+ *   default     - kernel defaults
+ *   low-latency - Nagle is off: small messages (KA, TXDONE) are sent immediately
+ *   bulk        - Nagle and corking, large buffers: fewer segments at higher latency
+ *   cellular    - Nagle is off, bursts are corked, dead links are detected by 
+ *                 TCP keepalive and user timeout
+ */
+class CAPCSocketPolicy {
+public:
+   // Find policy by name. NULL if not found
+   static const apc_sock_policy_s * find(const std::string& name);
+   // Names of all policies, comma separated
+   static std::string   getNames();
+
+   // Apply policy to connected socket. Failed options are logged and ignored
+   static void          apply(boost::asio::ip::tcp::socket& sock, const apc_sock_policy_s& policy, 
+                              const std::string& logName);
+   // Set / clear TCP_CORK. Clearing sends held data
+   static void          setCork(boost::asio::ip::tcp::socket& sock, bool isCork);
+   // Read TCP_INFO. false if it is not supported
+   static bool          getTcpInfo(boost::asio::ip::tcp::socket& sock, apc_tcp_info_s * pInfo);
+};
@@ -0,0 +1,516 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "APCTransport.h"
+
+#include <algorithm>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const int SHM_NUM_FDS = 3;   // memfd, doorbell of apc, doorbell of manager
+
+apc_transport_t apcParseTransport(const std::string& host, std::string * pPath)
+{
+   static const struct {
+      const char    * m_prefix;
+      apc_transport_t m_transport;
+   } PREFIXES[] = {
+      { "unix:", APC_TRANSPORT_UNIX },
+      { "shm:",  APC_TRANSPORT_SHM  },
+   };
+   for (const auto& p : PREFIXES) {
+      size_t len = strlen(p.m_prefix);
+      if (host.compare(0, len, p.m_prefix) == 0) {
+         if (pPath)
+            *pPath = host.substr(len);
+         return p.m_transport;
+      }
+   }
+   return APC_TRANSPORT_TCP;
+}
+
+static std::string sysError(const char * op)
+{
+   return std::string(op) + ": " + strerror(errno);
+}
+
+static int setCloexec(int fd, bool isNonBlock)
+{
+   if (fd < 0)
+      return fd;
+   int flags = fcntl(fd, F_GETFL);
+   if (fcntl(fd, F_SETFD, FD_CLOEXEC) != 0 || 
+       (isNonBlock && (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0))) {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+// Anonymous shared memory. Old C libraries (armpi toolchain) have no memfd_create:
+// unlinked temporary file is used
+static int shmCreateFd()
+{
+#ifdef MFD_CLOEXEC
+   return memfd_create("apc_shm", MFD_CLOEXEC);
+#else
+   char path[] = "/dev/shm/apc_shm.XXXXXX";
+   int  fd = mkstemp(path);
+   if (fd < 0) {
+      strcpy(path, "/tmp/apc_shm.XXXXXX");
+      fd = mkstemp(path);
+   }
+   if (fd >= 0)
+      unlink(path);
+   return setCloexec(fd, false);
+#endif
+}
+
+static int doorbellCreateFd()
+{
+#if defined(EFD_NONBLOCK) && defined(EFD_CLOEXEC)
+   return eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+   return setCloexec(eventfd(0, 0), true);
+#endif
+}
+
+/////////////////////////////////////////////////
+//    Socket transports
+/////////////////////////////////////////////////
+template <>
+std::string CAPCTcpTransport::getName() const
+{
+   std::ostringstream        os;
+   boost::system::error_code ec;
+   os << "tcp " << m_socket.local_endpoint(ec) << " - " << m_socket.remote_endpoint(ec);
+   return os.str();
+}
+
+template <>
+boost::asio::ip::tcp::socket * CAPCTcpTransport::getTcpSocket()
+{
+   return &m_socket;
+}
+
+template <>
+std::string CAPCUnixTransport::getName() const
+{
+   // Socket path is the address of listening (manager) side
+   boost::system::error_code ec;
+   std::string path = m_socket.remote_endpoint(ec).path();
+   if (path.empty())
+      path = m_socket.local_endpoint(ec).path();
+   return "unix " + path;
+}
+
+template <>
+boost::asio::ip::tcp::socket * CAPCUnixTransport::getTcpSocket()
+{
+   return NULL;
+}
+
+/////////////////////////////////////////////////
+//    CAPCShmTransport
+/////////////////////////////////////////////////
+
+// Ring header in shared memory. Counters of producer and consumer are in
+// separate cache lines
+struct CAPCShmTransport::ring_s {
+   boost::atomic<uint32_t> m_head;               // Bytes written by producer
+   uint8_t                 m_pad1[60];
+   boost::atomic<uint32_t> m_tail;               // Bytes read by consumer
+   uint8_t                 m_pad2[60];
+   boost::atomic<uint32_t> m_isConsumerWaiting;  // Consumer waits for doorbell (ring is empty)
+   boost::atomic<uint32_t> m_isProducerWaiting;  // Producer waits for doorbell (ring is full)
+   uint8_t                 m_pad3[56];
+
+   ring_s() : m_head(0), m_tail(0), m_isConsumerWaiting(0), m_isProducerWaiting(0) {;}
+};
+
+// Sent with descriptors
+struct shm_hello_s {
+   uint32_t m_magic;
+   uint16_t m_version;
+   uint16_t m_reserved;
+   uint32_t m_ringSize;
+};
+
+static size_t shmSize(uint32_t ringSize, size_t ringHdrSize)
+{
+   return 2 * ringHdrSize + 2 * (size_t)ringSize;
+}
+
+IAPCTransport::ptr CAPCShmTransport::create(boost::asio::io_service& ioService, socket_t&& sock,
+                                            std::string * pError)
+{
+   const uint32_t ringSize = SHM_RING_SIZE;
+   size_t         memSize  = shmSize(ringSize, sizeof(ring_s));
+   int            fds[SHM_NUM_FDS] = { -1, -1, -1 };
+   void         * pMem = MAP_FAILED;
+   std::string    err;
+
+   fds[0] = shmCreateFd();
+   if (fds[0] < 0 || ftruncate(fds[0], memSize) != 0)
+      err = sysError("shared memory");
+   if (err.empty()) {
+      pMem = mmap(NULL, memSize, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+      if (pMem == MAP_FAILED)
+         err = sysError("mmap");
+   }
+   if (err.empty()) {
+      fds[1] = doorbellCreateFd();
+      fds[2] = doorbellCreateFd();
+      if (fds[1] < 0 || fds[2] < 0)
+         err = sysError("eventfd");
+   }
+   if (err.empty()) {
+      ring_s * pRings = static_cast<ring_s *>(pMem);
+      new (&pRings[0]) ring_s();
+      new (&pRings[1]) ring_s();
+
+      shm_hello_s hello = { SHM_MAGIC, SHM_VERSION, 0, ringSize };
+      char        ctrl[CMSG_SPACE(sizeof(fds))];
+      iovec       iov = { &hello, sizeof(hello) };
+      msghdr      msg;
+      memset(&msg, 0, sizeof(msg));
+      memset(ctrl, 0, sizeof(ctrl));
+      msg.msg_iov        = &iov;
+      msg.msg_iovlen     = 1;
+      msg.msg_control    = ctrl;
+      msg.msg_controllen = sizeof(ctrl);
+      cmsghdr * pCmsg = CMSG_FIRSTHDR(&msg);
+      pCmsg->cmsg_level = SOL_SOCKET;
+      pCmsg->cmsg_type  = SCM_RIGHTS;
+      pCmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+      memcpy(CMSG_DATA(pCmsg), fds, sizeof(fds));
+      if (sendmsg(sock.native_handle(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)sizeof(hello))
+         err = sysError("send of shared memory");
+   }
+   // Mapping is kept without descriptor
+   if (fds[0] >= 0)
+      ::close(fds[0]);
+   if (!err.empty()) {
+      if (pMem != MAP_FAILED)
+         munmap(pMem, memSize);
+      for (int i = 1; i < SHM_NUM_FDS; i++) {
+         if (fds[i] >= 0)
+            ::close(fds[i]);
+      }
+      *pError = err;
+      return IAPCTransport::ptr();
+   }
+
+   boost::shared_ptr<CAPCShmTransport> p(new CAPCShmTransport(ioService, std::move(sock),
+                                                              static_cast<uint8_t *>(pMem), memSize,
+                                                              ringSize, fds[1], fds[2], true));
+   p->start_p();
+   return p;
+}
+
+void CAPCShmTransport::asyncAccept(boost::asio::io_service& ioService, boost::shared_ptr<socket_t> sock,
+                                   accept_handler_t handler)
+{
+   sock->async_read_some(boost::asio::null_buffers(),
+                         boost::bind(&CAPCShmTransport::handleAcceptRead_p, boost::ref(ioService), sock,
+                                     handler, boost::asio::placeholders::error));
+}
+
+void CAPCShmTransport::handleAcceptRead_p(boost::asio::io_service& ioService, boost::shared_ptr<socket_t> sock,
+                                          accept_handler_t handler, const boost::system::error_code& error)
+{
+   if (error) {
+      handler(IAPCTransport::ptr(), error.message());
+      return;
+   }
+
+   shm_hello_s hello;
+   int         fds[SHM_NUM_FDS] = { -1, -1, -1 };
+   size_t      numFds = 0;
+   char        ctrl[CMSG_SPACE(sizeof(fds))];
+   iovec       iov = { &hello, sizeof(hello) };
+   msghdr      msg;
+   memset(&hello, 0, sizeof(hello));
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov        = &iov;
+   msg.msg_iovlen     = 1;
+   msg.msg_control    = ctrl;
+   msg.msg_controllen = sizeof(ctrl);
+   ssize_t len = recvmsg(sock->native_handle(), &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+   if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      asyncAccept(ioService, sock, handler);
+      return;
+   }
+   std::string err = len < 0 ? sysError("receive of shared memory") : "";
+   for (cmsghdr * pCmsg = len < 0 ? NULL : CMSG_FIRSTHDR(&msg); pCmsg != NULL; pCmsg = CMSG_NXTHDR(&msg, pCmsg)) {
+      if (pCmsg->cmsg_level == SOL_SOCKET && pCmsg->cmsg_type == SCM_RIGHTS) {
+         numFds = std::min((pCmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int), (size_t)SHM_NUM_FDS);
+         memcpy(fds, CMSG_DATA(pCmsg), numFds * sizeof(int));
+      }
+   }
+   if (err.empty() && (len != (ssize_t)sizeof(hello) || numFds != SHM_NUM_FDS || hello.m_magic != SHM_MAGIC))
+      err = "not a shared memory request";
+   if (err.empty() && hello.m_version != SHM_VERSION)
+      err = "unsupported shared memory version";
+   if (err.empty() && (hello.m_ringSize == 0 || (hello.m_ringSize & (hello.m_ringSize - 1)) != 0))
+      err = "invalid ring size";
+
+   size_t      memSize = shmSize(hello.m_ringSize, sizeof(ring_s));
+   void      * pMem = MAP_FAILED;
+   struct stat st;
+   if (err.empty() && (fstat(fds[0], &st) != 0 || (size_t)st.st_size < memSize))
+      err = "shared memory is too small";
+   if (err.empty()) {
+      pMem = mmap(NULL, memSize, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+      if (pMem == MAP_FAILED)
+         err = sysError("mmap");
+   }
+   if (fds[0] >= 0)
+      ::close(fds[0]);
+   if (!err.empty()) {
+      for (int i = 1; i < SHM_NUM_FDS; i++) {
+         if (fds[i] >= 0)
+            ::close(fds[i]);
+      }
+      handler(IAPCTransport::ptr(), err);
+      return;
+   }
+
+   boost::shared_ptr<CAPCShmTransport> p(new CAPCShmTransport(ioService, std::move(*sock),
+                                                              static_cast<uint8_t *>(pMem), memSize,
+                                                              hello.m_ringSize, fds[2], fds[1], false));
+   p->start_p();
+   handler(p, "");
+}
+
+CAPCShmTransport::CAPCShmTransport(boost::asio::io_service& ioService, socket_t&& sock, uint8_t * pMem,
+                                   size_t memSize, uint32_t ringSize, int doorbellFd, int peerDoorbellFd,
+                                   bool isApc)
+   : m_ioService(ioService),
+     m_socket(std::move(sock)),
+     m_doorbell(ioService, doorbellFd),
+     m_peerDoorbell(peerDoorbellFd),
+     m_pMem(pMem),
+     m_memSize(memSize),
+     m_ringSize(ringSize),
+     m_doorbellValue(0),
+     m_peerByte(0),
+     m_isOpen(true),
+     m_isPeerClosed(false),
+     m_isReading(false),
+     m_readBuf(NULL),
+     m_readSize(0)
+{
+   ring_s  * pRings = reinterpret_cast<ring_s *>(pMem);
+   uint8_t * pData  = pMem + 2 * sizeof(ring_s);
+   m_pTx    = isApc ? &pRings[0] : &pRings[1];
+   m_pRx    = isApc ? &pRings[1] : &pRings[0];
+   m_txData = isApc ? pData : pData + ringSize;
+   m_rxData = isApc ? pData + ringSize : pData;
+
+   boost::system::error_code ec;
+   std::string path = isApc ? m_socket.remote_endpoint(ec).path() : m_socket.local_endpoint(ec).path();
+   m_name = "shm " + path;
+}
+
+CAPCShmTransport::~CAPCShmTransport()
+{
+   if (m_pMem != NULL)
+      munmap(m_pMem, m_memSize);
+   if (m_peerDoorbell >= 0)
+      ::close(m_peerDoorbell);
+}
+
+void CAPCShmTransport::start_p()
+{
+   // Peer does not send anything to socket: completion is its closing
+   m_socket.async_read_some(boost::asio::buffer(&m_peerByte, sizeof(m_peerByte)),
+                            boost::bind(&CAPCShmTransport::handlePeerRead_p, shared_from_this(),
+                                        boost::asio::placeholders::error,
+                                        boost::asio::placeholders::bytes_transferred));
+   startDoorbellRead_p();
+}
+
+void CAPCShmTransport::startDoorbellRead_p()
+{
+   m_doorbell.async_read_some(boost::asio::buffer(&m_doorbellValue, sizeof(m_doorbellValue)),
+                              boost::bind(&CAPCShmTransport::handleDoorbell_p, shared_from_this(),
+                                          boost::asio::placeholders::error,
+                                          boost::asio::placeholders::bytes_transferred));
+}
+
+void CAPCShmTransport::asyncRead(uint8_t * buf, size_t size, handler_t handler)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (!m_isOpen) {
+      complete_p(handler, boost::asio::error::bad_descriptor, 0);
+      return;
+   }
+   m_isReading   = true;
+   m_readBuf     = buf;
+   m_readSize    = size;
+   m_readHandler = handler;
+   pump_p();
+}
+
+void CAPCShmTransport::asyncWrite(const uint8_t * buf, size_t size, handler_t handler)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (!m_isOpen) {
+      complete_p(handler, boost::asio::error::bad_descriptor, 0);
+      return;
+   }
+   write_s w = { buf, size, 0, handler };
+   m_writes.push_back(w);
+   pump_p();
+}
+
+void CAPCShmTransport::close()
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (!m_isOpen)
+      return;
+   m_isOpen = false;
+   boost::system::error_code ec;
+   m_doorbell.close(ec);
+   m_socket.close(ec);
+   if (m_isReading) {
+      m_isReading = false;
+      complete_p(m_readHandler, boost::asio::error::operation_aborted, 0);
+      m_readHandler = nullptr;
+   }
+   for (auto& w : m_writes)
+      complete_p(w.m_handler, boost::asio::error::operation_aborted, w.m_done);
+   m_writes.clear();
+}
+
+void CAPCShmTransport::handleDoorbell_p(const boost::system::error_code& error, size_t size)
+{
+   if (error)
+      return;              // Transport is closed
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (!m_isOpen)
+      return;
+   pump_p();
+   startDoorbellRead_p();
+}
+
+void CAPCShmTransport::handlePeerRead_p(const boost::system::error_code& error, size_t size)
+{
+   if (error == boost::asio::error::operation_aborted)
+      return;
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (!m_isOpen)
+      return;
+   // Data written before closing is still delivered
+   m_isPeerClosed = true;
+   pump_p();
+}
+
+void CAPCShmTransport::pump_p()
+{
+   bool isRing = pumpRead_p();
+   if (pumpWrite_p())
+      isRing = true;
+   if (isRing)
+      ringPeer_p();
+}
+
+// Waiting flag is set before the ring is checked again, and the peer checks
+// the flag after moving its counter (sequentially consistent): either the
+// peer sees the flag and rings, or this side sees the new counter
+bool CAPCShmTransport::pumpRead_p()
+{
+   if (!m_isReading)
+      return false;
+   uint32_t tail  = m_pRx->m_tail.load(boost::memory_order_relaxed);
+   uint32_t avail = m_pRx->m_head.load(boost::memory_order_acquire) - tail;
+   if (avail == 0) {
+      if (m_isPeerClosed) {
+         m_isReading = false;
+         complete_p(m_readHandler, boost::asio::error::eof, 0);
+         m_readHandler = nullptr;
+         return false;
+      }
+      m_pRx->m_isConsumerWaiting.store(1);
+      avail = m_pRx->m_head.load() - tail;
+      if (avail == 0)
+         return false;
+   }
+   m_pRx->m_isConsumerWaiting.store(0, boost::memory_order_relaxed);
+
+   uint32_t size  = (uint32_t)std::min((size_t)avail, m_readSize);
+   uint32_t pos   = tail & (m_ringSize - 1);
+   uint32_t first = std::min(size, m_ringSize - pos);
+   memcpy(m_readBuf, m_rxData + pos, first);
+   memcpy(m_readBuf + first, m_rxData, size - first);
+   m_pRx->m_tail.store(tail + size);
+
+   m_isReading = false;
+   complete_p(m_readHandler, boost::system::error_code(), size);
+   m_readHandler = nullptr;
+   return m_pRx->m_isProducerWaiting.load() != 0;
+}
+
+bool CAPCShmTransport::pumpWrite_p()
+{
+   bool isRing = false;
+   while (!m_writes.empty()) {
+      write_s& w = m_writes.front();
+      if (m_isPeerClosed) {
+         complete_p(w.m_handler, boost::asio::error::broken_pipe, w.m_done);
+         m_writes.pop_front();
+         continue;
+      }
+      uint32_t head  = m_pTx->m_head.load(boost::memory_order_relaxed);
+      uint32_t space = m_ringSize - (head - m_pTx->m_tail.load(boost::memory_order_acquire));
+      if (space == 0) {
+         m_pTx->m_isProducerWaiting.store(1);
+         space = m_ringSize - (head - m_pTx->m_tail.load());
+         if (space == 0)
+            break;
+      }
+      m_pTx->m_isProducerWaiting.store(0, boost::memory_order_relaxed);
+
+      uint32_t size  = (uint32_t)std::min((size_t)space, w.m_size - w.m_done);
+      uint32_t pos   = head & (m_ringSize - 1);
+      uint32_t first = std::min(size, m_ringSize - pos);
+      memcpy(m_txData + pos, w.m_buf + w.m_done, first);
+      memcpy(m_txData, w.m_buf + w.m_done + first, size - first);
+      m_pTx->m_head.store(head + size);
+      if (m_pTx->m_isConsumerWaiting.load() != 0)
+         isRing = true;
+
+      w.m_done += size;
+      if (w.m_done == w.m_size) {
+         complete_p(w.m_handler, boost::system::error_code(), w.m_size);
+         m_writes.pop_front();
+      }
+   }
+   return isRing;
+}
+
+void CAPCShmTransport::ringPeer_p()
+{
+   uint64_t one = 1;
+   // Counter of eventfd can not overflow in practice: failure is ignored
+   ssize_t  rc = ::write(m_peerDoorbell, &one, sizeof(one));
+   (void)rc;
+}
+
+void CAPCShmTransport::complete_p(const handler_t& handler, const boost::system::error_code& error, size_t size)
+{
+   m_ioService.post(std::bind(handler, error, size));
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "common.h"
+
+/**
+ * Transport of APC connection
+ */
+enum apc_transport_t {
+   APC_TRANSPORT_TCP  = 0,   // TCP socket (default)
+   APC_TRANSPORT_UNIX = 1,   // AF_UNIX stream socket, manager on the same host
+   APC_TRANSPORT_SHM  = 2,   // Shared memory rings, manager on the same host
+};
+
+// Transport of manager address: "unix:PATH", "shm:PATH" or TCP host name.
+// 'pPath' - socket path of local transports
+apc_transport_t apcParseTransport(const std::string& host, std::string * pPath);
+
+/**
+ * Byte stream of APC connection
+ *
+ * CAPCConnector (and manager emulator) read and write serialized APC messages
+ * through it: message format, sequence numbers and cache replay do not depend
+ * on transport. Completion handlers are called by IO service thread, never
+ * from the initiating call.
+ */
+class IAPCTransport {
+public:
+   typedef boost::shared_ptr<IAPCTransport> ptr;
+   typedef std::function<void(const boost::system::error_code&, size_t)> handler_t;
+
+   virtual ~IAPCTransport() {;}
+
+   // Read at least one byte. Only one read is pending at a time
+   virtual void asyncRead(uint8_t * buf, size_t size, handler_t handler) = 0;
+   // Write all bytes. Buffer must be valid until handler is called
+   virtual void asyncWrite(const uint8_t * buf, size_t size, handler_t handler) = 0;
+   // Close transport. Pending operations are completed with error
+   virtual void close() = 0;
+   virtual bool isOpen() const = 0;
+   // Transport and addresses for logs
+   virtual std::string getName() const = 0;
+   // TCP socket (socket policy, TCP_INFO). NULL for other transports
+   virtual boost::asio::ip::tcp::socket * getTcpSocket() { return NULL; }
+};
+
+/**
+ * Socket transport (TCP or AF_UNIX stream socket)
+ */
+template <class Protocol>
+class CAPCSocketTransport : public IAPCTransport {
+public:
+   typedef typename Protocol::socket socket_t;
+
+   explicit CAPCSocketTransport(socket_t&& sock) : m_socket(std::move(sock)) {;}
+
+   virtual void asyncRead(uint8_t * buf, size_t size, handler_t handler) {
+      m_socket.async_read_some(boost::asio::buffer(buf, size), handler);
+   }
+   virtual void asyncWrite(const uint8_t * buf, size_t size, handler_t handler) {
+      boost::asio::async_write(m_socket, boost::asio::buffer(buf, size), handler);
+   }
+   virtual void close() {
+      boost::system::error_code ec;
+      m_socket.close(ec);
+   }
+   virtual bool isOpen() const { return m_socket.is_open(); }
+   virtual std::string getName() const;
+   virtual boost::asio::ip::tcp::socket * getTcpSocket();
+
+private:
+   socket_t  m_socket;
+};
+
+typedef CAPCSocketTransport<boost::asio::ip::tcp>                 CAPCTcpTransport;
+typedef CAPCSocketTransport<boost::asio::local::stream_protocol>  CAPCUnixTransport;
+
+template <> std::string CAPCTcpTransport::getName() const;
+template <> boost::asio::ip::tcp::socket * CAPCTcpTransport::getTcpSocket();
+template <> std::string CAPCUnixTransport::getName() const;
+template <> boost::asio::ip::tcp::socket * CAPCUnixTransport::getTcpSocket();
+
+/**
+ * Shared memory transport
+ *
+ * apc connects to AF_UNIX socket of manager and passes to it (SCM_RIGHTS)
+ * memfd with two byte rings and two eventfd "doorbells", one per side.
+ * Ring 0 carries data apc -> manager, ring 1 manager -> apc. Every ring has
+ * one producer and one consumer: head and tail are atomic byte counters, no
+ * lock is shared between processes. The doorbell of peer is rung only when
+ * the peer waits for data (consumer) or for space (producer), so a busy
+ * stream is passed without system calls. The socket is kept open: peer sees
+ * its closing as end of stream.
+ */
+class CAPCShmTransport : public IAPCTransport, public boost::enable_shared_from_this<CAPCShmTransport> {
+public:
+   typedef boost::asio::local::stream_protocol::socket              socket_t;
+   typedef std::function<void(IAPCTransport::ptr, const std::string&)> accept_handler_t;
+
+   static const uint32_t SHM_MAGIC     = 0x4d485341;   // "ASHM"
+   static const uint16_t SHM_VERSION   = 1;
+   static const uint32_t SHM_RING_SIZE = 256 * 1024;   // Bytes per direction, power of 2
+
+   // apc side: create shared memory and pass it to manager over connected socket.
+   // NULL on error ('pError' - description)
+   static IAPCTransport::ptr create(boost::asio::io_service& ioService, socket_t&& sock, std::string * pError);
+   // Manager side: receive shared memory from accepted socket. 'handler' gets
+   // transport or NULL and error description
+   static void asyncAccept(boost::asio::io_service& ioService, boost::shared_ptr<socket_t> sock,
+                           accept_handler_t handler);
+
+   virtual ~CAPCShmTransport();
+
+   // IAPCTransport
+   virtual void asyncRead(uint8_t * buf, size_t size, handler_t handler);
+   virtual void asyncWrite(const uint8_t * buf, size_t size, handler_t handler);
+   virtual void close();
+   virtual bool isOpen() const { return m_isOpen; }
+   virtual std::string getName() const { return m_name; }
+
+private:
+   struct ring_s;
+   struct write_s {
+      const uint8_t * m_buf;
+      size_t          m_size;
+      size_t          m_done;
+      handler_t       m_handler;
+   };
+
+   CAPCShmTransport(boost::asio::io_service& ioService, socket_t&& sock, uint8_t * pMem, size_t memSize,
+                    uint32_t ringSize, int doorbellFd, int peerDoorbellFd, bool isApc);
+
+   static void handleAcceptRead_p(boost::asio::io_service& ioService, boost::shared_ptr<socket_t> sock,
+                                  accept_handler_t handler, const boost::system::error_code& error);
+
+   void start_p();
+   void startDoorbellRead_p();
+   void handleDoorbell_p(const boost::system::error_code& error, size_t size);
+   void handlePeerRead_p(const boost::system::error_code& error, size_t size);
+   // Move data between rings and pending operations. Called under m_lock
+   void pump_p();
+   bool pumpRead_p();
+   bool pumpWrite_p();
+   void ringPeer_p();
+   void complete_p(const handler_t& handler, const boost::system::error_code& error, size_t size);
+
+   boost::asio::io_service&              m_ioService;
+   socket_t                              m_socket;        // Rendezvous socket, kept for liveness of peer
+   boost::asio::posix::stream_descriptor m_doorbell;      // Own eventfd, rung by peer
+   int                                   m_peerDoorbell;  // eventfd of peer
+   uint8_t                             * m_pMem;          // Mapped shared memory
+   size_t                                m_memSize;
+   uint32_t                              m_ringSize;      // Bytes per direction, power of 2
+   ring_s                              * m_pTx;
+   ring_s                              * m_pRx;
+   uint8_t                             * m_txData;
+   uint8_t                             * m_rxData;
+   uint64_t                              m_doorbellValue; // Buffer of doorbell read
+   uint8_t                               m_peerByte;      // Buffer of socket read
+   std::string                           m_name;
+
+   boost::mutex                          m_lock;
+   bool                                  m_isOpen;
+   bool                                  m_isPeerClosed;
+   bool                                  m_isReading;     // Read is pending
+   uint8_t                             * m_readBuf;
+   size_t                                m_readSize;
+   handler_t                             m_readHandler;
+   std::deque<write_s>                   m_writes;        // Pending writes in order of calls
+};
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "APCUpstreamSched.h"
+#include "MoteTrafficStats.h"
+#include "6lowpan/6lowpanhdr.h"
+
+using namespace std;
+
+CAPCUpstreamSched::CAPCUpstreamSched() : m_numMsgs(0)
+{
+   clearStat();
+}
+
+apc_upclass_t CAPCUpstreamSched::getClass(apc_msg_type_t type, const uint8_t * payload, uint16_t size)
+{
+   if (type != APC_NET_RX)
+      return APC_UPCLASS_CONTROL;
+   mote_addr_s addr;
+   uint8_t     priority;
+   if (!CMoteTrafficStats::parseMeshHdr(payload, size, &addr, &priority))
+      return APC_UPCLASS_NORMAL;
+   return (apc_upclass_t)(APC_UPCLASS_CMD + PKT_PRIORITY_CMD - priority);
+}
+
+apc_error_t CAPCUpstreamSched::push(apc_msg_type_t type, const uint8_t * payload1, uint16_t size1,
+                                    const uint8_t * payload2, uint16_t size2, size_t maxMsgs)
+{
+   apc_upclass_t upClass = getClass(type, payload1, size1);
+   if (upClass != APC_UPCLASS_CONTROL && m_numMsgs >= maxMsgs) {
+      m_numRejected++;
+      return APC_ERR_OUTBUFOVERFLOW;
+   }
+
+   // Message is sent before all waiting messages of lower classes
+   for (int c = upClass + 1; c < APC_UPCLASS_NUM; c++) {
+      if (!m_queues[c].empty()) {
+         m_numBypassed++;
+         break;
+      }
+   }
+
+   m_queues[upClass].push_back(msg_s());
+   msg_s& msg = m_queues[upClass].back();
+   msg.m_type = type;
+   if (!m_freeBufs.empty()) {
+      msg.m_payload.swap(m_freeBufs.back());
+      m_freeBufs.pop_back();
+   }
+   msg.m_payload.assign(payload1, payload1 + size1);
+   if (size2 > 0)
+      msg.m_payload.insert(msg.m_payload.end(), payload2, payload2 + size2);
+
+   m_numHeld++;
+   if (++m_numMsgs > m_maxQueued)
+      m_maxQueued = (uint32_t)m_numMsgs;
+   return APC_OK;
+}
+
+const CAPCUpstreamSched::msg_s& CAPCUpstreamSched::front() const
+{
+   int c = 0;
+   while (m_queues[c].empty())
+      c++;
+   return m_queues[c].front();
+}
+
+void CAPCUpstreamSched::pop()
+{
+   for (int c = 0; c < APC_UPCLASS_NUM; c++) {
+      if (m_queues[c].empty())
+         continue;
+      m_freeBufs.push_back(vector<uint8_t>());
+      m_freeBufs.back().swap(m_queues[c].front().m_payload);
+      m_queues[c].pop_front();
+      m_numMsgs--;
+      return;
+   }
+}
+
+void CAPCUpstreamSched::clear()
+{
+   for (int c = 0; c < APC_UPCLASS_NUM; c++)
+      m_queues[c].clear();
+   m_freeBufs.clear();
+   m_numMsgs = 0;
+}
+
+void CAPCUpstreamSched::getStat(apc_sched_stats_s * pStat) const
+{
+   pStat->m_numQueued   = (uint32_t)m_numMsgs;
+   pStat->m_maxQueued   = m_maxQueued;
+   pStat->m_numHeld     = m_numHeld;
+   pStat->m_numBypassed = m_numBypassed;
+   pStat->m_numRejected = m_numRejected;
+}
+
+void CAPCUpstreamSched::clearStat()
+{
+   m_maxQueued   = (uint32_t)m_numMsgs;
+   m_numHeld     = 0;
+   m_numBypassed = 0;
+   m_numRejected = 0;
+}
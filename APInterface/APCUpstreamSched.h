@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "common.h"
+#include "APCProto.h"
+#include "public/APCError.h"
+#include "public/IAPCCommon.h"
+
+/**
+ * Priority classes of upstream messages, from the highest
+ */
+enum apc_upclass_t {
+   APC_UPCLASS_CONTROL,   ///< Messages of APC: TX done, time map, AP lost, pause / resume
+   APC_UPCLASS_CMD,       ///< Mesh packets by priority of mesh specifier
+   APC_UPCLASS_DATA,
+   APC_UPCLASS_NORMAL,
+   APC_UPCLASS_LOWEST,
+   APC_UPCLASS_NUM,
+};
+
+/**
+ * Priority scheduler of upstream messages
+ *
+ * Messages wait here while output to manager is busy (no free output
+ * buffer of connector or no credit of manager). CAPCClient takes them by
+ * priority class (FIFO inside of class) and assigns sequence number when
+ * the message is passed to connector. So control messages and high priority
+ * mesh packets bypass waiting bulk data, but sequence numbers still follow
+ * the order of sending and CAPCCache replay is not changed.
+ *
+ * Control messages are always accepted, mesh packets are rejected when
+ * 'maxMsgs' messages are waiting (free space of CAPCCache: waiting messages
+ * are moved there on disconnection). Messages the cache does not accept are
+ * counted as rejected too (see addRejected). Object is used under lock of CAPCClient.
+ */
+class CAPCUpstreamSched {
+public:
+   struct msg_s {
+      apc_msg_type_t       m_type;
+      std::vector<uint8_t> m_payload;
+   };
+
+   CAPCUpstreamSched();
+
+   // Add copy of message (parts are joined). APC_ERR_OUTBUFOVERFLOW if 'maxMsgs' are waiting
+   apc_error_t  push(apc_msg_type_t type, const uint8_t * payload1, uint16_t size1,
+                     const uint8_t * payload2, uint16_t size2, size_t maxMsgs);
+   // The first message of the highest class (scheduler is not empty)
+   const msg_s& front() const;
+   void         pop();
+   void         clear();
+
+   bool         empty() const { return m_numMsgs == 0; }
+   size_t       getNumMsgs() const { return m_numMsgs; }
+
+   void         getStat(apc_sched_stats_s * pStat) const;
+   void         clearStat();
+   // Waiting messages were dropped by owner (not accepted by cache)
+   void         addRejected(size_t num) { m_numRejected += num; }
+
+   // Priority class of message. APC_NET_RX is classified by mesh header of packet
+   static apc_upclass_t getClass(apc_msg_type_t type, const uint8_t * payload, uint16_t size);
+
+private:
+   std::deque<msg_s>                 m_queues[APC_UPCLASS_NUM];
+   std::vector<std::vector<uint8_t>> m_freeBufs;   // Payload buffers of sent messages for reuse
+   size_t                            m_numMsgs;
+
+   uint32_t                          m_maxQueued;
+   uint64_t                          m_numHeld;
+   uint64_t                          m_numBypassed;
+   uint64_t                          m_numRejected;
+};
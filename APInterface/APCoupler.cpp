@@ -22,6 +22,8 @@
 #include "6lowpan/public/dn_api_net.h" //For Clock Source Constants
 #include "common/IChangeNodeState.h"
 #include "APCProto.h"
+#include "AsyncLog.h"
+#include "FlightRecorder.h"
 
 using namespace std;
 // Manage the protocol with the AP, integrate with AP Connector
@@ -108,6 +110,8 @@ apc_error_t CAPCoupler::open(init_param_t& init_params)
    m_disconnectTimeoutShortMsec = init_params.disconnectShortBootTimeoutMsec;
    m_disconnectTimeoutLongMsec  = init_params.disconnectLongBootTimeoutMsec;
    m_apClkSource                = init_params.apClkSource;
+
+   m_moteStats.setSize(init_params.moteStatsSize);
    
    //m_smThread = new boost::thread(boost::bind(&CAPCoupler::smThreadFun_p, this));
    return APC_OK;
@@ -160,8 +164,7 @@ void CAPCoupler::disconnected(apc_stop_reason_t reason)
 void CAPCoupler::dataRx(const ap_intf_sendhdr_t& hdr,
                         const uint8_t * pPayload, uint32_t size)
 {
-   DUSTLOG_DEBUG(m_logname, "Manager RX dst=" << hdr.dst << " len=" << size
-                 << " txDoneId=" << hdr.txDoneId);
+   DUSTLOG_ASYNC_DEBUG(m_logname, "Manager RX dst={} len={} txDoneId={}", hdr.dst, size, hdr.txDoneId);
    
    // construct the AP Send header
    // note: byte ordering is handled in the send method
@@ -173,13 +176,17 @@ void CAPCoupler::dataRx(const ap_intf_sendhdr_t& hdr,
    apHdr.timeslot = hdr.slot;
    apHdr.channel  = hdr.offset;
    apHdr.dest     = hdr.dst;
+   if (hdr.isTxDoneRequested)
+      m_txDoneTracker.received(hdr.txDoneId, hdr.rxTime);
    // send data to AP Queue
-   sendApSend(apHdr, pPayload, size);
+   if (sendApSend(apHdr, pPayload, size, hdr.isTxDoneRequested) != APC_OK && hdr.isTxDoneRequested)
+      m_txDoneTracker.failed(hdr.txDoneId);
 }
 
 void CAPCoupler::resume()
 {
    DUSTLOG_INFO(m_logname, "Manager Resume");
+   CFlightRecorder::record(FLIGHTREC_CPL_RESUME);
    if (m_transport)
       m_transport->setAPMState(APM_FLOW_NORMAL);
 }
@@ -187,6 +194,7 @@ void CAPCoupler::resume()
 void CAPCoupler::pause()
 {
    DUSTLOG_INFO(m_logname, "Manager Pause");
+   CFlightRecorder::record(FLIGHTREC_CPL_PAUSE);
    if (m_transport)
       m_transport->setAPMState(APM_FLOW_PAUSE);
 }
@@ -194,6 +202,7 @@ void CAPCoupler::pause()
 void CAPCoupler::offline(apc_stop_reason_t reason)
 {
    DUSTLOG_INFO(m_logname, "Manager Offline: " << toString(reason));
+   CFlightRecorder::record(FLIGHTREC_CPL_OFFLINE, reason);
    if (m_transport)
       m_transport->setAPMState(APM_FLOW_PAUSE);
 }
@@ -201,6 +210,7 @@ void CAPCoupler::offline(apc_stop_reason_t reason)
 void CAPCoupler::online()
 {
    DUSTLOG_INFO(m_logname, "Manager Online");
+   CFlightRecorder::record(FLIGHTREC_CPL_ONLINE);
    if (m_transport)
       m_transport->setAPMState(APM_FLOW_NORMAL);
 }
@@ -232,6 +242,8 @@ void CAPCoupler::handleAPLost()
 {
    DUSTLOG_INFO(m_logname, "AP Lost");
    m_apConnected = false;
+   // Queued packets are lost with the AP
+   m_txDoneTracker.dropAll();
    if (m_mngrClient)
       m_mngrClient->sendApLost();
    sendEvent_p(E_APM_LOST);
@@ -252,6 +264,7 @@ void CAPCoupler::handleAPBoot()
 void CAPCoupler::handleAPReboot()
 {
    DUSTLOG_INFO(m_logname, "AP Reboot");
+   m_txDoneTracker.dropAll();
    sendGetApClkSource();
    sendGetNetId();
    m_apConnected = true;
@@ -271,13 +284,14 @@ void CAPCoupler::handleError(uint8_t cmdId, uint8_t rc)
 
 void CAPCoupler::handleAPReceive(const uint8_t* data, size_t length)
 {
-   DUSTLOG_DEBUG(m_logname, "AP RX Data [" << length << "]");
+   DUSTLOG_ASYNC_DEBUG(m_logname, "AP RX Data [{}]", length);
    DUSTLOG_TRACEDATA(m_logname, "AP data", data, length);
+   m_moteStats.addPacket(data, length);
    if (m_mngrClient == nullptr)
       return;
    // send data to Manager
    apc_error_t res = m_mngrClient->sendData(data, length);
-   DUSTLOG_DEBUG(m_logname, "AP RX Data: rc=" << (int)res);
+   DUSTLOG_ASYNC_DEBUG(m_logname, "AP RX Data: rc={}", (int)res);
 }
 
 void CAPCoupler::handleEvent(const dn_api_loc_notif_events_t& event)
@@ -348,7 +362,8 @@ void CAPCoupler::handleReadyForTime(const dn_api_loc_notif_ready_for_time_t& rea
 
 void CAPCoupler::handleTXDone(const dn_api_loc_notif_txdone_t& txDone)
 {
-   DUSTLOG_DEBUG(m_logname, "AP RX TXDone: pkt=" << txDone.packetId);
+   DUSTLOG_ASYNC_DEBUG(m_logname, "AP RX TXDone: pkt={}", txDone.packetId);
+   m_txDoneTracker.txDone(txDone.packetId);
    // send TXDone to Manager
    ap_intf_txdone_t apcTxDone = {0};
    apcTxDone.txDoneId = txDone.packetId;
@@ -356,7 +371,7 @@ void CAPCoupler::handleTXDone(const dn_api_loc_notif_txdone_t& txDone)
    apc_error_t res = APC_ERR_INIT; 
    if (m_mngrClient)
       res = m_mngrClient->sendTxDone(apcTxDone);
-   DUSTLOG_DEBUG(m_logname, "AP RX TXDone: rc=" << (int)res);
+   DUSTLOG_ASYNC_DEBUG(m_logname, "AP RX TXDone: rc={}", (int)res);
 }
 
 void CAPCoupler::handleParamMacAddress(const dn_api_rsp_get_macaddr_t& getMacAddr)
@@ -390,8 +405,7 @@ void CAPCoupler::handleParamAppInfo(const dn_api_rsp_get_appinfo_t& getAppInfo)
                        << " (expect version >= " 
                        << MIN_VERSION[0] << "." << MIN_VERSION[1] << "." 
                        << MIN_VERSION[2] << "." << MIN_VERSION[3] << ")" );
-         if (m_pWDdClient)
-            m_pWDdClient->disconnect(IChangeNodeState::STOP_FATAL_ERROR);
+         disconnectWatchdog_p();
          break;
 }
    }
@@ -510,6 +524,11 @@ void CAPCoupler::handleAPResume()
    if (m_mngrClient)
       m_mngrClient->sendResume();
 }
+void CAPCoupler::handleAPQueueSpace(uint32_t numFree)
+{
+   if (m_mngrClient)
+      m_mngrClient->setInputSpace(numFree);
+}
 
 void CAPCoupler::setClockSrource(EAPClockSource newClkSrc)
 {
@@ -529,8 +548,17 @@ apc_error_t CAPCoupler::sendCmd(uint8_t cmdId, const uint8_t* data, size_t lengt
 }
 
 apc_error_t CAPCoupler::sendApSend(dn_api_loc_apsend_ctrl_t& hdr,
-                                   const uint8_t* data, size_t length)
+                                   const uint8_t* data, size_t length, bool isTracked)
 {
+   ResponseCallback      resCallback = NULL;
+   ErrorResponseCallback errResCallback = NULL;
+   if (isTracked) {
+      resCallback    = boost::bind(&CAPCoupler::handleApSendResponse_p, this, hdr.packetId, _1, _2, _3);
+      errResCallback = boost::bind(&CAPCoupler::handleApSendErrorResponse_p, this, hdr.packetId, _1, _2);
+      // Before insertion: AP may answer before insertMsg returns
+      m_txDoneTracker.enqueued(hdr.packetId);
+   }
+
    // convert the header fields to network byte order
    hdr.packetId = htons(hdr.packetId);
    hdr.timeslot = htonl(hdr.timeslot);
@@ -543,10 +571,24 @@ apc_error_t CAPCoupler::sendApSend(dn_api_loc_apsend_ctrl_t& hdr,
    apc_error_t res = APC_ERR_INIT;
    if (m_transport)
       res = m_transport->insertMsg(DN_API_LOC_CMD_AP_SEND, 
-                                            output.data(), output.size());
+                                   output.data(), output.size(), false, resCallback, errResCallback);
    return res;
 }
 
+void CAPCoupler::handleApSendResponse_p(uint16_t txDoneId, uint8_t cmdId, const uint8_t* response, size_t size)
+{
+   m_txDoneTracker.acked(txDoneId);
+}
+
+void CAPCoupler::handleApSendErrorResponse_p(uint16_t txDoneId, uint8_t cmdId, uint8_t rc)
+{
+   // NACK: packet stays in queue of transport and is retried
+   if (rc != DN_API_RC_NO_RESOURCES)
+      m_txDoneTracker.failed(txDoneId);
+   // Error is reported as without callback
+   handleError(cmdId, rc);
+}
+
 apc_error_t CAPCoupler::sendSetApClkSource(uint8_t clkSource, bool isResetAP)
 {
    ResponseCallback      resCallback = NULL;
@@ -741,6 +783,14 @@ void CAPCoupler::synchStop_p()
 void CAPCoupler::handleSetClkSrcErrorResponse_p(uint8_t cmdId, uint8_t rc)
 {
    DUSTLOG_FATAL(m_logname, "Can not set Clock Source. RC " << (int)rc);
+   disconnectWatchdog_p();
+}
+
+// Report fatal error to watchdog, keep preceding events
+void CAPCoupler::disconnectWatchdog_p()
+{
+   CFlightRecorder::record(FLIGHTREC_CPL_WD_DISCONNECT, IChangeNodeState::STOP_FATAL_ERROR);
+   CFlightRecorder::save("wddisconnect");
    if (m_pWDdClient)
       m_pWDdClient->disconnect(IChangeNodeState::STOP_FATAL_ERROR);
 }
@@ -823,11 +873,13 @@ uint32_t CAPCoupler::runStateMachine_p()
    // Start Manager Client
    apc_error_t res;
    uint32_t    events;
-   // Start Manager Client
-   while ((res = m_mngrClient->start(m_client_start_param)) != APC_OK) {
+   // Start Manager Client. Connection is asynchronous and the client repeats it itself,
+   // so start fails only on configuration or resource error: retrying does not help
+   res = m_mngrClient->start(m_client_start_param);
+   if (res != APC_OK) {
       synchStop_p();
-      DUSTLOG_WARN(m_logname, "APC Client start failed, " << toString(res) << ". Retrying...");
-      boost::this_thread::sleep(boost::posix_time::milliseconds(RETRY_INTERVAL));
+      DUSTLOG_ERROR(m_logname, "APC Client start failed, " << toString(res) << ". Waiting for stop");
+      waitEvents_p(E_STOP);            // Throws exeption_stop
    }
    // Wait connection (or error)
    events = waitEvents_p(E_MNGR_CONNECT | E_MNGR_DISCONNECT | E_APM_BOOT | E_APM_LOST | E_AP_RESET);
@@ -849,6 +901,7 @@ uint32_t CAPCoupler::runStateMachine_p()
 // Send events to coupler state machine
 void CAPCoupler::sendEvent_p(uint32_t e)
 {
+   CFlightRecorder::record(FLIGHTREC_CPL_EVENT, e);
    if ((e & (E_MNGR_DISCONNECT | E_APM_LOST | E_APM_REBOOT | E_AP_DISCONNECT | E_AP_RESET)) != 0) {
       m_transport->disableJoin();
    }
@@ -21,6 +21,8 @@
 
 #include "SerialPort.h"
 #include "APMTransport.h"
+#include "TxDoneTracker.h"
+#include "MoteTrafficStats.h"
 
 
 #include "IAPCoupler.h"
@@ -79,6 +81,7 @@ public:
       uint32_t                    disconnectShortBootTimeoutMsec;
       uint32_t                    disconnectLongBootTimeoutMsec;
       EAPClockSource              apClkSource;
+      uint32_t                    moteStatsSize;   // Number of motes in upstream traffic table (0 - disable)
    };
 
    CAPCoupler(boost::asio::io_service& io_service);
@@ -104,6 +107,15 @@ public:
 
    void clearMgrStats() { m_mngrClient->clearStats(); }
 
+   // Latency of downstream packets by txDoneId
+   void getTxDoneStats(txdone_latency_stats_s * pStats) { m_txDoneTracker.getStat(pStats); }
+   void clearTxDoneStats() { m_txDoneTracker.clearStat(); }
+
+   // Upstream traffic of the heaviest motes
+   bool isMoteStatsEnabled() const { return m_moteStats.isEnabled(); }
+   void getMoteStats(mote_traffic_stats_s * pStats, uint32_t maxMotes) { m_moteStats.getStat(pStats, maxMotes); }
+   void clearMoteStats() { m_moteStats.clearStat(); }
+
    gps_status_t getGpsStatus() { return m_cur_gps_status; }
 
    EAPClockSource getApClkSrc() { return m_apClkSource;  }
@@ -147,6 +159,7 @@ public:
    virtual void handleParamApStatus(const dn_api_rsp_get_apstatus_t&);
    virtual void handleAPPause();
    virtual void handleAPResume();
+   virtual void handleAPQueueSpace(uint32_t numFree);
    virtual void handleAPLost();
    virtual void handleAPBoot();
    virtual void handleAPReboot();
@@ -168,8 +181,9 @@ private:
       exeption_stop(){;}
    };
 
+   // 'isTracked' - packet is in m_txDoneTracker
    apc_error_t sendApSend(dn_api_loc_apsend_ctrl_t& hdr,
-                          const uint8_t* data, size_t length);
+                          const uint8_t* data, size_t length, bool isTracked = false);
    apc_error_t sendSetApClkSource(uint8_t clkSource, bool isResetAP);
    apc_error_t sendGetApNetId();
    apc_error_t sendGetApMoteInfo();
@@ -201,6 +215,10 @@ private:
    void     setClockSource_p(bool isIntClkSrc);
    void     handleSetClkSrcResponse_p(uint8_t cmdId, const uint8_t* response, size_t size);
    void     handleSetClkSrcErrorResponse_p(uint8_t cmdId, uint8_t rc);
+   // Response of AP to AP_SEND of tracked packet
+   void     handleApSendResponse_p(uint16_t txDoneId, uint8_t cmdId, const uint8_t* response, size_t size);
+   void     handleApSendErrorResponse_p(uint16_t txDoneId, uint8_t cmdId, uint8_t rc);
+   void     disconnectWatchdog_p();
 
    // Get the interval (in seconds) between the given time and now, 
    // where the given time is expressed as a number of seconds since 
@@ -241,6 +259,9 @@ private:
    IWdClient         *  m_pWDdClient;        // Watch Dog client. Use for stop of APC
 
    bool                 m_isIntClkSrc;       // Flag set by manager
+
+   CTxDoneTracker       m_txDoneTracker;     // Downstream packets waiting for TX done
+   CMoteTrafficStats    m_moteStats;         // Upstream packets by source mote
 };
 
 bool        clkSrcStringToEnum(std::string str, EAPClockSource& clkSrc);
@@ -8,6 +8,8 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/thread.hpp>
 #include "common/IChangeNodeState.h"
+#include "AsyncLog.h"
+#include "FlightRecorder.h"
 
 using namespace std;
 
@@ -24,9 +26,6 @@ const uint16_t DEFAULT_MAX_RETRIES = 3;
 const uint16_t DEFAULT_MAX_MSG_SIZE = 256; // bytes -- TODO: sync with APC
 const uint32_t DEFAULT_MAX_PACKET_AGE = 1500; // milliseconds, max packet age before triggering 
                                               // TX_PAUSE to manager
-uint32_t last_numNotifRecv = 0;               // total notification received one second ago
-uint32_t numNotifRecv_30sec_ago = 0;          // total notification received 30 seconds ago
-uint32_t numNotifRecv_5min_ago = 0;           // total notification received 5 minutes ago
 
 
 CAPMTransport::init_param_t::init_param_t()
@@ -38,7 +37,8 @@ CAPMTransport::init_param_t::init_param_t()
      retryTimeout(DEFAULT_RETRY_TIMEOUT),
      maxRetries(DEFAULT_MAX_RETRIES),
      maxMsgSize(DEFAULT_MAX_MSG_SIZE),
-     maxPacketAge(DEFAULT_MAX_PACKET_AGE)
+     maxPacketAge(DEFAULT_MAX_PACKET_AGE),
+     fastRetry(true)
 {
    // Intentionally blank
 }
@@ -51,7 +51,8 @@ CAPMTransport::init_param_t::init_param_t(uint16_t aQueueSize,
                                           uint32_t aRetryTimeout,
                                           uint16_t aMaxRetries,
                                           uint16_t aMsgSize,
-                                          uint32_t aPacketAge)
+                                          uint32_t aPacketAge,
+                                          bool     aFastRetry)
    : maxQueueSize(aQueueSize),
      highQueueWatermark(aHighWatermark),
      lowQueueWatermark(aLowWatermark),
@@ -60,7 +61,8 @@ CAPMTransport::init_param_t::init_param_t(uint16_t aQueueSize,
      retryTimeout(aRetryTimeout),
      maxRetries(aMaxRetries),
      maxMsgSize(aMsgSize),
-     maxPacketAge(aPacketAge)
+     maxPacketAge(aPacketAge),
+     fastRetry(aFastRetry)
 {
    // Intentionally blank
 }
@@ -98,12 +100,12 @@ CAPMTransport::CAPMTransport(size_t maxMsgSize, boost::asio::io_service& io_serv
      m_init_params(), // initialize to defaults
      m_outputTimer(io_service),
      m_pingTimer(io_service),     
-     m_ppsTimer(io_service),     
      m_curRetryCount(0),
      m_curNackCount(0),
      m_respPacketId(0),
      m_notifPacketId(0),
      m_pending(false),
+     m_fastRetryArmed(false),
      m_outputQueue(),     
      m_log(), // TODO: replace static APM log strings
      m_sendTime(),
@@ -126,8 +128,21 @@ void CAPMTransport::open(const init_param_t& param)
    m_init_params = param;
 
    m_outputQueue.set_capacity(m_init_params.maxQueueSize); //Maximum number of commands which can be queued in circular buffer
+}
+
+CAPMTransport::APMTStats CAPMTransport::getAPMStatistics()
+{
+   APMTStats res = m_stats;
+   m_cmdRate.getStat(&res.m_cmdRate);
+   m_notifRate.getStat(&res.m_notifRate);
+   return res;
+}
 
-   startPPSTimer();  // start calculate packet per second from/to AP
+void CAPMTransport::clearAPMStatistics()
+{
+   m_stats.reset();
+   m_cmdRate.clear();
+   m_notifRate.clear();
 }
 
 apc_error_t CAPMTransport::stop()
@@ -164,6 +179,7 @@ apc_error_t CAPMTransport::stop()
                 "\nNACKS RECEIVED:" << m_stats.m_numNacks <<
                 "\nMAX NACKS IN A ROW:" << m_stats.m_maxNackCount <<
                 "\nRETRIES SENT: " << m_stats.m_numRetriesSent <<
+                "\nFAST RETRIES SENT: " << m_stats.m_numFastRetries <<
                 "\nNOTIF RETRIES : " << m_stats.m_numRetriesRecv << "\n");
    return APC_OK;
 }
@@ -181,10 +197,8 @@ apc_error_t CAPMTransport::handleMsg(apt_hdr_s* pHdr,
    bool isResp = pHdr->flags & 1;
    uint8_t pktId = pHdr->flags & 2;
 
-   ostringstream cmdstr;
-   cmdstr << "cmd: 0x" << hex << (int)pHdr->cmdId;
    const char* msgType = (isResp)?" RSP:":" REQ:";
-   DUSTLOG_DEBUG(APM_IO_LOGGER, "INP " << cmdstr.str() << msgType << (int)pktId);
+   DUSTLOG_DEBUG(APM_IO_LOGGER, "INP cmd: 0x" << hex << (int)pHdr->cmdId << dec << msgType << (int)pktId);
 
    apc_error_t res = APC_OK;
    if (isResp) {
@@ -200,8 +214,8 @@ apc_error_t CAPMTransport::handleMsg(apt_hdr_s* pHdr,
       }
       // ensure this response is for most recent command
       if (pHdr->cmdId != lastCmd) {
-         DUSTLOG_WARN(APM_IO_LOGGER, "INP " << cmdstr.str()
-                      << " does not match last cmd (0x" << std::hex << (int)lastCmd << ")");
+         DUSTLOG_WARN(APM_IO_LOGGER, "INP cmd: 0x" << hex << (int)pHdr->cmdId
+                      << " does not match last cmd (0x" << (int)lastCmd << ")");
          return APC_OK;
       }
       if (pktId != m_respPacketId) {
@@ -214,11 +228,7 @@ apc_error_t CAPMTransport::handleMsg(apt_hdr_s* pHdr,
 	  res = handleResponse(*pHdr, data, size);
       
    } else {
-      {
-         ostringstream prefix;
-         prefix << "INP " << cmdstr.str() << " data";
-         DUSTLOG_TRACEDATA(APM_RAWIO_LOGGER, prefix.str(), data, size);
-      }
+      DUSTLOG_TRACEDATA(APM_RAWIO_LOGGER, "INP cmd: 0x" << hex << (int)pHdr->cmdId << " data", data, size);
 	  // handle the notification
 	  res = handleNotification(*pHdr, data, size);
    }
@@ -233,6 +243,8 @@ apc_error_t CAPMTransport::handleResponse(const apt_hdr_s& hdr,
    
    apc_error_t res = APC_OK;
    bool belowLowWatermark = false;
+   bool isPopped = false;
+   size_t numQueued = 0;
    
    // Increment response counter
    m_stats.m_numRespRecv++;
@@ -251,6 +263,7 @@ apc_error_t CAPMTransport::handleResponse(const apt_hdr_s& hdr,
    
    // handle the result code
    uint8_t rc = data[0];
+   CFlightRecorder::record(FLIGHTREC_APM_ACK, hdr.cmdId, rc, static_cast<uint32_t>(curRspTime));
    DUSTLOG_DEBUG(APM_IO_LOGGER, "INP ACK "
                  << "cmd: 0x" << hex << (int)hdr.cmdId
                  << " rc: 0x" << hex << (int)rc);
@@ -273,6 +286,7 @@ apc_error_t CAPMTransport::handleResponse(const apt_hdr_s& hdr,
          m_stats.m_numNacks++; // increment total NACK counter
          m_curNackCount++;
          m_stats.m_maxNackCount = max(m_curNackCount, m_stats.m_maxNackCount);
+         CFlightRecorder::record(FLIGHTREC_APM_NACK, hdr.cmdId, m_curNackCount);
          startNackRetryTimer();
 
       } else {
@@ -285,6 +299,8 @@ apc_error_t CAPMTransport::handleResponse(const apt_hdr_s& hdr,
          m_stats.m_maxTimeInQueue = max(curTimeInQueue, m_stats.m_maxTimeInQueue);
 
 	      m_outputQueue.pop_front();
+         numQueued = m_outputQueue.size();
+         isPopped = true;
          belowLowWatermark = m_outputQueue.size() < m_init_params.lowQueueWatermark;
          m_curNackCount = 0;
 
@@ -303,18 +319,20 @@ apc_error_t CAPMTransport::handleResponse(const apt_hdr_s& hdr,
       m_notifHandler->handleAPResume();
       m_mngrInputState = APM_FLOW_NORMAL;
    }
+   if (isPopped)
+      m_notifHandler->handleAPQueueSpace(getQueueSpace_p(numQueued));
    
    if (rc == DN_API_RC_OK) {
       DUSTLOG_DEBUG(APM_RAWIO_LOGGER, "RC = DN_API_RC_OK");
-      // if the ACK contains data, then handle the response
-      if (size > 1) {
+      // Response callback gets every ACK (e.g. ACK of AP_SEND has no data),
+      // command handler - only ACK that contains data
+      if (size > 1)
          DUSTLOG_TRACEDATA(APM_RAWIO_LOGGER, "INP resp", data, size);
-         if (respCallback != NULL) {
-            DUSTLOG_DEBUG(APM_RAWIO_LOGGER, "Calling response callback");
-            respCallback(hdr.cmdId, data, size);
-         } else {
-            res = m_cmdHandler->handleCmd(hdr.cmdId, data, size);
-         }
+      if (respCallback != NULL) {
+         DUSTLOG_DEBUG(APM_RAWIO_LOGGER, "Calling response callback");
+         respCallback(hdr.cmdId, data, size);
+      } else if (size > 1) {
+         res = m_cmdHandler->handleCmd(hdr.cmdId, data, size);
       }
    } else {
       DUSTLOG_DEBUG(APM_RAWIO_LOGGER, "RC = " << (int)rc);
@@ -344,12 +362,14 @@ apc_error_t CAPMTransport::handleNotification(const apt_hdr_s& hdr,
       // increment number of bytes, packets received from AP
       m_stats.m_numBytesRecv += size;
       m_stats.m_numPktsRecv++;
+      m_notifRate.addPacket(size);
       // check if Manager is in a state to handle apReceive Command
       if (m_apInputState == APM_FLOW_PAUSE && 
           hdr.cmdId == DN_API_LOC_NOTIF_AP_RECEIVE) {
          sendAck(hdr.cmdId, pktId, DN_API_RC_NO_RESOURCES); //NACK to AP
-         DUSTLOG_WARN(APM_IO_LOGGER, "APC send NAK to AP.  (processing time " 
-            << (TO_USEC(TIME_NOW() - startTime).count()) << " usec)");
+         CFlightRecorder::record(FLIGHTREC_APM_NACK_SENT, hdr.cmdId);
+         DUSTLOG_ASYNC_WARN(APM_IO_LOGGER, "APC send NAK to AP.  (processing time {} usec)",
+                            TO_USEC(TIME_NOW() - startTime).count());
          return APC_ERR_STATE;
       }
       // process the notification before generating the ack
@@ -361,11 +381,10 @@ apc_error_t CAPMTransport::handleNotification(const apt_hdr_s& hdr,
    }
    else if (pktId == m_notifPacketId) {
       m_stats.m_numRetriesRecv++;
-      DUSTLOG_WARN(APM_IO_LOGGER, "********************** Retry received " <<  m_stats.m_numRetriesRecv);
-      DUSTLOG_WARN(APM_IO_LOGGER, "cmd: 0x" << setfill('0') << setw(2) << hex << (int)hdr.cmdId 
-         << ", flag: 0x" << setfill('0') << setw(2) << hex << (int)hdr.flags
-         << ",   time (us) : " << dec  
-         << boost::chrono::duration_cast<boost::chrono::microseconds>(startTime.time_since_epoch()).count());
+      CFlightRecorder::record(FLIGHTREC_APM_RETRY_RECV, hdr.cmdId, hdr.flags);
+      DUSTLOG_ASYNC_WARN(APM_IO_LOGGER, "********************** Retry received {}", m_stats.m_numRetriesRecv);
+      DUSTLOG_ASYNC_WARN(APM_IO_LOGGER, "cmd: 0x{02x}, flag: 0x{02x},   time (us) : {}", hdr.cmdId, hdr.flags,
+                         boost::chrono::duration_cast<boost::chrono::microseconds>(startTime.time_since_epoch()).count());
    }
    // send an acknowledgement -- TODO: not always?
    DUSTLOG_DEBUG(APM_IO_LOGGER, "OUT ACK " << "cmd: 0x" << hex << (int)hdr.cmdId);
@@ -373,8 +392,7 @@ apc_error_t CAPMTransport::handleNotification(const apt_hdr_s& hdr,
    
    int64_t t = TO_USEC(TIME_NOW() - startTime).count();
    if (t > 10000) {
-      DUSTLOG_WARN(APM_IO_LOGGER, "APC processing time of command " << (int)hdr.cmdId 
-                   << " is " << t << " usec");
+      DUSTLOG_ASYNC_WARN(APM_IO_LOGGER, "APC processing time of command {} is {} usec", hdr.cmdId, t);
    }
 
    return res;
@@ -395,6 +413,7 @@ apc_error_t CAPMTransport::insertMsg(uint8_t cmdId, const uint8_t* data, size_t
    }
 
    bool atHighWatermark = false;
+   size_t numQueued;
    {
       boost::unique_lock<boost::mutex> lock(m_lock);
 	   boost::chrono::steady_clock::time_point timestamp = TIME_NOW();
@@ -412,6 +431,7 @@ apc_error_t CAPMTransport::insertMsg(uint8_t cmdId, const uint8_t* data, size_t
       else
          m_outputQueue.push_back(APMCommand(cmdId, data, size, isSynch, resCallback, errRespCallback, timestamp));
        atHighWatermark = m_outputQueue.size() >= m_init_params.highQueueWatermark;
+       numQueued = m_outputQueue.size();
    }
    send(true);
       
@@ -423,6 +443,7 @@ apc_error_t CAPMTransport::insertMsg(uint8_t cmdId, const uint8_t* data, size_t
       m_notifHandler->handleAPPause();
       m_mngrInputState = APM_FLOW_PAUSE;
    }     
+   m_notifHandler->handleAPQueueSpace(getQueueSpace_p(numQueued));
 
    if (m_outputQueue.size() > 0) {
       startQueueCheckTimer();
@@ -494,6 +515,19 @@ apc_error_t CAPMTransport::dataReceived(const uint8_t* data, size_t size)
    return handleMsg(pHdr, (uint8_t*)(pHdr+1), size-sizeof(apt_hdr_s));
 }
 
+// Corrupted frame is received from AP. It can be the response for pending
+// command, so resend the command after retryDelay instead of retryTimeout.
+// Only one fast retry is done for every sent command.
+void CAPMTransport::frameError()
+{
+   if (!m_pending || !m_fastRetryArmed)
+      return;
+   m_fastRetryArmed = false;
+   m_stats.m_numFastRetries++;
+   DUSTLOG_DEBUG(APM_IO_LOGGER, "Corrupted frame received, fast retry of pending command");
+   startFastRetryTimer();
+}
+
 // timer callbacks
 
 void CAPMTransport::startRetryTimer()
@@ -546,6 +580,9 @@ void CAPMTransport::handleRetryTimeout(const boost::system::error_code& error)
          << (m_abortEnabled ? " AP is lost, reset AP." : ""));
       //AP is lost so no point of keep on pinging
       stopPingTimer();
+      CFlightRecorder::record(FLIGHTREC_APM_AP_LOST, m_init_params.maxRetries);
+      // keep serial traffic preceding AP lost
+      m_outputHandler->saveCapture("aplost");
       if (m_abortEnabled) {
          //Send AP Lost to manager
          sendAPLostNotif_p();
@@ -571,6 +608,28 @@ void CAPMTransport::startNackRetryTimer()
                                         this, boost::asio::placeholders::error));
 }
 
+// Fast retry is not counted in m_curRetryCount: corrupted frame does not
+// bring AP closer to AP lost or reopening of serial port
+void CAPMTransport::startFastRetryTimer()
+{
+   m_outputTimer.expires_from_now(boost::posix_time::milliseconds(m_init_params.retryDelay));
+   m_outputTimer.async_wait(boost::bind(&CAPMTransport::handleFastRetryTimeout,
+                                        this, boost::asio::placeholders::error));
+}
+
+void CAPMTransport::handleFastRetryTimeout(const boost::system::error_code& error)
+{
+   if (error) {
+      // timer cancelled
+      return;
+   }
+   sendRetry();
+   m_stats.m_numRetriesSent++;
+   // Resent command arms fast retry again, only one is done for every command
+   m_fastRetryArmed = false;
+   startRetryTimer();
+}
+
 size_t CAPMTransport::queueSize() 
 {
    boost::unique_lock<boost::mutex> lock(m_lock);
@@ -597,21 +656,21 @@ apc_error_t CAPMTransport::sendCommand(uint8_t cmdId, const uint8_t* data, size_
    if (length > 0) {
       copy(data, data+length, output.begin() + hdr.LENGTH);
    }
-   {
-      ostringstream prefix;
-      prefix << "OUT " << "cmd:" << setfill('0') << setw(2) << hex << (int)cmdId << " data";
-      DUSTLOG_TRACEDATA(APM_RAWIO_LOGGER, prefix.str(), output.data(), output.size());
-   }
+   DUSTLOG_TRACEDATA(APM_RAWIO_LOGGER, "OUT cmd:" << setfill('0') << setw(2) << hex << (int)cmdId << " data",
+                     output.data(), output.size());
    // send command
 
    //Note down send time to calculate response time when we receive packets from AP
    m_sendTime = TIME_NOW();
    //Increment Number of payload bytes sent from Mgr(APMTransport)->AP
    m_stats.m_numBytesSent+=length;
+   m_cmdRate.addPacket(length);
    
    // save packet for retries
    m_pending = true;
+   m_fastRetryArmed = m_init_params.fastRetry;
 
+   CFlightRecorder::record(FLIGHTREC_APM_SEND, cmdId, f, static_cast<uint32_t>(length));
    m_outputHandler->handleData(output);
 
    // set timer for retry
@@ -641,10 +700,9 @@ void CAPMTransport::send(bool isNew)
       APMCommand& cmd = m_outputQueue.front();
 
       if (!isNew) {
-         DUSTLOG_WARN(APM_IO_LOGGER, "sending retry cmd: 0x" 
-            << setfill('0') << setw(2) << hex << (int)cmd.cmdId
-            << ", time (us) : " << dec
-            << boost::chrono::duration_cast<boost::chrono::microseconds>(now.time_since_epoch()).count());
+         CFlightRecorder::record(FLIGHTREC_APM_RETRY, cmd.cmdId, m_curRetryCount + 1);
+         DUSTLOG_ASYNC_WARN(APM_IO_LOGGER, "sending retry cmd: 0x{02x}, time (us) : {}", cmd.cmdId,
+                            boost::chrono::duration_cast<boost::chrono::microseconds>(now.time_since_epoch()).count());
       } else {
          DUSTLOG_DEBUG(APM_IO_LOGGER, "Sending packet, cmdId: 0x" << hex << (int)cmd.cmdId);
       }
@@ -655,7 +713,7 @@ void CAPMTransport::send(bool isNew)
    
 void CAPMTransport::sendRetry()
 {
-   DUSTLOG_WARN(APM_RAWIO_LOGGER, "Sending retry attempt #" << m_curRetryCount+1);
+   DUSTLOG_ASYNC_WARN(APM_RAWIO_LOGGER, "Sending retry attempt #{}", m_curRetryCount+1);
    send(false);
 }
 
@@ -724,6 +782,14 @@ void CAPMTransport::clearOutputQueue()
    m_pending = false;
    m_apInputState = APM_FLOW_NORMAL;
    m_mngrInputState = APM_FLOW_NORMAL;
+   lock.unlock();
+   m_notifHandler->handleAPQueueSpace(getQueueSpace_p(0));
+}
+
+// Manager may send (credit) up to high watermark of output queue
+uint32_t CAPMTransport::getQueueSpace_p(size_t numQueued) const
+{
+   return numQueued < m_init_params.highQueueWatermark ? (uint32_t)(m_init_params.highQueueWatermark - numQueued) : 0;
 }
 
 bool CAPMTransport::isPortReady()
@@ -829,35 +895,3 @@ void CAPMTransport::sendAPLostNotif_p()
    setAPConnectionState_p(false);
    m_isRunning = false;
 }
-
-void CAPMTransport::startPPSTimer()
-{
-   m_ppsTimer.expires_from_now(boost::posix_time::milliseconds(1000));
-   m_ppsTimer.async_wait(boost::bind(&CAPMTransport::handlePPSTimeout, 
-                                      this, boost::asio::placeholders::error));
-}
-
-void CAPMTransport::handlePPSTimeout(const boost::system::error_code& error)
-{
-   uint32_t numNotifRecv;
-
-   numNotifRecv = m_stats.m_numPktsRecv - m_stats.m_numRespRecv;
-   m_stats.m_packetRate = numNotifRecv - last_numNotifRecv;
-   last_numNotifRecv = numNotifRecv;
-
-   m_stats.m_totalSecs ++;
-   // calculate last 30 sec average packet rate
-   if (m_stats.m_totalSecs % 30 == 0) {
-      m_stats.m_30secPacketRate = (numNotifRecv - numNotifRecv_30sec_ago) / 30.0;
-	  numNotifRecv_30sec_ago = numNotifRecv;
-   }
-
-   // calculate last 5 min average packet rate
-   if (m_stats.m_totalSecs % 300 == 0) {
-      m_stats.m_5minPacketRate = (numNotifRecv - numNotifRecv_5min_ago) / 300.0;
-	  numNotifRecv_5min_ago = numNotifRecv;
-   }
-
-   startPPSTimer();
-}
-
@@ -11,6 +11,7 @@
 #include "public/APCError.h"
 #include "APMSerializer.h"
 #include "SerialPort.h" // TODO: for IInputHandler, IAPMMsgHandler
+#include "StatRateCalc.h"
 #include "boost/circular_buffer.hpp"
 #include "boost/asio.hpp"
 #include "boost/bind.hpp"
@@ -94,7 +95,8 @@ public:
                    uint32_t aRetryTimeout,
                    uint16_t aMaxRetries,
                    uint16_t aMsgSize,
-                   uint32_t aMaxPacketAge);
+                   uint32_t aMaxPacketAge,
+                   bool     aFastRetry = true);
       
       uint16_t maxQueueSize;       ///< Maximum queue size for messages to AP
       uint16_t highQueueWatermark; ///< Flow control: stop accepting messages to the AP
@@ -105,6 +107,7 @@ public:
       uint16_t maxRetries;         ///< Maximum number of retries
       uint16_t maxMsgSize;         ///< Maximum message size (bytes)
       uint16_t maxPacketAge;       ///< Maximum packet age to trigger TX_PAUSE to manager
+      bool     fastRetry;          ///< Resend command after retryDelay if corrupted frame is received
    };
 
    CAPMTransport(size_t maxMsgSize, boost::asio::io_service& io_service,
@@ -128,6 +131,7 @@ public:
                                  bool isSynch = false);
 
    virtual apc_error_t dataReceived(const uint8_t* data, size_t size);
+   virtual void        frameError();
 
    // IAPMNotifHandler interface
    virtual void handleAPReceive(const uint8_t* data, size_t length)                  { m_notifHandler->handleAPReceive(data, length)   ;}
@@ -145,6 +149,7 @@ public:
    virtual void handleAPLost();
    virtual void handleAPPause()                                                      { m_notifHandler->handleAPPause()                 ;}
    virtual void handleAPResume()                                                     { m_notifHandler->handleAPResume()                ;}
+   virtual void handleAPQueueSpace(uint32_t numFree)                                 { m_notifHandler->handleAPQueueSpace(numFree)     ;}
    virtual void handleAPBoot();
    virtual void handleAPReboot();
    virtual void handleError(uint8_t cmdId, uint8_t rc)                               { m_notifHandler->handleError(cmdId, rc); }
@@ -163,16 +168,16 @@ public:
    // Output timer for NACK from AP
    void startNackRetryTimer();
    void handleNackRetryTimeout(const boost::system::error_code& error);
+
+   // Output timer for fast retry after corrupted frame
+   void startFastRetryTimer();
+   void handleFastRetryTimeout(const boost::system::error_code& error);
    
    // Ping timer management
    void startPingTimer();
    void stopPingTimer();
    void handlePingTimeout(const boost::system::error_code& error);
 
-   // Packet Per Second timer management
-   void startPPSTimer();
-   void handlePPSTimeout(const boost::system::error_code& error);
-
    size_t queueSize();
 
    // send the command in the front of the output queue
@@ -204,16 +209,15 @@ public:
       uint32_t         m_numNacks;        // Number of NACKs received from AP
       uint32_t         m_numRetriesSent;  // Number of Retries/TimeOuts sent to AP
       uint32_t         m_numRetriesRecv;  // Number of Retries received from AP
+      uint32_t         m_numFastRetries;  // Number of Retries sent after receiving corrupted frame
       uint32_t         m_maxNackCount;    // Maximum number of NACKs received from AP in a row
       uint64_t         m_minTimeInQueue;  // Minimum time packet spent in queue
       uint64_t         m_maxTimeInQueue;  // Maximum time packet spent in queue
       uint64_t         m_totalTimeInQueue;// Sum of time in queue for all packets (usec)
       uint32_t         m_numPacketsQueued;// Number of Packets ever pushed into queue
       mngr_duration_t  m_timeInQueue;     // time the current packet spent in queue
-      uint32_t         m_packetRate;      // record the current packet per second, TX and RX have same rate
-      double           m_30secPacketRate; // record the last 30 seconds packet rate
-      double           m_5minPacketRate;  // record the last 5 minutes packet rate
-      uint32_t         m_totalSecs;       // record the total seconds, needed to calculate avg pkt rate
+      ratestat_s       m_cmdRate;         // Rate of commands sent to AP (including retries)
+      ratestat_s       m_notifRate;       // Rate of notifications received from AP (without retries)
       APMTStats() {
          reset();
       };
@@ -232,28 +236,27 @@ public:
          m_numNacks       = 0;
          m_numRetriesSent = 0;
          m_numRetriesRecv = 0;
+         m_numFastRetries = 0;
          m_maxNackCount   = 0;
          m_minTimeInQueue = 10000000; // Initialized with big number so first response time will be always smaller
          m_maxTimeInQueue = 0;
          m_totalTimeInQueue = 0;
          m_numPacketsQueued = 0;
          m_timeInQueue    = mngr_duration_t::zero();
-         m_packetRate = 0;
-         m_30secPacketRate = 0;
-         m_5minPacketRate = 0;
-         m_totalSecs = 0;
+         m_cmdRate        = ratestat_s();
+         m_notifRate      = ratestat_s();
       }
    };
 
    /**
     * Get Transport Statistics
     */
-   APMTStats getAPMStatistics() const { return m_stats; }
+   APMTStats getAPMStatistics();
 
    /**
     * Clear Transport Statistics
     */
-   void clearAPMStatistics() { m_stats.reset(); }
+   void clearAPMStatistics();
 
    apc_error_t sendPing();
 
@@ -282,7 +285,6 @@ private:
 
    boost::asio::deadline_timer m_outputTimer;
    boost::asio::deadline_timer m_pingTimer;
-   boost::asio::deadline_timer m_ppsTimer;
 
    uint32_t m_curRetryCount;  ///< current send retry count
    uint32_t m_curNackCount;   ///< current Nack count
@@ -291,6 +293,7 @@ private:
    
    // Queue of messages to AP
    boost::atomic<bool> m_pending;
+   boost::atomic<bool> m_fastRetryArmed; ///< Fast retry is allowed for pending command
    boost::circular_buffer<APMCommand> m_outputQueue;
 
    std::string      m_log;
@@ -299,6 +302,8 @@ private:
    mngr_time_t m_sendTime;
 
    APMTStats m_stats; ///< AP transport statistics
+   CStatRateCalc m_cmdRate;   ///< rate of commands to AP
+   CStatRateCalc m_notifRate; ///< rate of notifications from AP
 
    boost::atomic<apm_flow_control_t> m_apInputState;   ///< flow control to AP
    boost::atomic<apm_flow_control_t> m_mngrInputState; ///< flow control to Manager
@@ -316,6 +321,8 @@ private:
    bool            setAPConnectionState_p(bool isConnected);
    void            startJoin_p();
    void            sendAPLostNotif_p();
+   // Free space of output queue below high watermark
+   uint32_t        getQueueSpace_p(size_t numQueued) const;
    void            handleDisconnectErrorResponse_p(uint8_t cmdId, uint8_t rc);
 
 };
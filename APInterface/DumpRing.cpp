@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "DumpRing.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+const char DUMP_LOGGER[] = "apc.dump";
+
+extern void convertToLocaltime(time_t * pTime, tm * pLocalTime, int32_t * pTZ);
+
+// Delete the oldest files "<prefix>*<suffix>" so that 'maxFiles' are left.
+// Time stamp in name gives order of files
+static void pruneDumpFiles(const std::string& dir, const std::string& prefix, const std::string& suffix,
+                           size_t maxFiles)
+{
+   boost::system::error_code ec;
+   std::vector<std::string>  files;
+   for (boost::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+      std::string name = it->path().filename().string();
+      if (name.size() > prefix.size() + suffix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+          name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+         files.push_back(it->path().string());
+   }
+   if (files.size() <= maxFiles)
+      return;
+   std::sort(files.begin(), files.end());
+   for (size_t i = 0; i < files.size() - maxFiles; i++) {
+      boost::filesystem::remove(files[i], ec);
+      if (ec)
+         DUSTLOG_WARN(DUMP_LOGGER, "Delete of old dump " << files[i] << " failed: " << ec.message());
+   }
+}
+
+std::string getDumpFileName(const std::string& dir, const char * reason, const char * ext)
+{
+   time_t    t = boost::chrono::system_clock::to_time_t(SYSTIME_NOW());
+   tm        locTime;
+   char      timeStr[32];
+   convertToLocaltime(&t, &locTime, NULL);
+   strftime(timeStr, sizeof(timeStr), "%Y%m%d-%H%M%S", &locTime);
+
+   std::string prefix = std::string("apc_") + reason + "_";
+   std::string suffix = std::string(".") + ext;
+   pruneDumpFiles(dir, prefix, suffix, DUMP_MAX_FILES - 1);
+
+   std::ostringstream os;
+   os << dir << "/" << prefix << timeStr << suffix;
+   return os.str();
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <memory>
+#include <string>
+
+#include "common.h"
+
+const uint32_t DUMP_MAX_FILES = 10;   // Dump files kept per reason and type, older ones are deleted
+
+/**
+ * Lock-free ring of the last N records (CSerialCapture, CFlightRecorder)
+ *
+ * Writers don't lock: every record claims its slot by incrementing the head
+ * index. The slot sequence number is odd while the record is written, the
+ * reader uses it to skip slots that are not finished or are overwritten
+ * during copying.
+ */
+template <typename T>
+class CDumpRing {
+public:
+   CDumpRing(uint32_t size)
+      : m_size(size), m_slots(new slot_s[size]), m_head(0)
+   {
+      for (uint32_t i = 0; i < m_size; i++)
+         m_slots[i].m_seq.store(0, boost::memory_order_relaxed);
+   }
+
+   uint32_t getSize() const { return m_size; }
+
+   // Claim slot and fill its record by fill(T&)
+   template <class F>
+   void add(F fill)
+   {
+      uint64_t idx  = m_head.fetch_add(1, boost::memory_order_relaxed);
+      slot_s&  slot = m_slots[idx % m_size];
+
+      slot.m_seq.store(idx * 2 + 1, boost::memory_order_relaxed);
+      boost::atomic_thread_fence(boost::memory_order_release);
+      fill(slot.m_rec);
+      slot.m_seq.store(idx * 2 + 2, boost::memory_order_release);
+   }
+
+   // Call visit(const T&) for copy of every finished record, in order of adding.
+   // Returns number of records added since creation
+   template <class V>
+   uint64_t read(V visit) const
+   {
+      uint64_t head  = m_head.load(boost::memory_order_acquire);
+      uint64_t first = head > m_size ? head - m_size : 0;
+      T        copy;
+      for (uint64_t idx = first; idx < head; idx++) {
+         const slot_s& slot = m_slots[idx % m_size];
+         uint64_t seq = slot.m_seq.load(boost::memory_order_acquire);
+         if (seq != idx * 2 + 2)
+            continue;   // not finished or already overwritten
+         copy = slot.m_rec;
+         boost::atomic_thread_fence(boost::memory_order_acquire);
+         if (slot.m_seq.load(boost::memory_order_relaxed) != seq)
+            continue;   // overwritten during copying
+         visit(copy);
+      }
+      return head;
+   }
+
+private:
+   struct slot_s {
+      boost::atomic<uint64_t> m_seq;   // 0 - empty, odd - writing, even - (index + 1) * 2
+      T                       m_rec;
+   };
+
+   uint32_t                  m_size;
+   std::unique_ptr<slot_s[]> m_slots;
+   boost::atomic<uint64_t>   m_head;   // Index of next record
+};
+
+/**
+ * Name of dump file: <dir>/apc_<reason>_<YYYYmmdd-HHMMSS>.<ext> (local time).
+ * Oldest files of the same reason and extension are deleted, so together
+ * with the new one at most DUMP_MAX_FILES are kept
+ */
+std::string getDumpFileName(const std::string& dir, const char * reason, const char * ext);
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "FlightRecorder.h"
+#include "Logger.h"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+const char FLIGHTREC_LOGGER[] = "apc.flightrec";
+
+boost::atomic<CFlightRecorder *> CFlightRecorder::s_recorder(NULL);
+boost::mutex                     CFlightRecorder::s_lock;
+std::string                      CFlightRecorder::s_dumpDir;
+
+static boost::atomic<uint16_t>   s_numThreads(0);
+static thread_local uint16_t     t_threadNum = 0;   // 0 - not assigned
+
+static uint64_t sysTimeNsec()
+{
+   return boost::chrono::duration_cast<boost::chrono::nanoseconds>(SYSTIME_NOW().time_since_epoch()).count();
+}
+
+CFlightRecorder::CFlightRecorder(uint32_t numRecords)
+   : m_ring(numRecords)
+{
+}
+
+void CFlightRecorder::enable(uint32_t numRecords, const std::string& dumpDir)
+{
+   boost::unique_lock<boost::mutex> lock(s_lock);
+   s_dumpDir = dumpDir;
+   if (numRecords > 0 && s_recorder.load() == NULL)
+      s_recorder.store(new CFlightRecorder(numRecords), boost::memory_order_release);
+}
+
+void CFlightRecorder::add_p(flightrec_event_t event, uint32_t arg0, uint32_t arg1, uint32_t arg2)
+{
+   if (t_threadNum == 0)
+      t_threadNum = ++s_numThreads;
+
+   m_ring.add([=](flightrec_record_s& rec) {
+      rec.m_timeNsec = sysTimeNsec();
+      rec.m_event    = static_cast<uint16_t>(event);
+      rec.m_thread   = t_threadNum;
+      rec.m_arg0     = arg0;
+      rec.m_arg1     = arg1;
+      rec.m_arg2     = arg2;
+   });
+}
+
+apc_error_t CFlightRecorder::save_p(const std::string& fileName, uint32_t* pNumRecords)
+{
+   std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+   if (!out)
+      return APC_ERR_IO;
+
+   // Records are copied before writing: header contains their number
+   std::vector<flightrec_record_s> recs;
+   recs.reserve(m_ring.getSize());
+   uint64_t head = m_ring.read([&](const flightrec_record_s& rec) { recs.push_back(rec); });
+   uint32_t numSaved = (uint32_t)recs.size();
+
+   flightrec_file_hdr_s hdr;
+   memset(&hdr, 0, sizeof(hdr));
+   hdr.m_magic        = FILE_MAGIC;
+   hdr.m_version      = FILE_VERSION;
+   hdr.m_recordSize   = sizeof(flightrec_record_s);
+   hdr.m_numRecords   = numSaved;
+   hdr.m_capacity     = m_ring.getSize();
+   hdr.m_numTotal     = head;
+   hdr.m_dumpTimeNsec = sysTimeNsec();
+   out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+   out.write(reinterpret_cast<const char*>(recs.data()), numSaved * sizeof(flightrec_record_s));
+   out.close();
+
+   if (pNumRecords)
+      *pNumRecords = numSaved;
+   return out ? APC_OK : APC_ERR_IO;
+}
+
+apc_error_t CFlightRecorder::dump(const std::string& fileName, uint32_t* pNumRecords)
+{
+   CFlightRecorder * p = s_recorder.load(boost::memory_order_acquire);
+   if (p == NULL)
+      return APC_ERR_STATE;
+   uint32_t    numRecords = 0;
+   apc_error_t res = p->save_p(fileName, &numRecords);
+   if (res == APC_OK) {
+      DUSTLOG_INFO(FLIGHTREC_LOGGER, "Flight recorder saved to " << fileName << " (" << numRecords << " records)");
+   } else {
+      DUSTLOG_ERROR(FLIGHTREC_LOGGER, "Flight recorder save to " << fileName << " failed: " << toString(res));
+   }
+   if (pNumRecords)
+      *pNumRecords = numRecords;
+   return res;
+}
+
+void CFlightRecorder::save(const char * reason)
+{
+   if (s_recorder.load(boost::memory_order_acquire) == NULL)
+      return;
+   std::string dumpDir;
+   {
+      boost::unique_lock<boost::mutex> lock(s_lock);
+      dumpDir = s_dumpDir;
+   }
+   uint32_t numRecords = 0;
+   dump(getDumpFileName(dumpDir, reason, "frec"), &numRecords);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+
+#include "common.h"
+#include "DumpRing.h"
+#include "public/APCError.h"
+
+/**
+ * Events of flight recorder. Meaning of arguments is given in comments.
+ * Keep in sync with python/bin/apc_flightrec.py
+ */
+enum flightrec_event_t {
+   // CAPMTransport
+   FLIGHTREC_APM_SEND        = 1,   ///< Command sent to AP. cmdId, flags, length
+   FLIGHTREC_APM_RETRY       = 2,   ///< Command resent to AP. cmdId, retry number
+   FLIGHTREC_APM_ACK         = 3,   ///< Response received from AP. cmdId, rc, response time (usec)
+   FLIGHTREC_APM_NACK        = 4,   ///< NACK received from AP. cmdId, NACKs in a row
+   FLIGHTREC_APM_NACK_SENT   = 5,   ///< Notification NACKed (input from AP is paused). notifId
+   FLIGHTREC_APM_RETRY_RECV  = 6,   ///< Repeated notification received from AP. notifId, flags
+   FLIGHTREC_APM_AP_LOST     = 7,   ///< No response from AP. max retries
+   // CAPCConnector
+   FLIGHTREC_APC_START       = 20,  ///< Connector started. interface ID
+   FLIGHTREC_APC_CONNECT     = 21,  ///< Connect sent. interface ID, mySeq, yourSeq
+   FLIGHTREC_APC_CONNECTED   = 22,  ///< Connect received. interface ID, mySeq, yourSeq
+   FLIGHTREC_APC_STOP        = 23,  ///< Connector stopped. interface ID, apc_stop_reason_t, apc_error_t
+   // CAPCClient cache
+   FLIGHTREC_CACHE_ADD       = 40,  ///< Packet added. seqNum, apc_msg_type_t, apc_error_t
+   FLIGHTREC_CACHE_CONFIRM   = 41,  ///< Packets confirmed by manager. seqNum, number of cached packets
+   FLIGHTREC_CACHE_RESEND    = 42,  ///< Packet resent after reconnection. seqNum, apc_msg_type_t
+   FLIGHTREC_CACHE_CLEAR     = 43,  ///< Cache cleared. number of cached packets
+   // CAPCoupler
+   FLIGHTREC_CPL_EVENT       = 60,  ///< Event of state machine. event mask
+   FLIGHTREC_CPL_PAUSE       = 61,  ///< Manager paused traffic
+   FLIGHTREC_CPL_RESUME      = 62,  ///< Manager resumed traffic
+   FLIGHTREC_CPL_OFFLINE     = 63,  ///< Manager offline. apc_stop_reason_t
+   FLIGHTREC_CPL_ONLINE      = 64,  ///< Manager online
+   FLIGHTREC_CPL_WD_DISCONNECT = 65,///< Fatal error reported to watchdog. stop severity
+};
+
+/**
+ * Flight recorder of transport and connector events
+ *
+ * Keeps the last N events (24-byte binary records with nanosecond system
+ * time) in a ring buffer. It is always on: recording takes one atomic
+ * increment and does not lock (CDumpRing).
+ *
+ * One recorder exists per process, it is created by enable(). Until then
+ * record() does nothing. The content is saved by dump() or, with a time
+ * stamped name in the dump directory, by save(). The file is decoded by
+ * python/bin/apc_flightrec.py.
+ *
+ * File format (host byte order): flightrec_file_hdr_s, then
+ * flightrec_record_s records in order of recording.
+ */
+class CFlightRecorder {
+public:
+   static const uint32_t FILE_MAGIC   = 0x43455246;  // "FREC"
+   static const uint16_t FILE_VERSION = 1;
+
+   struct flightrec_file_hdr_s {
+      uint32_t m_magic;
+      uint16_t m_version;
+      uint16_t m_recordSize;     // sizeof(flightrec_record_s)
+      uint32_t m_numRecords;     // Records in file
+      uint32_t m_capacity;       // Size of ring
+      uint64_t m_numTotal;       // Records written since start (lost = m_numTotal - m_numRecords)
+      uint64_t m_dumpTimeNsec;   // System time of dump
+   };
+
+   struct flightrec_record_s {
+      uint64_t m_timeNsec;       // System time, nsec from epoch
+      uint16_t m_event;          // flightrec_event_t
+      uint16_t m_thread;         // Sequential number of recording thread
+      uint32_t m_arg0;
+      uint32_t m_arg1;
+      uint32_t m_arg2;
+   };
+
+   // Create recorder with ring of 'numRecords' records (0 - disable).
+   // The ring is created once, later calls change the dump directory only
+   static void        enable(uint32_t numRecords, const std::string& dumpDir);
+
+   // Add event
+   static void        record(flightrec_event_t event, uint32_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0)
+   {
+      CFlightRecorder * p = s_recorder.load(boost::memory_order_acquire);
+      if (p)
+         p->add_p(event, arg0, arg1, arg2);
+   }
+
+   // Save content of ring buffer to file. APC_ERR_STATE if recorder is disabled
+   static apc_error_t dump(const std::string& fileName, uint32_t* pNumRecords);
+
+   // Save content of ring buffer to file in dump directory (DUMP_MAX_FILES per reason are kept)
+   static void        save(const char * reason);
+
+private:
+   CFlightRecorder(uint32_t numRecords);
+
+   void        add_p(flightrec_event_t event, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+   apc_error_t save_p(const std::string& fileName, uint32_t* pNumRecords);
+
+   CDumpRing<flightrec_record_s> m_ring;
+
+   // Never deleted: threads may record at any time
+   static boost::atomic<CFlightRecorder *> s_recorder;
+   static boost::mutex                     s_lock;      // s_dumpDir, creation of recorder
+   static std::string                      s_dumpDir;
+};
@@ -129,15 +129,33 @@ std::vector<unsigned char> encodeHDLC(const std::vector<unsigned char>& src)
 // HDLC_DATA (PAD) -> PACKET_COMPLETE, callback
 // HDLC_DATA (any) -> HDLC_DATA, append
 
+// HDLC_ESCAPE (PAD) -> PACKET_COMPLETE, abort
 // HDLC_ESCAPE (any) -> HDLC_DATA, append
 
+// HDLC_DISCARD (PAD) -> PACKET_COMPLETE
+// HDLC_DISCARD (any) -> HDLC_DISCARD
+
+// append to full buffer -> HDLC_DISCARD, oversize
+
 // 
 void CHDLC::addByte(uint8_t b)
 {
-   if (m_state == HDLC_ESCAPE) {
+   if (m_state == HDLC_DISCARD) {
+      if (b == HDLC_PADDING)
+         reset();
+      else
+         m_stats.m_numDiscardedBytes++;
+   }
+   else if (m_state == HDLC_ESCAPE) {
+      if (b == HDLC_PADDING) {
+         // abort sequence: drop frame, flag starts the next one
+         dropFrame(HDLC_ERR_ABORT);
+         reset();
+         return;
+      }
       uint8_t translated = b ^ HDLC_XORBYTE;
-      append(translated);
       m_state = HDLC_DATA;
+      append(translated);
    }
    else if (b == HDLC_ESCCHAR) {
       m_state = HDLC_ESCAPE;
@@ -146,17 +164,21 @@ void CHDLC::addByte(uint8_t b)
       int len = m_buffer.size();
       if (len > 2) {
          uint16_t fcs = (m_buffer[len-2] * 256) + m_buffer[len-1];
-         m_buffer.pop_back();
-         m_buffer.pop_back();
          // validate checksum
          if (validateChecksum(fcs)) {
+            m_buffer.pop_back();
+            m_buffer.pop_back();
+            m_stats.m_numFrames++;
             callback();
+         } else {
+            dropFrame(HDLC_ERR_FCS);
          }
-         // TODO: handle checksum error
+      } else if (len > 0) {
+         dropFrame(HDLC_ERR_RUNT);
       }
-      // small packets are silently dropped
       reset();
    } else {
+      m_state = HDLC_DATA;
       append(b);
    }
 }
@@ -171,6 +193,14 @@ bool CHDLC::validateChecksum(uint16_t frameFcs) {
 }
 
 void CHDLC::append(uint8_t byte) {
+   if (m_buffer.size() >= m_maxLength) {
+      // no space for the byte: drop frame and skip rest of it
+      dropFrame(HDLC_ERR_OVERSIZE);
+      m_stats.m_numDiscardedBytes++;
+      m_buffer.clear();
+      m_state = HDLC_DISCARD;
+      return;
+   }
    m_buffer.push_back(byte);
    m_runningFCS = addOneByteToFcs16(m_runningFCS, byte);
 }
@@ -181,6 +211,18 @@ void CHDLC::callback() {
    }
 }
 
+void CHDLC::dropFrame(hdlc_error_t err) {
+   switch(err) {
+   case HDLC_ERR_FCS:      m_stats.m_numFcsErrors++; break;
+   case HDLC_ERR_RUNT:     m_stats.m_numRunts++;     break;
+   case HDLC_ERR_OVERSIZE: m_stats.m_numOversize++;  break;
+   case HDLC_ERR_ABORT:    m_stats.m_numAborts++;    break;
+   }
+   m_stats.m_numDiscardedBytes += m_buffer.size();
+   if (m_handler)
+      m_handler->frameError(err, m_buffer.size());
+}
+
 void CHDLC::reset() {
    m_state = HDLC_PACKET_COMPLETE;
    m_buffer.clear();
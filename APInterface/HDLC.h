@@ -23,10 +23,35 @@ std::vector<uint8_t> encodeHDLC(const std::vector<uint8_t>& src);
  */
 uint16_t computeFCS16(const std::vector<uint8_t>& data);
 
+/**
+ * Reasons for dropping input frame
+ */
+enum hdlc_error_t {
+   HDLC_ERR_FCS,        // "FCS error"
+   HDLC_ERR_RUNT,       // "Runt frame"
+   HDLC_ERR_OVERSIZE,   // "Oversize frame"
+   HDLC_ERR_ABORT,      // "Abort sequence"
+};
+ENUM2STR(hdlc_error_t);
+
+/**
+ * HDLC decoder statistics
+ */
+struct hdlc_stats_s {
+   uint32_t m_numFrames;         // Number of valid frames
+   uint32_t m_numFcsErrors;      // Frames with wrong checksum
+   uint32_t m_numRunts;          // Frames shorter than FCS
+   uint32_t m_numOversize;       // Frames longer than input buffer
+   uint32_t m_numAborts;         // Frames terminated by abort sequence (ESC + flag)
+   uint64_t m_numDiscardedBytes; // Bytes of all dropped frames
+};
+
 // TODO: needs a better name
 class IHDLCCallback {
 public:
    virtual void frameComplete(const std::vector<uint8_t>& packet) = 0;
+   // Optional notification about dropped frame
+   virtual void frameError(hdlc_error_t err, size_t length) {;}
 };
 
 
@@ -35,29 +60,38 @@ class CHDLC {
       HDLC_PACKET_COMPLETE,
       HDLC_DATA,
       HDLC_ESCAPE,
+      HDLC_DISCARD,     // Oversize frame, skip bytes up to next flag
    };
 
 public:
+   // inputLength - max length of frame (without FCS)
    CHDLC(int inputLength, IHDLCCallback* handler) 
       : m_handler(handler),
         m_state(HDLC_PACKET_COMPLETE),
         m_buffer(inputLength),
+        m_maxLength(inputLength + sizeof(uint16_t)),
         m_runningFCS(0)
-   { reset(); }
+   { reset(); clearStats(); }
 
    void addByte(uint8_t b);
 
+   const hdlc_stats_s& getStats() const { return m_stats; }
+   void clearStats() { memset(&m_stats, 0, sizeof(m_stats)); }
+
 private:
    bool validateChecksum(uint16_t frameFcs);
    void append(uint8_t byte);
    void callback();
    void reset();
+   void dropFrame(hdlc_error_t err);
 
    IHDLCCallback* m_handler;
 
    ParseState   m_state;
    std::vector<uint8_t> m_buffer;
+   size_t       m_maxLength;
    uint32_t     m_runningFCS;
+   hdlc_stats_s m_stats;
 };
 
 
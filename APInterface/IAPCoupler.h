@@ -128,6 +128,11 @@ public:
     */
    virtual void handleAPResume() = 0;
 
+   /**
+    * Handle change of free space in the output queue to the AP (credit of manager)
+    */
+   virtual void handleAPQueueSpace(uint32_t numFree) = 0;
+
    /**
     * Handle AP Boot Notification
     */
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "MoteTrafficStats.h"
+#include "6lowpan/6lowpanhdr.h"
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+
+static const uint8_t MESH_DISPATCH   = 0x00;   // First byte of mesh packet
+static const size_t  MESH_SRC_OFFSET = 1 + sizeof(mesh_hdr_bgn_t);
+
+CMoteTrafficStats::CMoteTrafficStats() : m_size(0)
+{
+   clearStat();
+}
+
+void CMoteTrafficStats::setSize(uint32_t size)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   m_size = size;
+   m_heap.clear();
+   m_heap.reserve(size);
+   m_index.clear();
+   m_index.reserve(size);
+}
+
+bool CMoteTrafficStats::parseMeshHdr(const uint8_t * pData, size_t size, mote_addr_s * pAddr, uint8_t * pPriority)
+{
+   if (size < MESH_SRC_OFFSET || pData[0] != MESH_DISPATCH)
+      return false;
+   const mesh_spec_t& spec = ((const mesh_hdr_bgn_t *)(pData + 1))->meshSpec;
+   if (spec.srcElided)
+      pAddr->m_len = 0;
+   else
+      pAddr->m_len = spec.fLongSrc ? MAC_LONG_ADDR : MAC_SHORT_ADDR;
+   if (size < MESH_SRC_OFFSET + pAddr->m_len)
+      return false;
+
+   pAddr->m_addr = 0;
+   for (const uint8_t * p = pData + MESH_SRC_OFFSET; p < pData + MESH_SRC_OFFSET + pAddr->m_len; p++)
+      pAddr->m_addr = (pAddr->m_addr << 8) | *p;
+   *pPriority = spec.priority;
+   return true;
+}
+
+void CMoteTrafficStats::addPacket(const uint8_t * pData, size_t size)
+{
+   if (m_size == 0)
+      return;
+
+   mote_addr_s addr;
+   uint8_t     priority;
+   bool        isValid = parseMeshHdr(pData, size, &addr, &priority);
+
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (!isValid) {
+      m_numBadPkts++;
+      return;
+   }
+   m_numPkts++;
+   m_numBytes += size;
+   m_numPktsByPriority[priority]++;
+
+   auto it = m_index.find(addr);
+   if (it == m_index.end() && m_heap.size() < m_size) {
+      mote_traffic_s mote;
+      memset(&mote, 0, sizeof(mote));
+      mote.m_addr     = addr;
+      mote.m_numPkts  = 1;
+      mote.m_numBytes = size;
+      mote.m_numPktsByPriority[priority] = 1;
+      m_heap.push_back(mote);
+      m_index[addr] = m_heap.size() - 1;
+      siftUp_p(m_heap.size() - 1);
+      return;
+   }
+
+   size_t pos = 0;
+   if (it != m_index.end()) {
+      pos = it->second;
+   } else {
+      // Table is full: the least active mote is replaced
+      mote_traffic_s& mote = m_heap[0];
+      m_index.erase(mote.m_addr);
+      m_index[addr]   = 0;
+      mote.m_addr     = addr;
+      mote.m_errPkts  = mote.m_numPkts;
+      mote.m_errBytes = mote.m_numBytes;
+      memset(mote.m_numPktsByPriority, 0, sizeof(mote.m_numPktsByPriority));
+   }
+   mote_traffic_s& mote = m_heap[pos];
+   mote.m_numPkts++;
+   mote.m_numBytes += size;
+   mote.m_numPktsByPriority[priority]++;
+   siftDown_p(pos);
+}
+
+void CMoteTrafficStats::getStat(mote_traffic_stats_s * pStat, uint32_t maxMotes)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   pStat->m_tableSize  = m_size;
+   pStat->m_numPkts    = m_numPkts;
+   pStat->m_numBytes   = m_numBytes;
+   pStat->m_numBadPkts = m_numBadPkts;
+   memcpy(pStat->m_numPktsByPriority, m_numPktsByPriority, sizeof(m_numPktsByPriority));
+   pStat->m_motes = m_heap;
+   lock.unlock();
+
+   sort(pStat->m_motes.begin(), pStat->m_motes.end(),
+        [](const mote_traffic_s& a, const mote_traffic_s& b) {
+           return a.m_numPkts - a.m_errPkts > b.m_numPkts - b.m_errPkts;
+        });
+   if (maxMotes > 0 && pStat->m_motes.size() > maxMotes)
+      pStat->m_motes.resize(maxMotes);
+}
+
+void CMoteTrafficStats::clearStat()
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   m_heap.clear();
+   m_index.clear();
+   m_numPkts    = 0;
+   m_numBytes   = 0;
+   m_numBadPkts = 0;
+   memset(m_numPktsByPriority, 0, sizeof(m_numPktsByPriority));
+}
+
+void CMoteTrafficStats::siftUp_p(size_t pos)
+{
+   while (pos > 0) {
+      size_t parent = (pos - 1) / 2;
+      if (m_heap[parent].m_numPkts <= m_heap[pos].m_numPkts)
+         break;
+      swap_p(parent, pos);
+      pos = parent;
+   }
+}
+
+void CMoteTrafficStats::siftDown_p(size_t pos)
+{
+   for (;;) {
+      size_t smallest = pos;
+      size_t left     = 2 * pos + 1;
+      size_t right    = left + 1;
+      if (left < m_heap.size() && m_heap[left].m_numPkts < m_heap[smallest].m_numPkts)
+         smallest = left;
+      if (right < m_heap.size() && m_heap[right].m_numPkts < m_heap[smallest].m_numPkts)
+         smallest = right;
+      if (smallest == pos)
+         break;
+      swap_p(pos, smallest);
+      pos = smallest;
+   }
+}
+
+void CMoteTrafficStats::swap_p(size_t pos1, size_t pos2)
+{
+   swap(m_heap[pos1], m_heap[pos2]);
+   m_index[m_heap[pos1].m_addr] = pos1;
+   m_index[m_heap[pos2].m_addr] = pos2;
+}
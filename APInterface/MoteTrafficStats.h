@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+const uint8_t MOTE_NUM_PRIORITIES = 4;   // Priorities of mesh specifier
+
+/**
+ * Source address of upstream mesh packet
+ */
+struct mote_addr_s {
+   uint64_t m_addr;     ///< Short or long address, MSB first
+   uint8_t  m_len;      ///< Length of address: 0 (elided), 2 (short) or 8 (long)
+
+   bool operator==(const mote_addr_s& other) const {
+      return m_addr == other.m_addr && m_len == other.m_len;
+   }
+};
+
+/**
+ * Upstream traffic of one mote
+ *
+ * Counters are upper bounds, counters minus errors are lower bounds
+ * (see CMoteTrafficStats).
+ */
+struct mote_traffic_s {
+   mote_addr_s m_addr;
+   uint64_t    m_numPkts;                                ///< Packets
+   uint64_t    m_numBytes;                               ///< Bytes
+   uint64_t    m_errPkts;                                ///< Max overestimation of m_numPkts
+   uint64_t    m_errBytes;                               ///< Max overestimation of m_numBytes
+   uint64_t    m_numPktsByPriority[MOTE_NUM_PRIORITIES]; ///< Packets by priority since mote is in table
+};
+
+/**
+ * Upstream traffic statistics (see CMoteTrafficStats)
+ */
+struct mote_traffic_stats_s {
+   uint32_t                    m_tableSize;     ///< Max number of tracked motes
+   uint64_t                    m_numPkts;       ///< All upstream mesh packets
+   uint64_t                    m_numBytes;      ///< Bytes of all upstream mesh packets
+   uint64_t                    m_numBadPkts;    ///< Packets without valid mesh header
+   uint64_t                    m_numPktsByPriority[MOTE_NUM_PRIORITIES];
+   std::vector<mote_traffic_s> m_motes;         ///< Heaviest motes, sorted by guaranteed packets
+};
+
+/**
+ * Per-mote accounting of upstream packets
+ *
+ * Source address and priority are read in place from mesh header of
+ * packets received from AP. Only the heaviest motes are kept in bounded
+ * table (space-saving algorithm): when the table is full, the mote with
+ * the least packets is replaced by the new one, which inherits its
+ * counters as error. Every mote with more than numPkts/tableSize packets
+ * is guaranteed to be in the table. The table is min-heap by packets,
+ * so update of a mote is O(log tableSize).
+ */
+class CMoteTrafficStats {
+public:
+   CMoteTrafficStats();
+
+   // Set max number of tracked motes (0 - disable) and clear the table.
+   // Must be called before accounting is started
+   void setSize(uint32_t size);
+   bool isEnabled() const { return m_size > 0; }
+
+   // Account mesh packet received from AP
+   void addPacket(const uint8_t * pData, size_t size);
+
+   // Get statistics with 'maxMotes' heaviest motes (0 - all)
+   void getStat(mote_traffic_stats_s * pStat, uint32_t maxMotes);
+   void clearStat();
+
+   // Get source address and priority of mesh packet without copying.
+   // Returns false if it is not valid mesh packet
+   static bool parseMeshHdr(const uint8_t * pData, size_t size, mote_addr_s * pAddr, uint8_t * pPriority);
+
+private:
+   struct addr_hash_s {
+      size_t operator()(const mote_addr_s& addr) const {
+         return std::hash<uint64_t>()(addr.m_addr) ^ addr.m_len;
+      }
+   };
+   typedef std::unordered_map<mote_addr_s, size_t, addr_hash_s> index_t;
+
+   // Restore heap order (m_lock is locked)
+   void siftUp_p(size_t pos);
+   void siftDown_p(size_t pos);
+   void swap_p(size_t pos1, size_t pos2);
+
+   uint32_t                    m_size;
+   boost::mutex                m_lock;
+   std::vector<mote_traffic_s> m_heap;     // Min-heap by m_numPkts
+   index_t                     m_index;    // Address -> position in m_heap
+
+   uint64_t                    m_numPkts;
+   uint64_t                    m_numBytes;
+   uint64_t                    m_numBadPkts;
+   uint64_t                    m_numPktsByPriority[MOTE_NUM_PRIORITIES];
+};
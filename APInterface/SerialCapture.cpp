@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "SerialCapture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// pcap file format
+const uint32_t PCAP_MAGIC         = 0xa1b2c3d4;  // Microseconds timestamps, host byte order
+const uint16_t PCAP_VERSION_MAJOR = 2;
+const uint16_t PCAP_VERSION_MINOR = 4;
+const uint32_t PCAP_LINKTYPE_USER0 = 147;
+
+struct pcap_hdr_s {
+   uint32_t magic;
+   uint16_t versionMajor;
+   uint16_t versionMinor;
+   int32_t  thisZone;
+   uint32_t sigFigs;
+   uint32_t snapLen;
+   uint32_t linkType;
+};
+
+struct pcap_rec_hdr_s {
+   uint32_t tsSec;
+   uint32_t tsUsec;
+   uint32_t inclLen;
+   uint32_t origLen;
+};
+
+CSerialCapture::CSerialCapture(uint32_t numFrames)
+   : m_ring(numFrames)
+{
+}
+
+void CSerialCapture::add(capture_dir_t dir, const uint8_t* data, size_t length)
+{
+   m_ring.add([=](frame_s& frame) {
+      frame.m_timeUsec = TIME_D2USEC(SYSTIME_NOW().time_since_epoch());
+      frame.m_dir      = static_cast<uint8_t>(dir);
+      frame.m_origLen  = static_cast<uint16_t>(std::min<size_t>(length, UINT16_MAX));
+      frame.m_len      = data ? static_cast<uint16_t>(std::min<size_t>(length, CAPTURE_MAX_FRAME_LEN)) : 0;
+      if (frame.m_len > 0)
+         memcpy(frame.m_data, data, frame.m_len);
+   });
+}
+
+apc_error_t CSerialCapture::save(const std::string& fileName, uint32_t* pNumFrames)
+{
+   std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+   if (!out)
+      return APC_ERR_IO;
+
+   pcap_hdr_s hdr = { PCAP_MAGIC, PCAP_VERSION_MAJOR, PCAP_VERSION_MINOR, 0, 0,
+                      CAPTURE_MAX_FRAME_LEN + 1, PCAP_LINKTYPE_USER0 };
+   out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+
+   uint32_t numSaved = 0;
+   m_ring.read([&](const frame_s& frame) {
+      pcap_rec_hdr_s rec = { static_cast<uint32_t>(frame.m_timeUsec / 1000000),
+                             static_cast<uint32_t>(frame.m_timeUsec % 1000000),
+                             static_cast<uint32_t>(frame.m_len) + 1,
+                             static_cast<uint32_t>(frame.m_origLen) + 1 };
+      out.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+      out.write(reinterpret_cast<const char*>(&frame.m_dir), sizeof(frame.m_dir));
+      out.write(reinterpret_cast<const char*>(frame.m_data), frame.m_len);
+      numSaved++;
+   });
+   out.close();
+
+   if (pNumFrames)
+      *pNumFrames = numSaved;
+   return out ? APC_OK : APC_ERR_IO;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "common.h"
+#include "DumpRing.h"
+#include "public/APCError.h"
+
+/**
+ * Direction of captured frame
+ */
+enum capture_dir_t {
+   CAPTURE_DIR_TO_AP   = 0,   // Frame sent to AP
+   CAPTURE_DIR_FROM_AP = 1,   // Frame received from AP
+   CAPTURE_DIR_DROPPED = 2,   // Input frame dropped by HDLC decoder (length only)
+};
+
+const uint16_t CAPTURE_MAX_FRAME_LEN = 256;  // Longer frames are truncated
+
+/**
+ * Capture of serial traffic (flight recorder)
+ *
+ * Keeps the last N frames (decoded HDLC payload) in a ring buffer
+ * (CDumpRing, writers don't lock).
+ *
+ * The content is saved to pcap file (link type USER0). Every packet starts
+ * from one byte of direction (capture_dir_t) followed by the frame payload.
+ */
+class CSerialCapture {
+public:
+   CSerialCapture(uint32_t numFrames);
+   ~CSerialCapture() {;}
+
+   // Add frame to ring buffer. 'data' can be NULL to record length only
+   void        add(capture_dir_t dir, const uint8_t* data, size_t length);
+
+   // Save content of ring buffer to pcap file
+   apc_error_t save(const std::string& fileName, uint32_t* pNumFrames);
+
+   uint32_t    getNumFrames() const { return m_ring.getSize(); }
+
+private:
+   struct frame_s {
+      uint64_t m_timeUsec;             // System time (usec from epoch)
+      uint16_t m_origLen;              // Frame length
+      uint16_t m_len;                  // Number of saved bytes
+      uint8_t  m_dir;                  // capture_dir_t
+      uint8_t  m_data[CAPTURE_MAX_FRAME_LEN];
+   };
+
+   CDumpRing<frame_s>        m_ring;
+};
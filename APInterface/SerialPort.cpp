@@ -7,6 +7,7 @@
 #endif
 
 #include "SerialPort.h"
+#include "APMTransport.h"
 #include "apc_common.h"
 #include "Logger.h"
 
@@ -23,8 +24,6 @@
 
 using namespace boost::asio;
 
-const size_t MAX_HDLC_BUFFER_LEN = 256;
-
 const int DEFAULT_READ_TIMEOUT = 0;
 
 const char RESET_PORT_DATA[] = { 0 };
@@ -35,12 +34,13 @@ const char SERIAL_LOGGER[] = "apm.io.serial";
 
 CSerialPort::CSerialPort(boost::asio::io_service& io_service,
                          std::string apiPort, std::string resetPort,
-                         EAPResetSignal resetSignal,
+                         EAPResetSignal resetSignal, size_t maxMsgSize,
                          uint32_t  baud, bool useHDLC)
    : m_io_service(io_service),
      m_inputHandler(nullptr),
      m_readTimeout(DEFAULT_READ_TIMEOUT),
      m_encoder(NULL),
+     m_capture(NULL),
      m_apiPort(apiPort),
      m_resetPort(resetPort),
      m_serial(io_service),
@@ -49,7 +49,8 @@ CSerialPort::CSerialPort(boost::asio::io_service& io_service,
      m_input(INPUT_BUFFER_LEN)
 {
    if (useHDLC) {
-      m_encoder = new CHDLC(MAX_HDLC_BUFFER_LEN, this);
+      // Frame is header of AP API message and payload (FCS is added by CHDLC)
+      m_encoder = new CHDLC(apt_hdr_s::LENGTH + maxMsgSize, this);
    }
 
 #if 0
@@ -109,6 +110,7 @@ CSerialPort::~CSerialPort()
 {
    stop();
    delete m_encoder;
+   delete m_capture;
 }
 
 apc_error_t CSerialPort::start(IAPMMsgHandler& inputHandler)
@@ -148,6 +150,8 @@ void CSerialPort::handleRead(const boost::system::error_code& error,
 {
    mngr_time_t startTime = TIME_NOW();
    if (!error) {
+      // Frames are counted by frameComplete (HDLC) or here (raw mode)
+      m_rateFromAP.addEvent(m_encoder ? 0 : 1, length);
 
       if (m_inputHandler != NULL) {
          if (m_encoder) {
@@ -180,15 +184,70 @@ void CSerialPort::handleRead(const boost::system::error_code& error,
 // this handler is called when a complete HDLC frame is received
 void CSerialPort::frameComplete(const std::vector<uint8_t>& data)
 {
+   m_rateFromAP.addEvent(1, 0);
+   if (m_capture)
+      m_capture->add(CAPTURE_DIR_FROM_AP, data.data(), data.size());
    if (m_inputHandler) {
-      std::ostringstream os;
-      os << "HDLC frame " << "[" << data.size() << "]";
-      DUSTLOG_TRACEDATA(SERIAL_LOGGER, os.str(), data.data(), data.size());
+      DUSTLOG_TRACEDATA(SERIAL_LOGGER, "HDLC frame [" << data.size() << "]", data.data(), data.size());
 
       m_inputHandler->dataReceived(data.data(), data.size());
    }
 }
 
+// this handler is called when the HDLC decoder drops a frame
+void CSerialPort::frameError(hdlc_error_t err, size_t length)
+{
+   DUSTLOG_DEBUG(SERIAL_LOGGER, "HDLC frame dropped: " << toString(err) << " [" << length << "]");
+   if (m_capture)
+      m_capture->add(CAPTURE_DIR_DROPPED, NULL, length);
+   if (m_inputHandler)
+      m_inputHandler->frameError();
+}
+
+hdlc_stats_s CSerialPort::getHDLCStats()
+{
+   hdlc_stats_s res;
+   if (m_encoder)
+      res = m_encoder->getStats();
+   else
+      memset(&res, 0, sizeof(res));
+   return res;
+}
+
+void CSerialPort::clearHDLCStats()
+{
+   if (m_encoder)
+      m_encoder->clearStats();
+}
+
+void CSerialPort::enableCapture(uint32_t numFrames, const std::string& captureDir)
+{
+   delete m_capture;
+   m_capture = numFrames > 0 ? new CSerialCapture(numFrames) : NULL;
+   m_captureDir = captureDir;
+}
+
+apc_error_t CSerialPort::dumpCapture(const std::string& fileName, uint32_t* pNumFrames)
+{
+   if (!m_capture)
+      return APC_ERR_STATE;
+   apc_error_t res = m_capture->save(fileName, pNumFrames);
+   if (res == APC_OK) {
+      DUSTLOG_INFO(SERIAL_LOGGER, "Serial capture saved to " << fileName << " (" << *pNumFrames << " frames)");
+   } else {
+      DUSTLOG_ERROR(SERIAL_LOGGER, "Serial capture save to " << fileName << " failed: " << toString(res));
+   }
+   return res;
+}
+
+void CSerialPort::saveCapture(const char * reason)
+{
+   if (!m_capture)
+      return;
+   uint32_t numFrames = 0;
+   dumpCapture(getDumpFileName(m_captureDir, reason, "pcap"), &numFrames);
+}
+
 int CSerialPort::handleData(const std::vector<uint8_t>& data)
 {
    write(data);
@@ -208,13 +267,15 @@ void CSerialPort::write(const iobuffer_t& data)
       std::copy(data.begin(), data.end(), std::back_inserter(output));
    }
 
-   std::ostringstream os;
-   os << "HDLC output " << "[" << data.size() << "/" << output.size() << " BufID:" << budId << "]";
-   DUSTLOG_TRACEDATA(SERIAL_LOGGER, os.str(), output.data(), output.size());
+   DUSTLOG_TRACEDATA(SERIAL_LOGGER, "HDLC output [" << data.size() << "/" << output.size() << " BufID:" << budId << "]",
+                     output.data(), output.size());
    boost::asio::async_write(m_serial, boost::asio::buffer(output.data(), output.size()),
                             boost::bind(&CSerialPort::handleWriteComplete, this, budId,
                                         boost::asio::placeholders::error));
    m_statToAP.addEvent(startTime);
+   m_rateToAP.addPacket(output.size());
+   if (m_capture)
+      m_capture->add(CAPTURE_DIR_TO_AP, data.data(), data.size());
 }
 
 void CSerialPort::handleWriteComplete(CBufferPool::iobufid_t bufId, const boost::system::error_code& error)
@@ -327,4 +388,18 @@ CSerialPort::iobuffer_t& CSerialPort::CBufferPool::get(iobufid_t bufId)
    return m_pool[bufId].second;
 }
 
- 
\ No newline at end of file
+ 
+
+ratestat_s CSerialPort::getRateToAP()
+{
+   ratestat_s res;
+   m_rateToAP.getStat(&res);
+   return res;
+}
+
+ratestat_s CSerialPort::getRateFromAP()
+{
+   ratestat_s res;
+   m_rateFromAP.getStat(&res);
+   return res;
+}
@@ -10,7 +10,9 @@
 
 #include "common.h"
 #include "StatDelaysCalc.h"
+#include "StatRateCalc.h"
 #include "HDLC.h"
+#include "SerialCapture.h"
 #include "public/APCError.h"
 
 
@@ -49,6 +51,9 @@ public:
 
    //restart APM Port
    virtual apc_error_t restart() = 0;
+
+   // Save captured traffic (optional)
+   virtual void saveCapture(const char * reason) {;}
 };
 
 /**
@@ -59,6 +64,8 @@ class IAPMMsgHandler
 public:
    virtual ~IAPMMsgHandler() { ; }
    virtual apc_error_t dataReceived(const uint8_t* data, size_t size) = 0;
+   // Corrupted frame was dropped by HDLC decoder (optional)
+   virtual void frameError() {;}
 };
 
 
@@ -70,10 +77,12 @@ extern const uint32_t DEFAULT_BAUD_RATE;
 class CSerialPort : public IInputHandler, public IHDLCCallback {
 public:
    /**
+    * maxMsgSize - max size of AP API message (apm-max-msg-size), longer HDLC
+    *              frames are dropped
     */
    CSerialPort(boost::asio::io_service& io_service,
                std::string apiPort, std::string resetPort,
-               EAPResetSignal resetSignal,
+               EAPResetSignal resetSignal, size_t maxMsgSize,
               uint32_t baud = DEFAULT_BAUD_RATE, bool useHDLC = true);
    
    virtual ~CSerialPort();
@@ -97,6 +106,9 @@ public:
    // this handler is called when a complete frame is received by the HDLC decoder
    virtual void frameComplete(const std::vector<uint8_t>& data);
 
+   // this handler is called when the HDLC decoder drops a frame
+   virtual void frameError(hdlc_error_t err, size_t length);
+
    //to check if serialport is ready
    virtual bool isReady();
 
@@ -111,7 +123,19 @@ public:
 
    statdelays_s getStatToAP();
    statdelays_s getStatFromAP();
+   ratestat_s   getRateToAP();
+   ratestat_s   getRateFromAP();
    uint32_t     getNumOutBuffers() const { return m_outbufPool.getNumOutBuffers(); }
+   hdlc_stats_s getHDLCStats();
+   void         clearHDLCStats();
+
+   // Keep the last 'numFrames' frames in memory (0 - disable capture).
+   // Must be called before start()
+   void         enableCapture(uint32_t numFrames, const std::string& captureDir);
+   // Save captured frames to pcap file
+   apc_error_t  dumpCapture(const std::string& fileName, uint32_t* pNumFrames);
+   // Save captured frames to file in capture directory (DUMP_MAX_FILES per reason are kept)
+   virtual void saveCapture(const char * reason);
 
 private:
    typedef std::vector<uint8_t> iobuffer_t;
@@ -144,6 +168,8 @@ private:
    // serial port options
    int m_readTimeout; // millisecond timeout for read operations
    CHDLC* m_encoder;
+   CSerialCapture* m_capture;
+   std::string m_captureDir;
    
    // serial port
    std::string m_apiPort;
@@ -162,4 +188,6 @@ private:
 
    CStatDelaysCalc m_statToAP;
    CStatDelaysCalc m_statFromAP;
+   CStatRateCalc   m_rateToAP;     // HDLC frames / raw bytes written to AP
+   CStatRateCalc   m_rateFromAP;   // HDLC frames / raw bytes read from AP
 };
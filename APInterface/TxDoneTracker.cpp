@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "TxDoneTracker.h"
+#include <boost/assign/list_of.hpp>
+
+using namespace std;
+
+static const sec_t TXDONE_MAX_AGE         = sec_t(600);  // Max time of packet without TX done
+static const sec_t TXDONE_EXPIRE_INTERVAL = sec_t(10);   // Period of check of expired packets
+
+// Thresholds: apc internal stages are short, mesh delivery takes seconds
+static const vector<usec_t> APC_THRESHOLDS  = boost::assign::list_of
+   (usec_t(1000))
+   (usec_t(5000))
+   (usec_t(10000))
+   (usec_t(50000))
+;
+static const vector<usec_t> AP_THRESHOLDS   = boost::assign::list_of
+   (usec_t(10000))
+   (usec_t(50000))
+   (usec_t(100000))
+   (usec_t(500000))
+;
+static const vector<usec_t> MESH_THRESHOLDS = boost::assign::list_of
+   (usec_t(1000000))
+   (usec_t(5000000))
+   (usec_t(10000000))
+   (usec_t(30000000))
+;
+
+CTxDoneTracker::CTxDoneTracker() :
+   m_lastExpire(TIME_NOW()),
+   m_numFailed(0),
+   m_numLost(0),
+   m_numUnknown(0)
+{
+   m_rxToQueue.setThresholds(APC_THRESHOLDS);
+   m_queueToAck.setThresholds(AP_THRESHOLDS);
+   m_ackToTxDone.setThresholds(MESH_THRESHOLDS);
+   m_total.setThresholds(MESH_THRESHOLDS);
+}
+
+void CTxDoneTracker::received(uint16_t txDoneId, const mngr_time_t& rxTime)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   mngr_time_t now = TIME_NOW();
+   if (now - m_lastExpire >= TXDONE_EXPIRE_INTERVAL)
+      expire_p(now);
+
+   entry_s entry = { rxTime, TIME_EMPTY, TIME_EMPTY };
+   auto res = m_entries.insert(entries_t::value_type(txDoneId, entry));
+   if (!res.second) {
+      // Id is reused: previous packet never got TX done
+      res.first->second = entry;
+      m_numLost++;
+   }
+}
+
+void CTxDoneTracker::enqueued(uint16_t txDoneId)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   auto it = m_entries.find(txDoneId);
+   if (it == m_entries.end())
+      return;
+   it->second.m_queueTime = TIME_NOW();
+   m_rxToQueue.addEvent(TO_USEC(it->second.m_queueTime - it->second.m_rxTime));
+}
+
+void CTxDoneTracker::acked(uint16_t txDoneId)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   auto it = m_entries.find(txDoneId);
+   if (it == m_entries.end() || it->second.m_queueTime == TIME_EMPTY)
+      return;
+   it->second.m_ackTime = TIME_NOW();
+   m_queueToAck.addEvent(TO_USEC(it->second.m_ackTime - it->second.m_queueTime));
+}
+
+void CTxDoneTracker::failed(uint16_t txDoneId)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   if (m_entries.erase(txDoneId) > 0)
+      m_numFailed++;
+}
+
+void CTxDoneTracker::txDone(uint16_t txDoneId)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   auto it = m_entries.find(txDoneId);
+   if (it == m_entries.end()) {
+      m_numUnknown++;
+      return;
+   }
+   mngr_time_t now = TIME_NOW();
+   if (it->second.m_ackTime != TIME_EMPTY)
+      m_ackToTxDone.addEvent(TO_USEC(now - it->second.m_ackTime));
+   m_total.addEvent(TO_USEC(now - it->second.m_rxTime));
+   m_entries.erase(it);
+}
+
+void CTxDoneTracker::dropAll()
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   m_numLost += m_entries.size();
+   m_entries.clear();
+}
+
+void CTxDoneTracker::getStat(txdone_latency_stats_s * pStat)
+{
+   m_rxToQueue.getStat(&pStat->m_rxToQueue);
+   m_queueToAck.getStat(&pStat->m_queueToAck);
+   m_ackToTxDone.getStat(&pStat->m_ackToTxDone);
+   m_total.getStat(&pStat->m_total);
+
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   pStat->m_numInFlight = (uint32_t)m_entries.size();
+   pStat->m_numFailed   = m_numFailed;
+   pStat->m_numLost     = m_numLost;
+   pStat->m_numUnknown  = m_numUnknown;
+}
+
+void CTxDoneTracker::clearStat()
+{
+   m_rxToQueue.clear();
+   m_queueToAck.clear();
+   m_ackToTxDone.clear();
+   m_total.clear();
+
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   m_numFailed  = 0;
+   m_numLost    = 0;
+   m_numUnknown = 0;
+}
+
+void CTxDoneTracker::expire_p(const mngr_time_t& now)
+{
+   m_lastExpire = now;
+   for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+      if (now - it->second.m_rxTime > TXDONE_MAX_AGE) {
+         it = m_entries.erase(it);
+         m_numLost++;
+      } else {
+         ++it;
+      }
+   }
+}
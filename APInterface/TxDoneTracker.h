@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <unordered_map>
+
+#include "common.h"
+#include "StatDelaysCalc.h"
+
+/**
+ * Latency statistics of downstream packets (see CTxDoneTracker)
+ */
+struct txdone_latency_stats_s {
+   statdelays_s m_rxToQueue;     ///< Reception from manager -> AP output queue
+   statdelays_s m_queueToAck;    ///< AP output queue -> ACK of AP
+   statdelays_s m_ackToTxDone;   ///< ACK of AP -> TX done notification
+   statdelays_s m_total;         ///< Reception from manager -> TX done notification
+   uint32_t     m_numInFlight;   ///< Packets waiting for TX done
+   uint64_t     m_numFailed;     ///< Packets rejected by AP
+   uint64_t     m_numLost;       ///< Packets without TX done: expired, id reused or AP lost
+   uint64_t     m_numUnknown;    ///< TX done notifications of packets that are not tracked
+};
+
+/**
+ * Tracker of downstream packets by txDoneId
+ *
+ * Every packet that requests TX done notification is kept in in-flight
+ * table from reception from manager till the notification. Time of each
+ * stage (reception, AP output queue, ACK of AP, TX done) is recorded and
+ * delays between stages are added to histograms. The AP reuses txDoneId
+ * of manager, so the id is unique among packets in flight. Entries without
+ * notification are removed after TXDONE_MAX_AGE.
+ */
+class CTxDoneTracker {
+public:
+   CTxDoneTracker();
+
+   // Packet is received from manager at 'rxTime'
+   void received(uint16_t txDoneId, const mngr_time_t& rxTime);
+   // Packet is put to AP output queue
+   void enqueued(uint16_t txDoneId);
+   // AP accepted the packet
+   void acked(uint16_t txDoneId);
+   // AP rejected the packet or it was not queued
+   void failed(uint16_t txDoneId);
+   // TX done notification is received
+   void txDone(uint16_t txDoneId);
+   // Forget packets in flight (AP is lost or restarted)
+   void dropAll();
+
+   void getStat(txdone_latency_stats_s * pStat);
+   void clearStat();
+
+private:
+   struct entry_s {
+      mngr_time_t m_rxTime;
+      mngr_time_t m_queueTime;
+      mngr_time_t m_ackTime;
+   };
+   typedef std::unordered_map<uint16_t, entry_s> entries_t;
+
+   // Remove expired entries (m_lock is locked)
+   void expire_p(const mngr_time_t& now);
+
+   boost::mutex     m_lock;
+   entries_t        m_entries;
+   mngr_time_t      m_lastExpire;   // Time of last check of expired entries
+
+   CStatDelaysCalc  m_rxToQueue;
+   CStatDelaysCalc  m_queueToAck;
+   CStatDelaysCalc  m_ackToTxDone;
+   CStatDelaysCalc  m_total;
+   uint64_t         m_numFailed;
+   uint64_t         m_numLost;
+   uint64_t         m_numUnknown;
+};
@@ -15,6 +15,7 @@
 
 #include "common.h"
 #include "Logger.h"
+#include "AsyncLog.h"
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -25,6 +26,7 @@
 #include "GPS.h"
 #include "APCoupler.h"
 #include "APCClient.h"
+#include "FlightRecorder.h"
 
 #include "common/ProcessInputArguments.h"
 #include "watchdog/public/IWdClntWrapper.h"
@@ -70,6 +72,8 @@ public:
    std::string clientId;
    std::string sHostName;
    uint16_t    port;
+   std::string sStandbyHostName;
+   uint16_t    standbyPort;
    std::string sApiPortName;
    std::string sResetPortName;
    uint32_t    baudRate;
@@ -95,7 +99,18 @@ public:
    uint32_t apcKaTimeout;
    uint32_t apcfreeBufferTimeout;
    uint32_t apcReconnectDelay;
+   uint32_t apcReconnectMaxDelay;
+   uint32_t apcConnectTimeout;
    uint32_t apcDisconnectTimeout;
+   uint32_t apcNetRxBatchSize;
+   uint32_t apcNetRxBatchDelay;
+   uint32_t apcCompressLevel;
+   uint32_t apcProtoVer;
+   std::string apcSockPolicy;
+   uint32_t apcAckDelay;
+   uint32_t apcAckPkts;
+   bool     bApcCredit;
+   bool     bApcPrioritySched;
 
    uint32_t resetBootTimeout;
    uint32_t disconnectShortBootTimeoutMsec;
@@ -103,6 +118,16 @@ public:
 
    std::string sResetSignal;
    bool bReconnectSerial;
+   bool bFastRetry;
+   uint32_t captureSize;
+   std::string sCaptureDir;
+   uint32_t flightRecSize;
+   uint32_t moteStatsSize;
+   uint32_t logRingSize;
+   std::string sLogDropPolicy;
+   Logger::publisher_param_s logPublisher;
+   uint32_t logRateLimit;
+   uint32_t logRateBurst;
    bool bGpsdConn;
 
    std::string sApClkSource;
@@ -111,6 +136,7 @@ public:
    CApcProcessInputArguments(): CProcessInputArguments(DEFAULT_FILE_NAME, "APC") {
       sHostName = DEFAULT_MNGR_HOST;
       port = DEFAULT_MNGR_PORT;
+      standbyPort = 0;
       sApiPortName = DEFAULT_DEV_API_PORT;
       sResetPortName = DEFAULT_DEV_RESET_PORT;
       baudRate = DEFAULT_BAUD_RATE;
@@ -135,7 +161,18 @@ public:
       apcKaTimeout = APC_DEFAULT_KATIMEOUT;
       apcfreeBufferTimeout = APC_DEFAULT_FREEBUFFER_TIMEOUT;
       apcReconnectDelay = APC_DEFAULT_RECONNECT_DELAY;
+      apcReconnectMaxDelay = APC_DEFAULT_RECONNECT_MAX_DELAY;
+      apcConnectTimeout = APC_DEFAULT_CONNECT_TIMEOUT;
       apcDisconnectTimeout = APC_DEFAULT_DISCONNECT_TIMEOUT;
+      apcNetRxBatchSize = APC_DEFAULT_NETRX_BATCH_SIZE;
+      apcNetRxBatchDelay = APC_DEFAULT_NETRX_BATCH_DELAY;
+      apcCompressLevel = APC_DEFAULT_COMPRESS_LEVEL;
+      apcProtoVer = APC_DEFAULT_PROTO_VER;
+      apcSockPolicy = APC_DEFAULT_SOCK_POLICY;
+      apcAckDelay = APC_DEFAULT_ACK_DELAY;
+      apcAckPkts = APC_DEFAULT_ACK_PKTS;
+      bApcCredit = APC_DEFAULT_CREDIT;
+      bApcPrioritySched = APC_DEFAULT_PRIORITY_SCHED;
 
       resetBootTimeout                = RESET_BOOT_TIMEOUT;
       disconnectShortBootTimeoutMsec  = DISCONNECT_BOOT_TIMEOUT_SHORT;
@@ -143,6 +180,15 @@ public:
 
 	  sResetSignal = RESET_SIGNAL_TX;
 	  bReconnectSerial = true;
+	  bFastRetry = true;
+	  captureSize = APM_DEFAULT_CAPTURE_SIZE;
+	  sCaptureDir = APM_DEFAULT_CAPTURE_DIR;
+	  flightRecSize = APC_DEFAULT_FLIGHTREC_SIZE;
+	  moteStatsSize = APC_DEFAULT_MOTE_STATS_SIZE;
+	  logRingSize = APC_DEFAULT_LOG_RING_SIZE;
+	  sLogDropPolicy = APC_DEFAULT_LOG_DROP_POLICY;
+	  logRateLimit = APC_DEFAULT_LOG_RATE_LIMIT;
+	  logRateBurst = APC_DEFAULT_LOG_RATE_BURST;
 	  bGpsdConn = false;
 
       apClkSource = APM_DEFAULT_CLOCK_SOURCE;
@@ -156,7 +202,18 @@ protected:
       ("apc-free-buffer-timeout", boost::program_options::value<uint32_t>(&apcfreeBufferTimeout), "APC Client free buffer timeout")
       ("apc-ka-timeout", boost::program_options::value<uint32_t>(&apcKaTimeout), "APC Client keep-alive timeout")
       ("apc-max-queue-size", boost::program_options::value<uint32_t>(&apcMaxQueueSize), "APC Client queue size")
+      ("apc-netrx-batch-size", boost::program_options::value<uint32_t>(&apcNetRxBatchSize), "Max size of batch of packets to manager, in bytes (0 - no batching)")
+      ("apc-netrx-batch-delay", boost::program_options::value<uint32_t>(&apcNetRxBatchDelay), "Max delay of packet in batch to manager, in milliseconds")
+      ("apc-compress-level", boost::program_options::value<uint32_t>(&apcCompressLevel), "Compression level of manager connection 1-9, used if manager supports it (0 - no compression)")
+      ("apc-proto-ver", boost::program_options::value<uint32_t>(&apcProtoVer), "Max APC protocol version offered to manager (1 - full message header, 2 - compact header)")
+      ("apc-sock-policy", boost::program_options::value<string>(&apcSockPolicy), "Socket policy of manager connection: default, low-latency, bulk, cellular")
       ("apc-reconnect-delay", boost::program_options::value<uint32_t>(&apcReconnectDelay), "APC Client reconnection delay, in milliseconds")
+      ("apc-reconnect-max-delay", boost::program_options::value<uint32_t>(&apcReconnectMaxDelay), "Max reconnection delay after repeated failures, in milliseconds")
+      ("apc-connect-timeout", boost::program_options::value<uint32_t>(&apcConnectTimeout), "Max time of connection to one address of manager, in milliseconds (0 - unlimited)")
+      ("apc-ack-delay", boost::program_options::value<uint32_t>(&apcAckDelay), "Max delay of acknowledgement of packets from manager, in milliseconds (0 - by count and keep-alive only)")
+      ("apc-ack-pkts", boost::program_options::value<uint32_t>(&apcAckPkts), "Acknowledge every N packets from manager without delay (0 - by cache size)")
+      ("apc-credit", boost::program_options::value<bool>(&bApcCredit), "Offer credit flow control to manager instead of pause/resume messages")
+      ("apc-priority-sched", boost::program_options::value<bool>(&bApcPrioritySched), "Send control messages and high priority mesh packets to manager before waiting bulk data")
       ("api-device", boost::program_options::value<string>(&sApiPortName), "Serial device for AP Serial API")
       ("apm-max-msg-size", boost::program_options::value<uint16_t>(&maxMsgSize), "Maximum message size to AP")
       ("baud", boost::program_options::value<uint32_t>(&baudRate), "Baud rate")
@@ -167,12 +224,14 @@ protected:
       ("gpsd-timeout", boost::program_options::value<uint32_t>(&gpsdTimeout), "Read timeout from gpsd, in microseconds")
       ("gpsd-conn", boost::program_options::value<bool>(&bGpsdConn), "Whether APC connects to gpsd or not")
       ("high-queue-watermark", boost::program_options::value<uint16_t>(&highQueueWatermark), "High watermark for NACKing incoming messages")
-      ("host", boost::program_options::value<string>(&sHostName), "Manager APC host")
+      ("host", boost::program_options::value<string>(&sHostName), "Manager APC host. Manager on the same host: unix:PATH (AF_UNIX socket) or shm:PATH (shared memory rings, rendezvous on AF_UNIX socket PATH)")
       ("low-queue-watermark", boost::program_options::value<uint16_t>(&lowQueueWatermark), "Low watermark for allowing incoming messages")
       ("max-queue-size", boost::program_options::value<uint16_t>(&maxQueueSize), "Maximum queue size for messages to AP")
       ("max-retries", boost::program_options::value<uint16_t>(&maxRetries), "APC retry count to AP")
       ("ping-timeout", boost::program_options::value<uint32_t>(&pingTimeout), "Ping to AP if no activity recorded within this time, in milliseconds")
       ("port", boost::program_options::value<uint16_t>(&port), "Manager APC port")
+      ("standby-host", boost::program_options::value<string>(&sStandbyHostName), "Secondary manager APC host. Hot-standby connection is kept to it for fast failover (manager must support it)")
+      ("standby-port", boost::program_options::value<uint16_t>(&standbyPort), "Secondary manager APC port (0 - same as port)")
       ("reset-device", boost::program_options::value<string>(&sResetPortName), "Serial device for AP reset control")
       ("retry-delay", boost::program_options::value<uint32_t>(&retryDelay), "Delay on receiving a NACK before resending the command, in milliseconds")
       ("retry-timeout", boost::program_options::value<uint32_t>(&retryTimeout), "APC retry timeout to AP, in milliseconds")
@@ -181,6 +240,17 @@ protected:
       ("disconnect-boot-timeout-long", boost::program_options::value<uint32_t>(&disconnectLongBootTimeoutMsec), "Long boot-timeout after send disconnect command to AP")
       ("reset-signal", boost::program_options::value<string>(&sResetSignal), "Signal used to reset AP")
       ("reconnect-serial", boost::program_options::value<bool>(&bReconnectSerial), "Reconnect serial port on errors")
+      ("fast-retry", boost::program_options::value<bool>(&bFastRetry), "Resend command after retry-delay if corrupted frame is received from AP")
+      ("capture-size", boost::program_options::value<uint32_t>(&captureSize), "Number of serial frames kept in memory for capture (0 - disable)")
+      ("capture-dir", boost::program_options::value<string>(&sCaptureDir), "Directory for serial capture and flight recorder saved on AP lost (the last 10 files of each kind are kept)")
+      ("flightrec-size", boost::program_options::value<uint32_t>(&flightRecSize), "Number of transport and connector events kept in memory by flight recorder (0 - disable)")
+      ("mote-stats-size", boost::program_options::value<uint32_t>(&moteStatsSize), "Number of the heaviest motes kept in upstream traffic table (0 - disable)")
+      ("log-ring-size", boost::program_options::value<uint32_t>(&logRingSize), "Number of records per thread in asynchronous log ring (0 - synchronous logging)")
+      ("log-publish-queue-size", boost::program_options::value<uint32_t>(&logPublisher.m_maxQueueSize), "Maximum number of log events waiting for publishing to log subscribers")
+      ("log-publish-batch-size", boost::program_options::value<uint32_t>(&logPublisher.m_maxBatchSize), "Maximum number of log events in one notification to log subscribers (1 - one event with logger name as topic, >1 - batches, subscriber must support them)")
+      ("log-drop-policy", boost::program_options::value<string>(&sLogDropPolicy), "Log events dropped when publishing queue is full: 'oldest' or level name (events below the level are dropped first)")
+      ("log-rate-limit", boost::program_options::value<uint32_t>(&logRateLimit), "Maximum rate of INFO / WARN messages of one log call site, messages per second (0 - no limit)")
+      ("log-rate-burst", boost::program_options::value<uint32_t>(&logRateBurst), "Number of messages of one log call site allowed in burst over log-rate-limit")
       ("max-packet-age", boost::program_options::value<uint32_t>(&maxPacketAge), "Maximim age allowed for packets wait in queue before triggering PAUSE to manager, in milliseconds")
       ("ap-clock-source", boost::program_options::value<string>(&sApClkSource), "AP Clock Source, choice of GPS or AUTO")
       ;
@@ -194,6 +264,11 @@ protected:
          throw boost::program_options::error("Invalid reset-signal value, must be TX or DTR.");
       }
 
+      if (!Logger::parseDropPolicy(sLogDropPolicy, logPublisher)) {
+         throw boost::program_options::error("Invalid log-drop-policy value " + sLogDropPolicy +
+                                             ", should be 'oldest' or log level name.");
+      }
+
       if (!sApClkSource.empty()) {
           if (!clkSrcStringToEnum(sApClkSource, apClkSource)) {
              ostringstream errStr;
@@ -201,6 +276,11 @@ protected:
              throw boost::program_options::error(errStr.str());
           }
       }
+
+      if (CAPCSocketPolicy::find(apcSockPolicy) == NULL) {
+         throw boost::program_options::error("Invalid apc-sock-policy value " + apcSockPolicy +
+                                             ", should be one of: " + CAPCSocketPolicy::getNames());
+      }
    }
 };
 
@@ -213,6 +293,8 @@ void printConfiguration(CApcProcessInputArguments& inputArgs)
                 "Config file : "<<inputArgs.getVal().confName <<"\n"<<
                 "Host : " <<inputArgs.sHostName<<"\n"<<
                 "Port : "<<inputArgs.port<<"\n"<<
+                "Standby Host : " <<inputArgs.sStandbyHostName<<"\n"<<
+                "Standby Port : "<<inputArgs.standbyPort<<"\n"<<
                 "API Port : "<<inputArgs.sApiPortName<<"\n"<<
                 "Reset Port : "<<inputArgs.sResetPortName<<"\n"<<
                 "Baud : "<<inputArgs.baudRate<<"\n"<<
@@ -235,9 +317,31 @@ void printConfiguration(CApcProcessInputArguments& inputArgs)
                 "APC Client KA Timeout          : "<<inputArgs.apcKaTimeout<<"\n"<<
                 "APC Client Free Buffer Timeout : "<<inputArgs.apcfreeBufferTimeout<<"\n"<<
                 "APC Client Reconnect Delay     : "<<inputArgs.apcReconnectDelay<<"\n"<<
+                "APC Client Reconnect Max Delay : "<<inputArgs.apcReconnectMaxDelay<<"\n"<<
+                "APC Client Connect Timeout     : "<<inputArgs.apcConnectTimeout<<"\n"<<
                 "APC Client Disconnect Timeout  : "<<inputArgs.apcDisconnectTimeout<<"\n"<<
+                "APC Client NET_RX Batch Size   : "<<inputArgs.apcNetRxBatchSize<<"\n"<<
+                "APC Client NET_RX Batch Delay  : "<<inputArgs.apcNetRxBatchDelay<<"\n"<<
+                "APC Client Compression Level   : "<<inputArgs.apcCompressLevel<<"\n"<<
+                "APC Client Protocol Version    : "<<inputArgs.apcProtoVer<<"\n"<<
+                "APC Client Socket Policy       : "<<inputArgs.apcSockPolicy<<"\n"<<
+                "APC Client ACK Delay           : "<<inputArgs.apcAckDelay<<"\n"<<
+                "APC Client ACK Every Packets   : "<<inputArgs.apcAckPkts<<"\n"<<
+                "APC Client Credit              : "<<inputArgs.bApcCredit<<"\n"<<
+                "APC Client Priority Scheduler  : "<<inputArgs.bApcPrioritySched<<"\n"<<
                 "Reset Signal : "<<inputArgs.sResetSignal<<"\n"<<
-                "Reconnect Serial : "<<inputArgs.bReconnectSerial<<"\n"
+                "Reconnect Serial : "<<inputArgs.bReconnectSerial<<"\n"<<
+                "Fast Retry : "<<inputArgs.bFastRetry<<"\n"<<
+                "Capture Size : "<<inputArgs.captureSize<<"\n"<<
+                "Capture Dir : "<<inputArgs.sCaptureDir<<"\n"<<
+                "Flight Recorder Size : "<<inputArgs.flightRecSize<<"\n"<<
+                "Mote Stats Size : "<<inputArgs.moteStatsSize<<"\n"<<
+                "Log Ring Size : "<<inputArgs.logRingSize<<"\n"<<
+                "Log Publish Queue Size : "<<inputArgs.logPublisher.m_maxQueueSize<<"\n"<<
+                "Log Publish Batch Size : "<<inputArgs.logPublisher.m_maxBatchSize<<"\n"<<
+                "Log Drop Policy : "<<inputArgs.sLogDropPolicy<<"\n"<<
+                "Log Rate Limit : "<<inputArgs.logRateLimit<<"\n"<<
+                "Log Rate Burst : "<<inputArgs.logRateBurst<<"\n"<<
                 "Max Packet Age : "<<inputArgs.maxPacketAge<<"\n"
                 );
 }
@@ -269,6 +373,7 @@ try
    
    // setup logging and log level
    Logger::openLogging(inputArgs.getVal().logName);
+   Logger::setRateLimit("*", inputArgs.logRateLimit, inputArgs.logRateBurst);
    DUSTLOG_SETLEVEL(APC_LOG_NAME, inputArgs.getVal().logLevel);
    DUSTLOG_SETLEVEL("apm", inputArgs.getVal().logLevel);
    DUSTLOG_SETLEVEL("apc", inputArgs.getVal().logLevel);
@@ -285,7 +390,9 @@ try
           epWd      = epGetter.getClient(WATCHDOG_ENDPOINT_PATH),
           epWdNotif = epGetter.getClient(WATCHDOG_NOTIFY_ENDPOINT_PATH);
   
-   Logger::CScopedPublisher pub(ctx.get(), epLogNotif, log4cxx::Level::getTrace());
+   Logger::CScopedPublisher pub(ctx.get(), epLogNotif, log4cxx::Level::getTrace(), inputArgs.logPublisher);
+   // Destroyed before publisher: queued records are flushed to all appenders
+   Logger::CScopedAsyncLog asyncLog(inputArgs.logRingSize);
    
    CAPMTransport::init_param_t transportCfg(
                                             inputArgs.maxQueueSize,
@@ -296,7 +403,8 @@ try
                                             inputArgs.retryTimeout,
                                             inputArgs.maxRetries,
                                             inputArgs.maxMsgSize,
-                                            inputArgs.maxPacketAge
+                                            inputArgs.maxPacketAge,
+                                            inputArgs.bFastRetry
                                           );
 
    IGPS::start_param_t gpsCfg = {
@@ -315,6 +423,19 @@ try
       inputArgs.apcfreeBufferTimeout, // free buffer waiting time
       inputArgs.apcReconnectDelay,  // reconnectionDelayMsec 
       inputArgs.apcDisconnectTimeout, // offlineMsec,             
+      inputArgs.apcNetRxBatchSize,
+      inputArgs.apcNetRxBatchDelay,
+      inputArgs.apcCompressLevel,
+      inputArgs.apcProtoVer,
+      inputArgs.apcSockPolicy,
+      inputArgs.apcConnectTimeout,
+      inputArgs.apcReconnectMaxDelay,
+      inputArgs.sStandbyHostName,
+      inputArgs.standbyPort,
+      inputArgs.apcAckDelay,
+      inputArgs.apcAckPkts,
+      inputArgs.bApcCredit,
+      inputArgs.bApcPrioritySched,
    };
 
    if (inputArgs.sResetSignal == RESET_SIGNAL_TX) {
@@ -323,7 +444,9 @@ try
       APResetSignal = AP_RESET_SIGNAL_DTR;
    }
    CSerialPort   port(g_svc, inputArgs.sApiPortName, inputArgs.sResetPortName, APResetSignal,
-   	                  inputArgs.baudRate, true);
+   	                  inputArgs.maxMsgSize, inputArgs.baudRate, true);
+   port.enableCapture(inputArgs.captureSize, inputArgs.sCaptureDir);
+   CFlightRecorder::enable(inputArgs.flightRecSize, inputArgs.sCaptureDir);
    CGPS          gps;
    CAPCoupler    coupler(g_svc);
    CAPCClient    client(inputArgs.apcMaxQueueSize);  
@@ -363,7 +486,8 @@ try
       inputArgs.resetBootTimeout,
       inputArgs.disconnectShortBootTimeoutMsec,
       inputArgs.disconnectLongBootTimeoutMsec,
-      inputArgs.apClkSource
+      inputArgs.apClkSource,
+      inputArgs.moteStatsSize
    };
   
    result = coupler.open(apm_init_params);
@@ -415,12 +539,17 @@ try
    svr->stop();
 
 
+   Logger::async_stats_s logStats = Logger::getAsyncStats();
+   DUSTLOG_INFO(APC_LOG_NAME, "Async log: records " << logStats.m_numRecords << ", dropped " << logStats.m_numDropped
+                << ", max delay " << logStats.m_maxDelayUsec << " usec");
+   Logger::publisher_stats_s pubStats = Logger::getPublisherStats();
+   DUSTLOG_INFO(APC_LOG_NAME, "Log publisher: events " << pubStats.m_numPublished << ", batches " << pubStats.m_numBatches
+                << ", dropped " << pubStats.m_numDropped << ", max queued " << pubStats.m_maxQueued);
    DUSTLOG_INFO(APC_LOG_NAME, "Closing apc");
 
+   // Async log guard drains queued records and publisher is closed at the end of scope,
+   // logging is closed after them
    //Logger::closePublisher();
-   Logger::closeLogging();
-
-
 } catch(zmq::error_t& ex) {
       cout << "ZMQ error: "<< ex.what() << endl;
       return 1;
@@ -432,7 +561,7 @@ try
       return 1;
 } 
  
-   
+   Logger::closeLogging();
    return 0;
 }
 
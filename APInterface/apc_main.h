@@ -6,6 +6,7 @@
 
 #include "common.h"
 #include "apc_common.h"
+#include "APCProto.h"
 #ifdef GPSTEST
    #include "unit_tests/Testlibgpsmm.h"
 #else
@@ -40,6 +41,14 @@ const uint32_t APM_DEFAULT_RETRY_DELAY = 100; //in milliseconds, retry timer whe
 const uint16_t APM_DEFAULT_MAX_RETRIES = 3;
 const uint32_t APM_DEFAULT_RETRY_TIMEOUT = 800; // milliseconds
 const uint32_t APM_DEFAULT_MAX_PACKET_AGE = 1500; // milliseconds, time to trigger TX_PAUSE to manager
+const uint32_t APM_DEFAULT_CAPTURE_SIZE = 1024; // number of serial frames kept in memory
+const char     APM_DEFAULT_CAPTURE_DIR[] = "/tmp"; // directory for automatically saved captures
+const uint32_t APC_DEFAULT_FLIGHTREC_SIZE = 4096; // number of transport/connector events kept in memory
+const uint32_t APC_DEFAULT_MOTE_STATS_SIZE = 64; // number of motes in upstream traffic table
+const uint32_t APC_DEFAULT_LOG_RING_SIZE = 512; // records per thread in asynchronous log ring
+const char     APC_DEFAULT_LOG_DROP_POLICY[] = "oldest"; // log events dropped when publishing queue is full
+const uint32_t APC_DEFAULT_LOG_RATE_LIMIT = 0;  // messages per second of one log call site (0 - no limit)
+const uint32_t APC_DEFAULT_LOG_RATE_BURST = 50; // messages of one log call site allowed in burst
 
 const char GPSD_DEFAULT_HOST[] = "localhost";
 const char GPSD_DEFAULT_PORT[] = DEFAULT_GPSD_PORT;
@@ -51,7 +60,18 @@ const uint32_t APC_DEFAULT_MAX_QUEUE_SIZE = 20; // Default client queue size
 const uint32_t APC_DEFAULT_KATIMEOUT = 2000; // Default APC Keep-Alive timeout, in milliseconds
 const uint32_t APC_DEFAULT_FREEBUFFER_TIMEOUT = 2000; // Default APC time to wait for a free buffer, in milliseconds
 const uint32_t APC_DEFAULT_RECONNECT_DELAY = 1000; // Default interval for APC to attempt reconnection, in milliseconds
+const uint32_t APC_DEFAULT_RECONNECT_MAX_DELAY = 30000; // Default max interval between reconnection attempts (backoff), in milliseconds
+const uint32_t APC_DEFAULT_CONNECT_TIMEOUT = 5000; // Default max time of one connection attempt, in milliseconds
 const uint32_t APC_DEFAULT_DISCONNECT_TIMEOUT = 30000; // Default time to declare the connection is dead, in milliseconds
+const uint32_t APC_DEFAULT_NETRX_BATCH_SIZE = 1024; // Default max payload of NET_RX batch, in bytes (0 - no batching)
+const uint32_t APC_DEFAULT_NETRX_BATCH_DELAY = 5; // Default max time of packet in NET_RX batch, in milliseconds
+const uint32_t APC_DEFAULT_PROTO_VER = APC_PROTO_VER; // Default max protocol version offered to manager (v2 is opt-in: older managers reject other versions)
+const uint32_t APC_DEFAULT_COMPRESS_LEVEL = 0;    // Default compression level of manager connection (0 - off: CPU cost on small gateways)
+const uint32_t APC_DEFAULT_ACK_DELAY = 20;       // Default max delay of acknowledgement of packets from manager, in milliseconds
+const uint32_t APC_DEFAULT_ACK_PKTS = 16;        // Default number of packets from manager acknowledged without delay
+const bool     APC_DEFAULT_CREDIT = true;        // Offer credit flow control to manager by default
+const bool     APC_DEFAULT_PRIORITY_SCHED = true; // Send control and high priority messages before waiting bulk data
+const char     APC_DEFAULT_SOCK_POLICY[] = "low-latency"; // Default socket policy of manager connection (Nagle is off)
 
 // Boot timeout (msec)
 const uint32_t  RESET_BOOT_TIMEOUT             = 30000;
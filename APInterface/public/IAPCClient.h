@@ -5,6 +5,7 @@
 #include "APCError.h"
 #include <string>
 #include "common/StatDelays.h"
+#include "common/StatRate.h"
 
 namespace boost { namespace asio { class io_service; } }
 
@@ -101,12 +102,27 @@ public:
 
    struct start_param_t
    {
-      std::string      host;         ///< Hostname or IP address of manager
+      std::string      host;         ///< Hostname or IP address of manager. Manager on the same host:
+                                     ///< "unix:PATH" (AF_UNIX socket) or "shm:PATH" (shared memory)
       uint16_t         port;         ///< TCP port of manager
       uint32_t         kaTimeout;    ///< AP Keep Alive Timeouts (milliseconds)
       uint32_t         freeBufTimeout; ///< Max timeout waiting free packet (milliseconds)
       uint32_t         reconnectionDelayMsec;   ///< Delay between reconnection attempts
       uint32_t         disconnectTimeoutMsec;   ///< Max time before disconnecting when offline
+      uint32_t         netRxBatchSize;          ///< Max payload of NET_RX batch (0 - no batching)
+      uint32_t         netRxBatchDelayMsec;     ///< Max time of packet in open NET_RX batch
+      uint32_t         compressLevel;           ///< Offered compression level 1-9 (0 - no compression)
+      uint32_t         protoVer;                ///< Max offered APC protocol version
+      std::string      sockPolicy;              ///< Name of socket policy (see CAPCSocketPolicy)
+      uint32_t         connectTimeoutMsec;      ///< Max time of connection to one address of manager (0 - unlimited)
+      uint32_t         reconnectMaxDelayMsec;   ///< Max delay between connection attempts (backoff)
+      std::string      standbyHost;             ///< Secondary manager for hot-standby connection (empty - none)
+      uint16_t         standbyPort;             ///< TCP port of secondary manager (0 - same as port)
+      uint32_t         ackDelayMsec;            ///< Max delay of acknowledgement of received messages (0 - by count only)
+      uint32_t         ackEveryPkts;            ///< Acknowledge every N received messages (0 - by cache size)
+      bool             isCredit;                ///< Offer credit flow control (APC_FL_CREDIT) instead of PAUSE/RESUME
+      bool             isPrioritySched;         ///< Control messages and high priority mesh packets bypass
+                                                ///< bulk data waiting for output
    };
 
    virtual ~IAPCClient() {;}
@@ -167,19 +183,29 @@ public:
    virtual apc_error_t sendApLost() = 0;
 
    /**
-    * Send Resume message
+    * Send Resume message (not sent with credit flow control)
     *
     * \return result code.
     */
    virtual apc_error_t sendResume() = 0;
 
    /**
-    * Send Pause message
+    * Send Pause message (not sent with credit flow control)
     *
     * \return result code.
     */
    virtual apc_error_t sendPause () = 0;
 
+   /**
+    * Report free space of AP input (messages from manager it can accept).
+    * With credit flow control the manager may send this number of messages
+    * beyond received ones. Credit never decreases: space that is not used
+    * by the manager is not taken back.
+    *
+    * \param  numMsgs  Free space in messages
+    */
+   virtual void        setInputSpace(uint32_t numMsgs) = 0;
+
    /**
     * Gets the state.
     *
@@ -221,6 +247,37 @@ public:
    virtual statdelays_s getAPCCStats() const = 0;
    virtual uint32_t getNumRcvPkt() const = 0;
 
+   /**
+    * Gets rates of messages exchanged with the manager
+    *
+    * \param [out] pToMngr    Rate of messages sent to manager (can be NULL)
+    * \param [out] pFromMngr  Rate of messages received from manager (can be NULL)
+    */
+   virtual void getRateStats(ratestat_s * pToMngr, ratestat_s * pFromMngr) = 0;
+
+   /**
+    * Gets compression statistics of manager connections
+    *
+    * \param [out] pStats     Compressed / uncompressed bytes and CPU time
+    */
+   virtual void getCompressStats(apc_compress_stats_s * pStats) = 0;
+
+   /**
+    * Gets TCP state of manager connection
+    *
+    * \param [out] pInfo      RTT, congestion window, retransmissions
+    *
+    * \return false if there is no connection or TCP_INFO is not supported
+    */
+   virtual bool getTcpInfo(apc_tcp_info_s * pInfo) = 0;
+
+   /**
+    * Gets statistics of priority scheduler of upstream messages
+    *
+    * \param [out] pStats     Waiting, bypassed and rejected messages
+    */
+   virtual void getSchedStats(apc_sched_stats_s * pStats) = 0;
+
    /**
     * Clear the statistics
     *
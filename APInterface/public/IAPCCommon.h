@@ -52,6 +52,7 @@ struct ap_intf_sendhdr_t {
    uint32_t            slot;                 ///< Slot for the TX link
    uint8_t             offset;               ///< Offset for the TX link
    uint16_t            dst;                  ///< Destination mote ID
+   mngr_time_t         rxTime;               ///< Time of reception from Manager
 };
 
 /**
@@ -101,6 +102,41 @@ struct ap_intf_gpslock_t {
    ap_int_gpslockstat_t           gpsstate;   ///< state of gps lock. 0=no lock, 1=lock
 };
 
+/**
+ * Compression statistics of manager connection
+ */
+struct apc_compress_stats_s {
+   uint64_t m_txRawBytes;      ///< Sent bytes before compression
+   uint64_t m_txCompBytes;     ///< Sent bytes after compression
+   uint64_t m_rxCompBytes;     ///< Received compressed bytes
+   uint64_t m_rxRawBytes;      ///< Received bytes after decompression
+   uint64_t m_txCpuUsec;       ///< CPU time of compression
+   uint64_t m_rxCpuUsec;       ///< CPU time of decompression
+};
+
+/**
+ * Statistics of priority scheduler of upstream messages
+ */
+struct apc_sched_stats_s {
+   uint32_t m_numQueued;       ///< Messages waiting for output to manager
+   uint32_t m_maxQueued;       ///< Max number of waiting messages
+   uint64_t m_numHeld;         ///< Messages that waited for output
+   uint64_t m_numBypassed;     ///< Messages sent before waiting messages of lower priority
+   uint64_t m_numRejected;     ///< Mesh packets rejected when scheduler is full, messages dropped by cache
+};
+
+/**
+ * TCP state of manager connection (TCP_INFO)
+ */
+struct apc_tcp_info_s {
+   uint32_t m_rttUsec;         ///< Smoothed round trip time
+   uint32_t m_rttVarUsec;      ///< Variation of round trip time
+   uint32_t m_cwnd;            ///< Congestion window, segments
+   uint32_t m_unacked;         ///< Sent and not acknowledged segments
+   uint32_t m_lost;            ///< Segments considered lost
+   uint32_t m_totalRetrans;    ///< Retransmitted segments since connection start
+};
+
 /**
  * AP clock source
  */
@@ -10,10 +10,12 @@
 
 #include "rpc/public/RpcCommon.h"
 #include "rpc/public/ConvertDelayStat.h"
+#include "rpc/public/ConvertRateStat.h"
 #include "rpc/apc.pb.h"
 
 //#include "public/IAPCClient.h" // TODO: really need pointer to APCoupler
 #include "APCoupler.h"
+#include "FlightRecorder.h"
 
 #include "common/Version.h"
 
@@ -84,6 +86,15 @@ zmessage* CAPCRpcWorker::processCmdMsg(uint8_t cmdId, const std::string& params)
       case apc::GET_AP_CLKSRC:
          responseMsg = handleGetAPClkSrc(params);
          break;
+      case apc::DUMP_CAPTURE:
+         responseMsg = handleDumpCapture(params);
+         break;
+      case apc::DUMP_FLIGHTREC:
+         responseMsg = handleDumpFlightRec(params);
+         break;
+      case apc::GET_MOTE_STATS:
+         responseMsg = handleGetMoteStats(params);
+         break;
       default:
          DUSTLOG_ERROR(m_logname.c_str(), 
                        "Invalid RPC command: " << (int)cmdId);
@@ -166,6 +177,27 @@ zmessage* CAPCRpcWorker::handleGetStats(std::string requestStr)
       common::DelayStat * pStat = response.mutable_tomngr();
       statdelays_s apcStat = m_apcClient->getAPCCStats();
       convertDelayStat(apcStat, pStat);
+      ratestat_s toMngr, fromMngr;
+      m_apcClient->getRateStats(&toMngr, &fromMngr);
+      convertRateStat(toMngr,   response.mutable_mgrtxrate());
+      convertRateStat(fromMngr, response.mutable_mgrrxrate());
+      apc_compress_stats_s compStats;
+      m_apcClient->getCompressStats(&compStats);
+      response.set_mgrtxrawbytes(compStats.m_txRawBytes);
+      response.set_mgrtxcompbytes(compStats.m_txCompBytes);
+      response.set_mgrrxcompbytes(compStats.m_rxCompBytes);
+      response.set_mgrrxrawbytes(compStats.m_rxRawBytes);
+      response.set_mgrcompresscpuusec(compStats.m_txCpuUsec);
+      response.set_mgrdecompresscpuusec(compStats.m_rxCpuUsec);
+      apc_tcp_info_s tcpInfo;
+      if (m_apcClient->getTcpInfo(&tcpInfo)) {
+         response.set_mgrtcprttusec(tcpInfo.m_rttUsec);
+         response.set_mgrtcprttvarusec(tcpInfo.m_rttVarUsec);
+         response.set_mgrtcpcwnd(tcpInfo.m_cwnd);
+         response.set_mgrtcpretrans(tcpInfo.m_totalRetrans);
+         response.set_mgrtcpunacked(tcpInfo.m_unacked);
+         response.set_mgrtcplost(tcpInfo.m_lost);
+      }
    }
 
    if (apConnected) {
@@ -197,11 +229,44 @@ zmessage* CAPCRpcWorker::handleGetStats(std::string requestStr)
       common::DelayStat * pStatFrom = response.mutable_fromap();
       convertDelayStat(m_serPort->getStatFromAP(), pStatFrom);
       response.set_numoutbuffers(m_serPort->getNumOutBuffers());
-	  response.set_apcurrpktrate(apm_stats.m_packetRate);
-	  response.set_ap30secpktrate((double)apm_stats.m_30secPacketRate);
-	  response.set_ap5minpktrate((double)apm_stats.m_5minPacketRate);
-	  response.set_apavgpktrate((double)((apm_stats.m_numPktsRecv - apm_stats.m_numRespRecv)* 1.0 / apm_stats.m_totalSecs));
+      const rate_s& notifRate = apm_stats.m_notifRate.m_pkts;
+      response.set_apcurrpktrate((uint32_t)(notifRate.m_rate[RATE_WND_1SEC] + 0.5));
+      response.set_ap30secpktrate(notifRate.m_rate[RATE_WND_30SEC]);
+      response.set_ap5minpktrate(notifRate.m_rate[RATE_WND_5MIN]);
+      response.set_apavgpktrate(notifRate.m_avg);
+      convertRateStat(m_serPort->getRateToAP(),   response.mutable_serialtoap());
+      convertRateStat(m_serPort->getRateFromAP(), response.mutable_serialfromap());
+      convertRateStat(apm_stats.m_cmdRate,        response.mutable_apcmdrate());
+      convertRateStat(apm_stats.m_notifRate,      response.mutable_apnotifrate());
+
+      hdlc_stats_s hdlcStats = m_serPort->getHDLCStats();
+      response.set_hdlcframes(hdlcStats.m_numFrames);
+      response.set_hdlcfcserrors(hdlcStats.m_numFcsErrors);
+      response.set_hdlcrunts(hdlcStats.m_numRunts);
+      response.set_hdlcoversize(hdlcStats.m_numOversize);
+      response.set_hdlcaborts(hdlcStats.m_numAborts);
+      response.set_hdlcdiscardedbytes(hdlcStats.m_numDiscardedBytes);
+      response.set_apfastretries(apm_stats.m_numFastRetries);
    }
+
+   txdone_latency_stats_s txDoneStats;
+   m_apcApi->getTxDoneStats(&txDoneStats);
+   convertDelayStat(txDoneStats.m_rxToQueue,   response.mutable_txrxtoqueue());
+   convertDelayStat(txDoneStats.m_queueToAck,  response.mutable_txqueuetoack());
+   convertDelayStat(txDoneStats.m_ackToTxDone, response.mutable_txacktotxdone());
+   convertDelayStat(txDoneStats.m_total,       response.mutable_txtotal());
+   response.set_txinflight(txDoneStats.m_numInFlight);
+   response.set_txfailed(txDoneStats.m_numFailed);
+   response.set_txlost(txDoneStats.m_numLost);
+   response.set_txunknowntxdone(txDoneStats.m_numUnknown);
+
+   apc_sched_stats_s schedStats;
+   m_apcClient->getSchedStats(&schedStats);
+   response.set_upschedqueued(schedStats.m_numQueued);
+   response.set_upschedmaxqueued(schedStats.m_maxQueued);
+   response.set_upschedheld(schedStats.m_numHeld);
+   response.set_upschedbypassed(schedStats.m_numBypassed);
+   response.set_upschedrejected(schedStats.m_numRejected);
    
    return createResponse(apc::GET_APC_STATS, response);
 }
@@ -211,6 +276,9 @@ zmessage* CAPCRpcWorker::handleClearStats(std::string requestStr)
 {
    m_apcApi->clearAPMStats();
    m_apcApi->clearMgrStats();
+   m_apcApi->clearTxDoneStats();
+   m_apcApi->clearMoteStats();
+   m_serPort->clearHDLCStats();
    	
    return createResponse(apc::CLEAR_APC_STATS, RPC_OK, "");
 }
@@ -318,6 +386,74 @@ zmessage* CAPCRpcWorker::handleGetAPClkSrc(std::string requestStr)
    return createResponse(apc::GET_AP_CLKSRC, response);
 }
 
+zmessage* CAPCRpcWorker::handleDumpCapture(std::string requestStr)
+{
+   apc::DumpCaptureReq request;
+   parseFromString_p(request, requestStr);
+
+   uint32_t numFrames = 0;
+   apc_error_t res = m_serPort->dumpCapture(request.filename(), &numFrames);
+   if (res == APC_ERR_STATE)
+      return createResponse(apc::DUMP_CAPTURE, RPC_SERVICE_NOT_AVAILABLE, "Serial capture is disabled");
+   if (res != APC_OK)
+      return createResponse(apc::DUMP_CAPTURE, RPC_CREATE_FAILED, toString(res));
+
+   apc::DumpCaptureResp response;
+   response.set_filename(request.filename());
+   response.set_numframes(numFrames);
+   return createResponse(apc::DUMP_CAPTURE, response);
+}
+
+zmessage* CAPCRpcWorker::handleDumpFlightRec(std::string requestStr)
+{
+   apc::DumpFlightRecReq request;
+   parseFromString_p(request, requestStr);
+
+   uint32_t numRecords = 0;
+   apc_error_t res = CFlightRecorder::dump(request.filename(), &numRecords);
+   if (res == APC_ERR_STATE)
+      return createResponse(apc::DUMP_FLIGHTREC, RPC_SERVICE_NOT_AVAILABLE, "Flight recorder is disabled");
+   if (res != APC_OK)
+      return createResponse(apc::DUMP_FLIGHTREC, RPC_CREATE_FAILED, toString(res));
+
+   apc::DumpFlightRecResp response;
+   response.set_filename(request.filename());
+   response.set_numrecords(numRecords);
+   return createResponse(apc::DUMP_FLIGHTREC, response);
+}
+
+zmessage* CAPCRpcWorker::handleGetMoteStats(std::string requestStr)
+{
+   apc::MoteStatsReq request;
+   parseFromString_p(request, requestStr);
+
+   if (!m_apcApi->isMoteStatsEnabled())
+      return createResponse(apc::GET_MOTE_STATS, RPC_SERVICE_NOT_AVAILABLE, "Mote traffic accounting is disabled");
+
+   mote_traffic_stats_s stats;
+   m_apcApi->getMoteStats(&stats, request.maxmotes());
+
+   apc::MoteStatsResp response;
+   response.set_tablesize(stats.m_tableSize);
+   response.set_numpkts(stats.m_numPkts);
+   response.set_numbytes(stats.m_numBytes);
+   response.set_numbadpkts(stats.m_numBadPkts);
+   for (uint8_t priority = 0; priority < MOTE_NUM_PRIORITIES; priority++)
+      response.add_numpktsbypriority(stats.m_numPktsByPriority[priority]);
+   for (const auto& mote : stats.m_motes) {
+      apc::MoteTraffic * pMote = response.add_motes();
+      pMote->set_address(mote.m_addr.m_addr);
+      pMote->set_addrlen(mote.m_addr.m_len);
+      pMote->set_numpkts(mote.m_numPkts);
+      pMote->set_numbytes(mote.m_numBytes);
+      pMote->set_errpkts(mote.m_errPkts);
+      pMote->set_errbytes(mote.m_errBytes);
+      for (uint8_t priority = 0; priority < MOTE_NUM_PRIORITIES; priority++)
+         pMote->add_numpktsbypriority(mote.m_numPktsByPriority[priority]);
+   }
+   return createResponse(apc::GET_MOTE_STATS, response);
+}
+
 const std::string CAPCRpcWorker::cmdCodeToStr(uint8_t cmdcode)
 {
    return apc::APCCommandType_Name((apc::APCCommandType)cmdcode);
@@ -98,6 +98,21 @@ private:
     */
    zmessage* handleGetAPClkSrc(std::string requestStr);
 
+   /**
+    * Process Dump_Capture
+    */
+   zmessage* handleDumpCapture(std::string requestStr);
+
+   /**
+    * Process Dump_FlightRec
+    */
+   zmessage* handleDumpFlightRec(std::string requestStr);
+
+   /**
+    * Process Get_Mote_Stats
+    */
+   zmessage* handleGetMoteStats(std::string requestStr);
+
    /**
     * Convert from Enum to APM definition
     */
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "MicroBench.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+// ---------- Allocation counters
+
+static atomic<uint64_t> s_numAllocs(0);
+static atomic<uint64_t> s_numAllocBytes(0);
+
+static void * countedAlloc(size_t size)
+{
+   s_numAllocs.fetch_add(1, memory_order_relaxed);
+   s_numAllocBytes.fetch_add(size, memory_order_relaxed);
+   return malloc(size == 0 ? 1 : size);
+}
+
+void * operator new(size_t size)
+{
+   void * p = countedAlloc(size);
+   if (p == NULL)
+      throw bad_alloc();
+   return p;
+}
+
+void * operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void * operator new(size_t size, const nothrow_t&) noexcept
+{
+   return countedAlloc(size);
+}
+
+void * operator new[](size_t size, const nothrow_t&) noexcept
+{
+   return countedAlloc(size);
+}
+
+void operator delete(void * p) noexcept                         { free(p); }
+void operator delete[](void * p) noexcept                       { free(p); }
+void operator delete(void * p, const nothrow_t&) noexcept       { free(p); }
+void operator delete[](void * p, const nothrow_t&) noexcept     { free(p); }
+void operator delete(void * p, size_t) noexcept                 { free(p); }
+void operator delete[](void * p, size_t) noexcept               { free(p); }
+
+microbench_allocs_s microBenchAllocs()
+{
+   microbench_allocs_s res;
+   res.m_numAllocs = s_numAllocs.load(memory_order_relaxed);
+   res.m_numBytes  = s_numAllocBytes.load(memory_order_relaxed);
+   return res;
+}
+
+// ---------- CPktSizeDist
+
+CPktSizeDist::CPktSizeDist() : m_maxSize(0)
+{
+   // Typical mix of mesh traffic: short acks/events, sensor data, full frames
+   const bucket_s DEFAULT_DIST[] = {
+      {  20, 10 },
+      {  48, 25 },
+      {  80, 40 },
+      { 100, 15 },
+      { 124, 10 },
+   };
+   m_buckets.assign(DEFAULT_DIST, DEFAULT_DIST + sizeof(DEFAULT_DIST) / sizeof(DEFAULT_DIST[0]));
+}
+
+bool CPktSizeDist::parse(const string& str)
+{
+   vector<bucket_s> buckets;
+   istringstream    is(str);
+   string           item;
+   while (getline(is, item, ',')) {
+      istringstream isItem(item);
+      bucket_s      b = { 0, 1 };
+      char          sep;
+      if (!(isItem >> b.m_size) || b.m_size == 0)
+         return false;
+      if (isItem >> sep && (sep != ':' || !(isItem >> b.m_weight)))
+         return false;
+      buckets.push_back(b);
+   }
+   if (buckets.empty())
+      return false;
+   m_buckets = buckets;
+   return true;
+}
+
+vector<uint32_t> CPktSizeDist::generate(size_t count, uint32_t seed) const
+{
+   vector<uint32_t> weights;
+   for (const auto& b : m_buckets)
+      weights.push_back(b.m_weight);
+   mt19937                  gen(seed);
+   discrete_distribution<>  dist(weights.begin(), weights.end());
+   vector<uint32_t>         res(count);
+   for (auto& s : res) {
+      s = m_buckets[dist(gen)].m_size;
+      if (m_maxSize > 0 && s > m_maxSize)
+         s = m_maxSize;
+   }
+   return res;
+}
+
+string CPktSizeDist::toString() const
+{
+   ostringstream os;
+   for (size_t i = 0; i < m_buckets.size(); i++)
+      os << (i ? "," : "") << m_buckets[i].m_size << ":" << m_buckets[i].m_weight;
+   return os.str();
+}
+
+// ---------- CMicroBench
+
+CMicroBench::CMicroBench(uint32_t minTimeMsec, const string& filter)
+   : m_minTimeMsec(minTimeMsec), m_filter(filter)
+{
+}
+
+bool CMicroBench::isSelected(const string& name) const
+{
+   return m_filter.empty() || name.find(m_filter) != string::npos;
+}
+
+void CMicroBench::print(ostream& os, bool asJson) const
+{
+   if (asJson) {
+      os << "[";
+      for (size_t i = 0; i < m_results.size(); i++) {
+         const microbench_result_s& r = m_results[i];
+         os << (i ? ",\n " : "\n ")
+            << "{\"name\":\""         << r.m_name            << "\""
+            << ",\"ops\":"            << r.m_numOps
+            << ",\"nsPerOp\":"        << r.m_nsPerOp
+            << ",\"bytesPerOp\":"     << r.m_bytesPerOp
+            << ",\"allocsPerOp\":"    << r.m_allocsPerOp
+            << ",\"allocBytesPerOp\":"<< r.m_allocBytesPerOp << "}";
+      }
+      os << "\n]" << endl;
+      return;
+   }
+   os << left << setw(36) << "Benchmark" << right
+      << setw(12) << "ops" << setw(12) << "ns/op" << setw(10) << "B/op"
+      << setw(10) << "MB/s" << setw(12) << "allocs/op" << setw(14) << "alloc B/op" << endl;
+   for (const auto& r : m_results) {
+      double mbs = r.m_nsPerOp > 0 ? r.m_bytesPerOp * 1000.0 / r.m_nsPerOp : 0;
+      os << left << setw(36) << r.m_name << right << fixed
+         << setw(12) << r.m_numOps
+         << setw(12) << setprecision(1) << r.m_nsPerOp
+         << setw(10) << setprecision(1) << r.m_bytesPerOp
+         << setw(10) << setprecision(1) << mbs
+         << setw(12) << setprecision(2) << r.m_allocsPerOp
+         << setw(14) << setprecision(1) << r.m_allocBytesPerOp << endl;
+   }
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include "common.h"
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * \file MicroBench.h
+ * Minimal framework for microbenchmarks of hot functions
+ */
+
+/**
+ * Result of one benchmark
+ */
+struct microbench_result_s {
+   std::string m_name;
+   uint64_t    m_numOps;         ///< Operations in measured run
+   double      m_nsPerOp;        ///< Time per operation, nsec
+   double      m_bytesPerOp;     ///< Processed bytes per operation
+   double      m_allocsPerOp;    ///< Heap allocations per operation
+   double      m_allocBytesPerOp;///< Allocated bytes per operation
+};
+
+/**
+ * Counters of global operator new (replaced in MicroBench.cpp)
+ */
+struct microbench_allocs_s {
+   uint64_t m_numAllocs;
+   uint64_t m_numBytes;
+};
+microbench_allocs_s microBenchAllocs();
+
+/**
+ * Weighted distribution of packet sizes
+ */
+class CPktSizeDist {
+public:
+   struct bucket_s {
+      uint32_t m_size;
+      uint32_t m_weight;
+   };
+
+   CPktSizeDist();
+
+   // Parse "SIZE:WEIGHT[,SIZE:WEIGHT...]"
+   bool     parse(const std::string& str);
+   // Maximal size limited by 'maxSize'
+   void     setMaxSize(uint32_t maxSize) { m_maxSize = maxSize; }
+   // Generate 'count' sizes in random order
+   std::vector<uint32_t> generate(size_t count, uint32_t seed) const;
+   std::string toString() const;
+
+private:
+   std::vector<bucket_s> m_buckets;
+   uint32_t              m_maxSize;
+};
+
+/**
+ * Runner of microbenchmarks.
+ *
+ * Every benchmark is a functor 'size_t op(size_t i)' executing one operation
+ * on sample 'i' and returning number of processed bytes. Number of iterations
+ * is doubled until run takes at least 'minTimeMsec'.
+ */
+class CMicroBench {
+public:
+   CMicroBench(uint32_t minTimeMsec, const std::string& filter);
+
+   // Benchmark is selected by filter (substring of name)
+   bool isSelected(const std::string& name) const;
+
+   template <class Op>
+   void run(const std::string& name, Op op);
+
+   const std::vector<microbench_result_s>& getResults() const { return m_results; }
+   void print(std::ostream& os, bool asJson) const;
+
+private:
+   typedef std::chrono::steady_clock bench_clock_t;
+
+   uint32_t                         m_minTimeMsec;
+   std::string                      m_filter;
+   std::vector<microbench_result_s> m_results;
+};
+
+template <class Op>
+void CMicroBench::run(const std::string& name, Op op)
+{
+   if (!isSelected(name))
+      return;
+
+   volatile size_t sink = op(0);      // warm-up (caches, lazy allocations)
+   uint64_t numOps = 1000;
+   for (;;) {
+      size_t              bytes = 0;
+      microbench_allocs_s a0 = microBenchAllocs();
+      bench_clock_t::time_point t0 = bench_clock_t::now();
+      for (uint64_t i = 0; i < numOps; i++)
+         bytes += op(static_cast<size_t>(i));
+      bench_clock_t::duration   elapsed = bench_clock_t::now() - t0;
+      microbench_allocs_s a1 = microBenchAllocs();
+      sink = sink + bytes;
+
+      double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      if (ns >= m_minTimeMsec * 1e6 || numOps >= (1ULL << 40)) {
+         microbench_result_s r;
+         r.m_name            = name;
+         r.m_numOps          = numOps;
+         r.m_nsPerOp         = ns / numOps;
+         r.m_bytesPerOp      = static_cast<double>(bytes) / numOps;
+         r.m_allocsPerOp     = static_cast<double>(a1.m_numAllocs - a0.m_numAllocs) / numOps;
+         r.m_allocBytesPerOp = static_cast<double>(a1.m_numBytes - a0.m_numBytes) / numOps;
+         m_results.push_back(r);
+         return;
+      }
+      numOps *= 2;
+   }
+}
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+/*
+ * Microbenchmarks of hot functions of serial and manager paths:
+ * HDLC codec, APC and APM serializers, output cache and delay statistics.
+ */
+
+#include "MicroBench.h"
+#include "Logger.h"
+#include "StatDelaysCalc.h"
+#include "APInterface/APCCache.h"
+#include "APInterface/APCSerializer.h"
+#include "APInterface/APMSerializer.h"
+#include "APInterface/HDLC.h"
+
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using namespace std;
+namespace po = boost::program_options;
+
+// Number of pre-generated samples (power of 2)
+const size_t NUM_SAMPLES = 1024;
+const size_t SAMPLE_MASK = NUM_SAMPLES - 1;
+
+// Serial frame header: cmdId, length, flags
+const size_t APM_HDR_SIZE = 3;
+// Defaults of apc (see apc_main.h)
+const size_t   BENCH_APM_MAX_MSG_SIZE = 256;
+const uint32_t BENCH_APC_CACHE_SIZE   = 20;
+
+class CNullHDLCHandler : public IHDLCCallback {
+public:
+   CNullHDLCHandler() : m_numFrames(0) {;}
+   virtual void frameComplete(const vector<uint8_t>& packet) { m_numFrames++; }
+   size_t m_numFrames;
+};
+
+class CNullSerRxHandler : public ISerRxHandler {
+public:
+   CNullSerRxHandler() : m_numMsgs(0) {;}
+   virtual apc_error_t messageReceived(ap_intf_id_t apcId, apc_msg_type_t type, uint8_t flags,
+                                       uint32_t mySeq, uint32_t yourSeq,
+                                       const uint8_t * pPayload, uint16_t size)
+   {
+      m_numMsgs++;
+      return APC_OK;
+   }
+   size_t m_numMsgs;
+};
+
+class CNullAPMNotifHandler : public IAPMNotifHandler {
+public:
+   CNullAPMNotifHandler() : m_numNotifs(0) {;}
+   virtual void handleAPReceive(const uint8_t* data, size_t length) { m_numNotifs++; }
+   virtual void handleEvent(const dn_api_loc_notif_events_t& event) { m_numNotifs++; }
+   virtual void handleTimeIndication(const dn_api_loc_notif_time_t& timeMap) {;}
+   virtual void handleReadyForTime(const dn_api_loc_notif_ready_for_time_t& ready) {;}
+   virtual void handleTXDone(const dn_api_loc_notif_txdone_t& txDone) { m_numNotifs++; }
+   virtual void handleParamMacAddress(const dn_api_rsp_get_macaddr_t& getParam) {;}
+   virtual void handleParamMoteInfo(const dn_api_rsp_get_moteinfo_t& getMoteInfo) {;}
+   virtual void handleParamAppInfo(const dn_api_rsp_get_appinfo_t& getAppInfo) {;}
+   virtual void handleParamClkSrc(const dn_api_rsp_get_ap_clksrc_t& getClkSrc) {;}
+   virtual void handleParamNetId(const dn_api_rsp_get_netid_t& getNetId) {;}
+   virtual void handleParamGetTime(const dn_api_rsp_get_time_t& getTime) {;}
+   virtual void handleParamApStatus(const dn_api_rsp_get_apstatus_t& getApStatus) {;}
+   virtual void handleAPLost() {;}
+   virtual void handleAPPause() {;}
+   virtual void handleAPResume() {;}
+   virtual void handleAPQueueSpace(uint32_t numFree) {;}
+   virtual void handleAPBoot() {;}
+   virtual void handleAPReboot() {;}
+   virtual void handleError(uint8_t cmdId, uint8_t rc) {;}
+   size_t m_numNotifs;
+};
+
+// Random payloads with sizes from distribution
+static vector<vector<uint8_t> > genPayloads(const CPktSizeDist& dist, uint32_t seed)
+{
+   vector<uint32_t>         sizes = dist.generate(NUM_SAMPLES, seed);
+   vector<vector<uint8_t> > res(NUM_SAMPLES);
+   mt19937                  gen(seed);
+   for (size_t i = 0; i < NUM_SAMPLES; i++) {
+      res[i].resize(sizes[i]);
+      for (auto& b : res[i])
+         b = static_cast<uint8_t>(gen());
+   }
+   return res;
+}
+
+// Serial frames (cmdId, length, flags, payload) with FCS, before HDLC encoding
+static vector<vector<uint8_t> > genSerialFrames(const vector<vector<uint8_t> >& payloads)
+{
+   vector<vector<uint8_t> > res;
+   for (const auto& p : payloads) {
+      vector<uint8_t> frame;
+      frame.push_back(DN_API_LOC_NOTIF_AP_RECEIVE);
+      frame.push_back(static_cast<uint8_t>(p.size()));
+      frame.push_back(0);
+      frame.insert(frame.end(), p.begin(), p.end());
+      uint16_t fcs = computeFCS16(frame);
+      frame.push_back(static_cast<uint8_t>(fcs & 0xFF));
+      frame.push_back(static_cast<uint8_t>(fcs >> 8));
+      res.push_back(frame);
+   }
+   return res;
+}
+
+static void benchHDLC(CMicroBench& bench, const CPktSizeDist& dist, uint32_t seed)
+{
+   CPktSizeDist serialDist(dist);
+   serialDist.setMaxSize(DN_API_LOC_MAX_NOTIF_SIZE - APM_HDR_SIZE);
+   vector<vector<uint8_t> > payloads = genPayloads(serialDist, seed);
+   vector<vector<uint8_t> > frames   = genSerialFrames(payloads);
+   vector<vector<uint8_t> > encoded;
+   for (const auto& f : frames)
+      encoded.push_back(encodeHDLC(f));
+
+   bench.run("computeFCS16", [&](size_t i) -> size_t {
+      const vector<uint8_t>& f = frames[i & SAMPLE_MASK];
+      volatile uint16_t fcs = computeFCS16(f);
+      (void)fcs;
+      return f.size();
+   });
+
+   bench.run("encodeHDLC", [&](size_t i) -> size_t {
+      const vector<uint8_t>& f = frames[i & SAMPLE_MASK];
+      return encodeHDLC(f).size();
+   });
+
+   CNullHDLCHandler hdlcHandler;
+   CHDLC            hdlc(BENCH_APM_MAX_MSG_SIZE, &hdlcHandler);
+   bench.run("CHDLC::addByte (frame)", [&](size_t i) -> size_t {
+      const vector<uint8_t>& e = encoded[i & SAMPLE_MASK];
+      for (uint8_t b : e)
+         hdlc.addByte(b);
+      return e.size();
+   });
+   if (hdlc.getStats().m_numFcsErrors > 0)
+      cerr << "CHDLC: unexpected FCS errors " << hdlc.getStats().m_numFcsErrors << endl;
+}
+
+static void benchAPMSerializer(CMicroBench& bench, const CPktSizeDist& dist, uint32_t seed)
+{
+   CPktSizeDist serialDist(dist);
+   serialDist.setMaxSize(DN_API_LOC_MAX_NOTIF_SIZE - APM_HDR_SIZE);
+   vector<vector<uint8_t> > payloads = genPayloads(serialDist, seed);
+
+   // Every 8-th notification is TXDONE, others are received data
+   vector<uint8_t> cmdIds(NUM_SAMPLES, DN_API_LOC_NOTIF_AP_RECEIVE);
+   for (size_t i = 0; i < NUM_SAMPLES; i += 8) {
+      cmdIds[i] = DN_API_LOC_NOTIF_TXDONE;
+      payloads[i].resize(sizeof(dn_api_loc_notif_txdone_t));
+   }
+
+   CNullAPMNotifHandler notifHandler;
+   CAPMSerializer       serializer(BENCH_APM_MAX_MSG_SIZE, &notifHandler);
+   bench.run("CAPMSerializer::handleCmd", [&](size_t i) -> size_t {
+      vector<uint8_t>& p = payloads[i & SAMPLE_MASK];
+      serializer.handleCmd(cmdIds[i & SAMPLE_MASK], p.data(), p.size());
+      return p.size();
+   });
+}
+
+static void benchAPCSerializer(CMicroBench& bench, const CPktSizeDist& dist, uint32_t seed)
+{
+   vector<vector<uint8_t> > payloads = genPayloads(dist, seed);
+   CNullSerRxHandler        rxHandler;
+   CAPCSerializer           serializer(APC_MAX_MSG_SIZE, &rxHandler, "apc.bench");
+   vector<uint8_t>          msg(APC_MAX_MSG_SIZE);
+
+   bench.run("CAPCSerializer::prepMsg", [&](size_t i) -> size_t {
+      const vector<uint8_t>& p = payloads[i & SAMPLE_MASK];
+      size_t                 msgSize = 0;
+      serializer.prepMsg(msg.data(), msg.size(), &msgSize, 0, APC_NET_RX, 0,
+                         static_cast<uint32_t>(i + 1), 0, p.data(), p.size(), NULL, 0);
+      return msgSize;
+   });
+
+   // Pre-serialized NET_TX messages (header + apc_msg_net_tx_s + payload)
+   vector<vector<uint8_t> > msgs;
+   for (size_t i = 0; i < NUM_SAMPLES; i++) {
+      apc_msg_net_tx_s netTx;
+      memset(&netTx, 0, sizeof(netTx));
+      netTx.priority = static_cast<uint8_t>(i & 3);
+      netTx.txDoneId = static_cast<uint16_t>(i);
+      size_t msgSize = 0;
+      serializer.prepMsg(msg.data(), msg.size(), &msgSize, 0, APC_NET_TX, 0,
+                         static_cast<uint32_t>(i + 1), 0,
+                         reinterpret_cast<uint8_t *>(&netTx), sizeof(netTx),
+                         payloads[i].data(), payloads[i].size());
+      msgs.push_back(vector<uint8_t>(msg.begin(), msg.begin() + msgSize));
+   }
+   bench.run("CAPCSerializer::dataReceived", [&](size_t i) -> size_t {
+      vector<uint8_t>& m = msgs[i & SAMPLE_MASK];
+      serializer.dataReceived(0, m.data(), m.size());
+      return m.size();
+   });
+
+   // Downstream burst: 16 messages per read, split at random places between reads
+   vector<uint8_t> burst;
+   vector<size_t>  splits;
+   mt19937         gen(seed);
+   for (size_t i = 0; i < 16; i++)
+      burst.insert(burst.end(), msgs[i].begin(), msgs[i].end());
+   for (size_t i = 0; i < NUM_SAMPLES; i++)
+      splits.push_back(gen() % burst.size());
+   bench.run("CAPCSerializer::dataReceived burst", [&](size_t i) -> size_t {
+      size_t split = splits[i & SAMPLE_MASK];
+      serializer.dataReceived(0, burst.data(), split);
+      serializer.dataReceived(0, burst.data() + split, burst.size() - split);
+      return burst.size();
+   });
+   if (rxHandler.m_numMsgs == 0)
+      cerr << "CAPCSerializer: no messages received" << endl;
+
+   // In-place byte order conversion of NET_TX header
+   vector<vector<uint8_t> > netTxPayloads;
+   for (const auto& m : msgs)
+      netTxPayloads.push_back(vector<uint8_t>(m.begin() + sizeof(apc_hdr_s), m.end()));
+   bench.run("CAPCSerializer::convert", [&](size_t i) -> size_t {
+      vector<uint8_t>& p = netTxPayloads[i & SAMPLE_MASK];
+      serializer.convert((i & 1) ? NET_TO_HOST : HOST_TO_NET, APC_NET_TX, p.data(), p.size());
+      return p.size();
+   });
+}
+
+static void benchAPCCache(CMicroBench& bench, const CPktSizeDist& dist, uint32_t seed,
+                          uint32_t cacheSize)
+{
+   vector<vector<uint8_t> > payloads = genPayloads(dist, seed);
+   CAPCCache                cache(cacheSize);
+   uint32_t                 seqNum = 0;
+
+   // Manager confirms received packets every 16 messages
+   bench.run("CAPCCache::addPacket", [&](size_t i) -> size_t {
+      const vector<uint8_t>& p = payloads[i & SAMPLE_MASK];
+      cache.addPacket(APC_NET_RX, p.data(), p.size(), NULL, 0, &seqNum);
+      if ((seqNum & 0xF) == 0)
+         cache.confirmedSeqNum(seqNum);
+      return p.size();
+   });
+
+   // Replay of full cache after reconnection
+   cache.clear();
+   for (uint32_t i = 0; i < cacheSize; i++) {
+      const vector<uint8_t>& p = payloads[i & SAMPLE_MASK];
+      cache.addPacket(APC_NET_RX, p.data(), p.size(), NULL, 0, &seqNum);
+   }
+   cache.prepForGet();
+   CAPCCache::apc_cache_pkt_s pkt;
+   bench.run("CAPCCache::getNextPacket", [&](size_t i) -> size_t {
+      if (cache.getNextPacket(&pkt) == APC_ERR_NOTFOUND) {
+         cache.prepForGet();
+         cache.getNextPacket(&pkt);
+      }
+      return pkt.m_size;
+   });
+}
+
+static void benchStatDelays(CMicroBench& bench, uint32_t seed)
+{
+   // Delays around default thresholds (5, 7, 10, 50 msec)
+   vector<usec_t>                    delays(NUM_SAMPLES);
+   mt19937                           gen(seed);
+   exponential_distribution<double>  dist(1.0 / 6000);
+   for (auto& d : delays)
+      d = usec_t(static_cast<int64_t>(dist(gen)));
+
+   CStatDelaysCalc stat;
+   bench.run("CStatDelaysCalc::addEvent", [&](size_t i) -> size_t {
+      stat.addEvent(delays[i & SAMPLE_MASK]);
+      return 0;
+   });
+}
+
+int main(int argc, char ** argv)
+{
+   uint32_t     minTimeMsec, seed, cacheSize;
+   string       filter, sizes, logLevel, outFile;
+   bool         jsonOut = false;
+   CPktSizeDist dist;
+
+   po::options_description desc("Microbenchmark options");
+   desc.add_options()
+      ("help,h", "Show this help")
+      ("filter",     po::value<string>(&filter),
+                     "Run only benchmarks containing this substring")
+      ("min-time",   po::value<uint32_t>(&minTimeMsec)->default_value(500),
+                     "Minimal run time of each benchmark, msec")
+      ("sizes",      po::value<string>(&sizes)->default_value(dist.toString()),
+                     "Packet size distribution SIZE:WEIGHT[,SIZE:WEIGHT...]")
+      ("cache-size", po::value<uint32_t>(&cacheSize)->default_value(BENCH_APC_CACHE_SIZE),
+                     "Number of packets in APC cache")
+      ("seed",       po::value<uint32_t>(&seed)->default_value(1),
+                     "Random generator seed")
+      ("log-level",  po::value<string>(&logLevel)->default_value("INFO"),
+                     "Log level during benchmarks")
+      ("output",     po::value<string>(&outFile),
+                     "Write results to file")
+      ("json",       po::bool_switch(&jsonOut),
+                     "Results in JSON format");
+
+   po::variables_map vm;
+   try {
+      po::store(po::parse_command_line(argc, argv, desc), vm);
+      po::notify(vm);
+   } catch (const exception& e) {
+      cerr << e.what() << endl << desc << endl;
+      return 1;
+   }
+   if (vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+   }
+   if (!dist.parse(sizes)) {
+      cerr << "Wrong size distribution: " << sizes << endl;
+      return 1;
+   }
+   if (cacheSize == 0) {
+      cerr << "Wrong cache size" << endl;
+      return 1;
+   }
+
+   // Hot paths are measured with production log level, output is discarded
+   Logger::openLogging("/dev/null");
+   log4cxx::Logger::getRootLogger()->setLevel(log4cxx::Level::toLevel(logLevel, log4cxx::Level::getInfo()));
+
+   CMicroBench bench(minTimeMsec, filter);
+   benchHDLC(bench, dist, seed);
+   benchAPMSerializer(bench, dist, seed);
+   benchAPCSerializer(bench, dist, seed);
+   benchAPCCache(bench, dist, seed, cacheSize);
+   benchStatDelays(bench, seed);
+
+   if (!outFile.empty()) {
+      ofstream out(outFile.c_str());
+      bench.print(out, jsonOut);
+   }
+   bench.print(cout, jsonOut);
+   Logger::closeLogging();
+   return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "common.h"
+#include <iostream>
+
+/**
+ * Averaging windows of rate meter (exponentially weighted moving average)
+ */
+enum ratewindow_t {
+   RATE_WND_1SEC,
+   RATE_WND_10SEC,
+   RATE_WND_30SEC,      // Not in common.RateStat, kept for ap30secPktRate of APCStatsResp
+   RATE_WND_1MIN,
+   RATE_WND_5MIN,
+   RATE_WND_15MIN,
+   RATE_WND_NUM,
+};
+
+struct rate_s {
+   double   m_rate[RATE_WND_NUM];   // EWMA of number of events per second for every window
+   double   m_peak;                 // Max 1-second rate
+   double   m_avg;                  // Average rate since last clear
+   uint64_t m_total;                // Total number of events since last clear
+};
+
+struct ratestat_s {
+   rate_s   m_pkts;                 // Packets
+   rate_s   m_bytes;                // Bytes
+};
+
+std::ostream& operator << (std::ostream& os, const rate_s& stat);
+std::ostream& operator << (std::ostream& os, const ratestat_s& stat);
@@ -0,0 +1,102 @@
+#include "StatRateCalc.h"
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+using namespace std;
+
+// Length of averaging windows (seconds)
+static const double RATE_WINDOWS[RATE_WND_NUM] = { 1.0, 10.0, 30.0, 60.0, 300.0, 900.0 };
+
+CStatRateCalc::CStatRateCalc()
+{
+   clear();
+}
+
+void  CStatRateCalc::clear()
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   memset(&m_pkts,  0, sizeof(m_pkts));
+   memset(&m_bytes, 0, sizeof(m_bytes));
+   m_startTime = m_lastTick = TIME_NOW();
+}
+
+void CStatRateCalc::addEvent(uint32_t numPkts, size_t numBytes)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   update_p(TIME_NOW());
+   m_pkts.m_curCount  += numPkts;
+   m_pkts.m_total     += numPkts;
+   m_bytes.m_curCount += numBytes;
+   m_bytes.m_total    += numBytes;
+}
+
+void  CStatRateCalc::getStat(ratestat_s * pStat)
+{
+   boost::unique_lock<boost::mutex> lock(m_lock);
+   mngr_time_t now = TIME_NOW();
+   update_p(now);
+   double numSec = static_cast<double>(TO_USEC(now - m_startTime).count()) / 1000000.0;
+   getRate_p(m_pkts,  numSec, &pStat->m_pkts);
+   getRate_p(m_bytes, numSec, &pStat->m_bytes);
+}
+
+// Fold all finished seconds into averages.
+// All events of m_curCount belong to the first finished second, rest seconds are empty.
+void CStatRateCalc::update_p(const mngr_time_t& now)
+{
+   int64_t numSec = TO_SEC(now - m_lastTick).count();
+   if (numSec <= 0)
+      return;
+   fold_p(m_pkts,  numSec);
+   fold_p(m_bytes, numSec);
+   m_lastTick += sec_t(numSec);
+}
+
+void CStatRateCalc::fold_p(meter_s& meter, uint64_t numSec)
+{
+   double curRate = static_cast<double>(meter.m_curCount);
+   for (int i = 0; i < RATE_WND_NUM; i++) {
+      double decay = exp(-1.0 / RATE_WINDOWS[i]);
+      meter.m_rate[i] = meter.m_rate[i] * decay + curRate * (1.0 - decay);
+      if (numSec > 1)
+         meter.m_rate[i] *= exp(-static_cast<double>(numSec - 1) / RATE_WINDOWS[i]);
+   }
+   if (curRate > meter.m_peak)
+      meter.m_peak = curRate;
+   meter.m_curCount = 0;
+}
+
+void CStatRateCalc::getRate_p(const meter_s& meter, double numSec, rate_s * pRate)
+{
+   for (int i = 0; i < RATE_WND_NUM; i++)
+      pRate->m_rate[i] = meter.m_rate[i];
+   pRate->m_peak  = meter.m_peak;
+   pRate->m_total = meter.m_total;
+   pRate->m_avg   = numSec > 0 ? static_cast<double>(meter.m_total) / numSec : 0;
+}
+
+ostream& operator << (ostream& os, const rate_s& stat)
+{
+   ios::fmtflags f = os.flags();
+   os << fixed << setprecision(1)
+      << "1s: "  << stat.m_rate[RATE_WND_1SEC]  << ", 10s: " << stat.m_rate[RATE_WND_10SEC]
+      << ", 1m: " << stat.m_rate[RATE_WND_1MIN] << ", 5m: "  << stat.m_rate[RATE_WND_5MIN]
+      << ", 15m: " << stat.m_rate[RATE_WND_15MIN] << "; Peak: " << stat.m_peak
+      << "; Avg: " << stat.m_avg << "; All: " << stat.m_total;
+   os.flags(f);
+   return os;
+}
+
+ostream& operator << (ostream& os, const ratestat_s& stat)
+{
+   os << "pkt/s [" << stat.m_pkts << "] B/s [" << stat.m_bytes << "]";
+   return os;
+}
+
+std::ostream& operator << (std::ostream& os, CStatRateCalc& stat) {
+   ratestat_s s;
+   stat.getStat(&s);
+   os << s;
+   return os;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "StatRate.h"
+#include <boost/thread.hpp>
+
+/**
+ * Calculate packet and byte rates.
+ * Rates are averaged over 1s, 10s, 1min, 5min and 15min windows (EWMA).
+ * Counted events are folded into averages on 1-second boundaries when
+ * the meter is updated or read, so no timer is needed.
+ */
+class CStatRateCalc {
+public:
+   CStatRateCalc();
+   ~CStatRateCalc(){;}
+   void         clear();
+
+   // Add 'numPkts' packets with total size 'numBytes'
+   void         addEvent(uint32_t numPkts, size_t numBytes);
+   void         addPacket(size_t numBytes) { addEvent(1, numBytes); }
+
+   // Get rate statistics
+   void         getStat(ratestat_s * pStat);
+
+private:
+   struct meter_s {
+      double   m_rate[RATE_WND_NUM];
+      double   m_peak;
+      uint64_t m_total;
+      uint64_t m_curCount;          // Events of current (not finished) second
+   };
+
+   meter_s           m_pkts;
+   meter_s           m_bytes;
+   mngr_time_t       m_startTime;   // Time of last clear
+   mngr_time_t       m_lastTick;    // Begin of current second
+   boost::mutex      m_lock;
+
+   void         update_p(const mngr_time_t& now);
+   void         fold_p(meter_s& meter, uint64_t numSec);
+   void         getRate_p(const meter_s& meter, double numSec, rate_s * pRate);
+};
+
+std::ostream& operator << (std::ostream& os, CStatRateCalc& stat);
@@ -0,0 +1,665 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "APEmulator.h"
+#include "6lowpan/public/dn_api_local.h"
+#include "6lowpan/public/dn_api_param.h"
+#include "6lowpan/public/dn_api_net.h"
+
+#include <boost/bind.hpp>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Serial API header flags
+const uint8_t APT_FLAG_RESP   = 0x01;
+const uint8_t APT_FLAG_PKTID  = 0x02;
+const uint8_t APT_FLAG_SYNC   = 0x08;
+const size_t  APT_HDR_LEN     = 3;       // cmdId, length, flags
+
+const size_t  APEMU_MAX_FRAME = 256;
+const uint8_t APEMU_NO_PKTID  = 0xFF;
+const int     APEMU_TICK_MSEC = 5;       // Period of upstream generator
+const int     APEMU_RESET_MSEC = 100;    // Reboot delay after reset / disconnect
+
+// Reported AP identity. Application version must pass apc version check
+const uint8_t APEMU_MAC[DN_MACADDR_SIZE] = { 0x00, 0x17, 0x0D, 0x00, 0x00, 0xE5, 0x00, 0x01 };
+const dn_api_swver_t APEMU_VERSION = { 1, 4, 1, 0 };
+
+CAPEmulator::CAPEmulator(boost::asio::io_service& ioService, const apemu_config_s& config)
+   : m_ioService(ioService),
+     m_config(config),
+     m_masterFd(-1),
+     m_slaveFd(-1),
+     m_pty(ioService),
+     m_hdlc(APEMU_MAX_FRAME, this),
+     m_isWriting(false),
+     m_isStopped(false),
+     m_rnd(config.m_seed),
+     m_lastCmdId(0),
+     m_lastCmdPktId(APEMU_NO_PKTID),
+     m_netId(config.m_netId),
+     m_clkSrc(DN_API_AP_CLK_SOURCE_INTERNAL),
+     m_isOperational(false),
+     m_joinTimer(ioService),
+     m_notifPending(false),
+     m_notifPktId(0),
+     m_notifTimer(ioService),
+     m_upTimer(ioService),
+     m_upTokens(0),
+     m_upRate(config.m_upRate),
+     m_upSeq(0),
+     m_muteUntil(TIME_EMPTY),
+     m_scriptNacks(0),
+     m_scriptDrops(0),
+     m_scriptCorrupts(0),
+     m_scriptIdx(0),
+     m_scriptTimer(ioService)
+{
+   memset(&m_stats, 0, sizeof(m_stats));
+}
+
+CAPEmulator::~CAPEmulator()
+{
+   if (m_slaveFd >= 0)
+      close(m_slaveFd);
+   if (!m_config.m_linkName.empty())
+      unlink(m_config.m_linkName.c_str());
+}
+
+bool CAPEmulator::start(string * pError)
+{
+   if (!openPty_p(pError))
+      return false;
+
+   m_startTime = m_lastInput = m_upLastTick = TIME_NOW();
+   startRead_p();
+   boot_p();
+   startUpTimer_p();
+   startScriptTimer_p();
+   return true;
+}
+
+void CAPEmulator::stop()
+{
+   m_isStopped = true;
+   boost::system::error_code ec;
+   m_joinTimer.cancel(ec);
+   m_notifTimer.cancel(ec);
+   m_upTimer.cancel(ec);
+   m_scriptTimer.cancel(ec);
+   m_pty.close(ec);
+}
+
+bool CAPEmulator::openPty_p(string * pError)
+{
+   m_masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+   if (m_masterFd < 0 || grantpt(m_masterFd) < 0 || unlockpt(m_masterFd) < 0) {
+      *pError = string("can not create pty: ") + strerror(errno);
+      return false;
+   }
+   const char * slaveName = ptsname(m_masterFd);
+   m_slaveFd = open(slaveName, O_RDWR | O_NOCTTY);
+   if (m_slaveFd < 0) {
+      *pError = string("can not open ") + slaveName + ": " + strerror(errno);
+      return false;
+   }
+   // No echo and no line processing until apc configures the port
+   struct termios tio;
+   tcgetattr(m_slaveFd, &tio);
+   cfmakeraw(&tio);
+   tcsetattr(m_slaveFd, TCSANOW, &tio);
+
+   if (!m_config.m_linkName.empty()) {
+      unlink(m_config.m_linkName.c_str());
+      if (symlink(slaveName, m_config.m_linkName.c_str()) < 0) {
+         *pError = "can not create link " + m_config.m_linkName + ": " + strerror(errno);
+         return false;
+      }
+   }
+   m_pty.assign(m_masterFd);
+   cout << "AP emulator: " << slaveName
+        << (m_config.m_linkName.empty() ? "" : " -> " + m_config.m_linkName) << endl;
+   return true;
+}
+
+// ---------- Serial I/O
+
+void CAPEmulator::startRead_p()
+{
+   m_pty.async_read_some(boost::asio::buffer(m_readBuf, sizeof(m_readBuf)),
+                         boost::bind(&CAPEmulator::handleRead_p, this,
+                                     boost::asio::placeholders::error,
+                                     boost::asio::placeholders::bytes_transferred));
+}
+
+void CAPEmulator::handleRead_p(const boost::system::error_code& error, size_t size)
+{
+   if (m_isStopped)
+      return;
+   if (error) {
+      cerr << "AP emulator: read error " << error.message() << endl;
+      return;
+   }
+   for (size_t i = 0; i < size; i++)
+      m_hdlc.addByte(m_readBuf[i]);
+   startRead_p();
+}
+
+void CAPEmulator::frameComplete(const vector<uint8_t>& packet)
+{
+   if (packet.size() < APT_HDR_LEN)
+      return;
+   m_lastInput = TIME_NOW();
+   if (m_scriptDrops > 0 || m_rnd.check(m_config.m_dropProb)) {
+      if (m_scriptDrops > 0)
+         m_scriptDrops--;
+      m_stats.m_numDroppedIn++;
+      return;
+   }
+   m_stats.m_numFramesIn++;
+   m_stats.m_numBytesIn += packet.size();
+
+   uint8_t        cmdId = packet[0];
+   uint8_t        flags = packet[2];
+   const uint8_t* data  = packet.data() + APT_HDR_LEN;
+   size_t         size  = min<size_t>(packet[1], packet.size() - APT_HDR_LEN);
+   if (flags & APT_FLAG_RESP)
+      handleNotifAck_p(cmdId, flags & APT_FLAG_PKTID, data, size);
+   else
+      handleCmd_p(cmdId, flags & APT_FLAG_PKTID, data, size);
+}
+
+void CAPEmulator::writeFrame_p(uint8_t cmdId, uint8_t flags, const uint8_t * data, size_t size)
+{
+   vector<uint8_t> frame(APT_HDR_LEN + size);
+   frame[0] = cmdId;
+   frame[1] = static_cast<uint8_t>(size);
+   frame[2] = flags;
+   if (size > 0)
+      memcpy(frame.data() + APT_HDR_LEN, data, size);
+   m_stats.m_numFramesOut++;
+   m_stats.m_numBytesOut += frame.size();
+
+   vector<uint8_t> output = encodeHDLC(frame);
+   if (m_scriptCorrupts > 0 || m_rnd.check(m_config.m_corruptProb)) {
+      if (m_scriptCorrupts > 0)
+         m_scriptCorrupts--;
+      // Flip bits of one payload byte, keep framing bytes intact
+      size_t  idx = 1 + m_rnd.get(static_cast<uint32_t>(output.size() - 2));
+      uint8_t b   = output[idx] ^ 0x55;
+      if (output[idx] != 0x7D && b != 0x7E && b != 0x7D) {
+         output[idx] = b;
+         m_stats.m_numCorruptedOut++;
+      }
+   }
+   m_writeQueue.push_back(output);
+   startWrite_p();
+}
+
+void CAPEmulator::startWrite_p()
+{
+   if (m_isWriting || m_writeQueue.empty() || m_isStopped)
+      return;
+   m_isWriting = true;
+   boost::asio::async_write(m_pty, boost::asio::buffer(m_writeQueue.front()),
+                            boost::bind(&CAPEmulator::handleWrite_p, this,
+                                        boost::asio::placeholders::error,
+                                        boost::asio::placeholders::bytes_transferred));
+}
+
+void CAPEmulator::handleWrite_p(const boost::system::error_code& error, size_t size)
+{
+   m_isWriting = false;
+   if (error) {
+      if (!m_isStopped)
+         cerr << "AP emulator: write error " << error.message() << endl;
+      return;
+   }
+   m_writeQueue.pop_front();
+   startWrite_p();
+}
+
+// ---------- Commands
+
+void CAPEmulator::handleCmd_p(uint8_t cmdId, uint8_t pktId, const uint8_t * data, size_t size)
+{
+   // Retransmission of last command: response was lost, resend it
+   if (cmdId == m_lastCmdId && pktId == m_lastCmdPktId) {
+      m_stats.m_numDupCmds++;
+      sendResponse_p(cmdId, pktId, m_lastResp);
+      return;
+   }
+   m_stats.m_numCmds++;
+
+   bool            isReboot = false;
+   vector<uint8_t> resp(1, DN_API_RC_OK);
+   switch (cmdId) {
+   case DN_API_LOC_CMD_GETPARAM:
+      handleGetParam_p(data, size, &resp);
+      break;
+
+   case DN_API_LOC_CMD_SETPARAM:
+      if (size < 1) {
+         resp[0] = DN_API_RC_INVALID_LEN;
+         break;
+      }
+      resp.push_back(data[0]);
+      if (data[0] == DN_API_PARAM_NETID && size >= 1 + sizeof(uint16_t)) {
+         uint16_t netId;
+         memcpy(&netId, data + 1, sizeof(netId));
+         m_netId = ntohs(netId);
+      } else if (data[0] == DN_API_PARAM_AP_CLKSRC && size >= 2) {
+         // apc resets AP after change of clock source
+         isReboot = m_clkSrc != data[1];
+         m_clkSrc = data[1];
+      }
+      break;
+
+   case DN_API_LOC_CMD_JOIN:
+      m_stats.m_numJoins++;
+      m_joinTimer.expires_from_now(boost::posix_time::milliseconds(m_config.m_joinDelay));
+      m_joinTimer.async_wait([this](const boost::system::error_code& error) {
+         if (error || m_isStopped)
+            return;
+         m_isOperational = true;
+         m_upLastTick    = TIME_NOW();
+         m_upTokens      = 0;
+         sendEvent_p(DN_API_LOC_EV_OPERATIONAL, false);
+      });
+      break;
+
+   case DN_API_LOC_CMD_DISCONNECT:
+   case DN_API_LOC_CMD_RESET:
+      isReboot = true;
+      break;
+
+   case DN_API_LOC_CMD_AP_SEND:
+      handleApSend_p(data, size, &resp);
+      break;
+
+   default:
+      // WRITE_GPS_STATUS, time SETPARAM and others are accepted without action
+      break;
+   }
+
+   m_lastCmdId    = cmdId;
+   m_lastCmdPktId = pktId;
+   m_lastResp     = resp;
+   sendResponse_p(cmdId, pktId, resp);
+
+   if (isReboot) {
+      timer_ptr_t timer(new boost::asio::deadline_timer(m_ioService));
+      timer->expires_from_now(boost::posix_time::milliseconds(APEMU_RESET_MSEC));
+      timer->async_wait([this, timer](const boost::system::error_code& error) {
+         if (!error && !m_isStopped)
+            boot_p();
+      });
+   }
+}
+
+void CAPEmulator::handleGetParam_p(const uint8_t * data, size_t size, vector<uint8_t> * pResp)
+{
+   if (size < 1) {
+      (*pResp)[0] = DN_API_RC_INVALID_LEN;
+      return;
+   }
+   uint8_t paramId = data[0];
+   switch (paramId) {
+   case DN_API_PARAM_MACADDR: {
+      dn_api_rsp_get_macaddr_t rsp;
+      memset(&rsp, 0, sizeof(rsp));
+      rsp.paramId = paramId;
+      memcpy(rsp.macAddr, APEMU_MAC, sizeof(rsp.macAddr));
+      pResp->assign((uint8_t *)&rsp, (uint8_t *)&rsp + sizeof(rsp));
+   }
+   break;
+   case DN_API_PARAM_NETID: {
+      dn_api_rsp_get_netid_t rsp;
+      memset(&rsp, 0, sizeof(rsp));
+      rsp.paramId = paramId;
+      rsp.netId   = htons(m_netId);
+      pResp->assign((uint8_t *)&rsp, (uint8_t *)&rsp + sizeof(rsp));
+   }
+   break;
+   case DN_API_PARAM_MOTEINFO: {
+      dn_api_rsp_get_moteinfo_t rsp;
+      memset(&rsp, 0, sizeof(rsp));
+      rsp.paramId    = paramId;
+      rsp.apiVersion = 4;
+      memcpy(rsp.serialNumber, APEMU_MAC, sizeof(rsp.serialNumber));
+      rsp.swVer       = APEMU_VERSION;
+      rsp.swVer.build = htons(APEMU_VERSION.build);
+      pResp->assign((uint8_t *)&rsp, (uint8_t *)&rsp + sizeof(rsp));
+   }
+   break;
+   case DN_API_PARAM_APPINFO: {
+      dn_api_rsp_get_appinfo_t rsp;
+      memset(&rsp, 0, sizeof(rsp));
+      rsp.paramId      = paramId;
+      rsp.appVer       = APEMU_VERSION;
+      rsp.appVer.build = htons(APEMU_VERSION.build);
+      pResp->assign((uint8_t *)&rsp, (uint8_t *)&rsp + sizeof(rsp));
+   }
+   break;
+   case DN_API_PARAM_AP_CLKSRC: {
+      dn_api_rsp_get_ap_clksrc_t rsp;
+      memset(&rsp, 0, sizeof(rsp));
+      rsp.paramId  = paramId;
+      rsp.apClkSrc = m_clkSrc;
+      pResp->assign((uint8_t *)&rsp, (uint8_t *)&rsp + sizeof(rsp));
+   }
+   break;
+   case DN_API_PARAM_AP_STATUS: {
+      dn_api_rsp_get_apstatus_t rsp;
+      memset(&rsp, 0, sizeof(rsp));
+      rsp.paramId = paramId;
+      rsp.state   = m_isOperational ? DN_API_ST_OPERATIONAL : DN_API_ST_IDLE;
+      pResp->assign((uint8_t *)&rsp, (uint8_t *)&rsp + sizeof(rsp));
+   }
+   break;
+   case DN_API_PARAM_TIME: {
+      dn_api_rsp_get_time_t rsp;
+      memset(&rsp, 0, sizeof(rsp));
+      rsp.paramId = paramId;
+      rsp.upTime  = htonl(static_cast<uint32_t>(TO_SEC(TIME_NOW() - m_startTime).count()));
+      pResp->assign((uint8_t *)&rsp, (uint8_t *)&rsp + sizeof(rsp));
+   }
+   break;
+   default:
+      (*pResp)[0] = DN_API_RC_INVALID_VALUE;
+      pResp->push_back(paramId);
+      break;
+   }
+}
+
+void CAPEmulator::handleApSend_p(const uint8_t * data, size_t size, vector<uint8_t> * pResp)
+{
+   if (size < sizeof(dn_api_loc_apsend_ctrl_t)) {
+      (*pResp)[0] = DN_API_RC_INVALID_LEN;
+      return;
+   }
+   if (m_scriptNacks > 0 || m_rnd.check(m_config.m_nackProb)) {
+      if (m_scriptNacks > 0)
+         m_scriptNacks--;
+      m_stats.m_numApSendNacks++;
+      (*pResp)[0] = DN_API_RC_NO_RESOURCES;
+      return;
+   }
+   m_stats.m_numApSend++;
+
+   int64_t latency;
+   if (emuStampParse(data, size, sizeof(dn_api_loc_apsend_ctrl_t), NULL, &latency))
+      m_downLatency.add(latency);
+
+   dn_api_loc_apsend_ctrl_t ctrl;
+   memcpy(&ctrl, data, sizeof(ctrl));
+   uint16_t packetId = ntohs(ctrl.packetId);
+   if (packetId == 0xFFFF)
+      return;
+   timer_ptr_t timer(new boost::asio::deadline_timer(m_ioService));
+   timer->expires_from_now(boost::posix_time::milliseconds(m_config.m_txDoneDelay));
+   timer->async_wait([this, timer, packetId](const boost::system::error_code& error) {
+      if (!error && !m_isStopped)
+         sendTxDone_p(packetId);
+   });
+}
+
+void CAPEmulator::sendResponse_p(uint8_t cmdId, uint8_t pktId, const vector<uint8_t>& resp)
+{
+   uint8_t flags = APT_FLAG_RESP | pktId;
+   if (m_config.m_respDelay == 0) {
+      writeFrame_p(cmdId, flags, resp.data(), resp.size());
+      return;
+   }
+   timer_ptr_t timer(new boost::asio::deadline_timer(m_ioService));
+   timer->expires_from_now(boost::posix_time::milliseconds(m_config.m_respDelay));
+   timer->async_wait([this, timer, cmdId, flags, resp](const boost::system::error_code& error) {
+      if (!error && !m_isStopped)
+         writeFrame_p(cmdId, flags, resp.data(), resp.size());
+   });
+}
+
+// ---------- Notifications
+
+void CAPEmulator::boot_p()
+{
+   m_stats.m_numBoots++;
+   m_isOperational = false;
+   m_lastCmdPktId  = APEMU_NO_PKTID;
+   m_netId         = m_config.m_netId;
+   m_lastInput     = TIME_NOW();
+   boost::system::error_code ec;
+   m_joinTimer.cancel(ec);
+   m_notifTimer.cancel(ec);
+   m_notifQueue.clear();
+   m_notifPending = false;
+   sendEvent_p(DN_API_LOC_EV_BOOT, true);
+}
+
+void CAPEmulator::sendEvent_p(uint32_t events, bool isSync)
+{
+   dn_api_loc_notif_events_t ev;
+   ev.events = htonl(events);
+   ev.state  = m_isOperational ? DN_API_ST_OPERATIONAL : DN_API_ST_IDLE;
+   ev.alarms = 0;
+   // Events go before upstream data
+   notif_s notif = { DN_API_LOC_NOTIF_EVENTS, isSync,
+                     vector<uint8_t>((uint8_t *)&ev, (uint8_t *)&ev + sizeof(ev)) };
+   if (m_notifPending && !m_notifQueue.empty())
+      m_notifQueue.insert(m_notifQueue.begin() + 1, notif);
+   else
+      m_notifQueue.push_front(notif);
+   sendNotif_p();
+}
+
+void CAPEmulator::sendTxDone_p(uint16_t packetId)
+{
+   dn_api_loc_notif_txdone_t txDone;
+   txDone.packetId = htons(packetId);
+   txDone.status   = DN_API_TXSTATUS_OK;
+   m_stats.m_numTxDone++;
+   queueNotif_p(DN_API_LOC_NOTIF_TXDONE, (uint8_t *)&txDone, sizeof(txDone));
+}
+
+void CAPEmulator::queueNotif_p(uint8_t cmdId, const uint8_t * data, size_t size, bool isSync)
+{
+   notif_s notif = { cmdId, isSync, vector<uint8_t>(data, data + size) };
+   m_notifQueue.push_back(notif);
+   sendNotif_p();
+}
+
+// Stop-and-wait: the head of the queue is sent until apc acknowledges it
+void CAPEmulator::sendNotif_p()
+{
+   if (m_notifPending || m_notifQueue.empty())
+      return;
+   const notif_s& notif = m_notifQueue.front();
+   uint8_t flags = m_notifPktId | (notif.m_isSync ? APT_FLAG_SYNC : 0);
+   m_notifPending  = true;
+   m_notifSendTime = TIME_NOW();
+   writeFrame_p(notif.m_cmdId, flags, notif.m_payload.data(), notif.m_payload.size());
+   m_notifTimer.expires_from_now(boost::posix_time::milliseconds(m_config.m_ackTimeout));
+   m_notifTimer.async_wait(boost::bind(&CAPEmulator::handleNotifTimeout_p, this,
+                                       boost::asio::placeholders::error, false));
+}
+
+void CAPEmulator::handleNotifAck_p(uint8_t cmdId, uint8_t pktId, const uint8_t * data, size_t size)
+{
+   if (!m_notifPending || m_notifQueue.empty() ||
+       cmdId != m_notifQueue.front().m_cmdId || pktId != m_notifPktId)
+      return;   // late ACK of retransmitted notification
+
+   boost::system::error_code ec;
+   m_notifTimer.cancel(ec);
+   if (size > 0 && data[0] == DN_API_RC_NO_RESOURCES) {
+      // apc is paused, repeat the same notification later
+      m_stats.m_numNotifNacks++;
+      m_notifTimer.expires_from_now(boost::posix_time::milliseconds(m_config.m_nackDelay));
+      m_notifTimer.async_wait(boost::bind(&CAPEmulator::handleNotifTimeout_p, this,
+                                          boost::asio::placeholders::error, true));
+      return;
+   }
+   if (cmdId == DN_API_LOC_NOTIF_AP_RECEIVE) {
+      m_stats.m_numUpAcked++;
+      m_notifAckTime.add(TO_USEC(TIME_NOW() - m_notifSendTime).count());
+   }
+   m_notifQueue.pop_front();
+   m_notifPending = false;
+   m_notifPktId  ^= APT_FLAG_PKTID;
+   sendNotif_p();
+}
+
+void CAPEmulator::handleNotifTimeout_p(const boost::system::error_code& error, bool isRetry)
+{
+   if (error || m_isStopped || !m_notifPending)
+      return;
+   if (!isRetry)
+      m_stats.m_numNotifRetries++;
+   m_notifPending = false;
+   sendNotif_p();
+}
+
+// ---------- Upstream generator
+
+void CAPEmulator::startUpTimer_p()
+{
+   m_upTimer.expires_from_now(boost::posix_time::milliseconds(APEMU_TICK_MSEC));
+   m_upTimer.async_wait(boost::bind(&CAPEmulator::handleUpTimer_p, this,
+                                    boost::asio::placeholders::error));
+}
+
+void CAPEmulator::handleUpTimer_p(const boost::system::error_code& error)
+{
+   if (error || m_isStopped)
+      return;
+   mngr_time_t now = TIME_NOW();
+   // apc doesn't talk to AP that it considers reset: emulate boot
+   if (m_config.m_idleReboot > 0 &&
+       TO_MSEC(now - m_lastInput).count() >= static_cast<int64_t>(m_config.m_idleReboot))
+      boot_p();
+   generateUp_p(now);
+   startUpTimer_p();
+}
+
+void CAPEmulator::generateUp_p(const mngr_time_t& now)
+{
+   double elapsed = static_cast<double>(TO_USEC(now - m_upLastTick).count()) / 1000000.0;
+   m_upLastTick = now;
+   if (!m_isOperational || m_upRate == 0 || now < m_muteUntil) {
+      m_upTokens = 0;
+      return;
+   }
+   m_upTokens += elapsed * m_upRate;
+   vector<uint8_t> payload(m_config.m_upSize);
+   while (m_upTokens >= 1.0) {
+      m_upTokens -= 1.0;
+      if (m_config.m_upCount > 0 && m_upSeq >= m_config.m_upCount) {
+         m_upTokens = 0;
+         break;
+      }
+      m_upSeq++;
+      if (m_notifQueue.size() >= m_config.m_queueSize) {
+         m_stats.m_numUpDropped++;
+         continue;
+      }
+      m_stats.m_numUpGenerated++;
+      emuStampFill(payload.data(), payload.size(), m_upSeq);
+      queueNotif_p(DN_API_LOC_NOTIF_AP_RECEIVE, payload.data(), payload.size());
+   }
+}
+
+// ---------- Script
+
+void CAPEmulator::startScriptTimer_p()
+{
+   if (m_scriptIdx >= m_config.m_script.size())
+      return;
+   mngr_time_t at = m_startTime + msec_t(m_config.m_script[m_scriptIdx].m_timeMsec);
+   int64_t     waitMsec = max<int64_t>(0, TO_MSEC(at - TIME_NOW()).count());
+   m_scriptTimer.expires_from_now(boost::posix_time::milliseconds(waitMsec));
+   m_scriptTimer.async_wait(boost::bind(&CAPEmulator::handleScriptTimer_p, this,
+                                        boost::asio::placeholders::error));
+}
+
+void CAPEmulator::handleScriptTimer_p(const boost::system::error_code& error)
+{
+   if (error || m_isStopped)
+      return;
+   mngr_time_t now = TIME_NOW();
+   while (m_scriptIdx < m_config.m_script.size() &&
+          m_startTime + msec_t(m_config.m_script[m_scriptIdx].m_timeMsec) <= now)
+      runAction_p(m_config.m_script[m_scriptIdx++]);
+   startScriptTimer_p();
+}
+
+void CAPEmulator::runAction_p(const emu_action_s& action)
+{
+   cout << "AP emulator: " << action.m_timeMsec << " msec: " << action.m_action
+        << " " << action.m_arg << endl;
+   if (action.m_action == "nack") {
+      m_scriptNacks = action.m_arg;
+   } else if (action.m_action == "drop") {
+      m_scriptDrops = action.m_arg;
+   } else if (action.m_action == "corrupt") {
+      m_scriptCorrupts = action.m_arg;
+   } else if (action.m_action == "rate") {
+      m_upRate = action.m_arg;
+   } else if (action.m_action == "mute") {
+      m_muteUntil = TIME_NOW() + msec_t(action.m_arg);
+   } else if (action.m_action == "reboot") {
+      boot_p();
+   } else if (action.m_action == "stop") {
+      m_ioService.stop();
+   } else {
+      cerr << "AP emulator: unknown action " << action.m_action << endl;
+   }
+}
+
+// ---------- Statistics
+
+void CAPEmulator::printStats(ostream& os, bool asJson)
+{
+   const apemu_stats_s& s = m_stats;
+   const hdlc_stats_s&  h = m_hdlc.getStats();
+   if (asJson) {
+      os << "{\"framesIn\":"    << s.m_numFramesIn     << ",\"framesOut\":"    << s.m_numFramesOut
+         << ",\"bytesIn\":"     << s.m_numBytesIn      << ",\"bytesOut\":"     << s.m_numBytesOut
+         << ",\"cmds\":"        << s.m_numCmds         << ",\"dupCmds\":"      << s.m_numDupCmds
+         << ",\"apSend\":"      << s.m_numApSend       << ",\"apSendNacks\":"  << s.m_numApSendNacks
+         << ",\"txDone\":"      << s.m_numTxDone       << ",\"upGenerated\":"  << s.m_numUpGenerated
+         << ",\"upAcked\":"     << s.m_numUpAcked      << ",\"upDropped\":"    << s.m_numUpDropped
+         << ",\"notifNacks\":"  << s.m_numNotifNacks   << ",\"notifRetries\":" << s.m_numNotifRetries
+         << ",\"droppedIn\":"   << s.m_numDroppedIn    << ",\"corruptedOut\":" << s.m_numCorruptedOut
+         << ",\"boots\":"       << s.m_numBoots        << ",\"joins\":"        << s.m_numJoins
+         << ",\"hdlcFcsErrors\":" << h.m_numFcsErrors << ",\"hdlcRunts\":"    << h.m_numRunts
+         << ",\"downLatencyUsec\":";
+      m_downLatency.toJson(os);
+      os << ",\"upAckTimeUsec\":";
+      m_notifAckTime.toJson(os);
+      os << "}" << endl;
+      return;
+   }
+   os << "Frames in/out:        " << s.m_numFramesIn << " / " << s.m_numFramesOut << endl
+      << "Bytes in/out:         " << s.m_numBytesIn << " / " << s.m_numBytesOut << endl
+      << "Commands (dup):       " << s.m_numCmds << " (" << s.m_numDupCmds << ")" << endl
+      << "AP_SEND ok/nack:      " << s.m_numApSend << " / " << s.m_numApSendNacks << endl
+      << "TXDONE:               " << s.m_numTxDone << endl
+      << "Upstream gen/ack/drop:" << s.m_numUpGenerated << " / " << s.m_numUpAcked
+                                  << " / " << s.m_numUpDropped << endl
+      << "Notif NACKs/retries:  " << s.m_numNotifNacks << " / " << s.m_numNotifRetries << endl
+      << "Dropped in/corrupted: " << s.m_numDroppedIn << " / " << s.m_numCorruptedOut << endl
+      << "Boots/joins:          " << s.m_numBoots << " / " << s.m_numJoins << endl
+      << "HDLC FCS errors/runts:" << h.m_numFcsErrors << " / " << h.m_numRunts << endl
+      << "Downstream latency:   ";
+   m_downLatency.toJson(os);
+   os << endl << "Upstream ACK time:    ";
+   m_notifAckTime.toJson(os);
+   os << endl;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include "EmuCommon.h"
+#include "APInterface/HDLC.h"
+
+#include <boost/asio.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * \file APEmulator.h
+ * AP mote emulator on pseudo-terminal
+ */
+
+/**
+ * AP emulator configuration
+ */
+struct apemu_config_s {
+   std::string m_linkName;      ///< Symbolic link to slave side of pty (serial port name for apc)
+   uint32_t    m_upRate;        ///< Upstream (AP_RECEIVE) rate, pkt/s. 0 - no upstream traffic
+   uint32_t    m_upSize;        ///< Upstream payload size
+   uint32_t    m_upCount;       ///< Number of upstream packets. 0 - unlimited
+   uint32_t    m_respDelay;     ///< Delay of command response (msec)
+   uint32_t    m_ackTimeout;    ///< Retransmit notification if ACK is not received (msec)
+   uint32_t    m_nackDelay;     ///< Retransmit notification after NACK (msec)
+   uint32_t    m_txDoneDelay;   ///< Delay of TXDONE notification after AP_SEND (msec)
+   uint32_t    m_joinDelay;     ///< Delay of OPERATIONAL event after JOIN (msec)
+   uint32_t    m_idleReboot;    ///< Send BOOT event if nothing is received from apc (msec). 0 - disabled
+   uint32_t    m_queueSize;     ///< Max number of queued notifications
+   double      m_nackProb;      ///< Probability of AP_SEND NACK
+   double      m_dropProb;      ///< Probability of drop of input frame
+   double      m_corruptProb;   ///< Probability of corruption of output frame
+   uint16_t    m_netId;         ///< Network ID reported before SETPARAM<NETID>
+   uint32_t    m_seed;          ///< Random generator seed
+   std::vector<emu_action_s> m_script;
+};
+
+/**
+ * AP emulator statistics
+ */
+struct apemu_stats_s {
+   uint64_t m_numFramesIn;      ///< Valid frames received from apc
+   uint64_t m_numFramesOut;     ///< Frames sent to apc
+   uint64_t m_numBytesIn;       ///< Bytes of received frames
+   uint64_t m_numBytesOut;      ///< Bytes of sent frames
+   uint32_t m_numCmds;          ///< Commands received (without duplicates)
+   uint32_t m_numDupCmds;       ///< Repeated commands (response is resent)
+   uint32_t m_numApSend;        ///< Accepted AP_SEND commands
+   uint32_t m_numApSendNacks;   ///< NACKed AP_SEND commands
+   uint32_t m_numTxDone;        ///< Generated TXDONE notifications
+   uint32_t m_numUpGenerated;   ///< Generated AP_RECEIVE notifications
+   uint32_t m_numUpAcked;       ///< AP_RECEIVE notifications acknowledged by apc
+   uint32_t m_numUpDropped;     ///< AP_RECEIVE not generated due to full queue
+   uint32_t m_numNotifNacks;    ///< Notifications NACKed by apc
+   uint32_t m_numNotifRetries;  ///< Notifications retransmitted after ACK timeout
+   uint32_t m_numDroppedIn;     ///< Input frames dropped by emulator
+   uint32_t m_numCorruptedOut;  ///< Output frames corrupted by emulator
+   uint32_t m_numBoots;         ///< Generated BOOT events
+   uint32_t m_numJoins;         ///< JOIN commands
+};
+
+/**
+ * AP mote emulator.
+ *
+ * Creates pseudo-terminal and speaks serial API of AP mote on its master side:
+ * responds to commands of apc, generates boot / operational events, TXDONE and
+ * upstream (AP_RECEIVE) traffic with stamps used for latency measurement by
+ * Manager emulator. Downstream latency is measured on AP_SEND payload stamped
+ * by Manager emulator.
+ *
+ * All handlers run on one io_service thread.
+ */
+class CAPEmulator : public IHDLCCallback {
+public:
+   CAPEmulator(boost::asio::io_service& ioService, const apemu_config_s& config);
+   virtual ~CAPEmulator();
+
+   // Create pty and start emulation
+   bool start(std::string * pError);
+   void stop();
+
+   const apemu_stats_s& getStats() const { return m_stats; }
+   // Print statistics as text or JSON object
+   void printStats(std::ostream& os, bool asJson);
+
+   // IHDLCCallback
+   virtual void frameComplete(const std::vector<uint8_t>& packet);
+
+private:
+   struct notif_s {
+      uint8_t              m_cmdId;
+      bool                 m_isSync;
+      std::vector<uint8_t> m_payload;
+   };
+   typedef std::shared_ptr<boost::asio::deadline_timer> timer_ptr_t;
+
+   bool openPty_p(std::string * pError);
+   void startRead_p();
+   void handleRead_p(const boost::system::error_code& error, size_t size);
+   void writeFrame_p(uint8_t cmdId, uint8_t flags, const uint8_t * data, size_t size);
+   void startWrite_p();
+   void handleWrite_p(const boost::system::error_code& error, size_t size);
+
+   // Commands from apc
+   void handleCmd_p(uint8_t cmdId, uint8_t pktId, const uint8_t * data, size_t size);
+   void handleGetParam_p(const uint8_t * data, size_t size, std::vector<uint8_t> * pResp);
+   void handleApSend_p(const uint8_t * data, size_t size, std::vector<uint8_t> * pResp);
+   void sendResponse_p(uint8_t cmdId, uint8_t pktId, const std::vector<uint8_t>& resp);
+
+   // Notifications to apc
+   void boot_p();
+   void queueNotif_p(uint8_t cmdId, const uint8_t * data, size_t size, bool isSync = false);
+   void sendNotif_p();
+   void handleNotifAck_p(uint8_t cmdId, uint8_t pktId, const uint8_t * data, size_t size);
+   void handleNotifTimeout_p(const boost::system::error_code& error, bool isRetry);
+   void sendEvent_p(uint32_t events, bool isSync);
+   void sendTxDone_p(uint16_t packetId);
+
+   // Upstream generator
+   void startUpTimer_p();
+   void handleUpTimer_p(const boost::system::error_code& error);
+   void generateUp_p(const mngr_time_t& now);
+
+   // Script
+   void startScriptTimer_p();
+   void handleScriptTimer_p(const boost::system::error_code& error);
+   void runAction_p(const emu_action_s& action);
+
+   boost::asio::io_service&                 m_ioService;
+   apemu_config_s                           m_config;
+   int                                      m_masterFd;
+   int                                      m_slaveFd;      // Kept open: master read fails when slave is closed
+   boost::asio::posix::stream_descriptor    m_pty;
+   CHDLC                                    m_hdlc;
+   uint8_t                                  m_readBuf[1024];
+   std::deque<std::vector<uint8_t> >        m_writeQueue;
+   bool                                     m_isWriting;
+   bool                                     m_isStopped;
+   CEmuRandom                               m_rnd;
+
+   // Commands
+   uint8_t                                  m_lastCmdId;
+   uint8_t                                  m_lastCmdPktId;  // 0xFF - no command since boot
+   std::vector<uint8_t>                     m_lastResp;
+   uint16_t                                 m_netId;
+   uint8_t                                  m_clkSrc;
+   bool                                     m_isOperational;
+   boost::asio::deadline_timer              m_joinTimer;
+
+   // Notifications
+   std::deque<notif_s>                      m_notifQueue;
+   bool                                     m_notifPending;
+   uint8_t                                  m_notifPktId;
+   mngr_time_t                              m_notifSendTime;
+   boost::asio::deadline_timer              m_notifTimer;
+
+   // Upstream
+   boost::asio::deadline_timer              m_upTimer;
+   mngr_time_t                              m_upLastTick;
+   double                                   m_upTokens;
+   uint32_t                                 m_upRate;
+   uint32_t                                 m_upSeq;
+   mngr_time_t                              m_muteUntil;
+   mngr_time_t                              m_lastInput;
+
+   // Fault injection by script
+   uint32_t                                 m_scriptNacks;
+   uint32_t                                 m_scriptDrops;
+   uint32_t                                 m_scriptCorrupts;
+   size_t                                   m_scriptIdx;
+   mngr_time_t                              m_startTime;
+   boost::asio::deadline_timer              m_scriptTimer;
+
+   apemu_stats_s                            m_stats;
+   CLatencyStat                             m_downLatency;    // Manager emulator -> AP_SEND
+   CLatencyStat                             m_notifAckTime;   // AP_RECEIVE -> ACK from apc
+};
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "EmuCommon.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+uint64_t emuTimeUsec()
+{
+   return TIME_D2USEC(SYSTIME_NOW().time_since_epoch());
+}
+
+void emuStampFill(uint8_t * buf, size_t len, uint32_t seq)
+{
+   size_t offset = 0;
+   if (len >= sizeof(emu_stamp_s)) {
+      emu_stamp_s stamp;
+      stamp.magic    = htonl(EMU_STAMP_MAGIC);
+      stamp.seq      = htonl(seq);
+      stamp.timeUsec = htonll(emuTimeUsec());
+      memcpy(buf, &stamp, sizeof(stamp));
+      offset = sizeof(stamp);
+   }
+   for (size_t i = offset; i < len; i++)
+      buf[i] = static_cast<uint8_t>(i);
+}
+
+bool emuStampParse(const uint8_t * buf, size_t len, size_t offset,
+                   uint32_t * pSeq, int64_t * pLatencyUsec)
+{
+   if (len < offset + sizeof(emu_stamp_s))
+      return false;
+   emu_stamp_s stamp;
+   memcpy(&stamp, buf + offset, sizeof(stamp));
+   if (ntohl(stamp.magic) != EMU_STAMP_MAGIC)
+      return false;
+   if (pSeq)
+      *pSeq = ntohl(stamp.seq);
+   if (pLatencyUsec)
+      *pLatencyUsec = static_cast<int64_t>(emuTimeUsec() - ntohll(stamp.timeUsec));
+   return true;
+}
+
+CLatencyStat::CLatencyStat(size_t maxSamples)
+   : m_maxSamples(maxSamples), m_rnd(1)
+{
+   clear();
+}
+
+void CLatencyStat::clear()
+{
+   m_samples.clear();
+   m_sorted = true;
+   m_count  = 0;
+   m_min    = 0;
+   m_max    = 0;
+   m_sum    = 0;
+}
+
+void CLatencyStat::add(int64_t usec)
+{
+   if (m_count == 0 || usec < m_min)
+      m_min = usec;
+   if (m_count == 0 || usec > m_max)
+      m_max = usec;
+   m_sum += usec;
+   m_count++;
+   if (m_samples.size() < m_maxSamples) {
+      m_samples.push_back(usec);
+   } else {
+      uint64_t idx = m_rnd() % m_count;
+      if (idx < m_maxSamples)
+         m_samples[idx] = usec;
+   }
+   m_sorted = false;
+}
+
+int64_t CLatencyStat::percentile(double p)
+{
+   if (m_samples.empty())
+      return 0;
+   if (!m_sorted) {
+      sort(m_samples.begin(), m_samples.end());
+      m_sorted = true;
+   }
+   size_t idx = static_cast<size_t>(p / 100.0 * (m_samples.size() - 1) + 0.5);
+   return m_samples[min(idx, m_samples.size() - 1)];
+}
+
+void CLatencyStat::toJson(ostream& os)
+{
+   os << "{\"count\":" << m_count
+      << ",\"min\":"   << m_min
+      << ",\"avg\":"   << (m_count ? static_cast<int64_t>(m_sum / m_count) : 0)
+      << ",\"p50\":"   << percentile(50)
+      << ",\"p90\":"   << percentile(90)
+      << ",\"p99\":"   << percentile(99)
+      << ",\"max\":"   << m_max << "}";
+}
+
+bool emuReadScript(const string& fileName, vector<emu_action_s> * pActions, string * pError)
+{
+   ifstream in(fileName.c_str());
+   if (!in) {
+      *pError = "can not open " + fileName;
+      return false;
+   }
+   string line;
+   int    lineNum = 0;
+   while (getline(in, line)) {
+      lineNum++;
+      size_t start = line.find_first_not_of(" \t\r");
+      if (start == string::npos || line[start] == '#')
+         continue;
+      istringstream is(line);
+      emu_action_s action = { 0, "", 0 };
+      if (!(is >> action.m_timeMsec >> action.m_action)) {
+         ostringstream os;
+         os << fileName << ":" << lineNum << ": expected '<msec> <action> [<arg>]'";
+         *pError = os.str();
+         return false;
+      }
+      is >> action.m_arg;
+      pActions->push_back(action);
+   }
+   stable_sort(pActions->begin(), pActions->end(),
+               [](const emu_action_s& a, const emu_action_s& b) { return a.m_timeMsec < b.m_timeMsec; });
+   return true;
+}
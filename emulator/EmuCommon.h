@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include "common.h"
+#include "dn_pack.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * \file EmuCommon.h
+ * Helpers shared by AP and Manager emulators
+ */
+
+const uint32_t EMU_STAMP_MAGIC = 0x454D5531;   // "EMU1"
+
+PACKED_START
+/**
+ * Stamp in the beginning of payload generated by emulators.
+ * All fields are in network byte order.
+ */
+struct emu_stamp_s {
+   uint32_t magic;      ///< EMU_STAMP_MAGIC
+   uint32_t seq;        ///< Sequence number of generated packet
+   uint64_t timeUsec;   ///< System time of generation (usec from epoch)
+};
+PACKED_STOP
+
+// Current system time (usec from epoch)
+uint64_t emuTimeUsec();
+
+// Fill payload: stamp followed by byte pattern. Short buffer gets pattern only.
+void emuStampFill(uint8_t * buf, size_t len, uint32_t seq);
+
+// Find stamp at 'offset' of payload. Returns false if payload is not generated by emulator.
+bool emuStampParse(const uint8_t * buf, size_t len, size_t offset,
+                   uint32_t * pSeq, int64_t * pLatencyUsec);
+
+/**
+ * Latency statistics with percentiles.
+ * Keeps up to maxSamples values, then replaces random samples (reservoir sampling).
+ */
+class CLatencyStat {
+public:
+   CLatencyStat(size_t maxSamples = 1000000);
+
+   void     clear();
+   void     add(int64_t usec);
+   uint64_t count() const { return m_count; }
+   // Percentile (0..100) of samples, usec
+   int64_t  percentile(double p);
+
+   // Print: {"count":N,"min":..,"avg":..,"p50":..,"p90":..,"p99":..,"max":..}
+   void     toJson(std::ostream& os);
+
+private:
+   size_t               m_maxSamples;
+   std::vector<int64_t> m_samples;
+   bool                 m_sorted;
+   uint64_t             m_count;
+   int64_t              m_min;
+   int64_t              m_max;
+   double               m_sum;
+   std::mt19937         m_rnd;
+};
+
+/**
+ * Random events with given probability
+ */
+class CEmuRandom {
+public:
+   CEmuRandom(uint32_t seed) : m_rnd(seed), m_dist(0.0, 1.0) {;}
+   bool     check(double probability) { return probability > 0 && m_dist(m_rnd) < probability; }
+   uint32_t get(uint32_t maxVal) { return m_rnd() % maxVal; }
+private:
+   std::mt19937                           m_rnd;
+   std::uniform_real_distribution<double> m_dist;
+};
+
+/**
+ * Action of emulator script.
+ * Script file contains lines: <time msec> <action> [<argument>]
+ * Empty lines and lines starting with '#' are ignored.
+ */
+struct emu_action_s {
+   uint32_t    m_timeMsec;   ///< Time from emulator start
+   std::string m_action;
+   uint32_t    m_arg;
+};
+
+// Read script file. Returns false on error, actions are sorted by time
+bool emuReadScript(const std::string& fileName, std::vector<emu_action_s> * pActions,
+                   std::string * pError);
@@ -0,0 +1,868 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "MgrEmulator.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+
+using namespace std;
+
+const size_t  MGREMU_MAX_MSG_SIZE = MAX_NET_PKT_SIZE + MAX_APC_HDR_SIZE;
+const size_t  MGREMU_READ_BUF_SIZE = 8 * 1024;
+const int     MGREMU_TICK_MSEC    = 5;
+const char    MGREMU_NAME[]       = "mgremu";
+const char    MGREMU_LOG[]        = "mgremu";
+
+bool mgrEmuParseStream(const string& str, uint32_t defSize, mgremu_stream_s * pStream)
+{
+   istringstream is(str);
+   char     sep;
+   uint32_t priority = 0;
+   pStream->m_size = defSize;
+   if (!(is >> pStream->m_rate))
+      return false;
+   if (is >> sep) {
+      if (sep != ':' || !(is >> priority) || priority > 3)
+         return false;
+      if (is >> sep && (sep != ':' || !(is >> pStream->m_size)))
+         return false;
+   }
+   pStream->m_priority = static_cast<uint8_t>(priority);
+   return pStream->m_size <= MAX_NET_PKT_SIZE;
+}
+
+/////////////////////////////////////////////////
+//    CMgrSession
+/////////////////////////////////////////////////
+
+CMgrSession::CMgrSession(CMgrEmulator * pOwner, boost::asio::io_service& ioService,
+                         IAPCTransport::ptr transport)
+   : m_pOwner(pOwner),
+     m_ioService(ioService),
+     m_transport(transport),
+     m_serializer(MGREMU_MAX_MSG_SIZE, this, MGREMU_LOG),
+     m_isTxCompressed(false),
+     m_isRxCompressed(false),
+     m_readBuf(MGREMU_READ_BUF_SIZE),
+     m_isWriting(false),
+     m_isClosed(false),
+     m_isOnline(false),
+     m_isStandby(false),
+     m_isPaused(false),
+     m_sesId(APINTFID_EMPTY),
+     m_ackedSeq(0),
+     m_ackTimer(ioService),
+     m_isAckScheduled(false),
+     m_lastTx(TIME_NOW()),
+     m_isCredit(false),
+     m_isCreditFrozen(false),
+     m_apcLimit(0)
+{ ; }
+
+void CMgrSession::start()
+{
+   boost::system::error_code ec;
+   if (m_transport->getTcpSocket() != NULL)
+      m_transport->getTcpSocket()->set_option(boost::asio::ip::tcp::no_delay(true), ec);
+   startRead_p();
+}
+
+void CMgrSession::close()
+{
+   if (m_isClosed)
+      return;
+   m_isClosed = true;
+   boost::system::error_code ec;
+   m_ackTimer.cancel(ec);
+   m_transport->close();
+   m_pOwner->sessionClosed_p(this);
+}
+
+void CMgrSession::startRead_p()
+{
+   m_transport->asyncRead(m_readBuf.data(), m_readBuf.size(),
+                          boost::bind(&CMgrSession::handleRead_p, shared_from_this(),
+                                      boost::asio::placeholders::error,
+                                      boost::asio::placeholders::bytes_transferred));
+}
+
+void CMgrSession::handleRead_p(const boost::system::error_code& error, size_t size)
+{
+   if (m_isClosed)
+      return;
+   if (error) {
+      close();
+      return;
+   }
+   uint8_t       * pData = m_readBuf.data();
+   size_t          processed = 0;
+   apc_error_t     res = APC_OK;
+   if (!m_isRxCompressed) {
+      // Stops after CONNECT if compression is negotiated
+      res = m_serializer.dataReceived(m_sesId, pData, size, &processed);
+      pData += processed; size -= processed;
+   }
+   if (res == APC_OK && size > 0 && m_isRxCompressed && !m_isClosed) {
+      res = m_compressor->decompress(pData, size, [this](uint8_t * p, size_t n) {
+         return m_serializer.dataReceived(m_sesId, p, n);
+      });
+   }
+   if (res != APC_OK) {
+      if (res != APC_STOP_CONNECTOR)
+         cerr << "Manager emulator: #" << m_sesId << " protocol error " << toString(res) << endl;
+      close();
+      return;
+   }
+   if (m_isClosed)
+      return;
+   // No delay: acknowledge every portion of received data
+   CMgrEmulator::session_s * pSes = m_pOwner->getSession_p(m_sesId);
+   if (m_pOwner->m_config.m_ackDelay == 0 && pSes && m_ackedSeq != pSes->m_rxSeq) {
+      m_ackedSeq = pSes->m_rxSeq;
+      sendKa_p();
+   }
+   startRead_p();
+}
+
+apc_error_t CMgrSession::messageReceived(ap_intf_id_t apcId, apc_msg_type_t type, uint8_t flags,
+                                         uint32_t mySeq, uint32_t yourSeq,
+                                         const uint8_t * pPayload, uint16_t size)
+{
+   mgremu_stats_s& stats = m_pOwner->m_stats;
+   if (type == APC_CONNECT) {
+      if (size < sizeof(apc_msg_connect_s))
+         return APC_ERR_SIZE;
+      handleConnect_p(*(const apc_msg_connect_s *)pPayload, yourSeq);
+      return APC_OK;
+   }
+   if (type == APC_DISCONNECT)
+      return APC_STOP_CONNECTOR;
+   if (type == APC_ACTIVATE) {
+      if (size < sizeof(apc_msg_activate_s))
+         return APC_ERR_SIZE;
+      return handleActivate_p(*(const apc_msg_activate_s *)pPayload);
+   }
+
+   CMgrEmulator::session_s * pSes = m_pOwner->getSession_p(m_sesId);
+   if (pSes == NULL)
+      return APC_ERR_PROTOCOL;
+   if (type == APC_NET_RX_BATCH) {
+      // Packets have consecutive sequence numbers, mySeq is the last one
+      stats.m_numNetRxBatch++;
+      uint32_t        seq    = mySeq - ((const apc_msg_net_rx_batch_s *)pPayload)->numPkts;
+      size_t          offset = sizeof(apc_msg_net_rx_batch_s);
+      uint16_t        pktSize;
+      const uint8_t * pPkt;
+      while ((pPkt = CAPCSerializer::getBatchPkt(pPayload, size, &offset, &pktSize)) != NULL) {
+         if (++seq <= pSes->m_rxSeq)
+            stats.m_numDupRx++;
+         else
+            m_pOwner->netRxReceived_p(pPkt, pktSize);
+      }
+      if (mySeq > pSes->m_rxSeq) {
+         pSes->m_rxSeq = mySeq;
+         scheduleAck_p();
+      }
+      return APC_OK;
+   }
+   if (type == APC_NET_TXDONE_BATCH) {
+      stats.m_numTxDoneBatch++;
+      uint8_t                      numIds = ((const apc_msg_net_txdone_batch_s *)pPayload)->numIds;
+      uint32_t                     seq    = mySeq - numIds;
+      const apc_msg_net_txdone_s * pId    = (const apc_msg_net_txdone_s *)(pPayload + sizeof(apc_msg_net_txdone_batch_s));
+      for (uint8_t i = 0; i < numIds; i++, pId++) {
+         if (++seq <= pSes->m_rxSeq)
+            stats.m_numDupRx++;
+         else
+            m_pOwner->txDoneReceived_p(pId->txDoneId);
+      }
+      if (mySeq > pSes->m_rxSeq) {
+         pSes->m_rxSeq = mySeq;
+         scheduleAck_p();
+      }
+      return APC_OK;
+   }
+   if ((flags & APC_HDR_FLAGS_NOTRACK) == 0 && mySeq != 0) {
+      if (mySeq <= pSes->m_rxSeq) {
+         // Replayed from cache of apc, but it was received before disconnection
+         stats.m_numDupRx++;
+         return APC_OK;
+      }
+      pSes->m_rxSeq = mySeq;
+      scheduleAck_p();
+   }
+
+   switch (type) {
+   case APC_NET_RX:
+      m_pOwner->netRxReceived_p(pPayload, size);
+      break;
+   case APC_NET_TXDONE:
+      if (size >= sizeof(apc_msg_net_txdone_s))
+         m_pOwner->txDoneReceived_p(((const apc_msg_net_txdone_s *)pPayload)->txDoneId);
+      break;
+   case APC_NET_TX_PAUSE:
+      stats.m_numPause++;
+      m_isPaused = true;
+      break;
+   case APC_NET_TX_RESUME:
+      stats.m_numResume++;
+      m_isPaused = false;
+      break;
+   case APC_AP_LOST:
+      stats.m_numApLost++;
+      break;
+   case APC_KA:
+      stats.m_numKaRx++;
+      if (m_isCredit && size >= sizeof(apc_msg_credit_s) &&
+          (int32_t)(((const apc_msg_credit_s *)pPayload)->limit - m_apcLimit) > 0)
+         m_apcLimit = ((const apc_msg_credit_s *)pPayload)->limit;
+      break;
+   default:
+      break;
+   }
+   return APC_OK;
+}
+
+void CMgrSession::handleConnect_p(const apc_msg_connect_s& msg, uint32_t yourSeq)
+{
+   mgremu_stats_s& stats = m_pOwner->m_stats;
+   CMgrEmulator::session_s * pSes = NULL;
+   if (msg.sesId != APINTFID_EMPTY)
+      pSes = m_pOwner->getSession_p(msg.sesId);
+   // Standby connection is accepted for known session if secondary manager is emulated
+   bool isStandby = (msg.flags & APC_FL_STANDBY) != 0 && pSes != NULL && m_pOwner->m_config.m_standbyPort != 0;
+   if (isStandby) {
+      m_sesId = msg.sesId;
+      stats.m_numStandby++;
+   } else if (pSes != NULL) {
+      m_sesId = msg.sesId;
+      stats.m_numResumed++;
+      stats.m_numConnects++;
+   } else {
+      // New session. Unknown session ID is replaced too: apc will start from scratch
+      m_sesId = m_pOwner->newSession_p();
+      pSes    = m_pOwner->getSession_p(m_sesId);
+      stats.m_numConnects++;
+   }
+
+   apc_msg_connect_s reply;
+   memset(&reply, 0, sizeof(reply));
+   reply.ver   = (uint8_t)std::min((uint32_t)msg.ver, m_pOwner->m_config.m_protoVer);
+   reply.sesId = m_sesId;
+   reply.netId = m_pOwner->m_config.m_netId;
+   if (m_pOwner->m_config.m_netRxBatch)
+      reply.flags = msg.flags & (APC_FL_NETRX_BATCH | APC_FL_TXDONE_BATCH);
+   if (isStandby)
+      reply.flags |= APC_FL_STANDBY;
+   m_isCredit = m_pOwner->m_config.m_credit > 0 && (msg.flags & APC_FL_CREDIT) != 0;
+   if (m_isCredit)
+      reply.flags |= APC_FL_CREDIT;
+   if (m_pOwner->m_config.m_compressLevel > 0 && (msg.flags & APC_FL_COMPRESS) && !m_isRxCompressed) {
+      m_compressor.reset(new CAPCCompressor(APC_COMPRESS_DOWNSTREAM, m_pOwner->m_config.m_compressLevel,
+                                            &m_pOwner->m_compressStats, MGREMU_LOG));
+      if (m_compressor->init() == APC_OK) {
+         reply.flags |= APC_FL_COMPRESS;
+         // Rest of input is compressed
+         m_isRxCompressed = true;
+         m_serializer.breakInput();
+      } else {
+         m_compressor.reset();
+      }
+   }
+   strncpy(reply.identity, MGREMU_NAME, sizeof(reply.identity) - 1);
+   strncpy(reply.version,  MGREMU_NAME, sizeof(reply.version) - 1);
+   // Everything received before disconnection is confirmed, apc replays the rest
+   m_ackedSeq  = pSes->m_rxSeq;
+   m_isOnline  = !isStandby;
+   m_isStandby = isStandby;
+   m_isPaused  = false;
+   m_isCreditFrozen = false;
+   // apc gives credit after its last received message. Emulator does not keep sent
+   // messages: lost ones are skipped
+   m_apcLimit  = yourSeq;
+   if (m_isCredit && !isStandby)
+      pSes->m_txSeq = yourSeq;
+   // Compact header: input after CONNECT of apc, output after reply
+   if (reply.ver >= APC_PROTO_VER_2)
+      m_serializer.setRxVersion(reply.ver);
+   send_p(APC_CONNECT, APC_HDR_FLAGS_NOTRACK, 0, (const uint8_t *)&reply, sizeof(reply));
+   if (reply.ver >= APC_PROTO_VER_2)
+      m_serializer.setTxVersion(reply.ver);
+   m_isTxCompressed = m_isRxCompressed;
+   if (m_isCredit && !isStandby)
+      sendKa_p();
+}
+
+// Standby connection takes over the session. Other connections of the session are closed
+apc_error_t CMgrSession::handleActivate_p(const apc_msg_activate_s& msg)
+{
+   CMgrEmulator::session_s * pSes = m_pOwner->getSession_p(m_sesId);
+   if (pSes == NULL || !m_isStandby)
+      return APC_ERR_PROTOCOL;
+   m_pOwner->m_stats.m_numActivated++;
+   m_isStandby = false;
+   m_isOnline  = true;
+   m_isPaused  = false;
+   m_isCreditFrozen = false;
+   m_pOwner->sessionActivated_p(this);
+   // Everything received on lost connection is confirmed, apc replays the rest
+   m_ackedSeq = pSes->m_rxSeq;
+   m_apcLimit = msg.lastReceived;
+   if (m_isCredit)
+      pSes->m_txSeq = msg.lastReceived;
+   apc_msg_activate_s reply;
+   reply.lastSent     = pSes->m_txSeq;
+   reply.lastReceived = pSes->m_rxSeq;
+   send_p(APC_ACTIVATE, APC_HDR_FLAGS_NOTRACK, 0, (const uint8_t *)&reply, sizeof(reply));
+   if (m_isCredit)
+      sendKa_p();
+   return APC_OK;
+}
+
+// Delayed acknowledgement: all messages received during ackDelay are confirmed by one KA
+void CMgrSession::scheduleAck_p()
+{
+   uint32_t ackDelay = m_pOwner->m_config.m_ackDelay;
+   if (ackDelay == 0 || m_isAckScheduled)
+      return;
+   m_isAckScheduled = true;
+   m_ackTimer.expires_from_now(boost::posix_time::milliseconds(ackDelay));
+   ptr p = shared_from_this();
+   m_ackTimer.async_wait([p](const boost::system::error_code& error) {
+      p->m_isAckScheduled = false;
+      if (error || p->m_isClosed)
+         return;
+      CMgrEmulator::session_s * pSes = p->m_pOwner->getSession_p(p->m_sesId);
+      if (pSes == NULL || p->m_ackedSeq == pSes->m_rxSeq)
+         return;
+      p->m_ackedSeq = pSes->m_rxSeq;
+      p->sendKa_p();
+   });
+}
+
+void CMgrSession::sendKa_p()
+{
+   CMgrEmulator::session_s * pSes = m_pOwner->getSession_p(m_sesId);
+   m_pOwner->m_stats.m_numKaTx++;
+   if (!m_isCredit || m_isCreditFrozen || pSes == NULL || m_isStandby) {
+      // Empty KA keeps credit
+      send_p(APC_KA, APC_HDR_FLAGS_NOTRACK, 0, NULL, 0);
+      return;
+   }
+   apc_msg_credit_s credit;
+   credit.limit = pSes->m_rxSeq + m_pOwner->m_config.m_credit;
+   send_p(APC_KA, APC_HDR_FLAGS_NOTRACK, 0, (const uint8_t *)&credit, sizeof(credit));
+}
+
+bool CMgrSession::hasCredit()
+{
+   CMgrEmulator::session_s * pSes = m_pOwner->getSession_p(m_sesId);
+   return !m_isCredit || (pSes != NULL && (int32_t)(m_apcLimit - pSes->m_txSeq) > 0);
+}
+
+void CMgrSession::sendNetTx(uint8_t priority, uint32_t size, uint32_t seq)
+{
+   CMgrEmulator::session_s * pSes = m_pOwner->getSession_p(m_sesId);
+   if (pSes == NULL)
+      return;
+   apc_msg_net_tx_s hdr;
+   memset(&hdr, 0, sizeof(hdr));
+   hdr.priority = priority;
+   hdr.txDoneId = APC_NETTX_NOTXDONE;
+   if (m_pOwner->m_config.m_txDone) {
+      if (++m_pOwner->m_txDoneId == APC_NETTX_NOTXDONE)
+         m_pOwner->m_txDoneId = 0;
+      hdr.txDoneId = m_pOwner->m_txDoneId;
+      m_pOwner->m_txDoneWait[hdr.txDoneId] = TIME_NOW();
+   }
+   vector<uint8_t> payload(size);
+   emuStampFill(payload.data(), payload.size(), seq);
+   m_pOwner->m_stats.m_numNetTx++;
+   m_pOwner->m_stats.m_numNetTxBytes += size;
+   send_p(APC_NET_TX, 0, ++pSes->m_txSeq, (const uint8_t *)&hdr, sizeof(hdr),
+          payload.data(), payload.size());
+}
+
+void CMgrSession::sendPause(bool isPause)
+{
+   if (m_isCredit) {
+      m_isCreditFrozen = isPause;
+      if (!isPause)
+         sendKa_p();
+      return;
+   }
+   send_p(isPause ? APC_NET_TX_PAUSE : APC_NET_TX_RESUME, APC_HDR_FLAGS_NOTRACK, 0, NULL, 0);
+}
+
+void CMgrSession::checkKa(const mngr_time_t& now)
+{
+   if ((!isOnline() && !isStandby()) || TO_MSEC(now - m_lastTx).count() < m_pOwner->m_config.m_kaInterval)
+      return;
+   sendKa_p();
+}
+
+void CMgrSession::send_p(apc_msg_type_t type, uint8_t flags, uint32_t mySeq,
+                         const uint8_t * payload1, size_t size1,
+                         const uint8_t * payload2, size_t size2)
+{
+   if (m_isClosed)
+      return;
+   vector<uint8_t> msg(MGREMU_MAX_MSG_SIZE);
+   size_t          msgSize = 0;
+   apc_error_t res = m_serializer.prepMsg(msg.data(), msg.size(), &msgSize, m_sesId, type, flags,
+                                          mySeq, m_ackedSeq, payload1, size1, payload2, size2);
+   if (res != APC_OK) {
+      cerr << "Manager emulator: #" << m_sesId << " can not prepare " << toString(type)
+           << ": " << toString(res) << endl;
+      return;
+   }
+   msg.resize(msgSize);
+   if (m_isTxCompressed) {
+      vector<uint8_t> comp(MGREMU_MAX_MSG_SIZE + APC_COMPRESS_OVERHEAD);
+      if (m_compressor->compress(msg.data(), msg.size(), comp.data(), comp.size(), &msgSize) != APC_OK) {
+         // Stream of compressor is broken
+         close();
+         return;
+      }
+      comp.resize(msgSize);
+      msg.swap(comp);
+   }
+   m_writeQueue.push_back(msg);
+   m_lastTx = TIME_NOW();
+   startWrite_p();
+}
+
+void CMgrSession::startWrite_p()
+{
+   if (m_isWriting || m_writeQueue.empty() || m_isClosed)
+      return;
+   m_isWriting = true;
+   m_transport->asyncWrite(m_writeQueue.front().data(), m_writeQueue.front().size(),
+                           boost::bind(&CMgrSession::handleWrite_p, shared_from_this(),
+                                       boost::asio::placeholders::error,
+                                       boost::asio::placeholders::bytes_transferred));
+}
+
+void CMgrSession::handleWrite_p(const boost::system::error_code& error, size_t size)
+{
+   m_isWriting = false;
+   if (error) {
+      close();
+      return;
+   }
+   m_writeQueue.pop_front();
+   startWrite_p();
+}
+
+/////////////////////////////////////////////////
+//    CMgrEmulator
+/////////////////////////////////////////////////
+
+CMgrEmulator::CMgrEmulator(boost::asio::io_service& ioService, const mgremu_config_s& config)
+   : m_ioService(ioService),
+     m_config(config),
+     m_acceptor(ioService),
+     m_standbyAcceptor(ioService),
+     m_unixAcceptor(ioService),
+     m_shmAcceptor(ioService),
+     m_tickTimer(ioService),
+     m_isStopped(false),
+     m_lastSesId(0),
+     m_tokens(config.m_streams.size(), 0.0),
+     m_downSeq(0),
+     m_txDoneId(0),
+     m_outageUntil(TIME_EMPTY),
+     m_primaryOutageUntil(TIME_EMPTY),
+     m_pauseUntil(TIME_EMPTY),
+     m_scriptIdx(0),
+     m_hasUpSeq(false),
+     m_lastUpSeq(0)
+{
+   memset(&m_stats, 0, sizeof(m_stats));
+   for (const auto& s : config.m_streams)
+      m_rates.push_back(s.m_rate);
+}
+
+static bool listenOn(boost::asio::ip::tcp::acceptor& acceptor, uint16_t port, string * pError)
+{
+   try {
+      boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), port);
+      acceptor.open(endpoint.protocol());
+      acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+      acceptor.bind(endpoint);
+      acceptor.listen();
+   } catch (const exception& e) {
+      ostringstream os;
+      os << "can not listen on port " << port << ": " << e.what();
+      *pError = os.str();
+      return false;
+   }
+   return true;
+}
+
+// Socket file of previous run is removed
+static bool listenOn(boost::asio::local::stream_protocol::acceptor& acceptor, const string& path, string * pError)
+{
+   try {
+      ::unlink(path.c_str());
+      boost::asio::local::stream_protocol::endpoint endpoint(path);
+      acceptor.open(endpoint.protocol());
+      acceptor.bind(endpoint);
+      acceptor.listen();
+   } catch (const exception& e) {
+      *pError = "can not listen on " + path + ": " + e.what();
+      return false;
+   }
+   return true;
+}
+
+bool CMgrEmulator::start(string * pError)
+{
+   if (!listenOn(m_acceptor, m_config.m_port, pError))
+      return false;
+   if (m_config.m_standbyPort != 0 && !listenOn(m_standbyAcceptor, m_config.m_standbyPort, pError))
+      return false;
+   if (!m_config.m_unixPath.empty() && !listenOn(m_unixAcceptor, m_config.m_unixPath, pError))
+      return false;
+   if (!m_config.m_shmPath.empty() && !listenOn(m_shmAcceptor, m_config.m_shmPath, pError))
+      return false;
+   cout << "Manager emulator: port " << m_config.m_port;
+   if (m_config.m_standbyPort != 0)
+      cout << ", standby port " << m_config.m_standbyPort;
+   if (!m_config.m_unixPath.empty())
+      cout << ", unix:" << m_config.m_unixPath;
+   if (!m_config.m_shmPath.empty())
+      cout << ", shm:" << m_config.m_shmPath;
+   cout << endl;
+   m_startTime = m_lastTick = TIME_NOW();
+   m_nextDisconnect = m_startTime + msec_t(m_config.m_disconnectPeriod);
+   startAccept_p(m_acceptor);
+   if (m_config.m_standbyPort != 0)
+      startAccept_p(m_standbyAcceptor);
+   if (!m_config.m_unixPath.empty())
+      startLocalAccept_p(m_unixAcceptor);
+   if (!m_config.m_shmPath.empty())
+      startLocalAccept_p(m_shmAcceptor);
+   startTick_p();
+   return true;
+}
+
+void CMgrEmulator::stop()
+{
+   m_isStopped = true;
+   boost::system::error_code ec;
+   m_tickTimer.cancel(ec);
+   m_acceptor.close(ec);
+   m_standbyAcceptor.close(ec);
+   m_unixAcceptor.close(ec);
+   m_shmAcceptor.close(ec);
+   if (!m_config.m_unixPath.empty())
+      ::unlink(m_config.m_unixPath.c_str());
+   if (!m_config.m_shmPath.empty())
+      ::unlink(m_config.m_shmPath.c_str());
+   set<CMgrSession::ptr> connections(m_connections);
+   for (auto& c : connections)
+      c->close();
+}
+
+void CMgrEmulator::startAccept_p(boost::asio::ip::tcp::acceptor& acceptor)
+{
+   tcpsockptr_t sock(new boost::asio::ip::tcp::socket(m_ioService));
+   acceptor.async_accept(*sock,
+                         boost::bind(&CMgrEmulator::handleAccept_p, this, boost::ref(acceptor), sock,
+                                     boost::asio::placeholders::error));
+}
+
+void CMgrEmulator::handleAccept_p(boost::asio::ip::tcp::acceptor& acceptor, tcpsockptr_t sock,
+                                  const boost::system::error_code& error)
+{
+   if (error || m_isStopped)
+      return;
+   if (!isRefused_p(&acceptor == &m_standbyAcceptor))
+      addSession_p(IAPCTransport::ptr(new CAPCTcpTransport(std::move(*sock))));
+   startAccept_p(acceptor);
+}
+
+void CMgrEmulator::startLocalAccept_p(local_acceptor_t& acceptor)
+{
+   localsockptr_t sock(new boost::asio::local::stream_protocol::socket(m_ioService));
+   acceptor.async_accept(*sock,
+                         boost::bind(&CMgrEmulator::handleLocalAccept_p, this, boost::ref(acceptor), sock,
+                                     boost::asio::placeholders::error));
+}
+
+void CMgrEmulator::handleLocalAccept_p(local_acceptor_t& acceptor, localsockptr_t sock,
+                                       const boost::system::error_code& error)
+{
+   if (error || m_isStopped)
+      return;
+   // Socket of refused connection is closed when released
+   if (!isRefused_p(false)) {
+      if (&acceptor == &m_shmAcceptor) {
+         // apc passes shared memory right after connection
+         CAPCShmTransport::asyncAccept(m_ioService, sock,
+                                       boost::bind(&CMgrEmulator::handleShmAccept_p, this, _1, _2));
+      } else {
+         addSession_p(IAPCTransport::ptr(new CAPCUnixTransport(std::move(*sock))));
+      }
+   }
+   startLocalAccept_p(acceptor);
+}
+
+void CMgrEmulator::handleShmAccept_p(IAPCTransport::ptr transport, const string& error)
+{
+   if (m_isStopped)
+      return;
+   if (transport == nullptr) {
+      cerr << "Shared memory connection failed: " << error << endl;
+      return;
+   }
+   addSession_p(transport);
+}
+
+bool CMgrEmulator::isRefused_p(bool isStandbyPort)
+{
+   mngr_time_t now = TIME_NOW();
+   if (now < m_outageUntil || (!isStandbyPort && now < m_primaryOutageUntil)) {
+      m_stats.m_numRefused++;
+      return true;
+   }
+   return false;
+}
+
+void CMgrEmulator::addSession_p(IAPCTransport::ptr transport)
+{
+   CMgrSession::ptr session(new CMgrSession(this, m_ioService, transport));
+   m_connections.insert(session);
+   session->start();
+}
+
+CMgrEmulator::session_s * CMgrEmulator::getSession_p(uint32_t sesId)
+{
+   auto it = m_sessions.find(sesId);
+   return it == m_sessions.end() ? NULL : &it->second;
+}
+
+uint32_t CMgrEmulator::newSession_p()
+{
+   session_s ses = { 0, 0 };
+   m_sessions[++m_lastSesId] = ses;
+   return m_lastSesId;
+}
+
+void CMgrEmulator::sessionClosed_p(CMgrSession * pSession)
+{
+   m_stats.m_numDisconnects++;
+   for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+      if (it->get() == pSession) {
+         m_connections.erase(it);
+         break;
+      }
+   }
+}
+
+void CMgrEmulator::sessionActivated_p(CMgrSession * pSession)
+{
+   set<CMgrSession::ptr> connections(m_connections);
+   for (auto& c : connections)
+      if (c.get() != pSession && c->getSesId() == pSession->getSesId())
+         c->close();
+}
+
+void CMgrEmulator::netRxReceived_p(const uint8_t * payload, size_t size)
+{
+   m_stats.m_numNetRx++;
+   m_stats.m_numNetRxBytes += size;
+   uint32_t seq;
+   int64_t  latency;
+   if (!emuStampParse(payload, size, 0, &seq, &latency))
+      return;
+   m_upLatency.add(latency);
+   if (m_hasUpSeq && seq > m_lastUpSeq + 1)
+      m_stats.m_numLostRx += seq - m_lastUpSeq - 1;
+   if (!m_hasUpSeq || seq > m_lastUpSeq)
+      m_lastUpSeq = seq;
+   m_hasUpSeq = true;
+}
+
+void CMgrEmulator::txDoneReceived_p(uint16_t txDoneId)
+{
+   m_stats.m_numTxDone++;
+   auto it = m_txDoneWait.find(txDoneId);
+   if (it == m_txDoneWait.end())
+      return;
+   m_txDoneLatency.add(TO_USEC(TIME_NOW() - it->second).count());
+   m_txDoneWait.erase(it);
+}
+
+void CMgrEmulator::startTick_p()
+{
+   m_tickTimer.expires_from_now(boost::posix_time::milliseconds(MGREMU_TICK_MSEC));
+   m_tickTimer.async_wait(boost::bind(&CMgrEmulator::handleTick_p, this,
+                                      boost::asio::placeholders::error));
+}
+
+void CMgrEmulator::handleTick_p(const boost::system::error_code& error)
+{
+   if (error || m_isStopped)
+      return;
+   mngr_time_t now = TIME_NOW();
+
+   while (m_scriptIdx < m_config.m_script.size() &&
+          m_startTime + msec_t(m_config.m_script[m_scriptIdx].m_timeMsec) <= now)
+      runAction_p(m_config.m_script[m_scriptIdx++]);
+   if (m_isStopped)
+      return;
+
+   if (m_config.m_disconnectPeriod > 0 && now >= m_nextDisconnect) {
+      m_nextDisconnect = now + msec_t(m_config.m_disconnectPeriod);
+      injectDisconnect_p(m_config.m_outage);
+   }
+   if (m_pauseUntil != TIME_EMPTY && now >= m_pauseUntil) {
+      m_pauseUntil = TIME_EMPTY;
+      for (auto& c : m_connections)
+         if (c->isOnline())
+            c->sendPause(false);
+   }
+
+   generateDown_p(now);
+   for (auto& c : m_connections)
+      c->checkKa(now);
+   startTick_p();
+}
+
+void CMgrEmulator::generateDown_p(const mngr_time_t& now)
+{
+   double elapsed = static_cast<double>(TO_USEC(now - m_lastTick).count()) / 1000000.0;
+   m_lastTick = now;
+
+   CMgrSession::ptr target;
+   for (auto& c : m_connections) {
+      if (c->isOnline() && !c->isPaused()) {
+         target = c;
+         break;
+      }
+   }
+   for (size_t i = 0; i < m_config.m_streams.size(); i++) {
+      if (!target) {
+         m_tokens[i] = 0;
+         continue;
+      }
+      // Don't accumulate more than 1 sec of traffic
+      m_tokens[i] = min(m_tokens[i] + elapsed * m_rates[i], static_cast<double>(max<uint32_t>(m_rates[i], 1)));
+      while (m_tokens[i] >= 1.0) {
+         if (m_config.m_downCount > 0 && m_downSeq >= m_config.m_downCount) {
+            m_tokens[i] = 0;
+            break;
+         }
+         if (!target->hasCredit()) {
+            m_stats.m_numCreditWait++;
+            break;
+         }
+         m_tokens[i] -= 1.0;
+         target->sendNetTx(m_config.m_streams[i].m_priority, m_config.m_streams[i].m_size, ++m_downSeq);
+      }
+   }
+}
+
+void CMgrEmulator::injectDisconnect_p(uint32_t outageMsec)
+{
+   if (m_connections.empty())
+      return;
+   m_stats.m_numInjected++;
+   m_outageUntil = TIME_NOW() + msec_t(outageMsec);
+   cout << "Manager emulator: disconnect, outage " << outageMsec << " msec" << endl;
+   set<CMgrSession::ptr> connections(m_connections);
+   for (auto& c : connections)
+      c->close();
+}
+
+// Primary manager fails: active connections are closed, standby ones stay
+void CMgrEmulator::injectFailover_p(uint32_t outageMsec)
+{
+   m_stats.m_numInjected++;
+   m_primaryOutageUntil = TIME_NOW() + msec_t(outageMsec);
+   cout << "Manager emulator: failover, outage of primary port " << outageMsec << " msec" << endl;
+   set<CMgrSession::ptr> connections(m_connections);
+   for (auto& c : connections)
+      if (c->isOnline())
+         c->close();
+}
+
+void CMgrEmulator::runAction_p(const emu_action_s& action)
+{
+   cout << "Manager emulator: " << action.m_timeMsec << " msec: " << action.m_action
+        << " " << action.m_arg << endl;
+   if (action.m_action == "disconnect") {
+      injectDisconnect_p(action.m_arg);
+   } else if (action.m_action == "failover") {
+      injectFailover_p(action.m_arg);
+   } else if (action.m_action == "rate") {
+      for (auto& r : m_rates)
+         r = action.m_arg;
+   } else if (action.m_action == "pause") {
+      m_pauseUntil = TIME_NOW() + msec_t(action.m_arg);
+      for (auto& c : m_connections)
+         if (c->isOnline())
+            c->sendPause(true);
+   } else if (action.m_action == "stop") {
+      m_ioService.stop();
+   } else {
+      cerr << "Manager emulator: unknown action " << action.m_action << endl;
+   }
+}
+
+void CMgrEmulator::printStats(ostream& os, bool asJson)
+{
+   const mgremu_stats_s& s = m_stats;
+   apc_compress_stats_s  cs;
+   m_compressStats.getStat(&cs);
+   if (asJson) {
+      os << "{\"connects\":"  << s.m_numConnects    << ",\"resumed\":"     << s.m_numResumed
+         << ",\"refused\":"   << s.m_numRefused     << ",\"disconnects\":" << s.m_numDisconnects
+         << ",\"injected\":"  << s.m_numInjected
+         << ",\"standby\":"   << s.m_numStandby     << ",\"activated\":"   << s.m_numActivated
+         << ",\"netRx\":"     << s.m_numNetRx       << ",\"netRxBytes\":"  << s.m_numNetRxBytes
+         << ",\"netRxBatch\":" << s.m_numNetRxBatch
+         << ",\"rxCompBytes\":" << cs.m_rxCompBytes << ",\"rxRawBytes\":"  << cs.m_rxRawBytes
+         << ",\"txRawBytes\":"  << cs.m_txRawBytes  << ",\"txCompBytes\":" << cs.m_txCompBytes
+         << ",\"dupRx\":"     << s.m_numDupRx       << ",\"lostRx\":"      << s.m_numLostRx
+         << ",\"txDone\":"    << s.m_numTxDone      << ",\"txDoneBatch\":" << s.m_numTxDoneBatch
+         << ",\"pause\":"     << s.m_numPause
+         << ",\"resume\":"    << s.m_numResume      << ",\"apLost\":"      << s.m_numApLost
+         << ",\"netTx\":"     << s.m_numNetTx       << ",\"netTxBytes\":"  << s.m_numNetTxBytes
+         << ",\"kaTx\":"      << s.m_numKaTx        << ",\"kaRx\":"        << s.m_numKaRx
+         << ",\"creditWait\":" << s.m_numCreditWait
+         << ",\"upLatencyUsec\":";
+      m_upLatency.toJson(os);
+      os << ",\"txDoneLatencyUsec\":";
+      m_txDoneLatency.toJson(os);
+      os << "}" << endl;
+      return;
+   }
+   os << "Connects (resumed):   " << s.m_numConnects << " (" << s.m_numResumed << ")" << endl
+      << "Disconnects/injected: " << s.m_numDisconnects << " / " << s.m_numInjected
+                                  << ", refused " << s.m_numRefused << endl
+      << "Standby/activated:    " << s.m_numStandby << " / " << s.m_numActivated << endl
+      << "NET_RX pkts/bytes:    " << s.m_numNetRx << " / " << s.m_numNetRxBytes << endl
+      << "NET_RX batches:       " << s.m_numNetRxBatch << endl
+      << "Compressed RX/TX:     " << cs.m_rxCompBytes << " / " << cs.m_rxRawBytes << " bytes, "
+                                  << cs.m_txCompBytes << " / " << cs.m_txRawBytes << " bytes" << endl
+      << "NET_RX dup/lost:      " << s.m_numDupRx << " / " << s.m_numLostRx << endl
+      << "NET_TX pkts/bytes:    " << s.m_numNetTx << " / " << s.m_numNetTxBytes << endl
+      << "TXDONE/batches:       " << s.m_numTxDone << " / " << s.m_numTxDoneBatch << endl
+      << "PAUSE/RESUME/AP_LOST: " << s.m_numPause << " / " << s.m_numResume
+                                  << " / " << s.m_numApLost << endl
+      << "KA tx/rx:             " << s.m_numKaTx << " / " << s.m_numKaRx << endl
+      << "Credit wait (ticks):  " << s.m_numCreditWait << endl
+      << "Upstream latency:     ";
+   m_upLatency.toJson(os);
+   os << endl << "TXDONE latency:       ";
+   m_txDoneLatency.toJson(os);
+   os << endl;
+}
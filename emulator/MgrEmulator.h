@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include "EmuCommon.h"
+#include "APInterface/APCProto.h"
+#include "APInterface/APCSerializer.h"
+#include "APInterface/APCCompressor.h"
+#include "APInterface/APCTransport.h"
+
+#include <boost/asio.hpp>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * \file MgrEmulator.h
+ * Emulator of Manager side of APC protocol
+ */
+
+/**
+ * Downstream (NET_TX) traffic stream
+ */
+struct mgremu_stream_s {
+   uint32_t m_rate;       ///< pkt/s
+   uint8_t  m_priority;   ///< 0(lowest)-3(highest)
+   uint32_t m_size;       ///< Payload size
+};
+
+// Parse stream definition "RATE[:PRIORITY[:SIZE]]"
+bool mgrEmuParseStream(const std::string& str, uint32_t defSize, mgremu_stream_s * pStream);
+
+/**
+ * Manager emulator configuration
+ */
+struct mgremu_config_s {
+   uint16_t    m_port;           ///< TCP port for apc connections
+   uint16_t    m_standbyPort;    ///< TCP port of emulated secondary manager (hot-standby). 0 - disabled
+   std::string m_unixPath;       ///< AF_UNIX socket for apc connections ("unix:PATH"). Empty - disabled
+   std::string m_shmPath;        ///< AF_UNIX socket for shared memory connections ("shm:PATH"). Empty - disabled
+   uint32_t    m_netId;          ///< Network ID sent in CONNECT
+   std::vector<mgremu_stream_s> m_streams;
+   uint32_t    m_downCount;      ///< Number of NET_TX packets. 0 - unlimited
+   bool        m_txDone;         ///< Request TXDONE for NET_TX
+   uint32_t    m_ackDelay;       ///< Delay of acknowledgement of received messages (msec)
+   bool        m_netRxBatch;     ///< Accept APC_NET_RX_BATCH and APC_NET_TXDONE_BATCH offered by apc
+   uint32_t    m_compressLevel;  ///< Accept compression offered by apc with this level. 0 - refuse
+   uint32_t    m_protoVer;       ///< Max accepted protocol version
+   uint32_t    m_kaInterval;     ///< Send KA if nothing is sent (msec)
+   uint32_t    m_credit;         ///< Accept credit flow control offered by apc, upstream window in messages. 0 - refuse
+   uint32_t    m_disconnectPeriod; ///< Drop connection every N msec. 0 - disabled
+   uint32_t    m_outage;         ///< Connections are refused during N msec after injected disconnect
+   std::vector<emu_action_s> m_script;
+};
+
+/**
+ * Manager emulator statistics
+ */
+struct mgremu_stats_s {
+   uint32_t m_numConnects;       ///< Accepted CONNECT messages
+   uint32_t m_numResumed;        ///< CONNECT with known session (cache replay)
+   uint32_t m_numRefused;        ///< Connections refused during outage
+   uint32_t m_numStandby;        ///< Accepted standby connections (CONNECT with APC_FL_STANDBY)
+   uint32_t m_numActivated;      ///< Standby connections activated by apc (failover)
+   uint32_t m_numDisconnects;    ///< Connections closed (by any side)
+   uint32_t m_numInjected;       ///< Disconnects injected by emulator
+   uint64_t m_numNetRx;          ///< NET_RX messages (without replayed duplicates)
+   uint64_t m_numNetRxBytes;     ///< Payload bytes of NET_RX
+   uint64_t m_numNetRxBatch;     ///< NET_RX_BATCH messages
+   uint64_t m_numDupRx;          ///< Messages with already received sequence number
+   uint64_t m_numLostRx;         ///< Gaps in stamp sequence of AP emulator
+   uint32_t m_numTxDone;         ///< NET_TXDONE notifications (also in batches)
+   uint32_t m_numTxDoneBatch;    ///< NET_TXDONE_BATCH messages
+   uint32_t m_numPause;          ///< PAUSE received from apc
+   uint32_t m_numResume;         ///< RESUME received from apc
+   uint32_t m_numApLost;         ///< AP_LOST received from apc
+   uint64_t m_numNetTx;          ///< Sent NET_TX
+   uint64_t m_numNetTxBytes;     ///< Payload bytes of NET_TX
+   uint64_t m_numKaTx;           ///< Sent KA
+   uint64_t m_numKaRx;           ///< Received KA
+   uint64_t m_numCreditWait;     ///< Ticks with downstream waiting for credit of apc
+};
+
+class CMgrEmulator;
+
+/**
+ * Connection with one apc
+ */
+class CMgrSession : public ISerRxHandler, public std::enable_shared_from_this<CMgrSession> {
+public:
+   typedef std::shared_ptr<CMgrSession> ptr;
+
+   CMgrSession(CMgrEmulator * pOwner, boost::asio::io_service& ioService, IAPCTransport::ptr transport);
+   virtual ~CMgrSession() {;}
+
+   void     start();
+   void     close();
+   bool     isOnline() const { return m_isOnline && !m_isClosed; }
+   bool     isStandby() const { return m_isStandby && !m_isClosed; }
+   bool     isPaused() const { return m_isPaused; }
+   // apc gives credit for next NET_TX (always true without credit flow control)
+   bool     hasCredit();
+   uint32_t getSesId() const { return m_sesId; }
+
+   // Send NET_TX with stamped payload
+   void     sendNetTx(uint8_t priority, uint32_t size, uint32_t seq);
+   // Pause / resume apc: PAUSE/RESUME or, with credit flow control, no new credit
+   void     sendPause(bool isPause);
+   // Send KA if nothing is sent during kaInterval
+   void     checkKa(const mngr_time_t& now);
+
+   // ISerRxHandler
+   virtual apc_error_t messageReceived(ap_intf_id_t apcId, apc_msg_type_t type, uint8_t flags,
+                                       uint32_t mySeq, uint32_t yourSeq,
+                                       const uint8_t * pPayload, uint16_t size);
+private:
+   void startRead_p();
+   void handleRead_p(const boost::system::error_code& error, size_t size);
+   void send_p(apc_msg_type_t type, uint8_t flags, uint32_t mySeq,
+               const uint8_t * payload1, size_t size1,
+               const uint8_t * payload2 = NULL, size_t size2 = 0);
+   void startWrite_p();
+   void handleWrite_p(const boost::system::error_code& error, size_t size);
+   void handleConnect_p(const apc_msg_connect_s& msg, uint32_t yourSeq);
+   apc_error_t handleActivate_p(const apc_msg_activate_s& msg);
+   void scheduleAck_p();
+   // KA acknowledges received messages and carries credit of apc
+   void sendKa_p();
+
+   CMgrEmulator                    * m_pOwner;
+   boost::asio::io_service&          m_ioService;
+   IAPCTransport::ptr                m_transport;
+   CAPCSerializer                    m_serializer;
+   std::unique_ptr<CAPCCompressor>   m_compressor;   // Created if compression is negotiated
+   bool                              m_isTxCompressed;
+   bool                              m_isRxCompressed;
+   std::vector<uint8_t>              m_readBuf;
+   std::deque<std::vector<uint8_t> > m_writeQueue;
+   bool                              m_isWriting;
+   bool                              m_isClosed;
+   bool                              m_isOnline;
+   bool                              m_isStandby;    // Standby connection, not used until APC_ACTIVATE
+   bool                              m_isPaused;
+   uint32_t                          m_sesId;
+   uint32_t                          m_ackedSeq;     // Last sequence number reported to apc
+   boost::asio::deadline_timer       m_ackTimer;
+   bool                              m_isAckScheduled;
+   mngr_time_t                       m_lastTx;
+   bool                              m_isCredit;     // Credit flow control is negotiated
+   bool                              m_isCreditFrozen; // Credit is not increased (pause)
+   uint32_t                          m_apcLimit;     // Last sequence number apc accepts
+};
+
+/**
+ * Manager emulator.
+ *
+ * Accepts apc connections, answers APC_CONNECT (new or resumed session),
+ * generates stamped NET_TX streams, acknowledges received sequence numbers
+ * after configurable delay and injects disconnects to exercise cache replay
+ * of apc. With standby port it emulates pair of managers sharing sessions:
+ * apc keeps hot-standby connection on the second port and activates it
+ * when active connection is lost. apc on the same host can also connect
+ * over AF_UNIX socket or shared memory (see CAPCShmTransport). With credit
+ * flow control (APC_FL_CREDIT) NET_TX waits for credit of apc and apc gets
+ * credit of upstream window in acknowledging KA. Upstream latency is measured on NET_RX stamped by AP emulator,
+ * TXDONE latency - from NET_TX to NET_TXDONE.
+ *
+ * All handlers run on one io_service thread.
+ */
+class CMgrEmulator {
+public:
+   CMgrEmulator(boost::asio::io_service& ioService, const mgremu_config_s& config);
+
+   bool start(std::string * pError);
+   void stop();
+
+   const mgremu_stats_s& getStats() const { return m_stats; }
+   void printStats(std::ostream& os, bool asJson);
+
+private:
+   friend class CMgrSession;
+
+   // Sequence numbers of session, kept for reconnection
+   struct session_s {
+      uint32_t m_rxSeq;    ///< Last sequence number received from apc
+      uint32_t m_txSeq;    ///< Last sequence number sent to apc
+   };
+
+   typedef boost::asio::local::stream_protocol::acceptor local_acceptor_t;
+   typedef boost::shared_ptr<boost::asio::ip::tcp::socket> tcpsockptr_t;
+   typedef boost::shared_ptr<boost::asio::local::stream_protocol::socket> localsockptr_t;
+
+   void startAccept_p(boost::asio::ip::tcp::acceptor& acceptor);
+   void handleAccept_p(boost::asio::ip::tcp::acceptor& acceptor, tcpsockptr_t sock,
+                       const boost::system::error_code& error);
+   void startLocalAccept_p(local_acceptor_t& acceptor);
+   void handleLocalAccept_p(local_acceptor_t& acceptor, localsockptr_t sock,
+                            const boost::system::error_code& error);
+   void handleShmAccept_p(IAPCTransport::ptr transport, const std::string& error);
+   // Manager is "down" (outage): connection is dropped without any answer
+   bool isRefused_p(bool isStandbyPort);
+   void addSession_p(IAPCTransport::ptr transport);
+   void startTick_p();
+   void handleTick_p(const boost::system::error_code& error);
+   void generateDown_p(const mngr_time_t& now);
+   void injectDisconnect_p(uint32_t outageMsec);
+   void injectFailover_p(uint32_t outageMsec);
+   void runAction_p(const emu_action_s& action);
+
+   // Called by sessions
+   session_s * getSession_p(uint32_t sesId);
+   uint32_t    newSession_p();
+   void        sessionClosed_p(CMgrSession * pSession);
+   void        sessionActivated_p(CMgrSession * pSession);
+   void        netRxReceived_p(const uint8_t * payload, size_t size);
+   void        txDoneReceived_p(uint16_t txDoneId);
+
+   boost::asio::io_service&          m_ioService;
+   mgremu_config_s                   m_config;
+   boost::asio::ip::tcp::acceptor    m_acceptor;
+   boost::asio::ip::tcp::acceptor    m_standbyAcceptor;
+   local_acceptor_t                  m_unixAcceptor;
+   local_acceptor_t                  m_shmAcceptor;
+   boost::asio::deadline_timer       m_tickTimer;
+   bool                              m_isStopped;
+   std::set<CMgrSession::ptr>        m_connections;
+   std::map<uint32_t, session_s>     m_sessions;
+   CAPCCompressStats                 m_compressStats;
+   uint32_t                          m_lastSesId;
+
+   // Downstream generator
+   std::vector<double>               m_tokens;     // Per stream
+   std::vector<uint32_t>             m_rates;      // Per stream (script can change)
+   mngr_time_t                       m_lastTick;
+   uint32_t                          m_downSeq;
+   uint16_t                          m_txDoneId;
+   std::map<uint16_t, mngr_time_t>   m_txDoneWait; // txDoneId -> time of NET_TX
+
+   // Disconnect injection and script
+   mngr_time_t                       m_startTime;
+   mngr_time_t                       m_nextDisconnect;
+   mngr_time_t                       m_outageUntil;
+   mngr_time_t                       m_primaryOutageUntil; // Only primary port refuses (failover)
+   mngr_time_t                       m_pauseUntil;  // apc is paused by script
+   size_t                            m_scriptIdx;
+   bool                              m_hasUpSeq;
+   uint32_t                          m_lastUpSeq;   // Last stamp sequence of NET_RX
+
+   mgremu_stats_s                    m_stats;
+   CLatencyStat                      m_upLatency;      // AP emulator -> NET_RX
+   CLatencyStat                      m_txDoneLatency;  // NET_TX -> NET_TXDONE
+};
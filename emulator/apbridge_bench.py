@@ -0,0 +1,257 @@
+#!/usr/bin/env python
+'''
+End-to-end benchmark of AP Bridge.
+
+Starts apc between AP emulator (pty) and Manager emulator (TCP), drives fixed
+traffic profiles and writes packets/sec, latency per direction, CPU time and
+memory usage of apc as JSON.
+
+Each profile runs for warmup + duration seconds. Traffic generators are idle
+during warmup (apc boots AP and connects to manager) and are switched on by
+emulator scripts, so rates and latencies cover only the measured interval.
+'''
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+# Traffic profiles.
+#   up      - upstream rate of AP emulator, pkt/s
+#   down    - downstream rate of Manager emulator, pkt/s
+#   prio    - priority of downstream packets
+#   outages - list of (offset, outage) of injected manager disconnects, msec
+#   failovers - list of (offset, outage) of injected failovers to standby port, msec
+#   standby - apc keeps hot-standby connection to second port of Manager emulator
+#   transport - 'unix' or 'shm': apc connects to Manager emulator on the same host without TCP
+#   apcArgs - extra options of apc
+PROFILES = [
+    ('upstream_burst',   {'up': 400, 'down': 0}),
+    ('downstream_burst', {'up': 0,   'down': 40}),
+    ('mixed',            {'up': 200, 'down': 20, 'prio': 1}),
+    ('outage_replay',    {'up': 200, 'down': 10,
+                          'outages': [(2000, 1000), (6000, 3000)]}),
+    ('mixed_compressed', {'up': 200, 'down': 20, 'prio': 1,
+                          'apcArgs': ['--apc-compress-level', '6']}),
+    ('mixed_v2_header',  {'up': 200, 'down': 20, 'prio': 1,
+                          'apcArgs': ['--apc-proto-ver', '2']}),
+    ('mixed_nagle',      {'up': 200, 'down': 20, 'prio': 1,
+                          'apcArgs': ['--apc-sock-policy', 'default']}),
+    ('failover_standby', {'up': 200, 'down': 10, 'standby': True,
+                          'failovers': [(2000, 3000), (6000, 3000)]}),
+    ('mixed_unix',       {'up': 200, 'down': 20, 'prio': 1, 'transport': 'unix'}),
+    ('mixed_shm',        {'up': 200, 'down': 20, 'prio': 1, 'transport': 'shm'}),
+]
+
+PKT_SIZE = 80
+
+
+def free_port():
+    s = socket.socket()
+    s.bind(('127.0.0.1', 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+def write_script(path, actions):
+    with open(path, 'w') as f:
+        for (msec, action, arg) in actions:
+            f.write('{0} {1} {2}\n'.format(msec, action, arg))
+    return path
+
+
+def proc_usage(pid):
+    'CPU time (sec) and memory (KB) of running process'
+    usage = {}
+    try:
+        with open('/proc/{0}/stat'.format(pid)) as f:
+            fields = f.read().rsplit(')', 1)[1].split()
+        ticks = float(os.sysconf('SC_CLK_TCK'))
+        # fields start from 'state' (field 3 of stat)
+        usage['cpuUser'] = int(fields[11]) / ticks
+        usage['cpuSys'] = int(fields[12]) / ticks
+        usage['cpuTotal'] = usage['cpuUser'] + usage['cpuSys']
+        with open('/proc/{0}/status'.format(pid)) as f:
+            for line in f:
+                name, _, value = line.partition(':')
+                if name in ('VmRSS', 'VmHWM'):
+                    usage[name.replace('Vm', '').lower() + 'Kb'] = int(value.split()[0])
+    except (IOError, OSError, IndexError, ValueError):
+        pass
+    return usage
+
+
+def read_stats(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (IOError, OSError, ValueError):
+        return {}
+
+
+def direction(count, latency, duration):
+    return {'packets': count,
+            'pps':     round(count / float(duration), 1) if duration else 0,
+            'p50Usec': latency.get('p50', 0),
+            'p99Usec': latency.get('p99', 0),
+            'maxUsec': latency.get('max', 0)}
+
+
+def stop(proc, timeout=5.0):
+    if proc is None or proc.poll() is not None:
+        return
+    proc.send_signal(signal.SIGTERM)
+    deadline = time.time() + timeout
+    while proc.poll() is None and time.time() < deadline:
+        time.sleep(0.1)
+    if proc.poll() is None:
+        proc.kill()
+        proc.wait()
+
+
+def run_profile(name, profile, args, workdir):
+    pdir = os.path.join(workdir, name)
+    os.mkdir(pdir)
+    warmup_ms = args.warmup * 1000
+    total = args.warmup + args.duration
+    link = os.path.join(pdir, 'apemu')
+    port = free_port()
+    log = open(os.path.join(pdir, 'output.log'), 'w')
+
+    mgr_actions = []
+    if profile.get('down'):
+        mgr_actions.append((warmup_ms, 'rate', profile['down']))
+    for (offset, outage) in profile.get('outages', []):
+        mgr_actions.append((warmup_ms + offset, 'disconnect', outage))
+    for (offset, outage) in profile.get('failovers', []):
+        mgr_actions.append((warmup_ms + offset, 'failover', outage))
+    mgr_cmd = [args.mgremu, '--port', str(port), '--duration', str(total + 1),
+               '--down', '0:{0}:{1}'.format(profile.get('prio', 0), PKT_SIZE),
+               '--stats-file', os.path.join(pdir, 'mgremu.json'), '--json']
+    standby_args = []
+    if profile.get('standby'):
+        standby_port = free_port()
+        mgr_cmd += ['--standby-port', str(standby_port)]
+        standby_args = ['--standby-host', '127.0.0.1', '--standby-port', str(standby_port)]
+    host = '127.0.0.1'
+    if profile.get('transport'):
+        sock_path = os.path.join(pdir, 'mgr.sock')
+        mgr_cmd += ['--' + profile['transport'], sock_path]
+        host = '{0}:{1}'.format(profile['transport'], sock_path)
+    if mgr_actions:
+        mgr_cmd += ['--script', write_script(os.path.join(pdir, 'mgremu.script'), mgr_actions)]
+
+    ap_cmd = [args.apemu, '--link', link, '--duration', str(total + 1),
+              '--up-size', str(PKT_SIZE),
+              '--stats-file', os.path.join(pdir, 'apemu.json'), '--json']
+    if profile.get('up'):
+        ap_cmd += ['--script', write_script(os.path.join(pdir, 'apemu.script'),
+                                            [(warmup_ms, 'rate', profile['up'])])]
+
+    apc_cmd = [args.apc, '--client-id', 'bench',
+               '--api-device', link, '--reset-device', link,
+               '--host', host, '--port', str(port),
+               '--apc-reconnect-delay', '500',
+               '--api-proto', 'ipc', '--api-ipcpath', pdir,
+               '--config-file', os.path.join(pdir, 'apc.conf'),
+               '--log-file', os.path.join(pdir, 'apc.log'),
+               '--log-level', args.log_level] + standby_args + profile.get('apcArgs', [])
+
+    mgr = ap = apc = None
+    usage = {}
+    try:
+        mgr = subprocess.Popen(mgr_cmd, stdout=log, stderr=subprocess.STDOUT)
+        ap = subprocess.Popen(ap_cmd, stdout=log, stderr=subprocess.STDOUT)
+        deadline = time.time() + 5
+        while not os.path.exists(link) and time.time() < deadline:
+            time.sleep(0.05)
+        apc = subprocess.Popen(apc_cmd, stdout=log, stderr=subprocess.STDOUT)
+        start = time.time()
+        # Snapshot apc usage just before emulators finish
+        while time.time() - start < total:
+            time.sleep(0.2)
+            if apc.poll() is not None:
+                break
+            usage = proc_usage(apc.pid)
+        ap.wait()
+        mgr.wait()
+    finally:
+        for p in (apc, ap, mgr):
+            stop(p)
+        log.close()
+
+    mgr_stats = read_stats(os.path.join(pdir, 'mgremu.json'))
+    ap_stats = read_stats(os.path.join(pdir, 'apemu.json'))
+    result = {
+        'upstream':   direction(mgr_stats.get('netRx', 0),
+                                mgr_stats.get('upLatencyUsec', {}), args.duration),
+        'downstream': direction(ap_stats.get('apSend', 0),
+                                ap_stats.get('downLatencyUsec', {}), args.duration),
+        'txDone':     direction(mgr_stats.get('txDone', 0),
+                                mgr_stats.get('txDoneLatencyUsec', {}), args.duration),
+        'apc':        usage,
+        'apcExitCode': apc.returncode if apc else None,
+        'mgremu':     mgr_stats,
+        'apemu':      ap_stats,
+    }
+    result['apc']['cpuPercent'] = round(100.0 * usage.get('cpuTotal', 0) / total, 2)
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description='AP Bridge end-to-end benchmark')
+    parser.add_argument('--apc', required=True, help='Path to apc')
+    parser.add_argument('--apemu', required=True, help='Path to AP emulator')
+    parser.add_argument('--mgremu', required=True, help='Path to Manager emulator')
+    parser.add_argument('--duration', type=int, default=10,
+                        help='Measured interval of each profile, sec')
+    parser.add_argument('--warmup', type=int, default=5,
+                        help='Time to connect apc before traffic starts, sec')
+    parser.add_argument('--profiles', default='',
+                        help='Comma-separated list of profiles (default: all)')
+    parser.add_argument('--log-level', default='WARN', help='apc log level')
+    parser.add_argument('--keep', action='store_true', help='Keep working directory')
+    parser.add_argument('-o', '--output', help='Output JSON file (default: stdout)')
+    args = parser.parse_args()
+
+    selected = [p for p in args.profiles.split(',') if p]
+    names = [n for (n, _) in PROFILES]
+    for p in selected:
+        if p not in names:
+            parser.error('unknown profile {0}, choose from {1}'.format(p, ', '.join(names)))
+
+    workdir = tempfile.mkdtemp(prefix='apbridge_bench_')
+    report = {'duration': args.duration, 'warmup': args.warmup,
+              'timestamp': int(time.time()), 'profiles': {}}
+    try:
+        for (name, profile) in PROFILES:
+            if selected and name not in selected:
+                continue
+            print('Running profile {0}...'.format(name), file=sys.stderr)
+            report['profiles'][name] = run_profile(name, profile, args, workdir)
+    finally:
+        if args.keep:
+            print('Working directory: {0}'.format(workdir), file=sys.stderr)
+        else:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+    text = json.dumps(report, indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+    else:
+        print(text)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+/*
+ * AP mote emulator.
+ * Run apc with '--api-device <link> --reset-device <link>' to connect it to emulator.
+ */
+
+#include "APEmulator.h"
+
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <iostream>
+#include <signal.h>
+
+using namespace std;
+namespace po = boost::program_options;
+
+int main(int argc, char ** argv)
+{
+   apemu_config_s config;
+   string   scriptFile, statsFile;
+   uint32_t durationSec = 0;
+   bool     jsonStats = false;
+
+   po::options_description desc("AP emulator options");
+   desc.add_options()
+      ("help,h", "Show this help")
+      ("link",         po::value<string>(&config.m_linkName)->default_value("/tmp/apemu"),
+                       "Symbolic link to pty (use it as apc serial port)")
+      ("up-rate",      po::value<uint32_t>(&config.m_upRate)->default_value(0),
+                       "Upstream rate, pkt/s")
+      ("up-size",      po::value<uint32_t>(&config.m_upSize)->default_value(80),
+                       "Upstream payload size, bytes")
+      ("up-count",     po::value<uint32_t>(&config.m_upCount)->default_value(0),
+                       "Number of upstream packets (0 - unlimited)")
+      ("resp-delay",   po::value<uint32_t>(&config.m_respDelay)->default_value(0),
+                       "Command response delay, msec")
+      ("ack-timeout",  po::value<uint32_t>(&config.m_ackTimeout)->default_value(200),
+                       "Notification retransmit timeout, msec")
+      ("nack-delay",   po::value<uint32_t>(&config.m_nackDelay)->default_value(100),
+                       "Notification retransmit delay after NACK, msec")
+      ("txdone-delay", po::value<uint32_t>(&config.m_txDoneDelay)->default_value(10),
+                       "TXDONE delay after AP_SEND, msec")
+      ("join-delay",   po::value<uint32_t>(&config.m_joinDelay)->default_value(100),
+                       "Operational event delay after JOIN, msec")
+      ("idle-reboot",  po::value<uint32_t>(&config.m_idleReboot)->default_value(10000),
+                       "Boot again if apc is silent, msec (0 - disabled)")
+      ("queue-size",   po::value<uint32_t>(&config.m_queueSize)->default_value(64),
+                       "Max number of queued notifications")
+      ("nack",         po::value<double>(&config.m_nackProb)->default_value(0),
+                       "Probability of AP_SEND NACK (0..1)")
+      ("drop",         po::value<double>(&config.m_dropProb)->default_value(0),
+                       "Probability of input frame drop (0..1)")
+      ("corrupt",      po::value<double>(&config.m_corruptProb)->default_value(0),
+                       "Probability of output frame corruption (0..1)")
+      ("net-id",       po::value<uint16_t>(&config.m_netId)->default_value(1229),
+                       "Network ID")
+      ("seed",         po::value<uint32_t>(&config.m_seed)->default_value(1),
+                       "Random generator seed")
+      ("script",       po::value<string>(&scriptFile),
+                       "Script file: lines '<msec> <action> [<arg>]', actions: "
+                       "nack N, drop N, corrupt N, rate PPS, mute MSEC, reboot, stop")
+      ("duration",     po::value<uint32_t>(&durationSec)->default_value(0),
+                       "Stop after N seconds (0 - run until signal)")
+      ("stats-file",   po::value<string>(&statsFile),
+                       "Write statistics to file on exit")
+      ("json",         po::bool_switch(&jsonStats),
+                       "Statistics in JSON format");
+
+   po::variables_map vm;
+   try {
+      po::store(po::parse_command_line(argc, argv, desc), vm);
+      po::notify(vm);
+   } catch (const exception& e) {
+      cerr << e.what() << endl << desc << endl;
+      return 1;
+   }
+   if (vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+   }
+   if (!scriptFile.empty()) {
+      string err;
+      if (!emuReadScript(scriptFile, &config.m_script, &err)) {
+         cerr << err << endl;
+         return 1;
+      }
+   }
+
+   boost::asio::io_service ioService;
+   CAPEmulator             emulator(ioService, config);
+   string                  err;
+   if (!emulator.start(&err)) {
+      cerr << err << endl;
+      return 1;
+   }
+
+   boost::asio::signal_set signals(ioService, SIGINT, SIGTERM);
+   signals.async_wait([&ioService](const boost::system::error_code&, int) { ioService.stop(); });
+   boost::asio::deadline_timer durationTimer(ioService);
+   if (durationSec > 0) {
+      durationTimer.expires_from_now(boost::posix_time::seconds(durationSec));
+      durationTimer.async_wait([&ioService](const boost::system::error_code& error) {
+         if (!error)
+            ioService.stop();
+      });
+   }
+
+   ioService.run();
+   emulator.stop();
+
+   if (!statsFile.empty()) {
+      ofstream out(statsFile.c_str());
+      emulator.printStats(out, jsonStats);
+   }
+   emulator.printStats(cout, jsonStats);
+   return 0;
+}
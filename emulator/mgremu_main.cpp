@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+/*
+ * Manager emulator (APC protocol server).
+ * Run apc with '--host localhost --port <port>' to connect it to emulator,
+ * with '--host unix:<path>' or '--host shm:<path>' for local transports.
+ */
+
+#include "MgrEmulator.h"
+
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <iostream>
+#include <signal.h>
+
+using namespace std;
+namespace po = boost::program_options;
+
+int main(int argc, char ** argv)
+{
+   mgremu_config_s config;
+   vector<string>  streams;
+   uint32_t        downSize;
+   string          scriptFile, statsFile;
+   uint32_t        durationSec = 0;
+   bool            jsonStats = false;
+
+   po::options_description desc("Manager emulator options");
+   desc.add_options()
+      ("help,h", "Show this help")
+      ("port",         po::value<uint16_t>(&config.m_port)->default_value(9100),
+                       "TCP port for apc connections")
+      ("standby-port", po::value<uint16_t>(&config.m_standbyPort)->default_value(0),
+                       "TCP port of emulated secondary manager for hot-standby connections (0 - disabled)")
+      ("unix",         po::value<string>(&config.m_unixPath),
+                       "AF_UNIX socket path for apc connections (apc --host unix:PATH)")
+      ("shm",          po::value<string>(&config.m_shmPath),
+                       "AF_UNIX socket path for shared memory connections (apc --host shm:PATH)")
+      ("net-id",       po::value<uint32_t>(&config.m_netId)->default_value(1229),
+                       "Network ID")
+      ("down",         po::value<vector<string> >(&streams),
+                       "Downstream stream RATE[:PRIORITY[:SIZE]] (pkt/s, 0-3, bytes), can be repeated")
+      ("down-size",    po::value<uint32_t>(&downSize)->default_value(80),
+                       "Default downstream payload size, bytes")
+      ("down-count",   po::value<uint32_t>(&config.m_downCount)->default_value(0),
+                       "Number of downstream packets (0 - unlimited)")
+      ("txdone",       po::value<bool>(&config.m_txDone)->default_value(true),
+                       "Request TXDONE for downstream packets")
+      ("ack-delay",    po::value<uint32_t>(&config.m_ackDelay)->default_value(0),
+                       "Delay of acknowledgement of received messages, msec")
+      ("netrx-batch",  po::value<bool>(&config.m_netRxBatch)->default_value(true),
+                       "Accept batching of upstream packets and TXDONE offered by apc")
+      ("compress",     po::value<uint32_t>(&config.m_compressLevel)->default_value(1),
+                       "Accept compression offered by apc, compression level 1-9 (0 - refuse)")
+      ("proto-ver",    po::value<uint32_t>(&config.m_protoVer)->default_value(APC_PROTO_VER_MAX),
+                       "Max accepted APC protocol version (2 - compact header)")
+      ("ka-interval",  po::value<uint32_t>(&config.m_kaInterval)->default_value(1000),
+                       "Send keep-alive if nothing is sent during interval, msec")
+      ("credit",       po::value<uint32_t>(&config.m_credit)->default_value(0),
+                       "Accept credit flow control offered by apc, upstream window in messages (0 - refuse)")
+      ("disconnect-period", po::value<uint32_t>(&config.m_disconnectPeriod)->default_value(0),
+                       "Drop apc connection every N msec (0 - disabled)")
+      ("outage",       po::value<uint32_t>(&config.m_outage)->default_value(0),
+                       "Refuse connections during N msec after injected disconnect")
+      ("script",       po::value<string>(&scriptFile),
+                       "Script file: lines '<msec> <action> [<arg>]', actions: "
+                       "disconnect OUTAGE_MSEC, failover OUTAGE_MSEC, rate PPS, pause MSEC, stop")
+      ("duration",     po::value<uint32_t>(&durationSec)->default_value(0),
+                       "Stop after N seconds (0 - run until signal)")
+      ("stats-file",   po::value<string>(&statsFile),
+                       "Write statistics to file on exit")
+      ("json",         po::bool_switch(&jsonStats),
+                       "Statistics in JSON format");
+
+   po::variables_map vm;
+   try {
+      po::store(po::parse_command_line(argc, argv, desc), vm);
+      po::notify(vm);
+   } catch (const exception& e) {
+      cerr << e.what() << endl << desc << endl;
+      return 1;
+   }
+   if (vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+   }
+   for (const auto& s : streams) {
+      mgremu_stream_s stream;
+      if (!mgrEmuParseStream(s, downSize, &stream)) {
+         cerr << "Wrong stream definition: " << s << endl;
+         return 1;
+      }
+      config.m_streams.push_back(stream);
+   }
+   if (!scriptFile.empty()) {
+      string err;
+      if (!emuReadScript(scriptFile, &config.m_script, &err)) {
+         cerr << err << endl;
+         return 1;
+      }
+   }
+
+   boost::asio::io_service ioService;
+   CMgrEmulator            emulator(ioService, config);
+   string                  err;
+   if (!emulator.start(&err)) {
+      cerr << err << endl;
+      return 1;
+   }
+
+   boost::asio::signal_set signals(ioService, SIGINT, SIGTERM);
+   signals.async_wait([&ioService](const boost::system::error_code&, int) { ioService.stop(); });
+   boost::asio::deadline_timer durationTimer(ioService);
+   if (durationSec > 0) {
+      durationTimer.expires_from_now(boost::posix_time::seconds(durationSec));
+      durationTimer.async_wait([&ioService](const boost::system::error_code& error) {
+         if (!error)
+            ioService.stop();
+      });
+   }
+
+   ioService.run();
+   emulator.stop();
+
+   if (!statsFile.empty()) {
+      ofstream out(statsFile.c_str());
+      emulator.printStats(out, jsonStats);
+   }
+   emulator.printStats(cout, jsonStats);
+   return 0;
+}
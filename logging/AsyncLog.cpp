@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <boost/thread.hpp>
+#include <log4cxx/spi/location/locationinfo.h>
+
+using namespace std;
+
+namespace {
+
+// Delay of formatting after which original time shift is added to message
+const uint64_t LATE_RECORD_USEC = 100000;
+
+/**
+ * Ring of records of one thread.
+ * Single producer (owner thread), single consumer (background thread).
+ */
+class CAsyncRing {
+public:
+   CAsyncRing(uint32_t size) : m_head(0), m_tail(0), m_numRecords(0), m_numDropped(0)
+   {
+      uint32_t s = 1;
+      while (s < size)
+         s <<= 1;
+      m_records.resize(s);
+      m_mask = s - 1;
+   }
+
+   // Producer
+   Logger::async_record_s * reserve() {
+      uint32_t head = m_head.load(memory_order_relaxed);
+      if (head - m_tail.load(memory_order_acquire) >= m_records.size()) {
+         m_numDropped.store(m_numDropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+         return NULL;
+      }
+      return &m_records[head & m_mask];
+   }
+   void commit() {
+      m_head.store(m_head.load(memory_order_relaxed) + 1, memory_order_release);
+      m_numRecords.store(m_numRecords.load(memory_order_relaxed) + 1, memory_order_relaxed);
+   }
+
+   // Consumer
+   uint32_t getTail() const { return m_tail.load(memory_order_relaxed); }
+   uint32_t getHead() const { return m_head.load(memory_order_acquire); }
+   Logger::async_record_s& at(uint32_t idx) { return m_records[idx & m_mask]; }
+   void     release(uint32_t tail) { m_tail.store(tail, memory_order_release); }
+
+   uint64_t getNumRecords() const { return m_numRecords.load(memory_order_relaxed); }
+   uint64_t getNumDropped() const { return m_numDropped.load(memory_order_relaxed); }
+
+private:
+   vector<Logger::async_record_s> m_records;
+   uint32_t                       m_mask;
+   atomic<uint32_t>               m_head;        // Next record to write
+   atomic<uint32_t>               m_tail;        // Next record to format
+   atomic<uint64_t>               m_numRecords;  // Written only by producer
+   atomic<uint64_t>               m_numDropped;  // Written only by producer
+};
+
+struct async_state_s {
+   boost::mutex         m_lock;        // m_rings, m_thread
+   vector<CAsyncRing *> m_rings;       // Rings are never freed: threads may keep pointer
+   boost::thread      * m_thread;
+   boost::mutex         m_drainLock;   // Serialize drain of background thread and stopAsync
+   atomic<bool>         m_isRunning;
+   atomic<uint32_t>     m_ringSize;
+   atomic<uint64_t>     m_numSync;
+   atomic<uint64_t>     m_maxDelayUsec;
+
+   async_state_s() : m_thread(NULL), m_isRunning(false), m_ringSize(0), m_numSync(0), m_maxDelayUsec(0) {;}
+};
+
+// Never destroyed: threads may log during destruction of static objects
+async_state_s& state()
+{
+   static async_state_s * s_state = new async_state_s;
+   return *s_state;
+}
+
+thread_local CAsyncRing * t_ring = NULL;
+
+void dispatch_p(const Logger::async_record_s& rec, uint64_t nowUsec)
+{
+   string msg = Logger::formatAsyncRecord(rec);
+   uint64_t delay = nowUsec > rec.m_timeUsec ? nowUsec - rec.m_timeUsec : 0;
+   if (delay >= LATE_RECORD_USEC) {
+      // log4cxx timestamps event at formatting, show original time shift
+      ostringstream os;
+      os << msg << " [+" << delay / 1000 << " ms]";
+      msg = os.str();
+   }
+   async_state_s& s = state();
+   uint64_t maxDelay = s.m_maxDelayUsec.load(memory_order_relaxed);
+   if (delay > maxDelay)
+      s.m_maxDelayUsec.store(delay, memory_order_relaxed);
+
+   log4cxx::LevelPtr          level = log4cxx::Level::toLevel(rec.m_level);
+   log4cxx::spi::LocationInfo location(rec.m_site->m_file, rec.m_site->m_func, rec.m_site->m_line);
+   rec.m_entry->m_logger->forcedLog(level, msg, location);
+   if (rec.m_numSuppressed > 0)
+      Logger::logSuppressed(rec.m_entry->m_logger, level, rec.m_numSuppressed, location);
+}
+
+// Format all records written to rings, in order of time
+void drain_p()
+{
+   async_state_s&       s = state();
+   boost::unique_lock<boost::mutex> drainLock(s.m_drainLock);
+   vector<CAsyncRing *> rings;
+   {
+      boost::unique_lock<boost::mutex> lock(s.m_lock);
+      rings = s.m_rings;
+   }
+
+   vector<pair<CAsyncRing *, uint32_t> > heads;
+   vector<Logger::async_record_s *>      records;
+   for (auto r : rings) {
+      uint32_t head = r->getHead();
+      for (uint32_t i = r->getTail(); i != head; i++)
+         records.push_back(&r->at(i));
+      heads.push_back(make_pair(r, head));
+   }
+   if (records.empty())
+      return;
+   stable_sort(records.begin(), records.end(),
+               [](const Logger::async_record_s * a, const Logger::async_record_s * b) {
+                  return a->m_timeUsec < b->m_timeUsec;
+               });
+   uint64_t now = Logger::asyncTimeUsec();
+   for (auto rec : records)
+      dispatch_p(*rec, now);
+   for (auto& h : heads)
+      h.first->release(h.second);
+}
+
+void threadFun_p()
+{
+   async_state_s& s = state();
+   while (s.m_isRunning.load(memory_order_acquire)) {
+      drain_p();
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(Logger::ASYNC_LOG_FLUSH_PERIOD));
+   }
+   drain_p();
+}
+
+void formatArg_p(ostream& os, const Logger::async_record_s& rec, const Logger::async_arg_s& arg,
+                 bool isHex, int width)
+{
+   os << (isHex ? hex : dec);
+   if (width > 0)
+      os << setfill('0') << setw(width);
+   switch (arg.m_type) {
+   case Logger::ASYNC_ARG_INT:    os << arg.m_int;  break;
+   case Logger::ASYNC_ARG_UINT:   os << arg.m_uint; break;
+   case Logger::ASYNC_ARG_DOUBLE: os << arg.m_double; break;
+   case Logger::ASYNC_ARG_BOOL:   os << (arg.m_uint ? "true" : "false"); break;
+   case Logger::ASYNC_ARG_PTR:    os << arg.m_ptr;  break;
+   case Logger::ASYNC_ARG_STR:    os.write(rec.m_text + arg.m_str.m_offset, arg.m_str.m_length); break;
+   }
+   os << dec << setfill(' ');
+}
+
+}  // namespace
+
+uint64_t Logger::asyncTimeUsec()
+{
+   return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+string Logger::formatAsyncRecord(const async_record_s& rec)
+{
+   ostringstream os;
+   size_t        argIdx = 0;
+   for (const char * p = rec.m_site->m_format; *p; p++) {
+      if (*p != '{') {
+         os << *p;
+         continue;
+      }
+      // Placeholder {[0][width][x]}
+      const char * q = p + 1;
+      int  width = 0;
+      bool isHex = false;
+      while (*q >= '0' && *q <= '9')
+         width = width * 10 + (*q++ - '0');
+      if (*q == 'x')
+         isHex = true, q++;
+      if (*q != '}') {
+         os << *p;
+         continue;
+      }
+      if (argIdx < rec.m_numArgs)
+         formatArg_p(os, rec, rec.m_args[argIdx++], isHex, width);
+      else
+         os << "{?}";
+      p = q;
+   }
+   // Arguments without placeholders
+   for (; argIdx < rec.m_numArgs; argIdx++) {
+      os << ' ';
+      formatArg_p(os, rec, rec.m_args[argIdx], false, 0);
+   }
+   return os.str();
+}
+
+Logger::async_record_s * Logger::asyncBegin(async_record_s * pLocal)
+{
+   async_state_s& s = state();
+   if (!s.m_isRunning.load(memory_order_acquire))
+      return pLocal;
+   if (t_ring == NULL) {
+      CAsyncRing * ring = new CAsyncRing(s.m_ringSize.load());
+      boost::unique_lock<boost::mutex> lock(s.m_lock);
+      s.m_rings.push_back(ring);
+      t_ring = ring;
+   }
+   return t_ring->reserve();
+}
+
+void Logger::asyncCommit(async_record_s * pRec, async_record_s * pLocal)
+{
+   if (pRec == pLocal) {
+      state().m_numSync++;
+      dispatch_p(*pRec, pRec->m_timeUsec);
+   } else {
+      t_ring->commit();
+   }
+}
+
+bool Logger::startAsync(uint32_t ringSize)
+{
+   async_state_s& s = state();
+   boost::unique_lock<boost::mutex> lock(s.m_lock);
+   if (s.m_thread != NULL || ringSize == 0)
+      return false;
+   // Rings of threads from previous start are reused
+   s.m_ringSize = ringSize;
+   s.m_isRunning = true;
+   s.m_thread = new boost::thread(threadFun_p);
+   return true;
+}
+
+void Logger::stopAsync()
+{
+   async_state_s& s = state();
+   boost::thread * thread;
+   {
+      boost::unique_lock<boost::mutex> lock(s.m_lock);
+      thread = s.m_thread;
+      s.m_thread = NULL;
+      s.m_isRunning = false;
+   }
+   if (thread == NULL)
+      return;
+   thread->join();
+   delete thread;
+   // Records committed after last drain of the thread
+   drain_p();
+}
+
+Logger::async_stats_s Logger::getAsyncStats()
+{
+   async_state_s& s = state();
+   async_stats_s  res;
+   memset(&res, 0, sizeof(res));
+   boost::unique_lock<boost::mutex> lock(s.m_lock);
+   for (auto r : s.m_rings) {
+      res.m_numRecords += r->getNumRecords();
+      res.m_numDropped += r->getNumDropped();
+   }
+   res.m_numRings     = static_cast<uint32_t>(s.m_rings.size());
+   res.m_numSync      = s.m_numSync.load();
+   res.m_maxDelayUsec = s.m_maxDelayUsec.load();
+   return res;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2014, Linear Technology. All rights reserved.
+ */
+
+#pragma once
+
+#include "Logger.h"
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/** \file AsyncLog.h
+ * Asynchronous binary logging.
+ *
+ * DUSTLOG_ASYNC_* call sites store a compact record (time, logger, level,
+ * format, arguments) in a lock-free ring of the calling thread. A background
+ * thread formats records and passes them to log4cxx appenders (log file,
+ * remote publisher), so the calling thread never formats or writes messages.
+ *
+ * Format is a string literal with '{}' placeholders, '{x}' prints argument in
+ * hex, '{02x}' - hex with zero padding to 2 digits, '{4}' - decimal padded
+ * to 4 digits. Arguments may be integers, enums, floating point numbers,
+ * bool, pointers and strings (strings are copied, total size is limited by
+ * ASYNC_LOG_TEXT_SIZE).
+ *
+ * If the background thread is not started (see startAsync), records are
+ * formatted and logged synchronously. If a ring is full, records are
+ * dropped and counted (see getAsyncStats). Call sites are rate limited
+ * like DUSTLOG_WARN (see Logger::setRateLimit).
+ */
+
+/**
+ * Log a message with the specified level asynchronously
+ */
+#define DUSTLOG_ASYNC_MSG(loggerName, level, format, ...) \
+   { \
+      static Logger::CLogSite dustlogSite_; \
+      static const Logger::async_site_s dustlogAsyncSite_ = { format, __FILE__, __func__, __LINE__ }; \
+      const Logger::log_entry_s * dustlogEntry_ = dustlogSite_.getEntry(loggerName); \
+      uint32_t dustlogSuppressed_; \
+      if (Logger::isEnabled(dustlogEntry_->m_logger, level) && \
+          dustlogSite_.allow(dustlogEntry_, level, dustlogSuppressed_)) \
+         Logger::asyncLog(dustlogEntry_, level, &dustlogAsyncSite_, dustlogSuppressed_, ##__VA_ARGS__); \
+   }
+#define DUSTLOG_ASYNC_TRACE(loggerName, format, ...) \
+   DUSTLOG_ASYNC_MSG(loggerName, Logger::TRACE_LEVEL, format, ##__VA_ARGS__)
+#define DUSTLOG_ASYNC_DEBUG(loggerName, format, ...) \
+   DUSTLOG_ASYNC_MSG(loggerName, Logger::DEBUG_LEVEL, format, ##__VA_ARGS__)
+#define DUSTLOG_ASYNC_INFO(loggerName, format, ...) \
+   DUSTLOG_ASYNC_MSG(loggerName, Logger::INFO_LEVEL, format, ##__VA_ARGS__)
+#define DUSTLOG_ASYNC_WARN(loggerName, format, ...) \
+   DUSTLOG_ASYNC_MSG(loggerName, Logger::WARN_LEVEL, format, ##__VA_ARGS__)
+#define DUSTLOG_ASYNC_ERROR(loggerName, format, ...) \
+   DUSTLOG_ASYNC_MSG(loggerName, Logger::ERROR_LEVEL, format, ##__VA_ARGS__)
+
+namespace Logger {
+
+   const size_t   ASYNC_LOG_MAX_ARGS          = 8;    ///< Max number of arguments of record
+   const size_t   ASYNC_LOG_TEXT_SIZE         = 128;  ///< Size of buffer for string arguments
+   const uint32_t ASYNC_LOG_DEFAULT_RING_SIZE = 512;  ///< Records in ring of one thread
+   const uint32_t ASYNC_LOG_FLUSH_PERIOD      = 5;    ///< Period of background thread, msec
+
+   /**
+    * Static information of DUSTLOG_ASYNC_* call site
+    */
+   struct async_site_s {
+      const char * m_format;
+      const char * m_file;
+      const char * m_func;
+      int          m_line;
+   };
+
+   enum async_arg_type_t {
+      ASYNC_ARG_INT,
+      ASYNC_ARG_UINT,
+      ASYNC_ARG_DOUBLE,
+      ASYNC_ARG_BOOL,
+      ASYNC_ARG_PTR,
+      ASYNC_ARG_STR,
+   };
+
+   struct async_arg_s {
+      uint8_t  m_type;            ///< async_arg_type_t
+      union {
+         int64_t      m_int;
+         uint64_t     m_uint;
+         double       m_double;
+         const void * m_ptr;
+         struct {
+            uint16_t  m_offset;   ///< Offset of string in m_text of record
+            uint16_t  m_length;
+         } m_str;
+      };
+   };
+
+   /**
+    * Binary log record
+    */
+   struct async_record_s {
+      uint64_t              m_timeUsec;    ///< System time of call, usec since epoch
+      const log_entry_s   * m_entry;       ///< Logger
+      const async_site_s  * m_site;
+      int                   m_level;       ///< log4cxx level (Level::toInt())
+      uint8_t               m_numArgs;
+      uint32_t              m_numSuppressed; ///< Messages of call site suppressed by rate limit before this one
+      uint16_t              m_textSize;    ///< Used bytes of m_text
+      async_arg_s           m_args[ASYNC_LOG_MAX_ARGS];
+      char                  m_text[ASYNC_LOG_TEXT_SIZE];
+   };
+
+   /**
+    * Statistics of asynchronous logging
+    */
+   struct async_stats_s {
+      uint64_t m_numRecords;      ///< Records written to rings
+      uint64_t m_numDropped;      ///< Records dropped because ring was full
+      uint64_t m_numSync;         ///< Records logged synchronously (backend is stopped)
+      uint32_t m_numRings;        ///< Number of threads using asynchronous logging
+      uint64_t m_maxDelayUsec;    ///< Max delay between call and formatting
+   };
+
+   /**
+    * Start background thread. 'ringSize' - number of records in ring of each thread.
+    * \return false if already started
+    */
+   bool startAsync(uint32_t ringSize = ASYNC_LOG_DEFAULT_RING_SIZE);
+
+   /**
+    * Log all queued records and stop background thread
+    */
+   void stopAsync();
+
+   async_stats_s getAsyncStats();
+
+   /**
+    * Format record to string
+    */
+   std::string formatAsyncRecord(const async_record_s& rec);
+
+   /**
+    * Guard class for starting and stopping asynchronous logging
+    */
+   class CScopedAsyncLog {
+   public:
+      CScopedAsyncLog(uint32_t ringSize = ASYNC_LOG_DEFAULT_RING_SIZE) {
+         m_isStarted = ringSize > 0 && startAsync(ringSize);
+      }
+      ~CScopedAsyncLog() {
+         if (m_isStarted)
+            stopAsync();
+      }
+   private:
+      bool m_isStarted;
+   };
+
+   // Reserve record in ring of current thread (or in 'pLocal' if logging is synchronous)
+   async_record_s * asyncBegin(async_record_s * pLocal);
+   // Publish record reserved by asyncBegin
+   void             asyncCommit(async_record_s * pRec, async_record_s * pLocal);
+
+   // ---------- Packing of arguments
+
+   inline void asyncPackStr_p(async_record_s * pRec, async_arg_s& arg, const char * str, size_t len)
+   {
+      size_t avail = ASYNC_LOG_TEXT_SIZE - pRec->m_textSize;
+      if (len > avail)
+         len = avail;
+      memcpy(pRec->m_text + pRec->m_textSize, str, len);
+      arg.m_type = ASYNC_ARG_STR;
+      arg.m_str.m_offset = pRec->m_textSize;
+      arg.m_str.m_length = static_cast<uint16_t>(len);
+      pRec->m_textSize += static_cast<uint16_t>(len);
+   }
+
+   template <class T>
+   inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+   asyncPackArg_p(async_record_s *, async_arg_s& arg, const T& v)
+   {
+      arg.m_type = ASYNC_ARG_INT;
+      arg.m_int = v;
+   }
+
+   template <class T>
+   inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+   asyncPackArg_p(async_record_s *, async_arg_s& arg, const T& v)
+   {
+      arg.m_type = ASYNC_ARG_UINT;
+      arg.m_uint = v;
+   }
+
+   template <class T>
+   inline typename std::enable_if<std::is_enum<T>::value>::type
+   asyncPackArg_p(async_record_s *, async_arg_s& arg, const T& v)
+   {
+      arg.m_type = ASYNC_ARG_INT;
+      arg.m_int = static_cast<int64_t>(v);
+   }
+
+   template <class T>
+   inline typename std::enable_if<std::is_floating_point<T>::value>::type
+   asyncPackArg_p(async_record_s *, async_arg_s& arg, const T& v)
+   {
+      arg.m_type = ASYNC_ARG_DOUBLE;
+      arg.m_double = v;
+   }
+
+   template <class T>
+   inline typename std::enable_if<std::is_pointer<T>::value &&
+                                  !std::is_same<typename std::decay<typename std::remove_pointer<T>::type>::type, char>::value>::type
+   asyncPackArg_p(async_record_s *, async_arg_s& arg, const T& v)
+   {
+      arg.m_type = ASYNC_ARG_PTR;
+      arg.m_ptr = v;
+   }
+
+   inline void asyncPackArg_p(async_record_s *, async_arg_s& arg, const bool& v)
+   {
+      arg.m_type = ASYNC_ARG_BOOL;
+      arg.m_uint = v;
+   }
+
+   inline void asyncPackArg_p(async_record_s * pRec, async_arg_s& arg, const char * const & v)
+   {
+      asyncPackStr_p(pRec, arg, v ? v : "(null)", v ? strlen(v) : 6);
+   }
+
+   inline void asyncPackArg_p(async_record_s * pRec, async_arg_s& arg, char * const & v)
+   {
+      asyncPackStr_p(pRec, arg, v ? v : "(null)", v ? strlen(v) : 6);
+   }
+
+   template <size_t N>
+   inline void asyncPackArg_p(async_record_s * pRec, async_arg_s& arg, const char (&v)[N])
+   {
+      asyncPackStr_p(pRec, arg, v, strnlen(v, N));
+   }
+
+   inline void asyncPackArg_p(async_record_s * pRec, async_arg_s& arg, const std::string& v)
+   {
+      asyncPackStr_p(pRec, arg, v.data(), v.size());
+   }
+
+   inline void asyncPackArgs_p(async_record_s *) {;}
+
+   template <class T, class... Args>
+   inline void asyncPackArgs_p(async_record_s * pRec, const T& v, const Args&... args)
+   {
+      if (pRec->m_numArgs < ASYNC_LOG_MAX_ARGS)
+         asyncPackArg_p(pRec, pRec->m_args[pRec->m_numArgs++], v);
+      asyncPackArgs_p(pRec, args...);
+   }
+
+   uint64_t asyncTimeUsec();
+
+   /**
+    * Write record of DUSTLOG_ASYNC_* call site
+    */
+   template <class... Args>
+   void asyncLog(const log_entry_s * pEntry, const log4cxx::LevelPtr& level,
+                 const async_site_s * pSite, uint32_t numSuppressed, const Args&... args)
+   {
+      async_record_s   local;
+      async_record_s * pRec = asyncBegin(&local);
+      if (pRec == NULL)
+         return;
+      pRec->m_timeUsec = asyncTimeUsec();
+      pRec->m_entry    = pEntry;
+      pRec->m_site     = pSite;
+      pRec->m_level    = level->toInt();
+      pRec->m_numArgs  = 0;
+      pRec->m_numSuppressed = numSuppressed;
+      pRec->m_textSize = 0;
+      asyncPackArgs_p(pRec, args...);
+      asyncCommit(pRec, &local);
+   }
+}
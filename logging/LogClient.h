@@ -11,6 +11,7 @@
 #include "rpc/public/IBaseSubscriber.h"
 #include "rpc/public/SerializerUtility.h"
 #include "logevent.pb.h"
+#include "Logger.h"
 
 // TODO: namespace Logger
 
@@ -68,6 +69,13 @@ protected:
    virtual void handleEvent(zmqUtils::zmessage* logNotif)
    {
       std::string logger = logNotif->popstr();
+      if (logger == Logger::PUBLISHER_BATCH_NOTIF_ID) {
+         logevent::LogEventBatch batch;
+         deserialize2pb(batch, *logNotif);
+         for (int i = 0; i < batch.events_size(); i++)
+            handleLogEvent(batch.events(i));
+         return;
+      }
       logevent::LogEvent logmsg;
       deserialize2pb(logmsg, *logNotif);
       handleLogEvent(logmsg);
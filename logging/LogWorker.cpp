@@ -71,6 +71,41 @@ zmessage* LogWorker::processCmdMsg(rpc_cmdid_t cmdId, const std::string& params)
    }
    break;
 
+   case logevent::GET_RATE_LIMIT:
+   {
+      logevent::GetLoggerRequest loggerReq;
+      parseFromString_p(loggerReq, params);
+
+      if (loggerReq.logger() == "*" ||
+          log4cxx::LogManager::exists(loggerReq.logger()) != log4cxx::LoggerPtr()) {
+         logevent::GetRateLimitResponse rateLimitResp;
+         uint32_t rate, burst;
+         Logger::getRateLimit(loggerReq.logger(), rate, burst);
+         rateLimitResp.set_rate(rate);
+         rateLimitResp.set_burst(burst);
+         responseMsg = createResponse(cmdId, rateLimitResp);
+      } else {
+         responseMsg = createResponse(cmdId, RPC_INVALID_PARAMETERS, "");
+      }
+   }
+   break;
+
+   case logevent::SET_RATE_LIMIT:
+   {
+      logevent::SetRateLimitRequest setRateLimitReq;
+      parseFromString_p(setRateLimitReq, params);
+
+      if (setRateLimitReq.logger() == "*" ||
+          log4cxx::LogManager::exists(setRateLimitReq.logger()) != log4cxx::LoggerPtr()) {
+         uint32_t burst = setRateLimitReq.has_burst() ? setRateLimitReq.burst() : setRateLimitReq.rate();
+         Logger::setRateLimit(setRateLimitReq.logger(), setRateLimitReq.rate(), burst);
+         responseMsg = createResponse(cmdId, RPC_OK, "");
+      } else {
+         responseMsg = createResponse(cmdId, RPC_INVALID_PARAMETERS, "");
+      }
+   }
+   break;
+
    default:
       responseMsg = createResponse(cmdId, RPC_INVALID_COMMAND, "");
       break;
@@ -4,9 +4,14 @@
 
 #include "Logger.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <iomanip>
+#include <map>
+#include <memory>
 #include <sstream>
+#include <boost/thread/mutex.hpp>
 #include <google/protobuf/stubs/common.h>
 
 #include "log4cxx/basicconfigurator.h"
@@ -72,12 +77,32 @@ void Logger::initLogging()
 // Initialize the remote log publishing for this process
 void Logger::initPublisher(zmq::context_t* ctx,
                            std::string remoteLog,
-                           log4cxx::LevelPtr threshold)
+                           log4cxx::LevelPtr threshold,
+                           const publisher_param_s& param)
 {
-   RemoteLogger* rl = RemoteLogger::create(ctx, remoteLog);
+   RemoteLogger* rl = RemoteLogger::create(ctx, remoteLog, param);
    rl->setThreshold(threshold);
 }
 
+Logger::publisher_stats_s Logger::getPublisherStats()
+{
+   return RemoteLogger::getStats();
+}
+
+bool Logger::parseDropPolicy(const std::string& str, publisher_param_s& param)
+{
+   if (str == "oldest") {
+      param.m_dropPolicy = PUBLISHER_DROP_OLDEST;
+      return true;
+   }
+   log4cxx::LevelPtr level = log4cxx::Level::toLevel(str, log4cxx::LevelPtr());
+   if (level == log4cxx::LevelPtr())
+      return false;
+   param.m_dropPolicy = PUBLISHER_DROP_BELOW_LEVEL;
+   param.m_dropLevel  = level;
+   return true;
+}
+
 // Initialize the log system for this process
 void Logger::closePublisher()
 {
@@ -85,6 +110,119 @@ void Logger::closePublisher()
 }
 
 
+namespace {
+   const char ALL_LOGGERS[] = "*";
+
+   struct log_entries_s {
+      boost::mutex m_lock;
+      std::map<std::string, std::unique_ptr<Logger::log_entry_s> > m_entries;
+      uint32_t     m_defRateLimit;     // Rate limit of new entries
+      uint32_t     m_defRateBurst;
+
+      log_entries_s() : m_defRateLimit(0), m_defRateBurst(0) {;}
+   };
+
+   // Entries are never freed: call sites keep pointers to them and may log
+   // during destruction of static objects
+   log_entries_s& logEntries()
+   {
+      static log_entries_s * s_entries = new log_entries_s;
+      return *s_entries;
+   }
+
+   Logger::log_entry_s * getLogEntry_p(log_entries_s& e, const std::string& logname)
+   {
+      std::unique_ptr<Logger::log_entry_s>& entry = e.m_entries[logname];
+      if (!entry) {
+         entry.reset(new Logger::log_entry_s);
+         entry->m_name   = logname;
+         entry->m_logger = Logger::getLog(logname);
+         entry->m_rateLimit = e.m_defRateLimit;
+         entry->m_rateBurst = e.m_defRateBurst;
+      }
+      return entry.get();
+   }
+
+   uint64_t monotonicUsec()
+   {
+      return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+   }
+}
+
+const Logger::log_entry_s * Logger::getLogEntry(const std::string& logname)
+{
+   log_entries_s& e = logEntries();
+   boost::unique_lock<boost::mutex> lock(e.m_lock);
+   return getLogEntry_p(e, logname);
+}
+
+void Logger::setRateLimit(const std::string& logname, uint32_t rate, uint32_t burst)
+{
+   log_entries_s& e = logEntries();
+   boost::unique_lock<boost::mutex> lock(e.m_lock);
+   if (rate > 0 && burst == 0)
+      burst = 1;
+   if (logname == ALL_LOGGERS) {
+      e.m_defRateLimit = rate;
+      e.m_defRateBurst = burst;
+      for (auto& entry : e.m_entries) {
+         entry.second->m_rateBurst = burst;
+         entry.second->m_rateLimit = rate;
+      }
+   } else {
+      log_entry_s * entry = getLogEntry_p(e, logname);
+      entry->m_rateBurst = burst;
+      entry->m_rateLimit = rate;
+   }
+}
+
+void Logger::getRateLimit(const std::string& logname, uint32_t& rate, uint32_t& burst)
+{
+   log_entries_s& e = logEntries();
+   boost::unique_lock<boost::mutex> lock(e.m_lock);
+   if (logname == ALL_LOGGERS) {
+      rate  = e.m_defRateLimit;
+      burst = e.m_defRateBurst;
+   } else {
+      const log_entry_s * entry = getLogEntry_p(e, logname);
+      rate  = entry->m_rateLimit;
+      burst = entry->m_rateBurst;
+   }
+}
+
+void Logger::logSuppressed(const ILogger& logger, const log4cxx::LevelPtr& level, uint32_t numSuppressed,
+                           const log4cxx::spi::LocationInfo& location)
+{
+   std::ostringstream os;
+   os << "suppressed " << numSuppressed << " similar messages";
+   logger->forcedLog(level, os.str(), location);
+}
+
+bool Logger::CLogSite::allow_p(const log_entry_s * entry, uint32_t rate, uint32_t& numSuppressed)
+{
+   if (rate > 0) {
+      // Message is allowed if it does not arrive earlier than 'tolerance'
+      // before its theoretical arrival time (equivalent of token bucket)
+      uint64_t interval  = 1000000 / rate;
+      uint32_t burst     = entry->m_rateBurst.load(std::memory_order_relaxed);
+      uint64_t tolerance = interval * (burst > 0 ? burst - 1 : 0);
+      uint64_t now       = monotonicUsec();
+      uint64_t tat       = m_tatUsec.load(std::memory_order_relaxed);
+      for (;;) {
+         uint64_t start = std::max(tat, now);
+         if (start - now > tolerance) {
+            m_numSuppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+         }
+         if (m_tatUsec.compare_exchange_weak(tat, start + interval, std::memory_order_relaxed))
+            break;
+      }
+   }
+   numSuppressed = m_numSuppressed.exchange(0, std::memory_order_relaxed);
+   return true;
+}
+
 // Read global logging configuration from a file
 void Logger::readConfigFile(const std::string& confFile)
 {
@@ -5,6 +5,9 @@
 #ifndef Logger_H_
 #define Logger_H_
 
+#include <atomic>
+#include <cstring>
+#include <sstream>
 #include <string>
 #include <zmq.hpp>
 #include <log4cxx/logger.h>
@@ -15,41 +18,77 @@
 
 // The DUSTLOG_* macros mirror the underlying log4cxx message generators.
 // We use macros here so that the message parameter isn't evaluated unless
-// the log message will be output.
+// the log message will be output. Every call site keeps its logger in
+// a static Logger::CLogSite, so log4cxx::Logger::getLogger (locked map
+// lookup) is not called on each message.
+//
+// DUSTLOG_INFO and DUSTLOG_WARN are rate limited per call site if a rate
+// limit is set for the logger (see setRateLimit, no limit by default).
+// DUSTLOG_MSG, ERROR and FATAL messages are never suppressed.
+// Messages over the limit are not formatted, their number is reported
+// after the next logged message of the call site.
+
+// Log a message of call site with rate limiting
+#define DUSTLOG_LIMITED_P(loggerName, level, message) \
+   { \
+      static Logger::CLogSite dustlogSite_; \
+      const Logger::log_entry_s * dustlogEntry_ = dustlogSite_.getEntry(loggerName); \
+      uint32_t dustlogSuppressed_; \
+      if (Logger::isEnabled(dustlogEntry_->m_logger, level) && \
+          dustlogSite_.allow(dustlogEntry_, level, dustlogSuppressed_)) { \
+         LOG4CXX_LOG(dustlogEntry_->m_logger, level, message); \
+         if (dustlogSuppressed_ > 0) \
+            Logger::logSuppressed(dustlogEntry_->m_logger, level, dustlogSuppressed_, LOG4CXX_LOCATION); \
+      } \
+   }
 
 /**
  * Log a message using the specified logger at the specified level
  */
-#define DUSTLOG_MSG(loggerName, level, message) LOG4CXX_LOG(Logger::getLog(loggerName), level, message)
+#define DUSTLOG_MSG(loggerName, level, message) \
+   { static Logger::CLogSite dustlogSite_; LOG4CXX_LOG(dustlogSite_.get(loggerName), level, message); }
 /**
  * Log a TRACE-level message
  */
-#define DUSTLOG_TRACE(loggerName, message) LOG4CXX_TRACE(Logger::getLog(loggerName), message)
+#define DUSTLOG_TRACE(loggerName, message) \
+   { static Logger::CLogSite dustlogSite_; LOG4CXX_TRACE(dustlogSite_.get(loggerName), message); }
 /**
  * Log a DEBUG-level message
  */
-#define DUSTLOG_DEBUG(loggerName, message) LOG4CXX_DEBUG(Logger::getLog(loggerName), message)
+#define DUSTLOG_DEBUG(loggerName, message) \
+   { static Logger::CLogSite dustlogSite_; LOG4CXX_DEBUG(dustlogSite_.get(loggerName), message); }
 /**
  * Log an INFO-level message
  */
-#define DUSTLOG_INFO(loggerName, message)  LOG4CXX_INFO(Logger::getLog(loggerName), message)
+#define DUSTLOG_INFO(loggerName, message) DUSTLOG_LIMITED_P(loggerName, Logger::INFO_LEVEL, message)
 /**
  * Log a WARN-level message
  */
-#define DUSTLOG_WARN(loggerName, message)  LOG4CXX_WARN(Logger::getLog(loggerName), message)
+#define DUSTLOG_WARN(loggerName, message) DUSTLOG_LIMITED_P(loggerName, Logger::WARN_LEVEL, message)
 /**
  * Log an ERROR message
  */
-#define DUSTLOG_ERROR(loggerName, message) LOG4CXX_ERROR(Logger::getLog(loggerName), message)   
+#define DUSTLOG_ERROR(loggerName, message) DUSTLOG_LIMITED_P(loggerName, Logger::ERROR_LEVEL, message)
 /**
  * Log a FATAL message
  */
-#define DUSTLOG_FATAL(loggerName, message) LOG4CXX_FATAL(Logger::getLog(loggerName), message)
+#define DUSTLOG_FATAL(loggerName, message) \
+   { static Logger::CLogSite dustlogSite_; LOG4CXX_FATAL(dustlogSite_.get(loggerName), message); }
 /**
- * Log a TRACE-level message with the hex dump of a buffer
+ * Log a TRACE-level message with the hex dump of a buffer.
+ * 'prefix' is a stream expression like 'message', it is formatted only
+ * if TRACE level is enabled.
  */
 #define DUSTLOG_TRACEDATA(loggerName, prefix, buffer, length) \
-   Logger::logDumpData(Logger::getLog(loggerName), log4cxx::Level::getTrace(), prefix, buffer, length)
+   { \
+      static Logger::CLogSite dustlogSite_; \
+      const Logger::ILogger& dustlogLogger_ = dustlogSite_.get(loggerName); \
+      if (Logger::isEnabled(dustlogLogger_, Logger::TRACE_LEVEL)) { \
+         std::ostringstream dustlogPrefix_; \
+         dustlogPrefix_ << prefix; \
+         Logger::logDumpData(dustlogLogger_, Logger::TRACE_LEVEL, dustlogPrefix_.str(), buffer, length); \
+      } \
+   }
 
 /**
  * Set the log level for a logger
@@ -58,7 +97,11 @@
 /**
  * Check whether logging is enabled at a certain level
  */
-#define DUSTLOG_ISENABLED(loggerName, loglevel) Logger::isEnabled(Logger::getLog(loggerName), loglevel)
+#define DUSTLOG_ISENABLED(loggerName, loglevel) \
+   ([&]() -> bool { \
+      static Logger::CLogSite dustlogSite_; \
+      return Logger::isEnabled(dustlogSite_.get(loggerName), loglevel); \
+   }())
 
 /** 
  * Functions for managing the logging system
@@ -73,6 +116,8 @@ namespace Logger {
    const log4cxx::LevelPtr INFO_LEVEL = log4cxx::Level::getInfo();
    const log4cxx::LevelPtr DEBUG_LEVEL = log4cxx::Level::getDebug();
    const log4cxx::LevelPtr TRACE_LEVEL = log4cxx::Level::getTrace();
+   const log4cxx::LevelPtr WARN_LEVEL = log4cxx::Level::getWarn();
+   const log4cxx::LevelPtr ERROR_LEVEL = log4cxx::Level::getError();
    
    const char DEFAULT_LOG_FILE[] = "manager.log";
 
@@ -107,6 +152,54 @@ namespace Logger {
     */
    void initLogging();
 
+   /**
+    * Policy of the remote log publisher when its queue is full
+    */
+   enum publisher_drop_policy_t {
+      PUBLISHER_DROP_OLDEST,        ///< Drop the oldest queued event
+      PUBLISHER_DROP_BELOW_LEVEL,   ///< Drop events below m_dropLevel first, then the oldest
+   };
+
+   const uint32_t PUBLISHER_DEFAULT_QUEUE_SIZE = 1000;
+   const uint32_t PUBLISHER_DEFAULT_BATCH_SIZE = 1;     ///< Not batched: one event per notification
+   /// Notification identifier of log event batch (logevent::LogEventBatch)
+   const char     PUBLISHER_BATCH_NOTIF_ID[]   = "#batch";
+
+   /**
+    * Parameters of the remote log publisher
+    */
+   struct publisher_param_s {
+      uint32_t                m_maxQueueSize;  ///< Max number of events waiting for publishing
+      uint32_t                m_maxBatchSize;  ///< Max number of events in one notification. 1 - every
+                                               ///< event is sent with its logger name as identifier
+                                               ///< (subscribers may filter by prefix), >1 - in
+                                               ///< LogEventBatch with PUBLISHER_BATCH_NOTIF_ID
+      publisher_drop_policy_t m_dropPolicy;
+      log4cxx::LevelPtr       m_dropLevel;
+
+      publisher_param_s() : m_maxQueueSize(PUBLISHER_DEFAULT_QUEUE_SIZE),
+                            m_maxBatchSize(PUBLISHER_DEFAULT_BATCH_SIZE),
+                            m_dropPolicy(PUBLISHER_DROP_OLDEST),
+                            m_dropLevel(log4cxx::Level::getWarn()) {;}
+   };
+
+   /**
+    * Statistics of the remote log publisher
+    */
+   struct publisher_stats_s {
+      uint64_t m_numPublished;   ///< Events sent to subscribers
+      uint64_t m_numBatches;     ///< Notifications sent to subscribers
+      uint64_t m_numDropped;     ///< Events dropped because queue was full
+      uint32_t m_maxQueued;      ///< Max number of queued events
+   };
+
+   /**
+    * Parse drop policy: "oldest" or name of the level (e.g. "warn"), events
+    * below the level are dropped first.
+    * \return false if string is not valid
+    */
+   bool parseDropPolicy(const std::string& str, publisher_param_s& param);
+
    /**
     * Initialize the remote log publisher. This enables log and trace
     * notifications to be published to other processes using the zeromq
@@ -115,9 +208,16 @@ namespace Logger {
     * \param ctx ZeroMQ context pointer
     * \param remoteLog Endpoint address for subscribers to connect to
     * \param threshold Log level threshold for publishing messages
+    * \param param Queue and batch parameters
     */
    void initPublisher(zmq::context_t* ctx, std::string remoteLog,
-                      log4cxx::LevelPtr threshold = log4cxx::Level::getInfo());
+                      log4cxx::LevelPtr threshold = log4cxx::Level::getInfo(),
+                      const publisher_param_s& param = publisher_param_s());
+
+   /**
+    * \return statistics of the remote log publisher (zeros if it is not started)
+    */
+   publisher_stats_s getPublisherStats();
 
    /**
     * Shut down the remote log publisher
@@ -134,10 +234,12 @@ namespace Logger {
        * \param ctx ZeroMQ context pointer
        * \param remoteLog Endpoint address for subscribers to connect to
        * \param threshold Log level threshold for publishing messages
+       * \param param Queue and batch parameters
        */
       CScopedPublisher(zmq::context_t* ctx, std::string remoteLog,
-                       log4cxx::LevelPtr threshold = log4cxx::Level::getInfo()) {
-         initPublisher(ctx, remoteLog, threshold);
+                       log4cxx::LevelPtr threshold = log4cxx::Level::getInfo(),
+                       const publisher_param_s& param = publisher_param_s()) {
+         initPublisher(ctx, remoteLog, threshold, param);
       }
       
       ~CScopedPublisher() {
@@ -153,6 +255,94 @@ namespace Logger {
    {
       return log4cxx::Logger::getLogger(logname);
    }
+
+   /**
+    * Logger with its name. Entries are created once per name and never freed.
+    */
+   struct log_entry_s {
+      std::string           m_name;
+      ILogger               m_logger;
+      std::atomic<uint32_t> m_rateLimit;   ///< Messages per second of one call site (0 - no limit)
+      std::atomic<uint32_t> m_rateBurst;   ///< Messages of one call site allowed in burst
+   };
+
+   /**
+    * Set rate limit of INFO / WARN call sites of the logger: 'rate' messages per second
+    * with bursts of 'burst' messages (0 - no limit). Name "*" sets the limit
+    * of all loggers, including ones created later.
+    */
+   void setRateLimit(const std::string& logname, uint32_t rate, uint32_t burst);
+
+   /**
+    * Get rate limit of the logger
+    */
+   void getRateLimit(const std::string& logname, uint32_t& rate, uint32_t& burst);
+
+   /**
+    * Log number of messages suppressed by rate limit
+    */
+   void logSuppressed(const ILogger& logger, const log4cxx::LevelPtr& level, uint32_t numSuppressed,
+                      const log4cxx::spi::LocationInfo& location);
+
+   /**
+    * Get (create) the entry of the logger with the specified name
+    */
+   const log_entry_s * getLogEntry(const std::string& logname);
+
+   /**
+    * Logger cache of one DUSTLOG_* call site.
+    * Keeps the entry of the last used name, so the lookup in log4cxx
+    * repository is done only when the name of the call site changes.
+    */
+   class CLogSite {
+   public:
+      CLogSite() : m_entry(nullptr), m_tatUsec(0), m_numSuppressed(0) {;}
+
+      const log_entry_s * getEntry(const char * logname) {
+         const log_entry_s * entry = m_entry.load(std::memory_order_acquire);
+         if (entry == nullptr || strcmp(entry->m_name.c_str(), logname) != 0)
+            entry = update_p(logname);
+         return entry;
+      }
+
+      const log_entry_s * getEntry(const std::string& logname) {
+         const log_entry_s * entry = m_entry.load(std::memory_order_acquire);
+         if (entry == nullptr || entry->m_name != logname)
+            entry = update_p(logname);
+         return entry;
+      }
+
+      const ILogger& get(const char * logname)        { return getEntry(logname)->m_logger; }
+      const ILogger& get(const std::string& logname) { return getEntry(logname)->m_logger; }
+
+      /**
+       * Check rate limit of the call site. ERROR and higher levels are not limited.
+       * \param numSuppressed Number of messages suppressed since previous allowed message
+       * \return false if message must be suppressed
+       */
+      bool allow(const log_entry_s * entry, const log4cxx::LevelPtr& level, uint32_t& numSuppressed) {
+         numSuppressed = 0;
+         uint32_t rate = entry->m_rateLimit.load(std::memory_order_relaxed);
+         if (rate > 0 && level->isGreaterOrEqual(ERROR_LEVEL))
+            rate = 0;
+         if (rate == 0 && m_numSuppressed.load(std::memory_order_relaxed) == 0)
+            return true;
+         return allow_p(entry, rate, numSuppressed);
+      }
+
+   private:
+      bool allow_p(const log_entry_s * entry, uint32_t rate, uint32_t& numSuppressed);
+
+      const log_entry_s * update_p(const std::string& logname) {
+         const log_entry_s * entry = getLogEntry(logname);
+         m_entry.store(entry, std::memory_order_release);
+         return entry;
+      }
+
+      std::atomic<const log_entry_s *> m_entry;
+      std::atomic<uint64_t>            m_tatUsec;        // Theoretical arrival time of next message (token bucket as GCRA)
+      std::atomic<uint32_t>            m_numSuppressed;
+   };
    
    /**
     * Read the logging configuration for this process from a file
@@ -162,7 +352,7 @@ namespace Logger {
    /**
     * Sets the logging level for the specified logger
     */
-   inline void setLevel(ILogger logger, log4cxx::LevelPtr level)
+   inline void setLevel(const ILogger& logger, const log4cxx::LevelPtr& level)
    {
       logger->setLevel(level);
    }
@@ -170,7 +360,7 @@ namespace Logger {
    /**
     * \return: whether a log level is enabled for output on the specified logger
     */
-   inline bool isEnabled(ILogger logger, log4cxx::LevelPtr level)
+   inline bool isEnabled(const ILogger& logger, const log4cxx::LevelPtr& level)
    {
       return logger->isEnabledFor(level);
    }
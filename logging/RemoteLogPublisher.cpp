@@ -13,6 +13,8 @@ using namespace zmqUtils;
 
 extern bool changeIPCFilePrivilege(const std::string& serverAddr, std::string * pError);
 
+static const size_t PUBLISHER_MAX_TAKEN = 100;   // Max events taken from queue in one publish cycle
+
 logevent::LogLevel convertLogLevel(const log4cxx::LevelPtr& aLevel)
 {
    logevent::LogLevel result;
@@ -78,40 +80,14 @@ log4cxx::LevelPtr convertLogLevel(const logevent::LogLevel& aLevel)
    return result;
 }
 
-static
-void serializeLogEvent(const log4cxx::spi::LoggingEventPtr& event,
-                       zmessage& zevent)
-{
-   logevent::LogEvent pb_le;
-   pb_le.set_logger(event->getLoggerName());
-   pb_le.set_msg(event->getMessage());
-   pb_le.set_timestamp(event->getTimeStamp());
-   pb_le.set_loglevel(convertLogLevel(event->getLevel()));
-
-   std::ostringstream location;
-   const char* filename = event->getLocationInformation().getFileName();
-   int linenum = event->getLocationInformation().getLineNumber();
-   if (filename != NULL) {
-      location << filename << ":" << linenum
-               << " (" << event->getLocationInformation().getMethodName() << ")";
-   }
-   pb_le.set_location(location.str());
-   
-   // serialize the log event protobuf message into the notification
-   serialize2zmsg(pb_le, zevent);
-   
-   // allow subscriber filtering based on logger name
-   zevent.pushstr(event->getLoggerName().c_str());
-}
-
-
 RemoteLogger* RemoteLogger::remoteLogger = NULL;
 
-RemoteLogger* RemoteLogger::create(zmq::context_t* ctx, std::string remoteLogAddr)
+RemoteLogger* RemoteLogger::create(zmq::context_t* ctx, std::string remoteLogAddr,
+                                   const Logger::publisher_param_s& param)
 {
    // there should only be one RemoteLogger per process
    if (remoteLogger == NULL) {
-      remoteLogger = new RemoteLogger(ctx, remoteLogAddr);
+      remoteLogger = new RemoteLogger(ctx, remoteLogAddr, param);
       
       log4cxx::AppenderPtr appender(remoteLogger);
       log4cxx::Logger::getRootLogger()->addAppender(appender);
@@ -125,17 +101,36 @@ void RemoteLogger::shutdown()
       log4cxx::Logger::getRootLogger()->removeAppender(remoteLogger);
       // note: remoteLogger is released (destroyed) on removal
       // so it *should* automatically close the publisher socket
+      remoteLogger = NULL;
    }
 }
+
+Logger::publisher_stats_s RemoteLogger::getStats()
+{
+   Logger::publisher_stats_s res;
+   memset(&res, 0, sizeof(res));
+   if (remoteLogger != NULL) {
+      boost::unique_lock<boost::mutex> lock(remoteLogger->m_queueLock);
+      res = remoteLogger->m_stats;
+   }
+   return res;
+}
    
 
-RemoteLogger::RemoteLogger(zmq::context_t* ctx, std::string remoteLogAddr)
+RemoteLogger::RemoteLogger(zmq::context_t* ctx, std::string remoteLogAddr,
+                           const Logger::publisher_param_s& param)
    : log4cxx::AppenderSkeleton(),
      m_ctx(ctx),   
      m_remoteLogAddr(remoteLogAddr),
+     m_param(param),
+     m_logEventQueue(std::max<uint32_t>(param.m_maxQueueSize, 1)),
      m_queueThread(NULL),
-     m_queueRunning(true)
+     m_queueRunning(true),
+     m_numDroppedInBatch(0)
 {
+   if (m_param.m_maxBatchSize == 0)
+      m_param.m_maxBatchSize = 1;
+   memset(&m_stats, 0, sizeof(m_stats));
    m_queueThread = new boost::thread(boost::bind(&RemoteLogger::queueThreadFun_p, this));
 }
    
@@ -147,25 +142,52 @@ RemoteLogger::~RemoteLogger()
 void RemoteLogger::append(const log4cxx::spi::LoggingEventPtr& event,
                           log4cxx::helpers::Pool& p)
 {
-   // construct a message from the event
-   zmessage * pLognotif = new zmessage();
+   const log4cxx::LevelPtr& level = event->getLevel();
 
-   serializeLogEvent(event, *pLognotif);
-   
-   {  // Put message to Notification Queue
+   {  // Put event to queue
       boost::unique_lock<boost::mutex> lock(m_queueLock);
-      if (!m_queueRunning) {  // Drop message. Output thread is closed
-         delete pLognotif;
+      if (!m_queueRunning)    // Drop event. Output thread is closed
+         return;
+      if (m_logEventQueue.full() && !makeRoom_p(level))
          return;
-      }
 
-      bool isEmpty = m_logMsgQueue.empty();
-      m_logMsgQueue.push_front(pLognotif);
+      bool isEmpty = m_logEventQueue.empty();
+      m_logEventQueue.push_back(pending_event_s());
+      pending_event_s& ev = m_logEventQueue.back();
+      ev.m_timestamp  = event->getTimeStamp();
+      ev.m_level      = level;
+      ev.m_logger     = event->getLoggerName();
+      ev.m_msg        = event->getMessage();
+      ev.m_fileName   = event->getLocationInformation().getFileName();
+      ev.m_lineNumber = event->getLocationInformation().getLineNumber();
+      if (ev.m_fileName != NULL)
+         ev.m_methodName = event->getLocationInformation().getMethodName();
+      if (m_logEventQueue.size() > m_stats.m_maxQueued)
+         m_stats.m_maxQueued = static_cast<uint32_t>(m_logEventQueue.size());
       if (isEmpty)
          m_queueSignal.notify_all();
    }
 }
 
+// Called under m_queueLock when queue is full. Returns false if new event must be dropped
+bool RemoteLogger::makeRoom_p(const log4cxx::LevelPtr& level)
+{
+   m_stats.m_numDropped++;
+   m_numDroppedInBatch++;
+   if (m_param.m_dropPolicy == Logger::PUBLISHER_DROP_BELOW_LEVEL) {
+      if (!level->isGreaterOrEqual(m_param.m_dropLevel))
+         return false;
+      for (eventqueue_t::iterator it = m_logEventQueue.begin(); it != m_logEventQueue.end(); ++it) {
+         if (!it->m_level->isGreaterOrEqual(m_param.m_dropLevel)) {
+            m_logEventQueue.erase(it);
+            return true;
+         }
+      }
+   }
+   m_logEventQueue.pop_front();
+   return true;
+}
+
 void RemoteLogger::close() 
 {
    stopThread_p();
@@ -187,6 +209,47 @@ void RemoteLogger::stopThread_p()
    }
 }
 
+void RemoteLogger::fillEvent_p(const pending_event_s& ev, logevent::LogEvent * pb_le)
+{
+   pb_le->set_logger(ev.m_logger);
+   pb_le->set_msg(ev.m_msg);
+   pb_le->set_timestamp(ev.m_timestamp);
+   pb_le->set_loglevel(convertLogLevel(ev.m_level));
+   if (ev.m_fileName != NULL) {
+      std::ostringstream location;
+      location << ev.m_fileName << ":" << ev.m_lineNumber << " (" << ev.m_methodName << ")";
+      pb_le->set_location(location.str());
+   } else {
+      pb_le->set_location("");
+   }
+}
+
+void RemoteLogger::publishEvent_p(zmq::socket_t* socket, const pending_event_s& ev)
+{
+   logevent::LogEvent pb_le;
+   fillEvent_p(ev, &pb_le);
+   zmessage msg;
+   serialize2zmsg(pb_le, msg);
+   // allow subscriber filtering based on logger name
+   msg.pushstr(ev.m_logger.c_str());
+   msg.send(socket);
+}
+
+void RemoteLogger::publishBatch_p(zmq::socket_t* socket, std::vector<pending_event_s>& events,
+                                  uint32_t numDropped)
+{
+   logevent::LogEventBatch batch;
+   for (const auto& ev : events)
+      fillEvent_p(ev, batch.add_events());
+   if (numDropped > 0)
+      batch.set_numdropped(numDropped);
+
+   zmessage msg;
+   serialize2zmsg(batch, msg);
+   msg.pushstr(Logger::PUBLISHER_BATCH_NOTIF_ID);
+   msg.send(socket);
+}
+
 void RemoteLogger::queueThreadFun_p()
 {
    zmq::socket_t*    socket = new zmq::socket_t(*m_ctx, ZMQ_PUB);
@@ -194,32 +257,42 @@ void RemoteLogger::queueThreadFun_p()
    std::string errMsg;
    changeIPCFilePrivilege(m_remoteLogAddr, &errMsg);
 
-   zmessage * pMsg;
+   // Not batched events are also taken from queue in groups
+   bool   isBatch  = m_param.m_maxBatchSize > 1;
+   size_t maxTaken = isBatch ? m_param.m_maxBatchSize : PUBLISHER_MAX_TAKEN;
+   std::vector<pending_event_s> events;
+   events.reserve(maxTaken);
    for(;;) {
+      uint32_t numDropped;
       {
          boost::unique_lock<boost::mutex> lock(m_queueLock);
-         while(m_queueRunning && m_logMsgQueue.empty())
+         while(m_queueRunning && m_logEventQueue.empty())
             m_queueSignal.wait(lock);
          if (!m_queueRunning)    // Stop process of queue
             break;
-         pMsg = m_logMsgQueue.back();
-         m_logMsgQueue.pop_back();
+         while (!m_logEventQueue.empty() && events.size() < maxTaken) {
+            events.push_back(std::move(m_logEventQueue.front()));
+            m_logEventQueue.pop_front();
+         }
+         numDropped = m_numDroppedInBatch;
+         m_numDroppedInBatch = 0;
+         m_stats.m_numPublished += events.size();
+         m_stats.m_numBatches += isBatch ? 1 : events.size();
       }
-      if (pMsg == NULL)
-         continue;
-      pMsg->send(socket);
-
-      delete pMsg;
-      pMsg = NULL;
+      if (isBatch) {
+         publishBatch_p(socket, events, numDropped);
+      } else {
+         for (const auto& ev : events)
+            publishEvent_p(socket, ev);
+      }
+      events.clear();
    }
 
    delete socket;
 
    {  // Clean queue
       boost::unique_lock<boost::mutex> lock(m_queueLock);
-      for_each(m_logMsgQueue.begin(), m_logMsgQueue.end(), [](zmqUtils::zmessage * pMsg) -> void { if (pMsg) delete pMsg; });
-      m_logMsgQueue.clear();
+      m_logEventQueue.clear();
    }
 
 }
-
@@ -8,8 +8,10 @@
 #include <log4cxx/appenderskeleton.h>
 #include <zmq.hpp>
 #include <boost/thread.hpp>
+#include <boost/circular_buffer.hpp>
 #include <fstream>
 #include "rpc/public/zmqUtils.h"
+#include "Logger.h"
 #include "logevent.pb.h"
 
 
@@ -18,16 +20,30 @@ logevent::LogLevel convertLogLevel(const log4cxx::LevelPtr& aLevel);
 log4cxx::LevelPtr convertLogLevel(const logevent::LogLevel& aLevel);
 
 
+/**
+ * Appender publishing log events to remote subscribers.
+ *
+ * Events are kept in a bounded queue (when it is full, events are dropped
+ * according to the drop policy and counted) and sent by the publisher
+ * thread. By default every event is sent in its own notification with the
+ * logger name as identifier, so subscribers can filter loggers by prefix.
+ * If m_maxBatchSize > 1, events of one publish cycle are sent in one
+ * LogEventBatch notification (opt-in: subscriber must support it).
+ */
 class RemoteLogger : public log4cxx::AppenderSkeleton
 {
    static RemoteLogger* remoteLogger;
    
 public:
-   static RemoteLogger* create(zmq::context_t* ctx, std::string remoteLogAddr);
+   static RemoteLogger* create(zmq::context_t* ctx, std::string remoteLogAddr,
+                               const Logger::publisher_param_s& param = Logger::publisher_param_s());
    
    static void shutdown();
 
-   RemoteLogger(zmq::context_t* ctx, std::string remoteLogAddr);
+   static Logger::publisher_stats_s getStats();
+
+   RemoteLogger(zmq::context_t* ctx, std::string remoteLogAddr,
+                const Logger::publisher_param_s& param);
    virtual ~RemoteLogger();
 
    // TODO: declare log4cxx object wrappers
@@ -53,15 +69,34 @@ protected:
                        log4cxx::helpers::Pool& p);
 
 private:
+   // Log event waiting for publishing. Protobuf message is built by publisher thread
+   struct pending_event_s {
+      log4cxx_time_t    m_timestamp;
+      log4cxx::LevelPtr m_level;
+      std::string       m_logger;
+      std::string       m_msg;
+      const char      * m_fileName;
+      int               m_lineNumber;
+      std::string       m_methodName;
+   };
+   typedef boost::circular_buffer<pending_event_s> eventqueue_t;
+
    zmq::context_t*   m_ctx;
    std::string       m_remoteLogAddr;
+   Logger::publisher_param_s m_param;
 
-   std::list<zmqUtils::zmessage*>   m_logMsgQueue;
+   eventqueue_t                     m_logEventQueue;
    boost::thread                  * m_queueThread;
-   boost::mutex                     m_queueLock;
+   boost::mutex                     m_queueLock;   // m_logEventQueue, m_queueRunning, m_stats, m_numDroppedInBatch
    boost::condition_variable        m_queueSignal;
    bool                             m_queueRunning;
+   Logger::publisher_stats_s        m_stats;
+   uint32_t                         m_numDroppedInBatch;  // Dropped since last sent batch
 
+   bool makeRoom_p(const log4cxx::LevelPtr& level);
+   void fillEvent_p(const pending_event_s& ev, logevent::LogEvent * pb_le);
+   void publishEvent_p(zmq::socket_t* socket, const pending_event_s& ev);
+   void publishBatch_p(zmq::socket_t* socket, std::vector<pending_event_s>& events, uint32_t numDropped);
    void queueThreadFun_p();
    void stopThread_p();
 };
@@ -191,6 +191,17 @@ class CommandLineHandler(cmd.Cmd):
                                                                   rc,
                                                                   logger_resp.__str__(),
                                                                   ))
+             try:
+                resp = self.apcClient.send(logevent_pb2.GET_RATE_LIMIT,
+                                           logger_req.SerializeToString(),
+                                           LOGGER_SERVICE)
+             except Exception as e:
+                return
+             (rc, ) = struct.unpack("!L", resp[1])
+             if not rc:
+                rate_resp = logevent_pb2.GetRateLimitResponse.FromString(resp[2])
+                sys.stdout.write('Rate limit: {0} msg/s, burst {1}\n'.format(rate_resp.rate,
+                                                                            rate_resp.burst))
           else:
              sys.stdout.write('Logger: {0}, rc: {1}\n'.format(arg_str,
                                                              Enum_RpcResult.to_string(rc)))
@@ -312,7 +323,7 @@ class CommandLineHandler(cmd.Cmd):
        self.unsubscribeAllListeners()
 
     def do_set(self, *args):
-       ''' Usage: set <ap|loglevel> [args]
+       ''' Usage: set <ap|loglevel|ratelimit> [args]
            ap        -- set AP parameters
                         [args] is a parameter followed by value
                                parameter are
@@ -330,10 +341,14 @@ class CommandLineHandler(cmd.Cmd):
                                    - INFO  (4)
                                    - DEBUG (5)
                                    - TRACE (6)
+           ratelimit -- set rate limit of messages of one call site
+                        [args] is a logger ('*' for all loggers) followed by
+                               messages per second (0 - no limit) and
+                               optional burst size
        '''
        cmdArgs = args[0].split(" ")
 
-       if len(cmdArgs) != 3:
+       if len(cmdArgs) not in (3, 4):
           printError("INVALID_CL_ARGS")
           return
 
@@ -346,6 +361,8 @@ class CommandLineHandler(cmd.Cmd):
        try:
           if cmd == "loglevel" and numCmdArgs == 2:
               self.setLogLevel(cmdArgs[0].lower(), cmdArgs[1].lower())
+          elif cmd == "ratelimit" and numCmdArgs in (2, 3):
+              self.setRateLimit(cmdArgs[0].lower(), cmdArgs[1:])
           elif cmd == "ap" and numCmdArgs == 2:
              if cmdArgs[0].lower() == 'clksrc':
                  self.apcClient.rpcSetAPClkSrc(cmdArgs)
@@ -435,6 +452,53 @@ class CommandLineHandler(cmd.Cmd):
           printError(obv=str(e))
           return 
 
+    # Serial capture
+    def do_capture(self, *args):
+       ''' Usage: capture <fileName>
+           Save the last serial frames to pcap file (on APC host)
+       '''
+       iArgs = args[0].split()
+       if len(iArgs) != 1:
+          printError("INVALID_CL_ARGS")
+          return
+       try:
+          self.apcClient.rpcDumpCapture(os.path.abspath(iArgs[0]))
+       except Exception as e:
+          printError(obv=str(e))
+          return
+
+    # Flight recorder
+    def do_flightrec(self, *args):
+       ''' Usage: flightrec <fileName>
+           Save the last transport and connector events to file (on APC host).
+           Decode it by apc_flightrec.py
+       '''
+       iArgs = args[0].split()
+       if len(iArgs) != 1:
+          printError("INVALID_CL_ARGS")
+          return
+       try:
+          self.apcClient.rpcDumpFlightRec(os.path.abspath(iArgs[0]))
+       except Exception as e:
+          printError(obv=str(e))
+          return
+
+    # Upstream traffic of motes
+    def do_motes(self, *args):
+       ''' Usage: motes [num]
+           Show upstream traffic of the heaviest motes (all tracked motes by default).
+           Counters are cleared by 'stats clear'
+       '''
+       iArgs = args[0].split()
+       if len(iArgs) > 1 or (len(iArgs) == 1 and not iArgs[0].isdigit()):
+          printError("INVALID_CL_ARGS")
+          return
+       try:
+          self.apcClient.rpcGetMoteStats(int(iArgs[0]) if iArgs else 0)
+       except Exception as e:
+          printError(obv=str(e))
+          return
+
     # Reset command options
     def do_reset(self, *args):
        ''' Usage: reset ap
@@ -599,6 +663,41 @@ class CommandLineHandler(cmd.Cmd):
        if fShowResult:
           printInfo("Done")
 
+    def setRateLimit(self, loggerName, limitArgs):
+       '''Set rate limit of log messages
+
+       Keyword arguments:
+       loggerName - Logger name, '*' for all loggers
+       limitArgs  - Messages per second and optional burst size
+       '''
+
+       rate_req = logevent_pb2.SetRateLimitRequest()
+
+       try:
+          rate_req.logger = loggerName
+          rate_req.rate = int(limitArgs[0])
+          if len(limitArgs) > 1:
+             rate_req.burst = int(limitArgs[1])
+       except ValueError:
+          printError(obv="Invalid rate limit '{0}'".format(' '.join(limitArgs)))
+          return
+       try:
+          self.apcClient.send_msg(logevent_pb2.SET_RATE_LIMIT, 
+                                  rate_req,
+                                  "",
+                                  LOGGER_SERVICE)
+       except TimeoutError as exc:
+          printError(obv=str(exc))
+          return 
+       except RpcError as exc:
+          if  exc.result_code == Enum_RpcResult.to_int('RPC_INVALID_PARAMETERS'):
+              printRPCError('RPC_INVALID_PARAMETERS', loggerName)
+          else:
+              printError(obv=str(exc))
+          return
+
+       printInfo("Done")
+
 
 def main(argv):
     # Parse command line arguments    
@@ -0,0 +1,177 @@
+#!/usr/bin/env python
+'''
+Decoder of APC flight recorder files.
+
+apc keeps the last transport and connector events in memory and saves them
+to <capture-dir>/apc_<reason>_<time>.frec on AP lost and on fatal errors
+reported to watchdog, or on demand by 'flightrec <fileName>' command of
+apc_console. The format is defined in APInterface/FlightRecorder.h.
+
+Usage: apc_flightrec.py [--event NAME] [--utc] <file.frec>
+'''
+
+from __future__ import print_function
+
+import argparse
+import datetime
+import struct
+import sys
+
+FILE_MAGIC   = 0x43455246
+FILE_VERSION = 1
+HDR_FORMAT   = 'IHHIIQQ'      # flightrec_file_hdr_s
+REC_FORMAT   = 'QHHIII'       # flightrec_record_s
+
+# apc_stop_reason_t
+STOP_REASONS = [
+    'APC_STOP_NA', 'APC_DISCONNECT_MSG', 'APC_STOP_TIMEOUT', 'APC_STOP_CREATE',
+    'APC_STOP_READ', 'APC_STOP_WRITE', 'APC_STOP_CLOSE', 'APC_STOP_DELAYED',
+    'APC_STOP_CONNECT_NOT_FOUND', 'APC_STOP_CONNECT_NEW_PORT',
+    'APC_STOP_CONNECT_SAME_PORT', 'APC_STOP_PKTPARSE', 'APC_STOP_VER',
+    'APC_STOP_MAXAPC', 'APC_STOP_RECONNECTION',
+]
+
+# apc_error_t
+APC_ERRORS = [
+    'APC_OK', 'APC_STOP_CONNECTOR', 'APC_ERR_INIT', 'APC_ERR_SIZE',
+    'APC_ERR_OUTBUFOVERFLOW', 'APC_ERR_UNCONFIRMED_PKT', 'APC_ERR_IO',
+    'APC_ERR_ASYNC_OPERATION', 'APC_ERR_STATE', 'APC_ERR_PROTOCOL',
+    'APC_ERR_NOTFOUND', 'APC_ERR_PKTSERIALIZATION', 'APC_ERR_NOTCONNECT',
+    'APC_ERR_DISCONNECT', 'APC_ERR_OFFLINE', 'APC_ERR_CONNECT',
+]
+
+# apc_msg_type_t
+APC_MSG_TYPES = [
+    'NA', 'CONNECT', 'DISCONNECT', 'NET_TX', 'NET_RX', 'NET_TXDONE',
+    'NET_TX_PAUSE', 'NET_TX_RESUME', 'RESET_AP', 'KA', 'AP_LOST', 'GET_TIME',
+    'TIME_MAP', 'GPS_LOCK', 'DISCONNECT_AP', 'NET_RX_BATCH', 'ACTIVATE',
+    'NET_TXDONE_BATCH',
+]
+
+# Coupler events (APCoupler.cpp)
+COUPLER_EVENTS = [
+    (0x1, 'APM_BOOT'), (0x2, 'APM_REBOOT'), (0x4, 'APM_LOST'),
+    (0x8, 'MNGR_CONNECT'), (0x10, 'MNGR_DISCONNECT'), (0x20, 'TIMEOUT'),
+    (0x40, 'AP_RESET'), (0x80, 'AP_DISCONNECT'), (0x100, 'AP_END_BLACKOUT'),
+    (0x200, 'STOP'),
+]
+
+# IChangeNodeState::stopseverity_t
+STOP_SEVERITIES = ['STOP_OK', 'STOP_ERROR', 'STOP_FATAL_ERROR']
+
+
+def enumName(names, value):
+    return names[value] if value < len(names) else str(value)
+
+
+def hexByte(value):
+    return '0x{0:02x}'.format(value)
+
+
+def eventMask(value):
+    names = [name for bit, name in COUPLER_EVENTS if value & bit]
+    return '|'.join(names) if names else hex(value)
+
+
+# flightrec_event_t: (name, [(argument name, formatter), ...])
+EVENTS = {
+    1:  ('APM_SEND',         [('cmd', hexByte), ('flags', hexByte), ('len', str)]),
+    2:  ('APM_RETRY',        [('cmd', hexByte), ('retry', str)]),
+    3:  ('APM_ACK',          [('cmd', hexByte), ('rc', str), ('rspTime(us)', str)]),
+    4:  ('APM_NACK',         [('cmd', hexByte), ('inRow', str)]),
+    5:  ('APM_NACK_SENT',    [('notif', hexByte)]),
+    6:  ('APM_RETRY_RECV',   [('notif', hexByte), ('flags', hexByte)]),
+    7:  ('APM_AP_LOST',      [('retries', str)]),
+    20: ('APC_START',        [('intf', str)]),
+    21: ('APC_CONNECT',      [('intf', str), ('mySeq', str), ('yourSeq', str)]),
+    22: ('APC_CONNECTED',    [('intf', str), ('mySeq', str), ('yourSeq', str)]),
+    23: ('APC_STOP',         [('intf', str), ('reason', lambda v: enumName(STOP_REASONS, v)),
+                              ('err', lambda v: enumName(APC_ERRORS, v))]),
+    40: ('CACHE_ADD',        [('seq', str), ('type', lambda v: enumName(APC_MSG_TYPES, v)),
+                              ('res', lambda v: enumName(APC_ERRORS, v))]),
+    41: ('CACHE_CONFIRM',    [('seq', str), ('cached', str)]),
+    42: ('CACHE_RESEND',     [('seq', str), ('type', lambda v: enumName(APC_MSG_TYPES, v))]),
+    43: ('CACHE_CLEAR',      [('cached', str)]),
+    60: ('CPL_EVENT',        [('events', eventMask)]),
+    61: ('CPL_PAUSE',        []),
+    62: ('CPL_RESUME',       []),
+    63: ('CPL_OFFLINE',      [('reason', lambda v: enumName(STOP_REASONS, v))]),
+    64: ('CPL_ONLINE',       []),
+    65: ('CPL_WD_DISCONNECT',[('severity', lambda v: enumName(STOP_SEVERITIES, v))]),
+}
+
+
+def formatTime(timeNsec, isUtc):
+    sec, nsec = divmod(timeNsec, 1000000000)
+    t = datetime.datetime.utcfromtimestamp(sec) if isUtc else datetime.datetime.fromtimestamp(sec)
+    return '{0}.{1:09d}'.format(t.strftime('%Y-%m-%d %H:%M:%S'), nsec)
+
+
+def readFile(fileName):
+    with open(fileName, 'rb') as f:
+        data = f.read()
+    hdrSize = struct.calcsize('<' + HDR_FORMAT)
+    if len(data) < hdrSize:
+        raise ValueError('File is too short')
+    # File is written in byte order of APC host
+    for order in ('<', '>'):
+        hdr = struct.unpack_from(order + HDR_FORMAT, data)
+        if hdr[0] == FILE_MAGIC:
+            break
+    else:
+        raise ValueError('Not a flight recorder file')
+    magic, version, recSize, numRecords, capacity, numTotal, dumpTimeNsec = hdr
+    if version != FILE_VERSION:
+        raise ValueError('Unsupported version {0}'.format(version))
+    records = []
+    offset = hdrSize
+    for _ in range(numRecords):
+        if offset + recSize > len(data):
+            break
+        records.append(struct.unpack_from(order + REC_FORMAT, data, offset))
+        offset += recSize
+    info = {'capacity': capacity, 'numTotal': numTotal, 'dumpTimeNsec': dumpTimeNsec}
+    return info, records
+
+
+def formatRecord(rec, prevTimeNsec, isUtc):
+    timeNsec, event, thread, arg0, arg1, arg2 = rec
+    name, argDefs = EVENTS.get(event, ('EVENT_{0}'.format(event),
+                                       [('arg0', str), ('arg1', str), ('arg2', str)]))
+    args = ' '.join('{0}={1}'.format(argName, fmt(v))
+                    for (argName, fmt), v in zip(argDefs, (arg0, arg1, arg2)))
+    delta = (timeNsec - prevTimeNsec) / 1000.0 if prevTimeNsec else 0.0
+    return '{0} {1:+12.3f} T{2:<3} {3:<18} {4}'.format(formatTime(timeNsec, isUtc), delta,
+                                                       thread, name, args)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode APC flight recorder file')
+    parser.add_argument('fileName', help='flight recorder file (.frec)')
+    parser.add_argument('--event', action='append', default=[],
+                        help='show only events with name starting with EVENT (e.g. APM, CACHE_ADD)')
+    parser.add_argument('--utc', action='store_true', help='print UTC time instead of local time')
+    args = parser.parse_args()
+
+    try:
+        info, records = readFile(args.fileName)
+    except (IOError, ValueError, struct.error) as e:
+        print('Error: {0}'.format(e), file=sys.stderr)
+        return 1
+
+    print('Dump time: {0}, records: {1}, ring size: {2}, lost (overwritten): {3}'.format(
+          formatTime(info['dumpTimeNsec'], args.utc), len(records), info['capacity'],
+          info['numTotal'] - len(records)))
+    print('{0:<29} {1:>12} {2:<4} {3:<18} {4}'.format('Time', 'Delta(us)', 'Thr', 'Event', 'Arguments'))
+    prevTimeNsec = 0
+    for rec in records:
+        name = EVENTS.get(rec[1], ('',))[0]
+        if args.event and not any(name.startswith(e.upper()) for e in args.event):
+            continue
+        print(formatRecord(rec, prevTimeNsec, args.utc))
+        prevTimeNsec = rec[0]
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
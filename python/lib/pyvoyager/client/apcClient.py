@@ -15,6 +15,7 @@ from pyvoyager.baserpcclient import BaseRpcClient
 from pyvoyager.CLICommon import printInfo
 from pyvoyager.commonUtils import rpcRespToDict
 from pyvoyager.commonUtils import statDelaysToString
+from pyvoyager.commonUtils import rateStatToString
 
 from pyvoyager.enum import dn_to_str
 from pyvoyager.enum.GPSError_enum import Enum_gps_status_t
@@ -76,11 +77,39 @@ StatsDict = {
       'ap30secPktRate'   : [18, '30 sec average (pps)', '0.0'],
       'ap5minPktRate'    : [19, '5  min average (pps)', '0.0'],
       'apAvgPktRate'     : [20, 'total  average (pps)', '0.0'],
+      'apFastRetries'    : [21, 'Fast Retries Sent', '0'],
+      'hdlcFrames'       : [22, 'HDLC Frames Rcvd', '0'],
+      'hdlcFcsErrors'    : [23, 'HDLC FCS Errors', '0'],
+      'hdlcRunts'        : [24, 'HDLC Runt Frames', '0'],
+      'hdlcOversize'     : [25, 'HDLC Oversize Frames', '0'],
+      'hdlcAborts'       : [26, 'HDLC Aborted Frames', '0'],
+      'hdlcDiscardedBytes' : [27, 'HDLC Discarded Bytes', '0'],
       },
    'Manager/APC Statistics' : {
       'queueMgrCnt'    : [1, 'Packets Queued', '0'],
       'mgrPktSent'     : [2, 'Packets Sent', '0'],
       'mgrPktRecv'     : [3, 'Packets Rcvd', '0'],
+      'mgrTxRawBytes'  : [4, 'TX Bytes Uncompressed', '0'],
+      'mgrTxCompBytes' : [5, 'TX Bytes Compressed', '0'],
+      'mgrRxCompBytes' : [6, 'RX Bytes Compressed', '0'],
+      'mgrRxRawBytes'  : [7, 'RX Bytes Uncompressed', '0'],
+      'mgrCompressCpuUsec'   : [8, 'Compress CPU (us)', '0'],
+      'mgrDecompressCpuUsec' : [9, 'Decompress CPU (us)', '0'],
+      'mgrTcpRttUsec'  : [10, 'TCP RTT (us)', '0'],
+      'mgrTcpRttVarUsec' : [11, 'TCP RTT Var (us)', '0'],
+      'mgrTcpCwnd'     : [12, 'TCP Cwnd', '0'],
+      'mgrTcpRetrans'  : [13, 'TCP Retransmits', '0'],
+      'mgrTcpUnacked'  : [14, 'TCP Unacked', '0'],
+      'mgrTcpLost'     : [15, 'TCP Lost', '0'],
+      'txInFlight'     : [16, 'Downstream In Flight', '0'],
+      'txFailed'       : [17, 'Downstream Failed', '0'],
+      'txLost'         : [18, 'Downstream Lost', '0'],
+      'txUnknownTxDone': [19, 'Unknown TX Done', '0'],
+      'upSchedQueued'  : [20, 'Upstream Scheduled', '0'],
+      'upSchedMaxQueued' : [21, 'Upstream Max Scheduled', '0'],
+      'upSchedHeld'    : [22, 'Upstream Held', '0'],
+      'upSchedBypassed': [23, 'Upstream Bypassed', '0'],
+      'upSchedRejected': [24, 'Upstream Rejected', '0'],
       },
 }
 
@@ -378,6 +407,17 @@ class ApcClient(BaseRpcClient):
              delayStats = rpcRespToDict(apcStats_resp)
              if 'Manager' in names:
                 print "TX delays:  ", statDelaysToString(delayStats['toMngr'])
+                for title, field in [('Down queue: ', 'txRxToQueue'), ('Down AP ACK:', 'txQueueToAck'),
+                                     ('Down mesh:  ', 'txAckToTxDone'), ('Down total: ', 'txTotal')]:
+                   if field in delayStats:
+                      print title, statDelaysToString(delayStats[field])
+                rates = [('TX rate:    ', 'mgrTxRate'), ('RX rate:    ', 'mgrRxRate')]
+             else:
+                rates = [('Serial TX:  ', 'serialToAP'), ('Serial RX:  ', 'serialFromAP'),
+                         ('Commands:   ', 'apCmdRate'),  ('Notifs:     ', 'apNotifRate')]
+             for title, field in rates:
+                if field in delayStats:
+                   print title, rateStatToString(delayStats[field])
              print            
     
     def clearStats(self):
@@ -388,6 +428,56 @@ class ApcClient(BaseRpcClient):
                             "",
                             service=APC_RPC_SERVICE)
 
+    def rpcDumpCapture(self, fileName):
+       ''' Save serial capture to pcap file
+       '''
+       req = apc_pb2.DumpCaptureReq()
+       req.fileName = fileName
+       resp = self.send_msg(apc_pb2.DUMP_CAPTURE,
+                            req,
+                            apc_pb2.DumpCaptureResp,
+                            service=APC_RPC_SERVICE)
+       print "Saved {0} frames to {1}".format(resp.numFrames, resp.fileName)
+       return None
+
+    def rpcDumpFlightRec(self, fileName):
+       ''' Save flight recorder events to file
+       '''
+       req = apc_pb2.DumpFlightRecReq()
+       req.fileName = fileName
+       resp = self.send_msg(apc_pb2.DUMP_FLIGHTREC,
+                            req,
+                            apc_pb2.DumpFlightRecResp,
+                            service=APC_RPC_SERVICE)
+       print "Saved {0} records to {1}".format(resp.numRecords, resp.fileName)
+       return None
+
+    def rpcGetMoteStats(self, maxMotes):
+       ''' Get upstream traffic of the heaviest motes
+       '''
+       req = apc_pb2.MoteStatsReq()
+       req.maxMotes = maxMotes
+       resp = self.send_msg(apc_pb2.GET_MOTE_STATS,
+                            req,
+                            apc_pb2.MoteStatsResp,
+                            service=APC_RPC_SERVICE)
+       print "Upstream packets: {0:,}  bytes: {1:,}  bad: {2:,}  by priority: {3}".format(
+             resp.numPkts, resp.numBytes, resp.numBadPkts,
+             '/'.join('{:,}'.format(n) for n in resp.numPktsByPriority))
+       print "Motes (table size {0}), counters are upper bounds, '-' max error".format(resp.tableSize)
+       print '{0: <24}{1: >12}{2: >10}{3: >14}{4: >12}  {5}'.format(
+             'Address', 'Packets', '-', 'Bytes', '-', 'By priority')
+       for mote in resp.motes:
+          if mote.addrLen == 0:
+             addr = 'elided'
+          else:
+             addr = '-'.join('{:02X}'.format((mote.address >> (8 * i)) & 0xFF)
+                             for i in reversed(range(mote.addrLen)))
+          print '{0: <24}{1: >12,}{2: >10,}{3: >14,}{4: >12,}  {5}'.format(
+                addr, mote.numPkts, mote.errPkts, mote.numBytes, mote.errBytes,
+                '/'.join('{:,}'.format(n) for n in mote.numPktsByPriority))
+       return None
+
     def rpcSetAPClkSrc(self, args):
        ''' Set AP ClkSrc
        '''
@@ -235,5 +235,18 @@ def statDelaysToString(stat) :
     else :
         s = ''
     return s
+
+def rateToString(rate) :
+    return '1s: {:.1f}, 10s: {:.1f}, 1m: {:.1f}, 5m: {:.1f}, 15m: {:.1f}; Peak: {:.1f}'.format(
+               rate.get('rate1sec', 0), rate.get('rate10sec', 0), rate.get('rate1min', 0),
+               rate.get('rate5min', 0), rate.get('rate15min', 0), rate.get('peak', 0))
+
+def rateStatToString(stat) :
+    s = ''
+    if 'pkts' in stat :
+        s += 'pkt/s [' + rateToString(stat['pkts']) + ']'
+    if 'bytes' in stat :
+        s += ' B/s [' + rateToString(stat['bytes']) + ']'
+    return s
     
     
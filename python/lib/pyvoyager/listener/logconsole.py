@@ -20,6 +20,8 @@ class LogConsole(Listener):
     '''
 
     DEFAULT_MSG_FORMAT = "{0} {1} {2}: {3} {4}"  
+    # Notification id of log event batch (LogEventBatch)
+    BATCH_NOTIF_ID = '#batch'
 
     def __init__(self, ctx, logger_name, logger_addr, rpcClient, 
                  loglevel_filter = logevent_pb2.L_FATAL):
@@ -29,6 +31,8 @@ class LogConsole(Listener):
         self.rpcClient = rpcClient
         self.loggers = []
         self.loglevel_filter = loglevel_filter
+        # Number of events dropped by publisher
+        self.num_dropped = 0
         
     def logNotifFormat(self, msg):
         'Format a log notification'
@@ -104,8 +108,28 @@ class LogConsole(Listener):
         log.debug('Received log event from %s, len=%d', 
                   notifId, 
                   len(notification))
+        if notifId == self.BATCH_NOTIF_ID:
+            batch = logevent_pb2.LogEventBatch.FromString(notification)
+            if batch.numDropped:
+                self.num_dropped += batch.numDropped
+                print '*** {0} log events dropped by publisher (total {1})'.format(
+                    batch.numDropped, self.num_dropped)
+            for log_event in batch.events:
+                # INBOX is kept per logger
+                self.purgeInbox(log_event.logger)
+                self.processLogEvent(log_event.logger, log_event)
+            return
         # deserialize 
         log_event = logevent_pb2.LogEvent.FromString(notification)
+        self.processLogEvent(notifId, log_event)
+
+    def processLogEvent(self, notifId, log_event):
+        '''Process one log event
+        
+        Keyword arguments:
+        notifId      - Notification Id (logger name)
+        log_event    - Deserialized LogEvent
+        '''
         # Check the filter, allow error messages if the log level is severe
         # even if it is not subscribed
         log_severity = (log_event.logLevel <= self.loglevel_filter)
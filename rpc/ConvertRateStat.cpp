@@ -0,0 +1,17 @@
+#include "rpc/public/ConvertRateStat.h"
+
+static void convertRate(const rate_s& rate, common::Rate * pRpcRate) {
+   pRpcRate->set_rate1sec (rate.m_rate[RATE_WND_1SEC]);
+   pRpcRate->set_rate10sec(rate.m_rate[RATE_WND_10SEC]);
+   pRpcRate->set_rate1min (rate.m_rate[RATE_WND_1MIN]);
+   pRpcRate->set_rate5min (rate.m_rate[RATE_WND_5MIN]);
+   pRpcRate->set_rate15min(rate.m_rate[RATE_WND_15MIN]);
+   pRpcRate->set_peak(rate.m_peak);
+   pRpcRate->set_average(rate.m_avg);
+   pRpcRate->set_total(rate.m_total);
+}
+
+void convertRateStat(const ratestat_s& stat, common::RateStat * pRpcStat) {
+   convertRate(stat.m_pkts,  pRpcStat->mutable_pkts());
+   convertRate(stat.m_bytes, pRpcStat->mutable_bytes());
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include "StatRate.h"
+#include "common.pb.h"
+
+void convertRateStat(const ratestat_s& stat, common::RateStat * pRpcStat);
@@ -334,14 +334,14 @@ inline std::ostream& operator<<(std::ostream& os, const zmqUtils::zmessage& zmsg
 }
 
 #define DUSTLOG_MSGDEBUG(logger, prefix, msg) \
-   if (Logger::isEnabled(Logger::getLog(logger), log4cxx::Level::getDebug())) \
+   if (DUSTLOG_ISENABLED(logger, Logger::DEBUG_LEVEL)) \
    {\
       std::ostringstream os; os << *msg;\
       DUSTLOG_DEBUG(logger, prefix << os.str());   \
    }
 
 #define DUSTLOG_MSGTRACE(logger, prefix, msg) \
-   if (Logger::isEnabled(Logger::getLog(logger), log4cxx::Level::getTrace())) \
+   if (DUSTLOG_ISENABLED(logger, Logger::TRACE_LEVEL)) \
    {\
       std::ostringstream os; os << *msg;\
       DUSTLOG_TRACE(logger, prefix << os.str());   \